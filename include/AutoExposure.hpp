@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "Profiler.hpp"
+#include "RenderDefinitions.hpp"
+#include "RenderPass.hpp"
+#include "ShaderProgram.hpp"
+
+#include <vector>
+
+// A log luminance histogram of the tone mapping input is built in one dispatch, a single work group
+// reduces it to the average luminance, adapts it over time and clears the histogram for the next frame.
+// Everything stays on the GPU, the tone mapping reads the exposure from EXPOSURE_BUFFER_BINDING.
+constexpr uint32_t EXPOSURE_BUFFER_BINDING = 5;
+constexpr uint32_t LUMINANCE_HISTOGRAM_BUFFER_BINDING = 6;
+constexpr uint32_t LUMINANCE_HISTOGRAM_BIN_COUNT = 256;
+constexpr uint32_t LUMINANCE_HISTOGRAM_TILE_SIZE = 16;
+
+struct ExposureState
+{
+    float averageLuminance; //Adapted, 0 until the first frame was measured
+    float exposure;
+};
+
+struct AutoExposure
+{
+    ShaderProgram histogramProgram = {};
+    ShaderProgram exposureProgram = {};
+    GLuint histogramBuffer = 0;
+    GLuint exposureBuffer = 0;
+};
+
+AutoExposure CreateAutoExposure(ShaderProgram histogramProgram, ShaderProgram exposureProgram)
+{
+    AutoExposure autoExposure;
+    autoExposure.histogramProgram = histogramProgram;
+    autoExposure.exposureProgram = exposureProgram;
+
+    //The exposure reduction clears the histogram after reading it, it only has to start out cleared
+    std::vector<uint32_t> const bins(LUMINANCE_HISTOGRAM_BIN_COUNT, 0);
+    ExposureState const state = {0, 1};
+
+    glGenBuffers(1, &autoExposure.histogramBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, autoExposure.histogramBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bins.size() * sizeof(uint32_t), bins.data(), GL_DYNAMIC_COPY);
+    glGenBuffers(1, &autoExposure.exposureBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, autoExposure.exposureBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ExposureState), &state, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LUMINANCE_HISTOGRAM_BUFFER_BINDING, autoExposure.histogramBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EXPOSURE_BUFFER_BINDING, autoExposure.exposureBuffer);
+
+    return autoExposure;
+}
+
+void DeleteAutoExposure(AutoExposure &autoExposure)
+{
+    glDeleteBuffers(1, &autoExposure.histogramBuffer);
+    glDeleteBuffers(1, &autoExposure.exposureBuffer);
+    autoExposure.histogramBuffer = 0;
+    autoExposure.exposureBuffer = 0;
+}
+
+// Measures the lower left width x height texels of the color texture
+void DispatchAutoExposure(AutoExposure &autoExposure, GLuint colorTexture, int32_t width, int32_t height)
+{
+    //Timed like a render pass so that it shows up next to the tone mapping
+    ShortString const name = {"Auto Exposure", 13};
+#ifdef NDEBUG
+    glPushGroupMarkerEXT(name.length, name.data);
+#endif
+    sr::prof::BeginRenderPassZone(name);
+
+    sr::prof::BeginSubPassZone(0);
+    glUseProgram(autoExposure.histogramProgram.handle);
+    UpdatePerFrameUniforms(autoExposure.histogramProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glDispatchCompute((width + LUMINANCE_HISTOGRAM_TILE_SIZE - 1) / LUMINANCE_HISTOGRAM_TILE_SIZE,
+                      (height + LUMINANCE_HISTOGRAM_TILE_SIZE - 1) / LUMINANCE_HISTOGRAM_TILE_SIZE,
+                      1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    sr::prof::EndSubPassZone();
+
+    sr::prof::BeginSubPassZone(1);
+    glUseProgram(autoExposure.exposureProgram.handle);
+    UpdatePerFrameUniforms(autoExposure.exposureProgram);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(0);
+    sr::prof::EndSubPassZone();
+
+    sr::prof::EndRenderPassZone();
+#ifdef NDEBUG
+    glPopGroupMarkerEXT();
+#endif
+}
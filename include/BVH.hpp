@@ -0,0 +1,586 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "Culling.hpp"
+#include "Geometry.hpp"
+#include "JobSystem.hpp"
+#include "Math.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <vector>
+
+namespace sr::bvh
+{
+
+constexpr uint32_t BVH_BIN_COUNT = 12;
+constexpr uint32_t BVH_MAX_LEAF_SIZE = 4;
+constexpr float BVH_TRAVERSAL_COST = 1.f;
+constexpr uint32_t BVH_PARALLEL_BUILD_THRESHOLD = 4096;
+constexpr uint32_t BVH_INVALID_INDEX = UINT32_MAX;
+//The traversals push both children of a node, a tree no deeper than the stack size minus one never overflows it
+constexpr uint32_t BVH_STACK_SIZE = 64;
+constexpr uint32_t BVH_MAX_DEPTH = BVH_STACK_SIZE - 1;
+
+// Internal nodes store the index of the left child in leftFirst, the right child
+// always follows it. Leaves store the first entry of BVH::primitives instead.
+struct Node
+{
+    float min[3];
+    uint32_t leftFirst;
+    float max[3];
+    uint32_t count;
+};
+static_assert(sizeof(Node) == 32, "BVH node must be 32 bytes.");
+
+struct BVH
+{
+    std::vector<Node> nodes;
+    std::vector<uint32_t> primitives;      //Primitive indices in leaf order
+    std::vector<sr::geo::AABB> bounds;     //Primitive bounds, indexed by primitive
+    std::vector<uint32_t> parents;         //Parent node, indexed by node
+    std::vector<uint32_t> primitiveLeaves; //Leaf node, indexed by primitive
+    uint32_t nodeCount = 0;
+};
+
+inline sr::geo::AABB GetNodeAABB(Node const &node)
+{
+    return sr::geo::AABB{
+        {node.min[0], node.min[1], node.min[2]},
+        {node.max[0], node.max[1], node.max[2]}};
+}
+
+inline void SetNodeAABB(Node &node, sr::geo::AABB const &aabb)
+{
+    node.min[0] = aabb.min.x;
+    node.min[1] = aabb.min.y;
+    node.min[2] = aabb.min.z;
+    node.max[0] = aabb.max.x;
+    node.max[1] = aabb.max.y;
+    node.max[2] = aabb.max.z;
+}
+
+inline sr::geo::AABB MergeAABB(sr::geo::AABB const &a, sr::geo::AABB const &b)
+{
+    return sr::geo::AABB{
+        {std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)},
+        {std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z)}};
+}
+
+inline sr::geo::AABB GrowAABB(sr::geo::AABB const &aabb, sr::math::Vec3 p)
+{
+    return MergeAABB(aabb, sr::geo::AABB{p, p});
+}
+
+inline float SurfaceArea(sr::geo::AABB const &aabb)
+{
+    sr::math::Vec3 const e = aabb.max - aabb.min;
+    return e.x < 0 ? 0 : 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+inline sr::math::Vec3 Centroid(sr::geo::AABB const &aabb)
+{
+    return (aabb.min + aabb.max) * 0.5f;
+}
+
+constexpr sr::geo::AABB EmptyAABB()
+{
+    return sr::geo::AABB{{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+}
+
+namespace
+{
+
+struct BuildPrimitive
+{
+    sr::geo::AABB bounds;
+    sr::math::Vec3 centroid;
+    uint32_t index;
+};
+
+struct BuildContext
+{
+    BVH *bvh;
+    std::vector<BuildPrimitive> primitives; //Partitioned in place so that nodes read contiguous memory
+    std::atomic<uint32_t> nodeCount;
+    uint32_t parallelDepth;
+};
+
+// Primitives in bins [0, bin] go to the left child
+struct Split
+{
+    uint32_t axis = 0;
+    uint32_t bin = 0;
+    float minCentroid = 0;
+    float scale = 0;
+    float cost = FLT_MAX;
+};
+
+uint32_t CalculateBin(sr::math::Vec3 centroid, uint32_t axis, float minCentroid, float scale)
+{
+    return std::min(BVH_BIN_COUNT - 1, static_cast<uint32_t>((centroid.data[axis] - minCentroid) * scale));
+}
+
+// Bins all three axes in a single pass over the primitives
+Split FindSAHSplit(BuildContext const &context, uint32_t first, uint32_t count, sr::geo::AABB const &centroidBounds)
+{
+    sr::geo::AABB binBounds[3][BVH_BIN_COUNT];
+    uint32_t binCounts[3][BVH_BIN_COUNT] = {};
+    float scales[3] = {};
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        std::fill(std::begin(binBounds[axis]), std::end(binBounds[axis]), EmptyAABB());
+        float const extent = centroidBounds.max.data[axis] - centroidBounds.min.data[axis];
+        scales[axis] = extent > 0 ? BVH_BIN_COUNT / extent : 0;
+    }
+
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        auto const &primitive = context.primitives[i];
+
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            uint32_t const bin = CalculateBin(primitive.centroid, axis, centroidBounds.min.data[axis], scales[axis]);
+            binCounts[axis][bin]++;
+            binBounds[axis][bin] = MergeAABB(binBounds[axis][bin], primitive.bounds);
+        }
+    }
+
+    Split best;
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        if (scales[axis] == 0)
+        {
+            continue;
+        }
+
+        float rightAreas[BVH_BIN_COUNT - 1] = {};
+        uint32_t rightCounts[BVH_BIN_COUNT - 1] = {};
+        sr::geo::AABB rightBounds = EmptyAABB();
+        uint32_t rightSum = 0;
+        for (uint32_t i = BVH_BIN_COUNT - 1; i > 0; --i)
+        {
+            rightSum += binCounts[axis][i];
+            rightCounts[i - 1] = rightSum;
+            rightBounds = MergeAABB(rightBounds, binBounds[axis][i]);
+            rightAreas[i - 1] = SurfaceArea(rightBounds);
+        }
+
+        sr::geo::AABB leftBounds = EmptyAABB();
+        uint32_t leftSum = 0;
+        for (uint32_t i = 0; i < BVH_BIN_COUNT - 1; ++i)
+        {
+            leftSum += binCounts[axis][i];
+            leftBounds = MergeAABB(leftBounds, binBounds[axis][i]);
+
+            float const cost = leftSum * SurfaceArea(leftBounds) + rightCounts[i] * rightAreas[i];
+            if (leftSum > 0 && rightCounts[i] > 0 && cost < best.cost)
+            {
+                best = Split{axis, i, centroidBounds.min.data[axis], scales[axis], cost};
+            }
+        }
+    }
+
+    return best;
+}
+
+void BuildNode(BuildContext &context, uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth)
+{
+    BVH &bvh = *context.bvh;
+    Node &node = bvh.nodes[nodeIndex];
+
+    sr::geo::AABB nodeBounds = EmptyAABB();
+    sr::geo::AABB centroidBounds = EmptyAABB();
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        auto const &primitive = context.primitives[i];
+        nodeBounds = MergeAABB(nodeBounds, primitive.bounds);
+        centroidBounds = GrowAABB(centroidBounds, primitive.centroid);
+    }
+    SetNodeAABB(node, nodeBounds);
+
+    Split const split = count > 1 ? FindSAHSplit(context, first, count, centroidBounds) : Split{};
+    float const leafCost = static_cast<float>(count);
+    float const splitCost = BVH_TRAVERSAL_COST + split.cost / std::max(SurfaceArea(nodeBounds), FLT_MIN);
+
+    //No SAH split exists when all centroids coincide, those nodes fall back to an object median split
+    bool const medianSplit = split.cost == FLT_MAX && count > BVH_MAX_LEAF_SIZE;
+    if (depth >= BVH_MAX_DEPTH || (split.cost == FLT_MAX && !medianSplit) ||
+        (count <= BVH_MAX_LEAF_SIZE && splitCost >= leafCost))
+    {
+        node.leftFirst = first;
+        node.count = count;
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            uint32_t const primitive = context.primitives[i].index;
+            bvh.primitives[i] = primitive;
+            bvh.primitiveLeaves[primitive] = nodeIndex;
+        }
+        return;
+    }
+
+    //The order of primitives with the same centroid does not matter, the median needs no partition
+    uint32_t leftCount = count / 2;
+    if (!medianSplit)
+    {
+        auto const begin = context.primitives.begin() + first;
+        auto const middle = std::partition(begin, begin + count, [&split](BuildPrimitive const &primitive) {
+            return CalculateBin(primitive.centroid, split.axis, split.minCentroid, split.scale) <= split.bin;
+        });
+        leftCount = static_cast<uint32_t>(middle - begin);
+    }
+    assert(leftCount > 0 && leftCount < count);
+
+    uint32_t const left = context.nodeCount.fetch_add(2);
+    node.leftFirst = left;
+    node.count = 0;
+    bvh.parents[left] = nodeIndex;
+    bvh.parents[left + 1] = nodeIndex;
+
+    if (depth < context.parallelDepth && count > BVH_PARALLEL_BUILD_THRESHOLD)
+    {
+        sr::job::Counter counter;
+        sr::job::RunJob([&context, left, first, leftCount, depth]() {
+            BuildNode(context, left, first, leftCount, depth + 1);
+        }, &counter);
+        BuildNode(context, left + 1, first + leftCount, count - leftCount, depth + 1);
+        sr::job::WaitForCounter(counter);
+    }
+    else
+    {
+        BuildNode(context, left, first, leftCount, depth + 1);
+        BuildNode(context, left + 1, first + leftCount, count - leftCount, depth + 1);
+    }
+}
+
+sr::geo::AABB CalculateLeafAABB(BVH const &bvh, Node const &leaf)
+{
+    sr::geo::AABB result = EmptyAABB();
+    for (uint32_t i = leaf.leftFirst; i < leaf.leftFirst + leaf.count; ++i)
+    {
+        result = MergeAABB(result, bvh.bounds[bvh.primitives[i]]);
+    }
+
+    return result;
+}
+
+enum class eFrustumTest : uint8_t
+{
+    Outside,
+    Intersects,
+    Inside,
+};
+
+// Only the planes in planeMask are tested, the ones the box is completely inside of are cleared
+// so that the children of a node skip them
+eFrustumTest ClassifyAABB(sr::cull::Frustum const &frustum, Node const &node, uint8_t &planeMask)
+{
+    for (uint8_t i = 0; i < 6; ++i)
+    {
+        if ((planeMask & (1u << i)) == 0)
+        {
+            continue;
+        }
+
+        auto const &plane = frustum.planes[i];
+        float const nx = plane.normal.x, ny = plane.normal.y, nz = plane.normal.z;
+        float const positive = plane.distance +
+                               (nx > 0 ? nx * node.max[0] : nx * node.min[0]) +
+                               (ny > 0 ? ny * node.max[1] : ny * node.min[1]) +
+                               (nz > 0 ? nz * node.max[2] : nz * node.min[2]);
+        if (positive < 0)
+        {
+            return eFrustumTest::Outside;
+        }
+
+        float const negative = plane.distance +
+                               (nx > 0 ? nx * node.min[0] : nx * node.max[0]) +
+                               (ny > 0 ? ny * node.min[1] : ny * node.max[1]) +
+                               (nz > 0 ? nz * node.min[2] : nz * node.max[2]);
+        if (negative >= 0)
+        {
+            planeMask &= static_cast<uint8_t>(~(1u << i));
+        }
+    }
+
+    return planeMask == 0 ? eFrustumTest::Inside : eFrustumTest::Intersects;
+}
+
+// The builder partitions the primitives in place, so the ones of a subtree are a contiguous range
+// that starts at its leftmost leaf and ends at its rightmost leaf
+void AppendSubtree(BVH const &bvh, uint32_t nodeIndex, sr::cull::VisibilityList &list)
+{
+    uint32_t first = nodeIndex;
+    while (bvh.nodes[first].count == 0)
+    {
+        first = bvh.nodes[first].leftFirst;
+    }
+    uint32_t last = nodeIndex;
+    while (bvh.nodes[last].count == 0)
+    {
+        last = bvh.nodes[last].leftFirst + 1;
+    }
+
+    uint32_t const begin = bvh.nodes[first].leftFirst;
+    uint32_t const end = bvh.nodes[last].leftFirst + bvh.nodes[last].count;
+    std::copy(bvh.primitives.begin() + begin, bvh.primitives.begin() + end, list.indices.begin() + list.count);
+    list.count += end - begin;
+}
+
+bool IntersectRayAABB(
+    sr::math::Vec3 origin, sr::math::Vec3 invDirection, float tMax, float const (&min)[3], float const (&max)[3])
+{
+    float tNear = 0;
+    float tFar = tMax;
+
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        float const t0 = (min[i] - origin.data[i]) * invDirection.data[i];
+        float const t1 = (max[i] - origin.data[i]) * invDirection.data[i];
+        tNear = std::max(tNear, std::min(t0, t1));
+        tFar = std::min(tFar, std::max(t0, t1));
+    }
+
+    return tNear <= tFar;
+}
+
+bool IntersectSphereAABB(sr::math::Vec3 center, float radius, float const (&min)[3], float const (&max)[3])
+{
+    float distanceSq = 0;
+
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        float const v = center.data[i];
+        float const d = v < min[i] ? min[i] - v : (v > max[i] ? v - max[i] : 0);
+        distanceSq += d * d;
+    }
+
+    return distanceSq <= radius * radius;
+}
+
+} // namespace
+
+// Binned SAH build, subtrees above BVH_PARALLEL_BUILD_THRESHOLD primitives are built as separate jobs
+inline BVH CreateBVH(sr::geo::AABB const *aabbs, uint32_t count)
+{
+    assert(aabbs != nullptr);
+    assert(count > 0);
+
+    BVH bvh;
+    bvh.bounds.assign(aabbs, aabbs + count);
+    bvh.primitives.resize(count);
+    bvh.nodes.resize(2 * static_cast<uint64_t>(count) - 1);
+    bvh.parents.resize(bvh.nodes.size(), BVH_INVALID_INDEX);
+    bvh.primitiveLeaves.resize(count, BVH_INVALID_INDEX);
+
+    //A few more subtrees than threads so that stealing can even out unbalanced splits
+    uint32_t const taskCount = 4 * sr::job::GetJobThreadCount();
+    uint32_t parallelDepth = 0;
+    while ((1u << parallelDepth) < taskCount)
+    {
+        ++parallelDepth;
+    }
+
+    BuildContext context = {&bvh, std::vector<BuildPrimitive>(count), {1}, parallelDepth};
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        context.primitives[i] = BuildPrimitive{aabbs[i], Centroid(aabbs[i]), i};
+    }
+
+    BuildNode(context, 0, 0, count, 0);
+
+    bvh.nodeCount = context.nodeCount.load();
+    bvh.nodes.resize(bvh.nodeCount);
+    bvh.parents.resize(bvh.nodeCount);
+
+    return bvh;
+}
+
+inline std::vector<sr::geo::AABB> CreateTriangleAABBs(
+    sr::math::Vec3 const *vertices, uint32_t const *indices, uint64_t indexCount)
+{
+    assert(vertices != nullptr);
+    assert(indices != nullptr);
+    assert(indexCount % 3 == 0);
+
+    std::vector<sr::geo::AABB> aabbs(indexCount / 3);
+    for (uint64_t i = 0; i < aabbs.size(); ++i)
+    {
+        aabbs[i] = EmptyAABB();
+        aabbs[i] = GrowAABB(aabbs[i], vertices[indices[i * 3 + 0]]);
+        aabbs[i] = GrowAABB(aabbs[i], vertices[indices[i * 3 + 1]]);
+        aabbs[i] = GrowAABB(aabbs[i], vertices[indices[i * 3 + 2]]);
+    }
+
+    return aabbs;
+}
+
+inline sr::geo::AABB GetRootAABB(BVH const &bvh)
+{
+    assert(bvh.nodeCount > 0);
+    return GetNodeAABB(bvh.nodes[0]);
+}
+
+// Updates the bounds of a single primitive and refits the nodes on the path to the root.
+// The topology is kept, which is fine for the few models that move a little every frame.
+inline void RefitBVH(BVH &bvh, uint32_t primitive, sr::geo::AABB const &aabb)
+{
+    assert(primitive < bvh.bounds.size());
+
+    bvh.bounds[primitive] = aabb;
+
+    uint32_t nodeIndex = bvh.primitiveLeaves[primitive];
+    SetNodeAABB(bvh.nodes[nodeIndex], CalculateLeafAABB(bvh, bvh.nodes[nodeIndex]));
+
+    nodeIndex = bvh.parents[nodeIndex];
+    while (nodeIndex != BVH_INVALID_INDEX)
+    {
+        Node &node = bvh.nodes[nodeIndex];
+        SetNodeAABB(node, MergeAABB(
+                              GetNodeAABB(bvh.nodes[node.leftFirst]),
+                              GetNodeAABB(bvh.nodes[node.leftFirst + 1])));
+        nodeIndex = bvh.parents[nodeIndex];
+    }
+}
+
+inline void QueryFrustum(BVH const &bvh, sr::cull::Frustum const &frustum, sr::cull::VisibilityList &list)
+{
+    list.indices.resize(bvh.bounds.size());
+    list.count = 0;
+
+    //Every entry keeps the planes its parent was not completely inside of
+    uint32_t stack[BVH_STACK_SIZE];
+    uint8_t planeMasks[BVH_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize] = 0;
+    planeMasks[stackSize++] = 0x3F;
+
+    while (stackSize > 0)
+    {
+        --stackSize;
+        uint32_t const nodeIndex = stack[stackSize];
+        uint8_t planeMask = planeMasks[stackSize];
+        Node const &node = bvh.nodes[nodeIndex];
+
+        eFrustumTest const test = ClassifyAABB(frustum, node, planeMask);
+        if (test == eFrustumTest::Outside)
+        {
+            continue;
+        }
+
+        if (test == eFrustumTest::Inside)
+        {
+            AppendSubtree(bvh, nodeIndex, list);
+        }
+        else if (node.count > 0)
+        {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+            {
+                uint32_t const primitive = bvh.primitives[i];
+                Node bounds = {};
+                SetNodeAABB(bounds, bvh.bounds[primitive]);
+                uint8_t primitiveMask = planeMask;
+                if (ClassifyAABB(frustum, bounds, primitiveMask) != eFrustumTest::Outside)
+                {
+                    list.indices[list.count++] = primitive;
+                }
+            }
+        }
+        else
+        {
+            assert(stackSize + 2 <= BVH_STACK_SIZE);
+            stack[stackSize] = node.leftFirst;
+            planeMasks[stackSize++] = planeMask;
+            stack[stackSize] = node.leftFirst + 1;
+            planeMasks[stackSize++] = planeMask;
+        }
+    }
+}
+
+inline void QuerySphere(BVH const &bvh, sr::math::Vec3 center, float radius, std::vector<uint32_t> &result)
+{
+    result.clear();
+
+    uint32_t stack[BVH_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        Node const &node = bvh.nodes[stack[--stackSize]];
+        if (!IntersectSphereAABB(center, radius, node.min, node.max))
+        {
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+            {
+                Node primitive = {};
+                SetNodeAABB(primitive, bvh.bounds[bvh.primitives[i]]);
+                if (IntersectSphereAABB(center, radius, primitive.min, primitive.max))
+                {
+                    result.push_back(bvh.primitives[i]);
+                }
+            }
+        }
+        else
+        {
+            assert(stackSize + 2 <= BVH_STACK_SIZE);
+            stack[stackSize++] = node.leftFirst;
+            stack[stackSize++] = node.leftFirst + 1;
+        }
+    }
+}
+
+// Returns every primitive whose bounds are hit by the ray within [0, tMax]
+inline void QueryRay(
+    BVH const &bvh, sr::math::Vec3 origin, sr::math::Vec3 direction, float tMax, std::vector<uint32_t> &result)
+{
+    result.clear();
+
+    sr::math::Vec3 const invDirection = {
+        direction.x != 0 ? 1.f / direction.x : FLT_MAX,
+        direction.y != 0 ? 1.f / direction.y : FLT_MAX,
+        direction.z != 0 ? 1.f / direction.z : FLT_MAX};
+
+    uint32_t stack[BVH_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        Node const &node = bvh.nodes[stack[--stackSize]];
+        if (!IntersectRayAABB(origin, invDirection, tMax, node.min, node.max))
+        {
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+            {
+                Node primitive = {};
+                SetNodeAABB(primitive, bvh.bounds[bvh.primitives[i]]);
+                if (IntersectRayAABB(origin, invDirection, tMax, primitive.min, primitive.max))
+                {
+                    result.push_back(bvh.primitives[i]);
+                }
+            }
+        }
+        else
+        {
+            assert(stackSize + 2 <= BVH_STACK_SIZE);
+            stack[stackSize++] = node.leftFirst;
+            stack[stackSize++] = node.leftFirst + 1;
+        }
+    }
+}
+
+} // namespace sr::bvh
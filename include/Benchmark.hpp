@@ -0,0 +1,500 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "BVH.hpp"
+#include "Culling.hpp"
+#include "Geometry.hpp"
+#include "JobSystem.hpp"
+#include "LightClusters.hpp"
+#include "Math.hpp"
+#include "OcclusionCulling.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// CPU side micro benchmarks, they do not need a GL context and run with --benchmark
+namespace sr::bench
+{
+
+namespace
+{
+
+template <typename Func>
+float MeasureAverageMs(uint32_t iterations, Func func)
+{
+    auto const start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        func();
+    }
+    auto const end = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration<float, std::milli>(end - start).count() / iterations;
+}
+
+std::vector<sr::geo::AABB> CreateRandomAABBs(uint32_t count, float worldExtent, std::mt19937 &generator)
+{
+    std::uniform_real_distribution<float> position(-worldExtent, worldExtent);
+    std::uniform_real_distribution<float> size(1.f, worldExtent * 0.01f);
+
+    std::vector<sr::geo::AABB> aabbs(count);
+    for (auto &aabb : aabbs)
+    {
+        aabb.min = {position(generator), position(generator), position(generator)};
+        aabb.max = aabb.min + sr::math::Vec3{size(generator), size(generator), size(generator)};
+    }
+
+    return aabbs;
+}
+
+sr::cull::Occluder CreateBoxOccluder(sr::geo::AABB const &aabb)
+{
+    sr::cull::Occluder occluder;
+
+    for (uint8_t i = 0; i < 8; ++i)
+    {
+        occluder.vertices.push_back({
+            i & 1 ? aabb.max.x : aabb.min.x,
+            i & 2 ? aabb.max.y : aabb.min.y,
+            i & 4 ? aabb.max.z : aabb.min.z});
+    }
+    occluder.indices = {
+        0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5,
+        0, 4, 5, 0, 5, 1, 2, 3, 7, 2, 7, 6,
+        0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3};
+
+    return occluder;
+}
+
+// Samples the view frustum on a grid, picks the cluster of every sample the way lighting.frag does
+// and counts the lights that reach the sample but are missing from the list of its cluster
+uint64_t CountMissedClusterLights(sr::cull::LightClusters const &clusters,
+                                  PointLight const *lights,
+                                  uint32_t count,
+                                  sr::math::Matrix4x4 const &view,
+                                  sr::cull::ClusterProjection const &projection)
+{
+    using namespace sr::cull;
+    constexpr uint32_t sampleCount = 20; //Per axis
+
+    std::vector<sr::math::Vec3> positions(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        sr::math::Vec4 const position = view * sr::math::Vec4{lights[i].position.x, lights[i].position.y, lights[i].position.z, 1};
+        positions[i] = {position.x, position.y, position.z};
+    }
+
+    uint64_t missed = 0;
+    for (uint32_t k = 0; k < sampleCount; ++k)
+    {
+        float const depth = projection.near * std::pow(projection.far / projection.near, (k + 0.5f) / sampleCount);
+        uint32_t const slice = std::min(
+            static_cast<uint32_t>(std::max(std::log2(depth) * clusters.depthScale + clusters.depthBias, 0.f)),
+            CLUSTER_COUNT_Z - 1);
+        for (uint32_t j = 0; j < sampleCount; ++j)
+        {
+            float const ndcY = -1.f + 2.f * (j + 0.5f) / sampleCount;
+            uint32_t const y = std::min(static_cast<uint32_t>((ndcY * 0.5f + 0.5f) * CLUSTER_COUNT_Y), CLUSTER_COUNT_Y - 1);
+            for (uint32_t i = 0; i < sampleCount; ++i)
+            {
+                float const ndcX = -1.f + 2.f * (i + 0.5f) / sampleCount;
+                uint32_t const x = std::min(static_cast<uint32_t>((ndcX * 0.5f + 0.5f) * CLUSTER_COUNT_X), CLUSTER_COUNT_X - 1);
+                sr::math::Vec3 const sample = {ndcX * depth / projection.xScale, ndcY * depth / projection.yScale, -depth};
+
+                ClusterRange const &range = clusters.ranges[(slice * CLUSTER_COUNT_Y + y) * CLUSTER_COUNT_X + x];
+                uint32_t const *begin = clusters.indices.data() + range.offset;
+                uint32_t const *end = begin + range.count;
+                for (uint32_t light = 0; light < count; ++light)
+                {
+                    sr::math::Vec3 const d = positions[light] - sample;
+                    if (d.x * d.x + d.y * d.y + d.z * d.z <= lights[light].radius * lights[light].radius
+                        && std::find(begin, end, light) == end)
+                    {
+                        ++missed;
+                    }
+                }
+            }
+        }
+    }
+
+    return missed;
+}
+
+//Queries return their results in traversal order, so both sides are sorted before comparing
+bool IsSameSet(std::vector<uint32_t> a, std::vector<uint32_t> b)
+{
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    return a == b;
+}
+
+//Returns the occluder the segment from the eye to the point passes through, or -1 if nothing blocks it
+int32_t FindBlockingOccluder(sr::math::Vec3 eye, sr::math::Vec3 point, sr::geo::AABB const *occluders, size_t count)
+{
+    sr::math::Vec3 const direction = point - eye;
+    sr::math::Vec3 const invDirection = {1.f / direction.x, 1.f / direction.y, 1.f / direction.z};
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        float const min[3] = {occluders[i].min.x, occluders[i].min.y, occluders[i].min.z};
+        float const max[3] = {occluders[i].max.x, occluders[i].max.y, occluders[i].max.z};
+        if (sr::bvh::IntersectRayAABB(eye, invDirection, 1.f, min, max))
+        {
+            return static_cast<int32_t>(i);
+        }
+    }
+
+    return -1;
+}
+
+bool IsPointInFrustum(sr::math::Matrix4x4 const &viewProj, sr::math::Vec3 point)
+{
+    sr::math::Vec4 const clip = viewProj * sr::math::Vec4{point.x, point.y, point.z, 1};
+    return clip.w > 0 && std::abs(clip.x) <= clip.w && std::abs(clip.y) <= clip.w && std::abs(clip.z) <= clip.w;
+}
+
+std::vector<uint32_t> GetVisibleIndices(sr::cull::VisibilityList const &list)
+{
+    return std::vector<uint32_t>(list.indices.begin(), list.indices.begin() + list.count);
+}
+
+} // namespace
+
+// Compares hierarchical BVH queries against the linear scans for a growing number of boxes.
+// Returns false if a query does not find the same boxes as its linear scan.
+inline bool RunBVHBenchmark()
+{
+    constexpr float worldExtent = 2000.f;
+    constexpr uint32_t iterations = 16;
+    uint32_t const counts[] = {1000, 10000, 100000, 1000000};
+
+    std::mt19937 generator(42);
+
+    sr::cull::Frustum const frustum = sr::cull::ExtractFrustum(
+        sr::math::CreatePerspectiveProjectionMatrix(1.f, worldExtent, 1.0472f, 16.f / 9.f) *
+        sr::math::CreateRotationMatrixY(0.7f));
+    sr::math::Vec3 const sphereCenter = {100, 50, -300};
+    float const sphereRadius = worldExtent * 0.1f;
+    sr::math::Vec3 const rayOrigin = {-worldExtent, 0, 0};
+    sr::math::Vec3 const rayDirection = {1, 0, 0};
+    float const rayLength = worldExtent * 2.f;
+    bool valid = true;
+
+    std::printf("%10s %10s %12s %12s %12s %12s %12s %12s %6s\n",
+                "Boxes", "Build ms", "Frustum lin", "Frustum BVH", "Sphere lin", "Sphere BVH", "Ray lin", "Ray BVH", "Match");
+
+    for (uint32_t count : counts)
+    {
+        auto const aabbs = CreateRandomAABBs(count, worldExtent, generator);
+
+        sr::cull::AABBSoA soa;
+        sr::cull::ResizeAABBSoA(soa, count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            sr::cull::StoreAABB(soa, i, aabbs[i]);
+        }
+
+        sr::bvh::BVH bvh;
+        float const buildMs = MeasureAverageMs(1, [&]() { bvh = sr::bvh::CreateBVH(aabbs.data(), count); });
+
+        sr::cull::VisibilityList list;
+        std::vector<uint32_t> result;
+
+        float const frustumLinearMs = MeasureAverageMs(iterations, [&]() {
+            sr::cull::CullAABBs(frustum, soa, list);
+        });
+        auto const frustumLinear = GetVisibleIndices(list);
+        float const frustumBvhMs = MeasureAverageMs(iterations, [&]() {
+            sr::bvh::QueryFrustum(bvh, frustum, list);
+        });
+        bool match = IsSameSet(frustumLinear, GetVisibleIndices(list));
+
+        float const sphereLinearMs = MeasureAverageMs(iterations, [&]() {
+            result.clear();
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                sr::bvh::Node node = {};
+                sr::bvh::SetNodeAABB(node, aabbs[i]);
+                if (sr::bvh::IntersectSphereAABB(sphereCenter, sphereRadius, node.min, node.max))
+                {
+                    result.push_back(i);
+                }
+            }
+        });
+        auto const sphereLinear = result;
+        float const sphereBvhMs = MeasureAverageMs(iterations, [&]() {
+            sr::bvh::QuerySphere(bvh, sphereCenter, sphereRadius, result);
+        });
+        match = match && IsSameSet(sphereLinear, result);
+
+        sr::math::Vec3 const invDirection = {1.f / rayDirection.x, FLT_MAX, FLT_MAX};
+        float const rayLinearMs = MeasureAverageMs(iterations, [&]() {
+            result.clear();
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                sr::bvh::Node node = {};
+                sr::bvh::SetNodeAABB(node, aabbs[i]);
+                if (sr::bvh::IntersectRayAABB(rayOrigin, invDirection, rayLength, node.min, node.max))
+                {
+                    result.push_back(i);
+                }
+            }
+        });
+        auto const rayLinear = result;
+        float const rayBvhMs = MeasureAverageMs(iterations, [&]() {
+            sr::bvh::QueryRay(bvh, rayOrigin, rayDirection, rayLength, result);
+        });
+        match = match && IsSameSet(rayLinear, result);
+        valid = valid && match;
+
+        std::printf("%10u %10.3f %12.4f %12.4f %12.4f %12.4f %12.4f %12.4f %6s\n",
+                    count, buildMs, frustumLinearMs, frustumBvhMs, sphereLinearMs, sphereBvhMs, rayLinearMs, rayBvhMs,
+                    match ? "yes" : "no");
+    }
+
+    return valid;
+}
+
+// Flies a camera down a street of a city block grid and reports how many of the
+// frustum visible boxes the occlusion buffer rejects at every step of the path.
+// Returns false if it rejects a box whose center the eye sees, or keeps a box that is
+// completely behind a single block shrunk by a margin that covers the buffer resolution.
+inline bool RunOcclusionBenchmark()
+{
+    constexpr uint32_t blockCount = 10;
+    constexpr float blockSize = 160.f;
+    constexpr float streetWidth = 60.f;
+    constexpr uint32_t boxCount = 20000;
+    constexpr uint32_t pathStepCount = 16;
+    constexpr float hiddenMargin = 16.f;
+
+    std::mt19937 generator(42);
+    float const worldExtent = blockCount * (blockSize + streetWidth) * 0.5f;
+
+    std::vector<sr::cull::Occluder> occluders;
+    std::vector<sr::geo::AABB> blocks;
+    std::vector<sr::geo::AABB> shrunkBlocks;
+    for (uint32_t x = 0; x < blockCount; ++x)
+    {
+        for (uint32_t z = 0; z < blockCount; ++z)
+        {
+            sr::math::Vec3 const min = {
+                -worldExtent + x * (blockSize + streetWidth) + streetWidth,
+                0,
+                -worldExtent + z * (blockSize + streetWidth) + streetWidth};
+            sr::geo::AABB const block = {min, min + sr::math::Vec3{blockSize, 120.f, blockSize}};
+            occluders.push_back(CreateBoxOccluder(block));
+            blocks.push_back(block);
+            shrunkBlocks.push_back({
+                block.min + sr::math::Vec3{hiddenMargin, hiddenMargin, hiddenMargin},
+                block.max - sr::math::Vec3{hiddenMargin, hiddenMargin, hiddenMargin}});
+        }
+    }
+
+    std::uniform_real_distribution<float> position(-worldExtent, worldExtent);
+    sr::cull::AABBSoA boxes;
+    sr::cull::ResizeAABBSoA(boxes, boxCount);
+    for (uint32_t i = 0; i < boxCount; ++i)
+    {
+        sr::math::Vec3 const min = {position(generator), 0, position(generator)};
+        sr::cull::StoreAABB(boxes, i, {min, min + sr::math::Vec3{4, 4, 4}});
+    }
+
+    auto depthBuffer = sr::cull::CreateDepthBuffer(256, 128);
+    std::vector<sr::cull::ScreenTriangle> triangles;
+    sr::cull::VisibilityList frustumVisible;
+    sr::cull::VisibilityList visible;
+
+    auto const proj = sr::math::CreatePerspectiveProjectionMatrix(1.f, 4000.f, 1.0472f, 2.f);
+
+    bool valid = true;
+
+    std::printf("%6s %14s %10s %10s %10s %12s %12s\n",
+                "Step", "Frustum boxes", "Occluded", "Raster ms", "Test ms", "Seen culled", "Hidden kept");
+    for (uint32_t step = 0; step < pathStepCount; ++step)
+    {
+        float const t = step / static_cast<float>(pathStepCount - 1);
+        sr::math::Vec3 const cameraPosition = {
+            -worldExtent + streetWidth * 0.5f, 20.f, worldExtent - t * 2.f * worldExtent};
+        float const yaw = -0.5f + t;
+        auto const view = sr::math::CreateRotationMatrixY(-yaw) * sr::math::CreateTranslationMatrix(-cameraPosition);
+        auto const viewProj = proj * view;
+
+        sr::cull::CullAABBs(sr::cull::ExtractFrustum(viewProj), boxes, frustumVisible);
+
+        float const rasterMs = MeasureAverageMs(1, [&]() {
+            sr::cull::TransformOccluders(
+                occluders.data(), occluders.size(), viewProj, depthBuffer.width, depthBuffer.height, triangles);
+            sr::cull::RasterizeOccluders(depthBuffer, triangles);
+        });
+        float const testMs = MeasureAverageMs(1, [&]() {
+            sr::cull::CullOccludedAABBs(depthBuffer, viewProj, boxes, frustumVisible, visible);
+        });
+
+        std::vector<bool> kept(boxCount, false);
+        for (uint64_t i = 0; i < visible.count; ++i)
+        {
+            kept[visible.indices[i]] = true;
+        }
+
+        uint64_t seenCulled = 0;
+        uint64_t hiddenKept = 0;
+        for (uint64_t i = 0; i < frustumVisible.count; ++i)
+        {
+            uint32_t const index = frustumVisible.indices[i];
+            sr::geo::AABB const aabb = sr::cull::LoadAABB(boxes, index);
+            sr::math::Vec3 const center = (aabb.min + aabb.max) * 0.5f;
+
+            if (!kept[index] && IsPointInFrustum(viewProj, center)
+                && FindBlockingOccluder(cameraPosition, center, blocks.data(), blocks.size()) < 0)
+            {
+                ++seenCulled;
+            }
+
+            //A block is convex, so the box is hidden if all of its corners are behind the same one
+            int32_t const blocker = FindBlockingOccluder(cameraPosition, aabb.min, shrunkBlocks.data(), shrunkBlocks.size());
+            bool hidden = blocker >= 0;
+            for (uint8_t c = 1; c < 8 && hidden; ++c)
+            {
+                sr::math::Vec3 const corner = {
+                    c & 1 ? aabb.max.x : aabb.min.x,
+                    c & 2 ? aabb.max.y : aabb.min.y,
+                    c & 4 ? aabb.max.z : aabb.min.z};
+                hidden = FindBlockingOccluder(cameraPosition, corner, &shrunkBlocks[blocker], 1) == 0;
+            }
+            if (kept[index] && hidden)
+            {
+                ++hiddenKept;
+            }
+        }
+        valid = valid && seenCulled == 0 && hiddenKept == 0;
+
+        float const occluded = frustumVisible.count > 0
+                                   ? 100.f * (1.f - visible.count / static_cast<float>(frustumVisible.count))
+                                   : 0.f;
+        std::printf("%6u %14llu %9.1f%% %10.3f %10.3f %12llu %12llu\n",
+                    step,
+                    static_cast<unsigned long long>(frustumVisible.count),
+                    occluded,
+                    rasterMs,
+                    testMs,
+                    static_cast<unsigned long long>(seenCulled),
+                    static_cast<unsigned long long>(hiddenKept));
+    }
+
+    return valid;
+}
+
+// Froxel assignment of point lights spread over a box around a camera looking down -z,
+// the slices are built on the job workers. Returns false if a cluster misses a light that reaches it.
+inline bool RunLightClusterBenchmark()
+{
+    constexpr uint32_t iterations = 20;
+    constexpr uint32_t lightCounts[] = {100, 1000, 4000, 16000};
+
+    sr::geo::AABB const bounds = {{-1500.f, -200.f, -3000.f}, {1500.f, 800.f, 0.f}};
+    auto const view = sr::math::CreateRotationMatrixY(0.3f);
+    auto const proj = sr::math::CreatePerspectiveProjectionMatrix(10.f, 3000.f, 1.0472f, 16.f / 9.f);
+    sr::cull::ClusterProjection const projection = {10.f, 3000.f, proj._11, proj._22};
+    sr::cull::LightClusters clusters;
+    bool valid = true;
+
+    std::printf("%8s %10s %14s %8s\n", "Lights", "Build ms", "Light indices", "Missed");
+    for (uint32_t const count : lightCounts)
+    {
+        auto const lights = CreatePointLights(count, bounds);
+        float const buildMs = MeasureAverageMs(iterations, [&]() {
+            sr::cull::BuildLightClusters(clusters, lights.data(), count, view, projection);
+        });
+        uint64_t const missed = CountMissedClusterLights(clusters, lights.data(), count, view, projection);
+        valid = valid && missed == 0;
+        std::printf("%8u %10.3f %14llu %8llu\n",
+                    count,
+                    buildMs,
+                    static_cast<unsigned long long>(sr::cull::GetClusterLightIndexCount(clusters)),
+                    static_cast<unsigned long long>(missed));
+    }
+
+    return valid;
+}
+
+// Spawn overhead of empty jobs and scaling of a fine grained parallel for over the worker count.
+// Initializes and shuts down the job system itself, so it must not already be running.
+inline void RunJobSystemBenchmark()
+{
+    constexpr uint32_t spawnCount = 100000;
+    constexpr uint64_t elementCount = 1 << 22;
+    constexpr uint32_t iterations = 8;
+    uint64_t const grainSizes[] = {256, 4096, 65536};
+
+    std::vector<float> data(elementCount);
+    for (uint64_t i = 0; i < elementCount; ++i)
+    {
+        data[i] = static_cast<float>(i);
+    }
+
+    auto const kernel = [&data](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; ++i)
+        {
+            data[i] = std::sqrt(data[i] * 1.0001f + 1.f);
+        }
+    };
+
+    float const serialMs = MeasureAverageMs(iterations, [&kernel]() { kernel(0, elementCount); });
+
+    uint32_t const hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint32_t> workerCounts = {0};
+    for (uint32_t workers = 1; workers < hardwareThreads; workers *= 2)
+    {
+        workerCounts.push_back(workers);
+    }
+    if (workerCounts.back() != hardwareThreads - 1)
+    {
+        workerCounts.push_back(hardwareThreads - 1);
+    }
+
+    std::printf("Parallel for over %llu elements, serial %.3f ms\n",
+                static_cast<unsigned long long>(elementCount), serialMs);
+    std::printf("%8s %14s %14s %14s %14s\n", "Workers", "Spawn ns/job", "Grain 256", "Grain 4096", "Grain 65536");
+
+    for (uint32_t workers : workerCounts)
+    {
+        sr::job::InitializeJobSystem(workers);
+
+        std::atomic<uint32_t> executed = {0};
+        float const spawnMs = MeasureAverageMs(iterations, [&executed]() {
+            sr::job::Counter counter;
+            for (uint32_t i = 0; i < spawnCount; ++i)
+            {
+                sr::job::RunJob([&executed]() { executed.fetch_add(1, std::memory_order_relaxed); }, &counter);
+            }
+            sr::job::WaitForCounter(counter);
+        });
+        assert(executed == spawnCount * iterations);
+
+        float speedups[3] = {};
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            float const parallelMs = MeasureAverageMs(iterations, [&kernel, &grainSizes, i]() {
+                sr::job::ParallelFor(elementCount, grainSizes[i], kernel);
+            });
+            speedups[i] = serialMs / parallelMs;
+        }
+
+        std::printf("%8u %14.1f %13.2fx %13.2fx %13.2fx\n",
+                    workers, spawnMs * 1e6f / spawnCount, speedups[0], speedups[1], speedups[2]);
+
+        sr::job::DeinitializeJobSystem();
+    }
+}
+
+} // namespace sr::bench
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "Math.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+// Scripted camera flights, the same t always gives the same camera so runs can be compared
+struct CameraPathKey
+{
+    sr::math::Vec3 pos;
+    float xWorldAngle;
+    float yWorldAngle;
+};
+
+namespace
+{
+
+float CatmullRom(float p0, float p1, float p2, float p3, float t)
+{
+    return 0.5f * (2 * p1 + (p2 - p0) * t + (2 * p0 - 5 * p1 + 4 * p2 - p3) * t * t +
+                   (3 * p1 - p0 - 3 * p2 + p3) * t * t * t);
+}
+
+} // namespace
+
+// Catmull-Rom spline through the keys, t in [0, 1] covers the whole path with equal time between keys
+CameraPathKey SampleCameraPath(CameraPathKey const *keys, uint32_t count, float t)
+{
+    assert(keys != nullptr && count > 0);
+    if (count == 1)
+    {
+        return keys[0];
+    }
+
+    float const segment = std::min(std::max(t, 0.f), 1.f) * (count - 1);
+    uint32_t const i = std::min(static_cast<uint32_t>(segment), count - 2);
+    float const local = segment - i;
+
+    CameraPathKey const &k0 = keys[i > 0 ? i - 1 : 0];
+    CameraPathKey const &k1 = keys[i];
+    CameraPathKey const &k2 = keys[i + 1];
+    CameraPathKey const &k3 = keys[std::min(i + 2, count - 1)];
+
+    CameraPathKey key;
+    key.pos = {CatmullRom(k0.pos.x, k1.pos.x, k2.pos.x, k3.pos.x, local),
+               CatmullRom(k0.pos.y, k1.pos.y, k2.pos.y, k3.pos.y, local),
+               CatmullRom(k0.pos.z, k1.pos.z, k2.pos.z, k3.pos.z, local)};
+    key.xWorldAngle = CatmullRom(k0.xWorldAngle, k1.xWorldAngle, k2.xWorldAngle, k3.xWorldAngle, local);
+    key.yWorldAngle = CatmullRom(k0.yWorldAngle, k1.yWorldAngle, k2.yWorldAngle, k3.yWorldAngle, local);
+
+    return key;
+}
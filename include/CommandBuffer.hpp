@@ -0,0 +1,570 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "Culling.hpp"
+#include "Profiler.hpp"
+#include "RenderDefinitions.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+// Command buffers are plain byte streams that can be recorded on any thread, they only
+// read CPU side data. Uniform values are copied at record time, so the replay on the
+// GL thread does not touch the data the uniform bindings point to.
+
+enum class eCommandType : uint32_t
+{
+    PushMarker,
+    PopMarker,
+    BeginSubPass,
+    EndSubPass,
+    BindProgram,
+    SetUniforms,
+    BindTextures,
+    BindSamplers,
+    Draw,
+    SetPolygonOffset,
+    SetBlend,
+};
+
+enum class eUniformType : uint32_t
+{
+    UI32,
+    Float1,
+    Float2,
+    Float3,
+    Float4,
+    Mat4,
+};
+
+struct CommandHeader
+{
+    eCommandType type;
+    uint32_t size; //Including the header
+};
+
+struct MarkerCommand
+{
+    ShortString name;
+};
+
+struct BeginSubPassCommand
+{
+    uint8_t subPass;
+    GLuint framebuffer;
+    int32_t width;
+    int32_t height;
+    float clearColor[4];
+    float clearDepth;
+    GLenum depthFunction;
+    bool enableWriteToDepth;
+    bool enableClearDepthBuffer;
+    bool enableClearColorBuffer;
+};
+
+struct BindProgramCommand
+{
+    GLuint program;
+};
+
+// Followed by entryCount UniformEntry structures, each one followed by its values
+struct SetUniformsCommand
+{
+    uint32_t entryCount;
+};
+
+struct UniformEntry
+{
+    int32_t location;
+    eUniformType type;
+    int32_t count;
+};
+
+struct TextureBinding
+{
+    GLenum unit;
+    GLenum target;
+    GLuint handle;
+};
+
+// Followed by bindingCount TextureBinding structures
+struct BindTexturesCommand
+{
+    uint32_t bindingCount;
+};
+
+// Binds the sampler to count units starting at first, 0 unbinds them
+struct BindSamplersCommand
+{
+    uint32_t first;
+    uint32_t count;
+    GLuint sampler;
+};
+
+struct DrawCommand
+{
+    GLuint vertexArray;
+    uint32_t indexCount;
+};
+
+struct PolygonOffsetCommand
+{
+    float factor;
+    float units;
+    bool enable;
+};
+
+struct BlendCommand
+{
+    bool enable;
+};
+
+struct CommandBuffer
+{
+    std::vector<uint8_t> data;
+    uint32_t commandCount = 0;
+};
+
+namespace
+{
+
+constexpr uint32_t AlignCommandSize(uint32_t size)
+{
+    return (size + 3u) & ~3u;
+}
+
+void WriteCommandData(CommandBuffer &buffer, void const *data, uint32_t size)
+{
+    uint64_t const offset = buffer.data.size();
+    buffer.data.resize(offset + AlignCommandSize(size), 0);
+    std::memcpy(buffer.data.data() + offset, data, size);
+}
+
+template <typename T>
+void WriteCommandData(CommandBuffer &buffer, T const &value)
+{
+    static_assert(std::is_pod<T>::value, "Command data must be a POD type.");
+    WriteCommandData(buffer, &value, sizeof(T));
+}
+
+uint64_t BeginCommand(CommandBuffer &buffer, eCommandType type)
+{
+    uint64_t const offset = buffer.data.size();
+    WriteCommandData(buffer, CommandHeader{type, 0});
+    buffer.commandCount++;
+
+    return offset;
+}
+
+void EndCommand(CommandBuffer &buffer, uint64_t offset)
+{
+    uint32_t const size = static_cast<uint32_t>(buffer.data.size() - offset);
+    std::memcpy(buffer.data.data() + offset + offsetof(CommandHeader, size), &size, sizeof(size));
+}
+
+void RecordCommand(CommandBuffer &buffer, eCommandType type)
+{
+    EndCommand(buffer, BeginCommand(buffer, type));
+}
+
+template <typename T>
+void RecordCommand(CommandBuffer &buffer, eCommandType type, T const &command)
+{
+    uint64_t const offset = BeginCommand(buffer, type);
+    WriteCommandData(buffer, command);
+    EndCommand(buffer, offset);
+}
+
+constexpr uint32_t GetUniformComponentCount(eUniformType type)
+{
+    switch (type)
+    {
+    case eUniformType::UI32:
+    case eUniformType::Float1:
+        return 1;
+    case eUniformType::Float2:
+        return 2;
+    case eUniformType::Float3:
+        return 3;
+    case eUniformType::Float4:
+        return 4;
+    case eUniformType::Mat4:
+        return 16;
+    }
+
+    return 0;
+}
+
+template <typename T>
+void WriteFrameUniforms(CommandBuffer &buffer, HeapArray<T> const &bindings, eUniformType type, uint32_t &entryCount)
+{
+    for (uint32_t i = 0; i < bindings.count; ++i)
+    {
+        auto const &uniform = bindings.data[i];
+        if (uniform.location == -1)
+        {
+            continue;
+        }
+
+        WriteCommandData(buffer, UniformEntry{uniform.location, type, uniform.count});
+        WriteCommandData(buffer, uniform.data, uniform.count * GetUniformComponentCount(type) * 4);
+        entryCount++;
+    }
+}
+
+template <typename T>
+void WriteModelUniforms(
+    CommandBuffer &buffer, HeapArray<T> const &bindings, eUniformType type, uint64_t index, uint32_t &entryCount)
+{
+    for (uint32_t i = 0; i < bindings.count; ++i)
+    {
+        auto const &uniform = bindings.data[i];
+        if (uniform.location == -1)
+        {
+            continue;
+        }
+
+        uint8_t const *data = reinterpret_cast<uint8_t const *>(uniform.data);
+        data = data + uniform.offset + uniform.stride * index;
+
+        WriteCommandData(buffer, UniformEntry{uniform.location, type, 1});
+        WriteCommandData(buffer, data, GetUniformComponentCount(type) * 4);
+        entryCount++;
+    }
+}
+
+void RecordSetUniforms(CommandBuffer &buffer, PerFrameUniformBindings const &bindings)
+{
+    uint64_t const offset = BeginCommand(buffer, eCommandType::SetUniforms);
+    uint64_t const countOffset = buffer.data.size();
+    WriteCommandData(buffer, SetUniformsCommand{0});
+
+    uint32_t entryCount = 0;
+    WriteFrameUniforms(buffer, bindings.UI32, eUniformType::UI32, entryCount);
+    WriteFrameUniforms(buffer, bindings.Float1, eUniformType::Float1, entryCount);
+    WriteFrameUniforms(buffer, bindings.Float2, eUniformType::Float2, entryCount);
+    WriteFrameUniforms(buffer, bindings.Float3, eUniformType::Float3, entryCount);
+    WriteFrameUniforms(buffer, bindings.Float4, eUniformType::Float4, entryCount);
+    WriteFrameUniforms(buffer, bindings.Float16, eUniformType::Mat4, entryCount);
+
+    std::memcpy(buffer.data.data() + countOffset, &entryCount, sizeof(entryCount));
+    EndCommand(buffer, offset);
+}
+
+void RecordSetUniforms(CommandBuffer &buffer, PerModleUniformBindings const &bindings, uint64_t index)
+{
+    uint64_t const offset = BeginCommand(buffer, eCommandType::SetUniforms);
+    uint64_t const countOffset = buffer.data.size();
+    WriteCommandData(buffer, SetUniformsCommand{0});
+
+    uint32_t entryCount = 0;
+    WriteModelUniforms(buffer, bindings.UI32, eUniformType::UI32, index, entryCount);
+    WriteModelUniforms(buffer, bindings.Float1, eUniformType::Float1, index, entryCount);
+    WriteModelUniforms(buffer, bindings.Float2, eUniformType::Float2, index, entryCount);
+    WriteModelUniforms(buffer, bindings.Float3, eUniformType::Float3, index, entryCount);
+    WriteModelUniforms(buffer, bindings.Float4, eUniformType::Float4, index, entryCount);
+    WriteModelUniforms(buffer, bindings.Float16, eUniformType::Mat4, index, entryCount);
+
+    std::memcpy(buffer.data.data() + countOffset, &entryCount, sizeof(entryCount));
+    EndCommand(buffer, offset);
+}
+
+void RecordBindTextures(CommandBuffer &buffer, TextureBinding const *bindings, uint32_t count)
+{
+    uint64_t const offset = BeginCommand(buffer, eCommandType::BindTextures);
+    WriteCommandData(buffer, BindTexturesCommand{count});
+    WriteCommandData(buffer, bindings, sizeof(TextureBinding) * count);
+    EndCommand(buffer, offset);
+}
+
+// Missing textures are bound as 0, which matches unbinding them after every draw
+void RecordBindRenderModelTextures(CommandBuffer &buffer, RenderModel const *model, uint32_t bindingOffset)
+{
+    GLuint const handles[RENDER_MODEL_TEXTURE_COUNT] = {
+        model != nullptr ? model->albedoTexture : 0,
+        model != nullptr ? model->normalTexture : 0,
+        model != nullptr ? model->bumpTexture : 0,
+        model != nullptr ? model->metallicTexture : 0,
+        model != nullptr ? model->roughnessTexture : 0,
+    };
+
+    TextureBinding bindings[RENDER_MODEL_TEXTURE_COUNT];
+    for (uint32_t i = 0; i < RENDER_MODEL_TEXTURE_COUNT; ++i)
+    {
+        bindings[i] = TextureBinding{GL_TEXTURE0 + bindingOffset + i, GL_TEXTURE_2D, handles[i]};
+    }
+
+    RecordBindTextures(buffer, bindings, RENDER_MODEL_TEXTURE_COUNT);
+}
+
+template <typename T>
+T const &ReadCommandData(uint8_t const *&cursor)
+{
+    T const &value = *reinterpret_cast<T const *>(cursor);
+    cursor += AlignCommandSize(sizeof(T));
+
+    return value;
+}
+
+void ExecuteSetUniforms(uint8_t const *cursor)
+{
+    uint32_t const entryCount = ReadCommandData<SetUniformsCommand>(cursor).entryCount;
+
+    for (uint32_t i = 0; i < entryCount; ++i)
+    {
+        auto const &entry = ReadCommandData<UniformEntry>(cursor);
+        uint32_t const size = entry.count * GetUniformComponentCount(entry.type) * 4;
+        void const *data = cursor;
+        cursor += AlignCommandSize(size);
+
+        switch (entry.type)
+        {
+        case eUniformType::UI32:
+            glUniform1uiv(entry.location, entry.count, static_cast<uint32_t const *>(data));
+            break;
+        case eUniformType::Float1:
+            glUniform1fv(entry.location, entry.count, static_cast<float const *>(data));
+            break;
+        case eUniformType::Float2:
+            glUniform2fv(entry.location, entry.count, static_cast<float const *>(data));
+            break;
+        case eUniformType::Float3:
+            glUniform3fv(entry.location, entry.count, static_cast<float const *>(data));
+            break;
+        case eUniformType::Float4:
+            glUniform4fv(entry.location, entry.count, static_cast<float const *>(data));
+            break;
+        case eUniformType::Mat4:
+            glUniformMatrix4fv(entry.location, entry.count, GL_TRUE, static_cast<float const *>(data));
+            break;
+        }
+    }
+}
+
+} // namespace
+
+void ResetCommandBuffer(CommandBuffer &buffer)
+{
+    buffer.data.clear();
+    buffer.commandCount = 0;
+}
+
+void RecordPolygonOffset(CommandBuffer &buffer, bool enable, float factor, float units)
+{
+    RecordCommand(buffer, eCommandType::SetPolygonOffset, PolygonOffsetCommand{factor, units, enable});
+}
+
+void RecordBlend(CommandBuffer &buffer, bool enable)
+{
+    RecordCommand(buffer, eCommandType::SetBlend, BlendCommand{enable});
+}
+
+// Same sequence of state changes and draws as ExecuteRenderPass
+void RecordRenderPass(
+    CommandBuffer &buffer, RenderPass const &pass, RenderModel const *models, uint32_t const *indices, uint64_t count)
+{
+    RecordCommand(buffer, eCommandType::PushMarker, MarkerCommand{pass.name});
+
+    for (uint8_t i = 0; i < pass.subPassCount; ++i)
+    {
+        auto const &subPass = pass.subPasses[i];
+        if (!subPass.active)
+        {
+            continue;
+        }
+
+        BeginSubPassCommand begin;
+        begin.subPass = i;
+        begin.framebuffer = subPass.fbo;
+        begin.width = pass.width;
+        begin.height = pass.height;
+        for (uint8_t j = 0; j < 4; ++j)
+        {
+            begin.clearColor[j] = static_cast<float>(subPass.desc.colorClearValue[j]);
+        }
+        begin.clearDepth = static_cast<float>(subPass.desc.depthClearValue);
+        begin.depthFunction = subPass.desc.depthTestFunction;
+        begin.enableWriteToDepth = subPass.desc.enableWriteToDepth;
+        begin.enableClearDepthBuffer = subPass.desc.enableClearDepthBuffer;
+        begin.enableClearColorBuffer = subPass.desc.enableClearColorBuffer;
+        RecordCommand(buffer, eCommandType::BeginSubPass, begin);
+
+        RecordCommand(buffer, eCommandType::BindProgram, BindProgramCommand{pass.program.handle});
+        RecordSetUniforms(buffer, pass.program.perFrameUniformBindings);
+
+        TextureBinding dependencies[RENDER_PASS_MAX_DEPENDENCIES];
+        for (uint8_t j = 0; j < subPass.desc.dependencyCount; ++j)
+        {
+            auto const &dependency = subPass.desc.dependencies[j];
+            dependencies[j] = TextureBinding{dependency.unit, dependency.texture, dependency.handle};
+        }
+        RecordBindTextures(buffer, dependencies, subPass.desc.dependencyCount);
+        if (subPass.desc.modelSampler != 0)
+        {
+            RecordCommand(buffer, eCommandType::BindSamplers,
+                          BindSamplersCommand{subPass.desc.dependencyCount, RENDER_MODEL_TEXTURE_COUNT, subPass.desc.modelSampler});
+        }
+
+        for (uint64_t j = 0; j < count; ++j)
+        {
+            uint64_t const index = indices != nullptr ? indices[j] : j;
+            RecordSetUniforms(buffer, pass.program.perModelUniformBindings, index);
+            RecordBindRenderModelTextures(buffer, &models[index], subPass.desc.dependencyCount);
+            RecordCommand(buffer, eCommandType::Draw, DrawCommand{models[index].vertexArrayObject, models[index].indexCount});
+        }
+
+        RecordBindRenderModelTextures(buffer, nullptr, subPass.desc.dependencyCount);
+        if (subPass.desc.modelSampler != 0)
+        {
+            RecordCommand(buffer, eCommandType::BindSamplers,
+                          BindSamplersCommand{subPass.desc.dependencyCount, RENDER_MODEL_TEXTURE_COUNT, 0});
+        }
+        for (uint8_t j = 0; j < subPass.desc.dependencyCount; ++j)
+        {
+            dependencies[j].handle = 0;
+        }
+        RecordBindTextures(buffer, dependencies, subPass.desc.dependencyCount);
+
+        RecordCommand(buffer, eCommandType::EndSubPass);
+    }
+
+    RecordCommand(buffer, eCommandType::PopMarker);
+}
+
+void RecordRenderPass(
+    CommandBuffer &buffer, RenderPass const &pass, RenderModel const *models, sr::cull::VisibilityList const &visibility)
+{
+    RecordRenderPass(buffer, pass, models, visibility.indices.data(), visibility.count);
+}
+
+// Replays a recorded buffer, must be called on the thread that owns the GL context
+void ExecuteCommandBuffer(CommandBuffer const &buffer)
+{
+    uint8_t const *cursor = buffer.data.data();
+    uint8_t const *const end = cursor + buffer.data.size();
+
+    while (cursor < end)
+    {
+        auto const &header = *reinterpret_cast<CommandHeader const *>(cursor);
+        assert(header.size >= sizeof(CommandHeader));
+        uint8_t const *payload = cursor + sizeof(CommandHeader);
+        cursor += header.size;
+
+        switch (header.type)
+        {
+        case eCommandType::PushMarker:
+        {
+            auto const &command = ReadCommandData<MarkerCommand>(payload);
+#ifdef NDEBUG
+            glPushGroupMarkerEXT(command.name.length, command.name.data);
+#endif
+            sr::prof::BeginRenderPassZone(command.name);
+            break;
+        }
+        case eCommandType::PopMarker:
+        {
+            sr::prof::EndRenderPassZone();
+#ifdef NDEBUG
+            glPopGroupMarkerEXT();
+#endif
+            break;
+        }
+        case eCommandType::BeginSubPass:
+        {
+            auto const &command = ReadCommandData<BeginSubPassCommand>(payload);
+
+            sr::prof::BeginSubPassZone(command.subPass);
+            glBindFramebuffer(GL_FRAMEBUFFER, command.framebuffer);
+            glClearColor(command.clearColor[0], command.clearColor[1], command.clearColor[2], command.clearColor[3]);
+            glColorMask(command.enableClearColorBuffer,
+                        command.enableClearColorBuffer,
+                        command.enableClearColorBuffer,
+                        command.enableClearColorBuffer);
+            glClearDepth(command.clearDepth);
+            glDepthMask(command.enableWriteToDepth);
+            glDepthFunc(command.depthFunction);
+            glViewport(0, 0, command.width, command.height);
+            glScissor(0, 0, command.width, command.height);
+            glClear(
+                (command.enableClearColorBuffer ? ClearBufferMask::GL_COLOR_BUFFER_BIT : ClearBufferMask::GL_NONE_BIT) | (command.enableClearDepthBuffer ? ClearBufferMask::GL_DEPTH_BUFFER_BIT : ClearBufferMask::GL_NONE_BIT));
+            break;
+        }
+        case eCommandType::EndSubPass:
+        {
+            glUseProgram(0);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            sr::prof::EndSubPassZone();
+            break;
+        }
+        case eCommandType::BindProgram:
+        {
+            glUseProgram(ReadCommandData<BindProgramCommand>(payload).program);
+            break;
+        }
+        case eCommandType::SetUniforms:
+        {
+            ExecuteSetUniforms(payload);
+            break;
+        }
+        case eCommandType::BindTextures:
+        {
+            uint32_t const bindingCount = ReadCommandData<BindTexturesCommand>(payload).bindingCount;
+            auto const *bindings = reinterpret_cast<TextureBinding const *>(payload);
+            for (uint32_t i = 0; i < bindingCount; ++i)
+            {
+                glActiveTexture(bindings[i].unit);
+                glBindTexture(bindings[i].target, bindings[i].handle);
+            }
+            break;
+        }
+        case eCommandType::BindSamplers:
+        {
+            auto const &command = ReadCommandData<BindSamplersCommand>(payload);
+            for (uint32_t i = 0; i < command.count; ++i)
+            {
+                glBindSampler(command.first + i, command.sampler);
+            }
+            break;
+        }
+        case eCommandType::Draw:
+        {
+            auto const &command = ReadCommandData<DrawCommand>(payload);
+            glBindVertexArray(command.vertexArray);
+            glDrawElements(GL_TRIANGLES, command.indexCount, GL_UNSIGNED_INT, nullptr);
+            break;
+        }
+        case eCommandType::SetPolygonOffset:
+        {
+            auto const &command = ReadCommandData<PolygonOffsetCommand>(payload);
+            if (command.enable)
+            {
+                glEnable(GL_POLYGON_OFFSET_FILL);
+                glPolygonOffset(command.factor, command.units);
+            }
+            else
+            {
+                glDisable(GL_POLYGON_OFFSET_FILL);
+            }
+            break;
+        }
+        case eCommandType::SetBlend:
+        {
+            auto const &command = ReadCommandData<BlendCommand>(payload);
+            if (command.enable)
+            {
+                glEnable(GL_BLEND);
+            }
+            else
+            {
+                glDisable(GL_BLEND);
+            }
+            break;
+        }
+        }
+    }
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "Geometry.hpp"
+#include "Math.hpp"
+
+#include <immintrin.h>
+
+#include <cassert>
+#include <vector>
+
+namespace sr::cull
+{
+
+constexpr uint32_t AABB_BATCH_SIZE = 8;
+
+// Points with Dot(normal, p) + distance >= 0 are on the inner side
+struct Plane
+{
+    sr::math::Vec3 normal = {};
+    float distance = 0;
+};
+
+struct Frustum
+{
+    Plane planes[6];
+};
+
+// Boxes are stored per component so that the kernel can load 8 of them at once,
+// arrays are padded to AABB_BATCH_SIZE with empty boxes
+struct AABBSoA
+{
+    std::vector<float> minX;
+    std::vector<float> minY;
+    std::vector<float> minZ;
+    std::vector<float> maxX;
+    std::vector<float> maxY;
+    std::vector<float> maxZ;
+    uint64_t count = 0;
+};
+
+struct VisibilityList
+{
+    std::vector<uint32_t> indices;
+    uint64_t count = 0;
+};
+
+inline Plane NormalizePlane(sr::math::Vec4 plane)
+{
+    float const length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+    assert(length > 0);
+
+    return Plane{plane.xyz / length, plane.w / length};
+}
+
+// Gribb-Hartmann extraction, works for both perspective and orthographic projections
+inline Frustum ExtractFrustum(sr::math::Matrix4x4 const &viewProj)
+{
+    Frustum frustum;
+
+    frustum.planes[0] = NormalizePlane(viewProj._4 + viewProj._1); //Left
+    frustum.planes[1] = NormalizePlane(viewProj._4 - viewProj._1); //Right
+    frustum.planes[2] = NormalizePlane(viewProj._4 + viewProj._2); //Bottom
+    frustum.planes[3] = NormalizePlane(viewProj._4 - viewProj._2); //Top
+    frustum.planes[4] = NormalizePlane(viewProj._4 + viewProj._3); //Near
+    frustum.planes[5] = NormalizePlane(viewProj._4 - viewProj._3); //Far
+
+    return frustum;
+}
+
+inline void ResizeAABBSoA(AABBSoA &soa, uint64_t count)
+{
+    uint64_t const paddedCount = (count + AABB_BATCH_SIZE - 1) / AABB_BATCH_SIZE * AABB_BATCH_SIZE;
+
+    soa.minX.resize(paddedCount, 0);
+    soa.minY.resize(paddedCount, 0);
+    soa.minZ.resize(paddedCount, 0);
+    soa.maxX.resize(paddedCount, 0);
+    soa.maxY.resize(paddedCount, 0);
+    soa.maxZ.resize(paddedCount, 0);
+    soa.count = count;
+}
+
+inline void StoreAABB(AABBSoA &soa, uint64_t index, sr::geo::AABB const &aabb)
+{
+    assert(index < soa.count);
+
+    soa.minX[index] = aabb.min.x;
+    soa.minY[index] = aabb.min.y;
+    soa.minZ[index] = aabb.min.z;
+    soa.maxX[index] = aabb.max.x;
+    soa.maxY[index] = aabb.max.y;
+    soa.maxZ[index] = aabb.max.z;
+}
+
+inline sr::geo::AABB LoadAABB(AABBSoA const &soa, uint64_t index)
+{
+    assert(index < soa.count);
+
+    return sr::geo::AABB{
+        {soa.minX[index], soa.minY[index], soa.minZ[index]},
+        {soa.maxX[index], soa.maxY[index], soa.maxZ[index]}};
+}
+
+inline bool IsAABBVisible(Frustum const &frustum, sr::geo::AABB const &aabb)
+{
+    for (auto const &plane : frustum.planes)
+    {
+        sr::math::Vec3 const positive = {
+            plane.normal.x > 0 ? aabb.max.x : aabb.min.x,
+            plane.normal.y > 0 ? aabb.max.y : aabb.min.y,
+            plane.normal.z > 0 ? aabb.max.z : aabb.min.z};
+
+        if (sr::math::Dot(plane.normal, positive) + plane.distance < 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+namespace
+{
+
+inline uint32_t WriteVisibleIndices(uint32_t mask, uint64_t base, uint64_t count, uint32_t *visible)
+{
+    uint32_t written = 0;
+
+    for (uint32_t i = 0; i < AABB_BATCH_SIZE && base + i < count; ++i)
+    {
+        if (mask & (1u << i))
+        {
+            visible[written++] = static_cast<uint32_t>(base + i);
+        }
+    }
+
+    return written;
+}
+
+} // namespace
+
+// Tests AABB_BATCH_SIZE boxes per iteration against all six planes. For every plane only
+// the box corner furthest along the plane normal matters, its distance is the sum of
+// per axis max(n * min, n * max) which needs no branches.
+inline uint64_t CullAABBs(Frustum const &frustum, AABBSoA const &boxes, uint32_t *visible)
+{
+    assert(visible != nullptr);
+    assert(boxes.minX.size() % AABB_BATCH_SIZE == 0);
+
+    uint64_t visibleCount = 0;
+
+#if defined(__AVX__)
+    for (uint64_t i = 0; i < boxes.count; i += AABB_BATCH_SIZE)
+    {
+        __m256 const minX = _mm256_loadu_ps(&boxes.minX[i]);
+        __m256 const minY = _mm256_loadu_ps(&boxes.minY[i]);
+        __m256 const minZ = _mm256_loadu_ps(&boxes.minZ[i]);
+        __m256 const maxX = _mm256_loadu_ps(&boxes.maxX[i]);
+        __m256 const maxY = _mm256_loadu_ps(&boxes.maxY[i]);
+        __m256 const maxZ = _mm256_loadu_ps(&boxes.maxZ[i]);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (auto const &plane : frustum.planes)
+        {
+            __m256 const nx = _mm256_set1_ps(plane.normal.x);
+            __m256 const ny = _mm256_set1_ps(plane.normal.y);
+            __m256 const nz = _mm256_set1_ps(plane.normal.z);
+
+            __m256 distance = _mm256_set1_ps(plane.distance);
+            distance = _mm256_add_ps(distance, _mm256_max_ps(_mm256_mul_ps(nx, minX), _mm256_mul_ps(nx, maxX)));
+            distance = _mm256_add_ps(distance, _mm256_max_ps(_mm256_mul_ps(ny, minY), _mm256_mul_ps(ny, maxY)));
+            distance = _mm256_add_ps(distance, _mm256_max_ps(_mm256_mul_ps(nz, minZ), _mm256_mul_ps(nz, maxZ)));
+
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        uint32_t const mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+        visibleCount += WriteVisibleIndices(mask, i, boxes.count, visible + visibleCount);
+    }
+#else
+    for (uint64_t i = 0; i < boxes.count; i += AABB_BATCH_SIZE)
+    {
+        __m128 const minX[2] = {_mm_loadu_ps(&boxes.minX[i]), _mm_loadu_ps(&boxes.minX[i + 4])};
+        __m128 const minY[2] = {_mm_loadu_ps(&boxes.minY[i]), _mm_loadu_ps(&boxes.minY[i + 4])};
+        __m128 const minZ[2] = {_mm_loadu_ps(&boxes.minZ[i]), _mm_loadu_ps(&boxes.minZ[i + 4])};
+        __m128 const maxX[2] = {_mm_loadu_ps(&boxes.maxX[i]), _mm_loadu_ps(&boxes.maxX[i + 4])};
+        __m128 const maxY[2] = {_mm_loadu_ps(&boxes.maxY[i]), _mm_loadu_ps(&boxes.maxY[i + 4])};
+        __m128 const maxZ[2] = {_mm_loadu_ps(&boxes.maxZ[i]), _mm_loadu_ps(&boxes.maxZ[i + 4])};
+
+        __m128 inside[2] = {
+            _mm_castsi128_ps(_mm_set1_epi32(-1)),
+            _mm_castsi128_ps(_mm_set1_epi32(-1))};
+        for (auto const &plane : frustum.planes)
+        {
+            __m128 const nx = _mm_set1_ps(plane.normal.x);
+            __m128 const ny = _mm_set1_ps(plane.normal.y);
+            __m128 const nz = _mm_set1_ps(plane.normal.z);
+
+            for (uint8_t j = 0; j < 2; ++j)
+            {
+                __m128 distance = _mm_set1_ps(plane.distance);
+                distance = _mm_add_ps(distance, _mm_max_ps(_mm_mul_ps(nx, minX[j]), _mm_mul_ps(nx, maxX[j])));
+                distance = _mm_add_ps(distance, _mm_max_ps(_mm_mul_ps(ny, minY[j]), _mm_mul_ps(ny, maxY[j])));
+                distance = _mm_add_ps(distance, _mm_max_ps(_mm_mul_ps(nz, minZ[j]), _mm_mul_ps(nz, maxZ[j])));
+
+                inside[j] = _mm_and_ps(inside[j], _mm_cmpge_ps(distance, _mm_setzero_ps()));
+            }
+        }
+
+        uint32_t const mask = static_cast<uint32_t>(_mm_movemask_ps(inside[0])) |
+                              (static_cast<uint32_t>(_mm_movemask_ps(inside[1])) << 4);
+        visibleCount += WriteVisibleIndices(mask, i, boxes.count, visible + visibleCount);
+    }
+#endif
+
+    return visibleCount;
+}
+
+inline void MarkAllVisible(VisibilityList &list, uint64_t count)
+{
+    list.indices.resize(count);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        list.indices[i] = static_cast<uint32_t>(i);
+    }
+    list.count = count;
+}
+
+inline void CullAABBs(Frustum const &frustum, AABBSoA const &boxes, VisibilityList &list)
+{
+    list.indices.resize(boxes.count);
+    list.count = list.indices.empty() ? 0 : CullAABBs(frustum, boxes, list.indices.data());
+}
+
+} // namespace sr::cull
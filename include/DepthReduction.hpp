@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "Math.hpp"
+#include "RenderDefinitions.hpp"
+#include "RenderPass.hpp"
+#include "ShaderProgram.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+// Reduces the depth pre-pass output to the visible view depth range and the light space bounds
+// of the samples in every cascade. The result is read back a few frames later through a fence,
+// the CPU never waits for the GPU.
+constexpr uint32_t DEPTH_REDUCTION_LATENCY = 3;
+constexpr uint32_t DEPTH_REDUCTION_GROUP_TEXELS = 32; //16x16 invocations, 2x2 texels each
+
+struct DepthBounds
+{
+    float minDepth = 0; //View space distance to the closest and the farthest visible sample
+    float maxDepth = 0;
+    sr::math::Vec2 lightMin[SHADOW_CASCADE_MAX_COUNT] = {};
+    sr::math::Vec2 lightMax[SHADOW_CASCADE_MAX_COUNT] = {};
+    bool cascadeValid[SHADOW_CASCADE_MAX_COUNT] = {};
+    float splits[SHADOW_CASCADE_MAX_COUNT] = {}; //Cascade splits the samples were sorted with
+    uint32_t cascadeCount = 0;
+    bool valid = false;
+    uint64_t frame = 0; //Dispatch the bounds were computed in
+};
+
+struct DepthReductionResult
+{
+    uint32_t minDepth;
+    uint32_t maxDepth;
+    uint32_t lightBounds[SHADOW_CASCADE_MAX_COUNT * 4];
+};
+
+struct DepthReduction
+{
+    ShaderProgram program = {};
+    GLuint buffers[DEPTH_REDUCTION_LATENCY] = {};
+    GLsync fences[DEPTH_REDUCTION_LATENCY] = {};
+    ShadowCascades cascades[DEPTH_REDUCTION_LATENCY] = {};
+    uint64_t dispatchedFrames = 0;
+    uint64_t readFrames = 0;
+    uint64_t skippedFrames = 0; //Dispatches dropped because the GPU was too far behind
+};
+
+namespace
+{
+
+// Inverse of OrderedFloat in depth_reduction.comp
+float DecodeOrderedFloat(uint32_t u)
+{
+    uint32_t const bits = (u & 0x80000000u) != 0 ? u & 0x7FFFFFFFu : ~u;
+    float f = 0;
+    std::memcpy(&f, &bits, sizeof(float));
+
+    return f;
+}
+
+DepthReductionResult CreateEmptyDepthReductionResult()
+{
+    DepthReductionResult result;
+    result.minDepth = UINT32_MAX;
+    result.maxDepth = 0;
+    for (uint32_t i = 0; i < SHADOW_CASCADE_MAX_COUNT; ++i)
+    {
+        result.lightBounds[i * 4 + 0] = UINT32_MAX;
+        result.lightBounds[i * 4 + 1] = UINT32_MAX;
+        result.lightBounds[i * 4 + 2] = 0;
+        result.lightBounds[i * 4 + 3] = 0;
+    }
+
+    return result;
+}
+
+} // namespace
+
+DepthReduction CreateDepthReduction(ShaderProgram program)
+{
+    DepthReduction reduction;
+    reduction.program = program;
+
+    glGenBuffers(DEPTH_REDUCTION_LATENCY, reduction.buffers);
+    for (GLuint buffer : reduction.buffers)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(DepthReductionResult), nullptr, GL_DYNAMIC_READ);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    return reduction;
+}
+
+void DeleteDepthReduction(DepthReduction &reduction)
+{
+    for (GLsync &fence : reduction.fences)
+    {
+        if (fence != nullptr)
+        {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    glDeleteBuffers(DEPTH_REDUCTION_LATENCY, reduction.buffers);
+}
+
+// Skips the frame instead of waiting when every buffer is still in flight
+void DispatchDepthReduction(DepthReduction &reduction,
+                            ShadowCascades const &cascades,
+                            GLuint depthTexture,
+                            int32_t width,
+                            int32_t height)
+{
+    uint32_t const slot = reduction.dispatchedFrames % DEPTH_REDUCTION_LATENCY;
+    if (reduction.fences[slot] != nullptr)
+    {
+        reduction.skippedFrames++;
+        return;
+    }
+
+#ifdef NDEBUG
+    glPushGroupMarkerEXT(15, "Depth Reduction");
+#endif
+
+    DepthReductionResult const empty = CreateEmptyDepthReductionResult();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, reduction.buffers[slot]);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(DepthReductionResult), &empty);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glUseProgram(reduction.program.handle);
+    UpdatePerFrameUniforms(reduction.program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, reduction.buffers[slot]);
+
+    glDispatchCompute((width + DEPTH_REDUCTION_GROUP_TEXELS - 1) / DEPTH_REDUCTION_GROUP_TEXELS,
+                      (height + DEPTH_REDUCTION_GROUP_TEXELS - 1) / DEPTH_REDUCTION_GROUP_TEXELS,
+                      1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+
+    reduction.cascades[slot] = cascades;
+    reduction.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, UnusedMask::GL_NONE_BIT);
+    reduction.dispatchedFrames++;
+
+#ifdef NDEBUG
+    glPopGroupMarkerEXT();
+#endif
+}
+
+// Polls the oldest dispatches without waiting, bounds keeps the newest finished result.
+// Returns true if bounds was updated.
+bool ReadDepthReduction(DepthReduction &reduction, DepthBounds &bounds)
+{
+    bool updated = false;
+    while (reduction.readFrames < reduction.dispatchedFrames)
+    {
+        uint32_t const slot = reduction.readFrames % DEPTH_REDUCTION_LATENCY;
+        GLenum const status = glClientWaitSync(reduction.fences[slot], SyncObjectMask::GL_NONE_BIT, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            break;
+        }
+        glDeleteSync(reduction.fences[slot]);
+        reduction.fences[slot] = nullptr;
+
+        DepthReductionResult result;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, reduction.buffers[slot]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(DepthReductionResult), &result);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        bounds.minDepth = DecodeOrderedFloat(result.minDepth);
+        bounds.maxDepth = DecodeOrderedFloat(result.maxDepth);
+        bounds.valid = result.minDepth != UINT32_MAX && bounds.minDepth <= bounds.maxDepth;
+        for (uint32_t i = 0; i < SHADOW_CASCADE_MAX_COUNT; ++i)
+        {
+            bounds.lightMin[i] = {DecodeOrderedFloat(result.lightBounds[i * 4 + 0]),
+                                  DecodeOrderedFloat(result.lightBounds[i * 4 + 1])};
+            bounds.lightMax[i] = {DecodeOrderedFloat(result.lightBounds[i * 4 + 2]),
+                                  DecodeOrderedFloat(result.lightBounds[i * 4 + 3])};
+            bounds.cascadeValid[i] = result.lightBounds[i * 4 + 0] != UINT32_MAX &&
+                                     bounds.lightMin[i].x <= bounds.lightMax[i].x;
+        }
+        std::copy(std::begin(reduction.cascades[slot].splits), std::end(reduction.cascades[slot].splits), bounds.splits);
+        bounds.cascadeCount = reduction.cascades[slot].count;
+        bounds.frame = reduction.readFrames;
+
+        reduction.readFrames++;
+        updated = true;
+    }
+
+    return updated;
+}
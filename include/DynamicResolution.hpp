@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Picks the internal render resolution from the measured GPU frame time. The scene passes render
+// into the lower left part of the full size targets and the first full resolution pass upscales,
+// so a new scale never reallocates anything.
+constexpr uint32_t DYNAMIC_RESOLUTION_LOG_SIZE = 64;
+
+struct DynamicResolutionSettings
+{
+    float budgetMs = 16.6f;
+    float minScale = 0.5f;
+    float maxScale = 1.f;
+    float lowerThreshold = 0.8f; //Share of the budget below which the scale goes up
+    float upperThreshold = 1.f;  //and above which it goes down
+    float scaleStep = 0.05f;     //Scales are multiples of it, small changes are ignored
+    uint32_t settleFrames = 8;   //Measurements at a new scale before the next change
+};
+
+struct DynamicResolutionLogEntry
+{
+    uint64_t frame = 0;
+    float averageMs = 0;
+    float oldScale = 0;
+    float newScale = 0;
+};
+
+struct DynamicResolution
+{
+    DynamicResolutionSettings settings = {};
+    float scale = 1;
+    float averageMs = 0;          //Of the measurements taken at the current scale
+    uint32_t settledFrames = 0;
+    uint64_t frame = 0;
+    DynamicResolutionLogEntry log[DYNAMIC_RESOLUTION_LOG_SIZE] = {};
+    uint64_t logCount = 0;        //Entries ever written, the log keeps the last DYNAMIC_RESOLUTION_LOG_SIZE
+};
+
+int32_t GetDynamicResolutionSize(float scale, int32_t size)
+{
+    return std::max(1, static_cast<int32_t>(std::lround(scale * size)));
+}
+
+// Feeds one GPU frame time measured at measuredScale, returns true if the scale changed.
+// The cost is assumed to grow with the pixel count, the new scale aims at the middle of the band.
+bool UpdateDynamicResolution(DynamicResolution &controller, float gpuMs, float measuredScale)
+{
+    DynamicResolutionSettings const &settings = controller.settings;
+    controller.frame++;
+
+    //Frames still in flight when the scale changed do not say anything about the new one
+    if (std::abs(measuredScale - controller.scale) > 0.001f)
+    {
+        return false;
+    }
+
+    controller.averageMs = controller.settledFrames == 0 ? gpuMs : controller.averageMs * 0.8f + gpuMs * 0.2f;
+    controller.settledFrames++;
+    if (controller.settledFrames < settings.settleFrames)
+    {
+        return false;
+    }
+
+    float const load = controller.averageMs / settings.budgetMs;
+    bool const overBudget = load > settings.upperThreshold && controller.scale > settings.minScale;
+    bool const underBudget = load < settings.lowerThreshold && controller.scale < settings.maxScale;
+    if (!overBudget && !underBudget)
+    {
+        return false;
+    }
+
+    float const targetLoad = 0.5f * (settings.lowerThreshold + settings.upperThreshold);
+    float scale = controller.scale * std::sqrt(targetLoad / std::max(load, 0.001f));
+    scale = std::round(scale / settings.scaleStep) * settings.scaleStep;
+    scale = std::min(std::max(scale, settings.minScale), settings.maxScale);
+    if (std::abs(scale - controller.scale) < 0.5f * settings.scaleStep)
+    {
+        return false;
+    }
+
+    DynamicResolutionLogEntry &entry = controller.log[controller.logCount++ % DYNAMIC_RESOLUTION_LOG_SIZE];
+    entry.frame = controller.frame;
+    entry.averageMs = controller.averageMs;
+    entry.oldScale = controller.scale;
+    entry.newScale = scale;
+
+    controller.scale = scale;
+    controller.settledFrames = 0;
+
+    return true;
+}
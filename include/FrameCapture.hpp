@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "RenderDefinitions.hpp"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+// Frame capture for the golden image tests. Color targets are copied to pixel buffers and mapped
+// a few frames later through a fence, the CPU never waits for the GPU.
+constexpr uint32_t FRAME_READBACK_LATENCY = 3;
+
+// RGBA8, the rows are stored bottom to top the way GL reads them
+struct Image
+{
+    int32_t width = 0;
+    int32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+struct FrameReadback
+{
+    GLuint buffers[FRAME_READBACK_LATENCY] = {};
+    GLsync fences[FRAME_READBACK_LATENCY] = {};
+    int32_t widths[FRAME_READBACK_LATENCY] = {};
+    int32_t heights[FRAME_READBACK_LATENCY] = {};
+    uint32_t tags[FRAME_READBACK_LATENCY] = {};
+    uint64_t requestedFrames = 0;
+    uint64_t readFrames = 0;
+};
+
+struct ImageDiff
+{
+    float psnr = 0;               //dB over the RGB channels, infinity for identical images
+    float maxError = 0;           //Largest channel difference in [0, 1]
+    float meanDeltaE = 0;         //Mean CIELAB difference of the 3x3 filtered images
+    float perceptualErrorRatio = 0; //Pixels with a filtered CIELAB difference above the JND
+};
+
+FrameReadback CreateFrameReadback()
+{
+    FrameReadback readback;
+    glCreateBuffers(FRAME_READBACK_LATENCY, readback.buffers);
+
+    return readback;
+}
+
+void DeleteFrameReadback(FrameReadback &readback)
+{
+    for (uint32_t i = 0; i < FRAME_READBACK_LATENCY; ++i)
+    {
+        if (readback.fences[i] != nullptr)
+        {
+            glDeleteSync(readback.fences[i]);
+        }
+    }
+    glDeleteBuffers(FRAME_READBACK_LATENCY, readback.buffers);
+    readback = {};
+}
+
+bool IsFrameReadbackPending(FrameReadback const &readback)
+{
+    return readback.readFrames < readback.requestedFrames;
+}
+
+// Copies the first mip of a color texture, returns false if every buffer is still in flight
+bool RequestFrameReadback(FrameReadback &readback, GLuint texture, int32_t width, int32_t height, uint32_t tag)
+{
+    uint32_t const slot = readback.requestedFrames % FRAME_READBACK_LATENCY;
+    if (readback.fences[slot] != nullptr)
+    {
+        return false;
+    }
+
+    GLsizei const size = width * height * 4;
+    if (readback.widths[slot] != width || readback.heights[slot] != height)
+    {
+        glNamedBufferData(readback.buffers[slot], size, nullptr, GL_STREAM_READ);
+        readback.widths[slot] = width;
+        readback.heights[slot] = height;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffers[slot]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTextureImage(texture, 0, GL_RGBA, GL_UNSIGNED_BYTE, size, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback.tags[slot] = tag;
+    readback.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, UnusedMask::GL_NONE_BIT);
+    readback.requestedFrames++;
+
+    return true;
+}
+
+// Polls the oldest request without waiting, returns true and its image and tag once it finished
+bool ReadFrameReadback(FrameReadback &readback, Image &image, uint32_t &tag)
+{
+    if (!IsFrameReadbackPending(readback))
+    {
+        return false;
+    }
+
+    uint32_t const slot = readback.readFrames % FRAME_READBACK_LATENCY;
+    GLenum const status = glClientWaitSync(readback.fences[slot], SyncObjectMask::GL_NONE_BIT, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+    {
+        return false;
+    }
+    glDeleteSync(readback.fences[slot]);
+    readback.fences[slot] = nullptr;
+
+    image.width = readback.widths[slot];
+    image.height = readback.heights[slot];
+    image.pixels.resize(static_cast<size_t>(image.width) * image.height * 4);
+    void const *data = glMapNamedBufferRange(readback.buffers[slot], 0, image.pixels.size(), GL_MAP_READ_BIT);
+    std::memcpy(image.pixels.data(), data, image.pixels.size());
+    glUnmapNamedBuffer(readback.buffers[slot]);
+
+    tag = readback.tags[slot];
+    readback.readFrames++;
+
+    return true;
+}
+
+bool WritePng(char const *path, Image const &image)
+{
+    stbi_flip_vertically_on_write(true);
+    if (stbi_write_png(path, image.width, image.height, 4, image.pixels.data(), image.width * 4) == 0)
+    {
+        std::cerr << "Failed to write image: " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool LoadPng(char const *path, Image &image)
+{
+    stbi_set_flip_vertically_on_load(true);
+    int width = 0, height = 0, channels = 0;
+    unsigned char *data = stbi_load(path, &width, &height, &channels, 4);
+    if (data == nullptr)
+    {
+        return false;
+    }
+
+    image.width = width;
+    image.height = height;
+    image.pixels.assign(data, data + static_cast<size_t>(width) * height * 4);
+    stbi_image_free(data);
+
+    return true;
+}
+
+namespace
+{
+
+float SrgbToLinear(float channel)
+{
+    return channel <= 0.04045f ? channel / 12.92f : std::pow((channel + 0.055f) / 1.055f, 2.4f);
+}
+
+float LabF(float t)
+{
+    return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.f / 116.f;
+}
+
+// D65 CIELAB of the 3x3 box filtered image, the filter stands in for the contrast sensitivity
+// of the eye so that single texel noise counts less than structured differences
+std::vector<float> GetFilteredLab(Image const &image)
+{
+    std::vector<float> lab(static_cast<size_t>(image.width) * image.height * 3);
+    for (int32_t y = 0; y < image.height; ++y)
+    {
+        for (int32_t x = 0; x < image.width; ++x)
+        {
+            float rgb[3] = {};
+            float weight = 0;
+            for (int32_t j = std::max(y - 1, 0); j <= std::min(y + 1, image.height - 1); ++j)
+            {
+                for (int32_t i = std::max(x - 1, 0); i <= std::min(x + 1, image.width - 1); ++i)
+                {
+                    uint8_t const *texel = &image.pixels[(static_cast<size_t>(j) * image.width + i) * 4];
+                    for (uint32_t c = 0; c < 3; ++c)
+                    {
+                        rgb[c] += SrgbToLinear(texel[c] / 255.f);
+                    }
+                    weight++;
+                }
+            }
+            float const r = rgb[0] / weight, g = rgb[1] / weight, b = rgb[2] / weight;
+
+            float const fx = LabF((0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.95047f);
+            float const fy = LabF(0.2126f * r + 0.7152f * g + 0.0722f * b);
+            float const fz = LabF((0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.08883f);
+
+            float *out = &lab[(static_cast<size_t>(y) * image.width + x) * 3];
+            out[0] = 116 * fy - 16;
+            out[1] = 500 * (fx - fy);
+            out[2] = 200 * (fy - fz);
+        }
+    }
+
+    return lab;
+}
+
+} // namespace
+
+// The images have to be the same size, alpha is ignored
+ImageDiff CompareImages(Image const &a, Image const &b)
+{
+    assert(a.width == b.width && a.height == b.height);
+    constexpr float JUST_NOTICEABLE_DELTA_E = 2.3f;
+
+    ImageDiff diff;
+    uint64_t const pixelCount = static_cast<uint64_t>(a.width) * a.height;
+    if (pixelCount == 0)
+    {
+        return diff;
+    }
+
+    double squaredError = 0;
+    uint32_t maxError = 0;
+    for (uint64_t i = 0; i < pixelCount; ++i)
+    {
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            int32_t const error = static_cast<int32_t>(a.pixels[i * 4 + c]) - b.pixels[i * 4 + c];
+            squaredError += error * error;
+            maxError = std::max(maxError, static_cast<uint32_t>(std::abs(error)));
+        }
+    }
+    double const mse = squaredError / (pixelCount * 3);
+    diff.psnr = mse > 0 ? static_cast<float>(10 * std::log10(255.0 * 255.0 / mse))
+                        : std::numeric_limits<float>::infinity();
+    diff.maxError = maxError / 255.f;
+
+    std::vector<float> const labA = GetFilteredLab(a);
+    std::vector<float> const labB = GetFilteredLab(b);
+    double deltaESum = 0;
+    uint64_t noticeable = 0;
+    for (uint64_t i = 0; i < pixelCount; ++i)
+    {
+        float const dl = labA[i * 3 + 0] - labB[i * 3 + 0];
+        float const da = labA[i * 3 + 1] - labB[i * 3 + 1];
+        float const db = labA[i * 3 + 2] - labB[i * 3 + 2];
+        float const deltaE = std::sqrt(dl * dl + da * da + db * db);
+        deltaESum += deltaE;
+        noticeable += deltaE > JUST_NOTICEABLE_DELTA_E;
+    }
+    diff.meanDeltaE = static_cast<float>(deltaESum / pixelCount);
+    diff.perceptualErrorRatio = static_cast<float>(noticeable) / pixelCount;
+
+    return diff;
+}
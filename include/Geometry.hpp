@@ -42,8 +42,8 @@ inline AABB CalculateAABB(sr::math::Vec3 const *data, uint64_t length)
     assert(data[0] != data[1]);
 
     AABB result = {
-        {-FLT_MAX, -FLT_MAX, -FLT_MAX},
-        {FLT_MAX, FLT_MAX, FLT_MAX}};
+        {FLT_MAX, FLT_MAX, FLT_MAX},
+        {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
 
     for (uint64_t i = 0; i < length; ++i)
     {
@@ -91,4 +91,26 @@ inline AABB CalculateAABB(
     return result;
 }
 
+//Arvo's method, transforms a box and returns the box around the result
+inline AABB TransformAABB(AABB const &aabb, sr::math::Matrix4x4 const &m)
+{
+    AABB result = {
+        {m._14, m._24, m._34},
+        {m._14, m._24, m._34}};
+
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        for (uint8_t j = 0; j < 3; ++j)
+        {
+            float const a = m.rows[i][j] * aabb.min.data[j];
+            float const b = m.rows[i][j] * aabb.max.data[j];
+
+            result.min.data[i] += a < b ? a : b;
+            result.max.data[i] += a < b ? b : a;
+        }
+    }
+
+    return result;
+}
+
 } // namespace sr::geo
@@ -0,0 +1,342 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing job system. Every thread owns a deque, it pushes and pops at the back
+// while idle threads steal from the front of the others. The thread that initializes
+// the system is the main thread, it is the only one that runs MainThread jobs (GL calls)
+// and it only does so while waiting for a counter.
+namespace sr::job
+{
+
+constexpr uint32_t JOB_INVALID_THREAD_INDEX = UINT32_MAX;
+constexpr uint32_t JOB_MAIN_THREAD_INDEX = 0;
+
+enum class eJobAffinity : uint8_t
+{
+    Any,
+    MainThread,
+};
+
+struct Counter;
+
+struct Job
+{
+    std::function<void()> function;
+    Counter *counter = nullptr;
+    eJobAffinity affinity = eJobAffinity::Any;
+};
+
+// Number of unfinished jobs, the jobs added with RunJobAfter are queued once it drops to zero
+struct Counter
+{
+    std::atomic<uint32_t> value = {0};
+    std::atomic<uint32_t> decrementsInFlight = {0};
+    std::mutex mutex;
+    std::vector<Job> continuations;
+};
+
+struct JobQueue
+{
+    std::mutex mutex;
+    std::deque<Job> jobs;
+};
+
+struct JobSystem
+{
+    std::vector<std::unique_ptr<JobQueue>> queues; //Main thread queue first, then one per worker
+    JobQueue mainThreadQueue;
+    std::vector<std::thread> workers;
+    std::atomic<uint32_t> queuedJobCount = {0};    //Jobs of Any affinity waiting in the queues
+    std::atomic<uint32_t> sleepingWorkerCount = {0};
+    std::atomic<uint32_t> nextExternalQueue = {0};
+    std::atomic<bool> stop = {false};
+    std::mutex sleepMutex;
+    std::condition_variable wakeCondition;
+};
+
+inline JobSystem g_jobSystem;
+inline thread_local uint32_t t_threadIndex = JOB_INVALID_THREAD_INDEX;
+
+namespace
+{
+
+bool PopJob(JobQueue &queue, Job &job, bool back)
+{
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.jobs.empty())
+    {
+        return false;
+    }
+
+    if (back)
+    {
+        job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+    }
+    else
+    {
+        job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+    }
+
+    return true;
+}
+
+void WakeWorkers()
+{
+    if (g_jobSystem.sleepingWorkerCount.load() > 0)
+    {
+        //Taking the lock orders the wake up after a worker that is about to sleep checked the count
+        {
+            std::lock_guard<std::mutex> lock(g_jobSystem.sleepMutex);
+        }
+        g_jobSystem.wakeCondition.notify_one();
+    }
+}
+
+void ExecuteJob(Job &job);
+
+void PushJob(Job &&job)
+{
+    if (g_jobSystem.queues.empty())
+    {
+        //Not initialized, behave like a plain function call
+        ExecuteJob(job);
+        return;
+    }
+
+    if (job.affinity == eJobAffinity::MainThread)
+    {
+        std::lock_guard<std::mutex> lock(g_jobSystem.mainThreadQueue.mutex);
+        g_jobSystem.mainThreadQueue.jobs.push_back(std::move(job));
+        return;
+    }
+
+    uint32_t queueIndex = t_threadIndex;
+    if (queueIndex == JOB_INVALID_THREAD_INDEX)
+    {
+        queueIndex = g_jobSystem.nextExternalQueue.fetch_add(1) % g_jobSystem.queues.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(g_jobSystem.queues[queueIndex]->mutex);
+        g_jobSystem.queues[queueIndex]->jobs.push_back(std::move(job));
+    }
+    g_jobSystem.queuedJobCount.fetch_add(1);
+    WakeWorkers();
+}
+
+void DecrementCounter(Counter &counter)
+{
+    counter.decrementsInFlight.fetch_add(1);
+    if (counter.value.fetch_sub(1) == 1)
+    {
+        std::vector<Job> continuations;
+        {
+            std::lock_guard<std::mutex> lock(counter.mutex);
+            continuations.swap(counter.continuations);
+        }
+        for (auto &continuation : continuations)
+        {
+            PushJob(std::move(continuation));
+        }
+    }
+    //Last access, a waiter may destroy the counter right after
+    counter.decrementsInFlight.fetch_sub(1);
+}
+
+void ExecuteJob(Job &job)
+{
+    job.function();
+    if (job.counter != nullptr)
+    {
+        DecrementCounter(*job.counter);
+    }
+}
+
+// Own queue first (LIFO keeps the caches warm), then steal the oldest job of the others
+bool TryRunJob()
+{
+    Job job;
+    uint32_t const threadIndex = t_threadIndex;
+    uint32_t const queueCount = static_cast<uint32_t>(g_jobSystem.queues.size());
+
+    if (threadIndex == JOB_MAIN_THREAD_INDEX && PopJob(g_jobSystem.mainThreadQueue, job, false))
+    {
+        ExecuteJob(job);
+        return true;
+    }
+
+    bool found = threadIndex != JOB_INVALID_THREAD_INDEX && PopJob(*g_jobSystem.queues[threadIndex], job, true);
+    uint32_t const first = threadIndex != JOB_INVALID_THREAD_INDEX ? threadIndex + 1 : 0;
+    for (uint32_t i = 0; i < queueCount && !found; ++i)
+    {
+        uint32_t const victim = (first + i) % queueCount;
+        found = victim != threadIndex && PopJob(*g_jobSystem.queues[victim], job, false);
+    }
+
+    if (!found)
+    {
+        return false;
+    }
+
+    g_jobSystem.queuedJobCount.fetch_sub(1);
+    ExecuteJob(job);
+
+    return true;
+}
+
+void RunWorker(uint32_t threadIndex)
+{
+    t_threadIndex = threadIndex;
+
+    while (!g_jobSystem.stop.load())
+    {
+        if (TryRunJob())
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(g_jobSystem.sleepMutex);
+        g_jobSystem.sleepingWorkerCount.fetch_add(1);
+        g_jobSystem.wakeCondition.wait(lock, []() {
+            return g_jobSystem.stop.load() || g_jobSystem.queuedJobCount.load() > 0;
+        });
+        g_jobSystem.sleepingWorkerCount.fetch_sub(1);
+    }
+}
+
+} // namespace
+
+// Starts workerCount threads, the calling thread becomes the main thread.
+// With zero workers every job runs on the thread that waits for it.
+inline void InitializeJobSystem(uint32_t workerCount)
+{
+    assert(g_jobSystem.queues.empty());
+
+    g_jobSystem.stop = false;
+    t_threadIndex = JOB_MAIN_THREAD_INDEX;
+    for (uint32_t i = 0; i <= workerCount; ++i)
+    {
+        g_jobSystem.queues.push_back(std::make_unique<JobQueue>());
+    }
+    for (uint32_t i = 1; i <= workerCount; ++i)
+    {
+        g_jobSystem.workers.emplace_back(RunWorker, i);
+    }
+}
+
+inline void DeinitializeJobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(g_jobSystem.sleepMutex);
+        g_jobSystem.stop = true;
+    }
+    g_jobSystem.wakeCondition.notify_all();
+
+    for (auto &worker : g_jobSystem.workers)
+    {
+        worker.join();
+    }
+    g_jobSystem.workers.clear();
+    g_jobSystem.queues.clear();
+    t_threadIndex = JOB_INVALID_THREAD_INDEX;
+}
+
+// Threads that execute jobs, including the main thread
+inline uint32_t GetJobThreadCount()
+{
+    return static_cast<uint32_t>(g_jobSystem.workers.size()) + 1;
+}
+
+inline void RunJob(std::function<void()> function, Counter *counter = nullptr, eJobAffinity affinity = eJobAffinity::Any)
+{
+    if (counter != nullptr)
+    {
+        counter->value.fetch_add(1);
+    }
+
+    PushJob(Job{std::move(function), counter, affinity});
+}
+
+// Queues the job once every job of the dependency has finished
+inline void RunJobAfter(
+    Counter &dependency,
+    std::function<void()> function,
+    Counter *counter = nullptr,
+    eJobAffinity affinity = eJobAffinity::Any)
+{
+    if (counter != nullptr)
+    {
+        counter->value.fetch_add(1);
+    }
+
+    Job job = {std::move(function), counter, affinity};
+    {
+        std::lock_guard<std::mutex> lock(dependency.mutex);
+        if (dependency.value.load() > 0)
+        {
+            dependency.continuations.push_back(std::move(job));
+            return;
+        }
+    }
+
+    PushJob(std::move(job));
+}
+
+// Runs other jobs until the counter drops to zero, so waiting inside a job does not deadlock
+inline void WaitForCounter(Counter &counter)
+{
+    while (counter.value.load() > 0 || counter.decrementsInFlight.load() > 0)
+    {
+        if (!TryRunJob())
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// Calls func(begin, end) for chunks of grainSize elements, the caller takes the last chunk
+template <typename Func>
+void ParallelFor(uint64_t count, uint64_t grainSize, Func const &func)
+{
+    assert(grainSize > 0);
+
+    struct Range
+    {
+        Func const *func;
+        uint64_t grainSize;
+    } const range = {&func, grainSize};
+
+    Counter counter;
+    uint64_t begin = 0;
+    for (; begin + grainSize < count; begin += grainSize)
+    {
+        //Captures fit into the small buffer of std::function, spawning does not allocate
+        Range const *context = &range;
+        RunJob([context, begin]() { (*context->func)(begin, begin + context->grainSize); }, &counter);
+    }
+    if (begin < count)
+    {
+        func(begin, count);
+    }
+
+    WaitForCounter(counter);
+}
+
+} // namespace sr::job
@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "Culling.hpp"
+#include "Geometry.hpp"
+#include "JobSystem.hpp"
+#include "Math.hpp"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+// Same layout as PointLight in lighting.frag, deferred_lighting.frag and light_culling.comp
+struct PointLight
+{
+    sr::math::Vec3 position;
+    float radius; //The falloff window reaches zero here
+};
+static_assert(sizeof(PointLight) == 16, "PointLight must match the std430 layout.");
+static_assert(std::is_pod<PointLight>::value, "PointLight must be a POD type.");
+
+namespace
+{
+
+float RadicalInverse(uint32_t index, uint32_t base)
+{
+    float result = 0;
+    float fraction = 1.f / base;
+    while (index > 0)
+    {
+        result += (index % base) * fraction;
+        index /= base;
+        fraction /= base;
+    }
+
+    return result;
+}
+
+} // namespace
+
+// Spreads count lights over the bounds with a Halton sequence, the same count always gives the same lights.
+// The radius shrinks with the count so that the lit volume stays in the same order of magnitude.
+std::vector<PointLight> CreatePointLights(uint32_t count, sr::geo::AABB const &bounds)
+{
+    float const radius = std::max(350.f * std::cbrt(5.f / std::max(count, 1u)), 100.f);
+    sr::math::Vec3 const size = bounds.max - bounds.min;
+
+    std::vector<PointLight> lights(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        lights[i].position = {bounds.min.x + size.x * RadicalInverse(i + 1, 2),
+                              bounds.min.y + size.y * RadicalInverse(i + 1, 3),
+                              bounds.min.z + size.z * RadicalInverse(i + 1, 5)};
+        lights[i].radius = radius;
+    }
+
+    return lights;
+}
+
+namespace sr::cull
+{
+
+// The view frustum is split into CLUSTER_COUNT_X x CLUSTER_COUNT_Y screen tiles and CLUSTER_COUNT_Z
+// slices with exponentially growing depth, lighting.frag finds its cluster with the same formulas
+constexpr uint32_t CLUSTER_COUNT_X = 16;
+constexpr uint32_t CLUSTER_COUNT_Y = 9;
+constexpr uint32_t CLUSTER_COUNT_Z = 24;
+constexpr uint32_t CLUSTER_COUNT = CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z;
+constexpr uint32_t LIGHT_BATCH_SIZE = AABB_BATCH_SIZE;
+
+// Offset into the light index list and light count, uvec2 in lighting.frag
+struct ClusterRange
+{
+    uint32_t offset;
+    uint32_t count;
+};
+
+// View space spheres per component, padded to LIGHT_BATCH_SIZE with spheres that touch nothing
+struct SphereSoA
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> radius;
+    std::vector<uint32_t> lights; //Index of the light every sphere belongs to
+    uint64_t count = 0;
+};
+
+// Symmetric perspective projection the clusters are fitted to
+struct ClusterProjection
+{
+    float near;
+    float far;
+    float xScale; //Projection _11
+    float yScale; //Projection _22
+};
+
+// Every slice is built by its own job into its own lists, they are concatenated at the end.
+// The vectors only grow, a build with the same light count does not allocate.
+struct LightClusters
+{
+    std::vector<ClusterRange> ranges;
+    std::vector<uint32_t> indices;
+    SphereSoA lights;
+    SphereSoA sliceLights[CLUSTER_COUNT_Z];
+    std::vector<uint32_t> sliceIndices[CLUSTER_COUNT_Z];
+    uint64_t sliceIndexCounts[CLUSTER_COUNT_Z] = {};
+    float depthScale = 0; //slice = log2(view depth) * depthScale + depthBias
+    float depthBias = 0;
+};
+
+namespace
+{
+
+inline void ResizeSphereSoA(SphereSoA &soa, uint64_t count)
+{
+    uint64_t const paddedCount = (count + LIGHT_BATCH_SIZE - 1) / LIGHT_BATCH_SIZE * LIGHT_BATCH_SIZE;
+
+    soa.x.resize(paddedCount);
+    soa.y.resize(paddedCount);
+    soa.z.resize(paddedCount);
+    soa.radius.resize(paddedCount);
+    soa.lights.resize(paddedCount);
+    soa.count = count;
+
+    //The squared distance to anything overflows to infinity
+    for (uint64_t i = count; i < paddedCount; ++i)
+    {
+        soa.x[i] = FLT_MAX;
+        soa.y[i] = FLT_MAX;
+        soa.z[i] = FLT_MAX;
+        soa.radius[i] = 0;
+    }
+}
+
+inline void StoreSphere(SphereSoA &soa, uint64_t index, float x, float y, float z, float radius, uint32_t light)
+{
+    soa.x[index] = x;
+    soa.y[index] = y;
+    soa.z[index] = z;
+    soa.radius[index] = radius;
+    soa.lights[index] = light;
+}
+
+// Overlap of LIGHT_BATCH_SIZE spheres with a box, one bit per sphere. The distance to the box
+// is max(min - c, 0, c - max) per axis, the sphere overlaps if its square is within the radius.
+inline uint32_t TestSpheresAABB(SphereSoA const &spheres, uint64_t i, sr::geo::AABB const &box)
+{
+#if defined(__AVX__)
+    __m256 const x = _mm256_loadu_ps(&spheres.x[i]);
+    __m256 const y = _mm256_loadu_ps(&spheres.y[i]);
+    __m256 const z = _mm256_loadu_ps(&spheres.z[i]);
+    __m256 const r = _mm256_loadu_ps(&spheres.radius[i]);
+    __m256 const zero = _mm256_setzero_ps();
+
+    __m256 const dx = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_set1_ps(box.min.x), x), zero),
+                                    _mm256_sub_ps(x, _mm256_set1_ps(box.max.x)));
+    __m256 const dy = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_set1_ps(box.min.y), y), zero),
+                                    _mm256_sub_ps(y, _mm256_set1_ps(box.max.y)));
+    __m256 const dz = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_set1_ps(box.min.z), z), zero),
+                                    _mm256_sub_ps(z, _mm256_set1_ps(box.max.z)));
+    __m256 const distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                          _mm256_mul_ps(dz, dz));
+
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(distance, _mm256_mul_ps(r, r), _CMP_LE_OQ)));
+#else
+    uint32_t mask = 0;
+    for (uint8_t j = 0; j < 2; ++j)
+    {
+        __m128 const x = _mm_loadu_ps(&spheres.x[i + j * 4]);
+        __m128 const y = _mm_loadu_ps(&spheres.y[i + j * 4]);
+        __m128 const z = _mm_loadu_ps(&spheres.z[i + j * 4]);
+        __m128 const r = _mm_loadu_ps(&spheres.radius[i + j * 4]);
+        __m128 const zero = _mm_setzero_ps();
+
+        __m128 const dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.min.x), x), zero),
+                                     _mm_sub_ps(x, _mm_set1_ps(box.max.x)));
+        __m128 const dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.min.y), y), zero),
+                                     _mm_sub_ps(y, _mm_set1_ps(box.max.y)));
+        __m128 const dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.min.z), z), zero),
+                                     _mm_sub_ps(z, _mm_set1_ps(box.max.z)));
+        __m128 const distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+        mask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(distance, _mm_mul_ps(r, r)))) << (j * 4);
+    }
+
+    return mask;
+#endif
+}
+
+inline float GetSliceDepth(ClusterProjection const &projection, uint32_t slice)
+{
+    return projection.near * std::pow(projection.far / projection.near, static_cast<float>(slice) / CLUSTER_COUNT_Z);
+}
+
+// The spheres that reach into the depth range of the slice are copied first, the clusters of the slice test those
+inline void BuildClusterSlice(LightClusters &clusters, ClusterProjection const &projection, uint32_t slice)
+{
+    float const nearDepth = GetSliceDepth(projection, slice);
+    float const farDepth = GetSliceDepth(projection, slice + 1);
+    //A box around the whole slice, the clusters of the slice only differ in x and y
+    float const maxX = farDepth / projection.xScale;
+    float const maxY = farDepth / projection.yScale;
+    sr::geo::AABB const sliceBox = {{-maxX, -maxY, -farDepth}, {maxX, maxY, -nearDepth}};
+
+    SphereSoA const &lights = clusters.lights;
+    SphereSoA &sliceLights = clusters.sliceLights[slice];
+    uint32_t visible[LIGHT_BATCH_SIZE];
+    ResizeSphereSoA(sliceLights, lights.count);
+    uint64_t sliceCount = 0;
+    for (uint64_t i = 0; i < lights.count; i += LIGHT_BATCH_SIZE)
+    {
+        uint32_t const written = WriteVisibleIndices(TestSpheresAABB(lights, i, sliceBox), i, lights.count, visible);
+        for (uint32_t j = 0; j < written; ++j)
+        {
+            uint32_t const k = visible[j];
+            StoreSphere(sliceLights, sliceCount++, lights.x[k], lights.y[k], lights.z[k], lights.radius[k], lights.lights[k]);
+        }
+    }
+    ResizeSphereSoA(sliceLights, sliceCount);
+
+    std::vector<uint32_t> &indices = clusters.sliceIndices[slice];
+    uint64_t indexCount = 0;
+    for (uint32_t y = 0; y < CLUSTER_COUNT_Y; ++y)
+    {
+        float const ndcMinY = -1.f + 2.f * y / CLUSTER_COUNT_Y;
+        float const ndcMaxY = -1.f + 2.f * (y + 1) / CLUSTER_COUNT_Y;
+        for (uint32_t x = 0; x < CLUSTER_COUNT_X; ++x)
+        {
+            float const ndcMinX = -1.f + 2.f * x / CLUSTER_COUNT_X;
+            float const ndcMaxX = -1.f + 2.f * (x + 1) / CLUSTER_COUNT_X;
+            //The sides of the froxel are planes through the camera, the box spans both of its depth ends
+            sr::geo::AABB const box = {
+                {std::min(ndcMinX * nearDepth, ndcMinX * farDepth) / projection.xScale,
+                 std::min(ndcMinY * nearDepth, ndcMinY * farDepth) / projection.yScale,
+                 -farDepth},
+                {std::max(ndcMaxX * nearDepth, ndcMaxX * farDepth) / projection.xScale,
+                 std::max(ndcMaxY * nearDepth, ndcMaxY * farDepth) / projection.yScale,
+                 -nearDepth}};
+
+            if (indices.size() < indexCount + sliceLights.x.size())
+            {
+                indices.resize(indexCount + sliceLights.x.size());
+            }
+            uint64_t const offset = indexCount;
+            for (uint64_t i = 0; i < sliceLights.count; i += LIGHT_BATCH_SIZE)
+            {
+                indexCount += WriteVisibleIndices(
+                    TestSpheresAABB(sliceLights, i, box), i, sliceLights.count, indices.data() + indexCount);
+            }
+            //Slice local positions for now, replaced by the lights once the slices are concatenated
+            clusters.ranges[(slice * CLUSTER_COUNT_Y + y) * CLUSTER_COUNT_X + x] = {
+                static_cast<uint32_t>(offset), static_cast<uint32_t>(indexCount - offset)};
+        }
+    }
+    clusters.sliceIndexCounts[slice] = indexCount;
+}
+
+} // namespace
+
+inline uint64_t GetClusterLightIndexCount(LightClusters const &clusters)
+{
+    uint64_t count = 0;
+    for (uint32_t slice = 0; slice < CLUSTER_COUNT_Z; ++slice)
+    {
+        count += clusters.sliceIndexCounts[slice];
+    }
+
+    return count;
+}
+
+// Assigns the lights to the clusters of the view, one job per depth slice
+inline void BuildLightClusters(LightClusters &clusters,
+                               PointLight const *lights,
+                               uint32_t count,
+                               sr::math::Matrix4x4 const &view,
+                               ClusterProjection const &projection)
+{
+    assert(projection.near > 0 && projection.far > projection.near);
+
+    float const logDepthRange = std::log2(projection.far / projection.near);
+    clusters.depthScale = CLUSTER_COUNT_Z / logDepthRange;
+    clusters.depthBias = -static_cast<float>(CLUSTER_COUNT_Z) * std::log2(projection.near) / logDepthRange;
+    clusters.ranges.resize(CLUSTER_COUNT);
+
+    ResizeSphereSoA(clusters.lights, count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        sr::math::Vec4 const position = view * sr::math::Vec4{lights[i].position.x, lights[i].position.y, lights[i].position.z, 1};
+        StoreSphere(clusters.lights, i, position.x, position.y, position.z, lights[i].radius, i);
+    }
+
+    sr::job::ParallelFor(CLUSTER_COUNT_Z, 1, [&clusters, &projection](uint64_t begin, uint64_t end) {
+        for (uint64_t slice = begin; slice < end; ++slice)
+        {
+            BuildClusterSlice(clusters, projection, static_cast<uint32_t>(slice));
+        }
+    });
+
+    //Never empty so that the buffer can be bound
+    clusters.indices.resize(std::max<uint64_t>(GetClusterLightIndexCount(clusters), 1));
+
+    uint64_t offset = 0;
+    for (uint32_t slice = 0; slice < CLUSTER_COUNT_Z; ++slice)
+    {
+        SphereSoA const &sliceLights = clusters.sliceLights[slice];
+        std::vector<uint32_t> const &sliceIndices = clusters.sliceIndices[slice];
+        for (uint64_t i = 0; i < clusters.sliceIndexCounts[slice]; ++i)
+        {
+            clusters.indices[offset + i] = sliceLights.lights[sliceIndices[i]];
+        }
+
+        ClusterRange *ranges = &clusters.ranges[slice * CLUSTER_COUNT_X * CLUSTER_COUNT_Y];
+        for (uint32_t i = 0; i < CLUSTER_COUNT_X * CLUSTER_COUNT_Y; ++i)
+        {
+            ranges[i].offset += static_cast<uint32_t>(offset);
+        }
+        offset += clusters.sliceIndexCounts[slice];
+    }
+}
+
+} // namespace sr::cull
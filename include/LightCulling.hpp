@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "Geometry.hpp"
+#include "LightClusters.hpp"
+#include "Math.hpp"
+#include "RenderDefinitions.hpp"
+#include "RenderPass.hpp"
+#include "ShaderProgram.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// Point lights live in a shader storage buffer that stays bound at POINT_LIGHT_BUFFER_BINDING, so the
+// forward lighting reads them as well. The deferred path bins them into screen tiles first, every tile
+// keeps a count followed by up to TILE_LIGHT_MAX_COUNT light indices. The clustered forward path
+// reads the light ranges and index lists the CPU built, see LightClusters.hpp.
+// Tiles with more lights drop the rest, they are counted and read back a few frames later through a fence.
+constexpr uint32_t POINT_LIGHT_BUFFER_BINDING = 1;
+constexpr uint32_t TILE_LIGHT_BUFFER_BINDING = 2;
+constexpr uint32_t CLUSTER_RANGE_BUFFER_BINDING = 3;
+constexpr uint32_t CLUSTER_INDEX_BUFFER_BINDING = 4;
+constexpr uint32_t LIGHT_TILE_SIZE = 16;
+constexpr uint32_t TILE_LIGHT_MAX_COUNT = 255;
+constexpr uint32_t LIGHT_CULLING_STATS_BUFFER_BINDING = 7;
+constexpr uint32_t LIGHT_CULLING_STATS_LATENCY = 3;
+
+// Same layout as LightCullingStats in light_culling.comp
+struct LightCullingStats
+{
+    uint32_t overflowTiles; //Tiles that dropped lights
+    uint32_t maxTileLights; //Lights that touch the busiest tile, dropped ones included
+};
+
+struct TiledLightCulling
+{
+    ShaderProgram program = {};
+    GLuint lightBuffer = 0;
+    GLuint tileBuffer = 0;
+    uint32_t tileCapacity = 0; //Tiles the tile buffer has room for
+    //The last buffer takes the stats of the dispatches that find every other buffer in flight
+    GLuint statsBuffers[LIGHT_CULLING_STATS_LATENCY + 1] = {};
+    GLsync statsFences[LIGHT_CULLING_STATS_LATENCY] = {};
+    uint64_t dispatchedFrames = 0;
+    uint64_t readFrames = 0;
+};
+
+struct ClusteredLightBuffers
+{
+    GLuint rangeBuffer = 0;
+    GLuint indexBuffer = 0;
+};
+
+TiledLightCulling CreateTiledLightCulling(ShaderProgram program)
+{
+    TiledLightCulling culling;
+    culling.program = program;
+
+    glGenBuffers(1, &culling.lightBuffer);
+    glGenBuffers(1, &culling.tileBuffer);
+    glGenBuffers(LIGHT_CULLING_STATS_LATENCY + 1, culling.statsBuffers);
+    for (GLuint buffer : culling.statsBuffers)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(LightCullingStats), nullptr, GL_DYNAMIC_READ);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    return culling;
+}
+
+void DeleteTiledLightCulling(TiledLightCulling &culling)
+{
+    for (GLsync &fence : culling.statsFences)
+    {
+        if (fence != nullptr)
+        {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    glDeleteBuffers(1, &culling.lightBuffer);
+    glDeleteBuffers(1, &culling.tileBuffer);
+    glDeleteBuffers(LIGHT_CULLING_STATS_LATENCY + 1, culling.statsBuffers);
+    culling.lightBuffer = 0;
+    culling.tileBuffer = 0;
+}
+
+void UploadPointLights(TiledLightCulling &culling, PointLight const *lights, uint32_t count)
+{
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, culling.lightBuffer);
+    //An empty buffer can not be bound, keep room for one light
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(count, 1u) * sizeof(PointLight), lights, GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, POINT_LIGHT_BUFFER_BINDING, culling.lightBuffer);
+}
+
+// Bins the lights into the tiles of the lower left width x height texels of the depth buffer
+void DispatchTiledLightCulling(TiledLightCulling &culling, GLuint depthTexture, int32_t width, int32_t height)
+{
+    uint32_t const tileCountX = (width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    uint32_t const tileCountY = (height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    if (tileCountX * tileCountY > culling.tileCapacity)
+    {
+        culling.tileCapacity = tileCountX * tileCountY;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, culling.tileBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER,
+                     culling.tileCapacity * (TILE_LIGHT_MAX_COUNT + 1) * sizeof(uint32_t),
+                     nullptr,
+                     GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    //Timed like a render pass so that it shows up next to the lighting passes
+    ShortString const name = {"Light Culling", 13};
+#ifdef NDEBUG
+    glPushGroupMarkerEXT(name.length, name.data);
+#endif
+    sr::prof::BeginRenderPassZone(name);
+    sr::prof::BeginSubPassZone(0);
+
+    uint32_t const slot = culling.dispatchedFrames % LIGHT_CULLING_STATS_LATENCY;
+    bool const statsSlotFree = culling.statsFences[slot] == nullptr;
+    LightCullingStats const emptyStats = {0, 0};
+    GLuint const statsBuffer = culling.statsBuffers[statsSlotFree ? slot : LIGHT_CULLING_STATS_LATENCY];
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(LightCullingStats), &emptyStats);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_CULLING_STATS_BUFFER_BINDING, statsBuffer);
+
+    glUseProgram(culling.program.handle);
+    UpdatePerFrameUniforms(culling.program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TILE_LIGHT_BUFFER_BINDING, culling.tileBuffer);
+
+    glDispatchCompute(tileCountX, tileCountY, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    if (statsSlotFree)
+    {
+        culling.statsFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, UnusedMask::GL_NONE_BIT);
+        culling.dispatchedFrames++;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+
+    sr::prof::EndSubPassZone();
+    sr::prof::EndRenderPassZone();
+#ifdef NDEBUG
+    glPopGroupMarkerEXT();
+#endif
+}
+
+// Polls the oldest dispatches without waiting, stats keeps the newest finished result.
+// Returns true if stats was updated.
+bool ReadLightCullingStats(TiledLightCulling &culling, LightCullingStats &stats)
+{
+    bool updated = false;
+    while (culling.readFrames < culling.dispatchedFrames)
+    {
+        uint32_t const slot = culling.readFrames % LIGHT_CULLING_STATS_LATENCY;
+        GLenum const status = glClientWaitSync(culling.statsFences[slot], SyncObjectMask::GL_NONE_BIT, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            break;
+        }
+        glDeleteSync(culling.statsFences[slot]);
+        culling.statsFences[slot] = nullptr;
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, culling.statsBuffers[slot]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(LightCullingStats), &stats);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        culling.readFrames++;
+        updated = true;
+    }
+
+    return updated;
+}
+
+ClusteredLightBuffers CreateClusteredLightBuffers()
+{
+    ClusteredLightBuffers buffers;
+    glGenBuffers(1, &buffers.rangeBuffer);
+    glGenBuffers(1, &buffers.indexBuffer);
+
+    return buffers;
+}
+
+void DeleteClusteredLightBuffers(ClusteredLightBuffers &buffers)
+{
+    glDeleteBuffers(1, &buffers.rangeBuffer);
+    glDeleteBuffers(1, &buffers.indexBuffer);
+    buffers = {};
+}
+
+// The buffers are respecified every frame, the driver hands out new storage while the last frame still reads the old
+void UploadLightClusters(ClusteredLightBuffers const &buffers, sr::cull::LightClusters const &clusters)
+{
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers.rangeBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 clusters.ranges.size() * sizeof(sr::cull::ClusterRange),
+                 clusters.ranges.data(),
+                 GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers.indexBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 clusters.indices.size() * sizeof(uint32_t),
+                 clusters.indices.data(),
+                 GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_RANGE_BUFFER_BINDING, buffers.rangeBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_INDEX_BUFFER_BINDING, buffers.indexBuffer);
+}
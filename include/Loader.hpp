@@ -5,6 +5,7 @@
  */
 #pragma once
 
+#include "JobSystem.hpp"
 #include "RenderDefinitions.hpp"
 #include "Math.hpp"
 
@@ -135,48 +136,58 @@ void LoadGeometry(tinyobj::attrib_t const &attrib, tinyobj::shape_t const &shape
     }
 }
 
+// Only registers the texture, the pixels are decoded by DecodeTextureSource
 TextureSource *CreateTextureSource(std::string const &folder, std::string const &path)
 {
     static std::unordered_map<std::string, TextureSource> s_textureSourceCache(11);
 
     std::string texturePath = folder + "/" + path;
     TextureSource *texture = &s_textureSourceCache[texturePath];
-    if (texture->data != nullptr)
+    if (texture->filepath.empty())
     {
-        return texture;
+        texture->filepath = std::move(texturePath);
     }
 
-    texture->filepath = std::move(texturePath);
-    texture->data = stbi_load(
-        texture->filepath.c_str(), &texture->width, &texture->height, &texture->channels, 0);
-    if (texture->data == nullptr)
+    return texture;
+}
+
+// Safe to call for different textures concurrently
+void DecodeTextureSource(TextureSource &texture)
+{
+    if (texture.data != nullptr)
+    {
+        return;
+    }
+
+    texture.data = stbi_load(
+        texture.filepath.c_str(), &texture.width, &texture.height, &texture.channels, 0);
+    if (texture.data == nullptr)
     {
-        std::cerr << "Failed to load texture: " << texture->filepath << std::endl;
+        std::cerr << "Failed to load texture: " << texture.filepath << std::endl;
     }
 
-    switch (texture->channels)
+    switch (texture.channels)
     {
     case 1:
-        texture->format = GL_RED;
+        texture.format = GL_RED;
         break;
     case 2:
-        texture->format = GL_RG;
+        texture.format = GL_RG;
         break;
     case 3:
-        texture->format = GL_RGB;
+        texture.format = GL_RGB;
         break;
     case 4:
-        texture->format = GL_RGBA;
+        texture.format = GL_RGBA;
         break;
     default:
         std::cerr << "Failed to detect texture format!" << std::endl;
         break;
     }
-
-    return texture;
 }
 
-MaterialSource CreateMaterialSource(std::string const &folder, tinyobj::material_t const &material)
+// Textures are registered but not decoded, see DecodeMaterialSources
+MaterialSource RegisterMaterialSource(std::string const &folder, tinyobj::material_t const &material)
 {
     TextureSource *albedo = nullptr;
     if (!material.diffuse_texname.empty())
@@ -217,6 +228,41 @@ MaterialSource CreateMaterialSource(std::string const &folder, tinyobj::material
     return MaterialSource{albedo, normal, bump, metallic, roughness, brdf};
 }
 
+// Decodes the textures of all materials in parallel, shared textures are decoded once
+void DecodeMaterialSources(MaterialSource const *materials, uint64_t count)
+{
+    std::vector<TextureSource *> textures;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        for (TextureSource *texture : {materials[i].albedo,
+                                       materials[i].normal,
+                                       materials[i].bump,
+                                       materials[i].metallic,
+                                       materials[i].roughness})
+        {
+            if (texture != nullptr && std::find(textures.begin(), textures.end(), texture) == textures.end())
+            {
+                textures.push_back(texture);
+            }
+        }
+    }
+
+    sr::job::ParallelFor(textures.size(), 1, [&textures](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; ++i)
+        {
+            DecodeTextureSource(*textures[i]);
+        }
+    });
+}
+
+MaterialSource CreateMaterialSource(std::string const &folder, tinyobj::material_t const &material)
+{
+    MaterialSource source = RegisterMaterialSource(folder, material);
+    DecodeMaterialSources(&source, 1);
+
+    return source;
+}
+
 void FreeMaterialSource(MaterialSource &material)
 {
     if (material.albedo != nullptr && material.albedo->data != nullptr)
@@ -276,16 +322,26 @@ bool LoadOBJ(std::string const &folder, std::string const &filename, std::vector
         return false;
     }
 
-    for (auto const &rawGeometry : rawGeometries)
+    //Shapes are loaded in parallel into separate lists, then appended in the file order
+    std::vector<std::vector<Geometry>> shapeGeometries(rawGeometries.size());
+    sr::job::ParallelFor(rawGeometries.size(), 1, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; ++i)
+        {
+            LoadGeometry(attrib, rawGeometries[i], shapeGeometries[i]);
+        }
+    });
+    for (auto &shape : shapeGeometries)
     {
-        LoadGeometry(attrib, rawGeometry, geometries);
+        std::move(shape.begin(), shape.end(), std::back_inserter(geometries));
     }
 
-    materials.reserve(rawMaterials.size());
+    uint64_t const firstMaterial = materials.size();
+    materials.reserve(firstMaterial + rawMaterials.size());
     for (auto const &material : rawMaterials)
     {
-        materials.push_back(CreateMaterialSource(folder, material));
+        materials.push_back(RegisterMaterialSource(folder, material));
     }
+    DecodeMaterialSources(materials.data() + firstMaterial, rawMaterials.size());
 
     return true;
 }
@@ -449,6 +449,50 @@ inline constexpr Matrix4x4 CreateTranslationMatrix(Vec3 vec) noexcept
     return CreateTranslationMatrix(vec.x, vec.y, vec.z);
 }
 
+// Views, model transforms and orthographic projections, the last row has to be 0 0 0 1.
+// The upper 3x3 is inverted from its cofactors and the translation is moved back through it.
+inline constexpr Matrix4x4 InverseAffine(Matrix4x4 const &m) noexcept
+{
+    float const c11 = m._22 * m._33 - m._23 * m._32;
+    float const c12 = m._23 * m._31 - m._21 * m._33;
+    float const c13 = m._21 * m._32 - m._22 * m._31;
+    float const c21 = m._13 * m._32 - m._12 * m._33;
+    float const c22 = m._11 * m._33 - m._13 * m._31;
+    float const c23 = m._12 * m._31 - m._11 * m._32;
+    float const c31 = m._12 * m._23 - m._13 * m._22;
+    float const c32 = m._13 * m._21 - m._11 * m._23;
+    float const c33 = m._11 * m._22 - m._12 * m._21;
+
+    float const det = m._11 * c11 + m._12 * c12 + m._13 * c13;
+    if (det == 0)
+    {
+        return {};
+    }
+    float const invDet = 1.f / det;
+
+    Vec3 const r1 = Vec3{c11, c21, c31} * invDet;
+    Vec3 const r2 = Vec3{c12, c22, c32} * invDet;
+    Vec3 const r3 = Vec3{c13, c23, c33} * invDet;
+    Vec3 const t = {m._14, m._24, m._34};
+
+    return {
+        r1.x, r1.y, r1.z, -Dot(r1, t),
+        r2.x, r2.y, r2.z, -Dot(r2, t),
+        r3.x, r3.y, r3.z, -Dot(r3, t),
+        0, 0, 0, 1};
+}
+
+// Perspective projections, jittered or sheared ones included: the only non zero elements are
+// _11, _13, _22, _23, _33, _34 and _43, so the inverse has the same handful of terms
+inline constexpr Matrix4x4 InversePerspective(Matrix4x4 const &m) noexcept
+{
+    return {
+        1.f / m._11, 0, 0, -m._13 / (m._11 * m._43),
+        0, 1.f / m._22, 0, -m._23 / (m._22 * m._43),
+        0, 0, 0, 1.f / m._43,
+        0, 0, 1.f / m._34, -m._33 / (m._34 * m._43)};
+}
+
 inline float CreateUniformRandomFloat(float min, float max) noexcept
 {
     return (std::rand() % static_cast<int32_t>(max - min)) - min;
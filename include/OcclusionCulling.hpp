@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "Culling.hpp"
+#include "Geometry.hpp"
+#include "JobSystem.hpp"
+#include "Math.hpp"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+namespace sr::cull
+{
+
+constexpr uint32_t OCCLUSION_TILE_WIDTH = 32;
+constexpr uint32_t OCCLUSION_TILE_HEIGHT = 16;
+
+// World space occluder triangles, kept on the CPU after loading
+struct Occluder
+{
+    std::vector<sr::math::Vec3> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// Depth is stored as NDC depth remapped to [0, 1], 1 is the far plane. Every tile
+// also keeps the farthest depth it contains, which lets most tests stop at tile level.
+struct DepthBuffer
+{
+    std::vector<float> depth;
+    std::vector<float> tileMaxDepth;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t tilesX = 0;
+    uint32_t tilesY = 0;
+};
+
+// Edge functions and the depth plane are evaluated at pixel centers as a * x + b * y + c. The occluders are
+// rasterized conservatively, c is offset so that the edge test at the center only passes if all corners of the
+// pixel are inside and the depth at the center is the farthest depth of the triangle over the pixel.
+struct ScreenTriangle
+{
+    float edgeA[3];
+    float edgeB[3];
+    float edgeC[3];
+    float depthA;
+    float depthB;
+    float depthC;
+    int32_t minX;
+    int32_t minY;
+    int32_t maxX;
+    int32_t maxY;
+};
+
+inline DepthBuffer CreateDepthBuffer(uint32_t width, uint32_t height)
+{
+    assert(width > 0 && width % OCCLUSION_TILE_WIDTH == 0);
+    assert(height > 0 && height % OCCLUSION_TILE_HEIGHT == 0);
+
+    DepthBuffer buffer;
+    buffer.width = width;
+    buffer.height = height;
+    buffer.tilesX = width / OCCLUSION_TILE_WIDTH;
+    buffer.tilesY = height / OCCLUSION_TILE_HEIGHT;
+    buffer.depth.resize(static_cast<uint64_t>(width) * height, 1.f);
+    buffer.tileMaxDepth.resize(static_cast<uint64_t>(buffer.tilesX) * buffer.tilesY, 1.f);
+
+    return buffer;
+}
+
+namespace
+{
+
+void EmitScreenTriangle(
+    sr::math::Vec4 const &c0, sr::math::Vec4 const &c1, sr::math::Vec4 const &c2,
+    uint32_t width, uint32_t height, std::vector<ScreenTriangle> &triangles)
+{
+    sr::math::Vec4 const *clip[3] = {&c0, &c1, &c2};
+    float x[3], y[3], z[3];
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        float const invW = 1.f / clip[i]->w;
+        x[i] = (clip[i]->x * invW * 0.5f + 0.5f) * width;
+        y[i] = (clip[i]->y * invW * 0.5f + 0.5f) * height;
+        z[i] = clip[i]->z * invW * 0.5f + 0.5f;
+    }
+
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0)
+    {
+        return;
+    }
+
+    //Occluders are rasterized double sided
+    if (area < 0)
+    {
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(z[1], z[2]);
+        area = -area;
+    }
+
+    ScreenTriangle triangle;
+    triangle.minX = std::max(0, static_cast<int32_t>(std::floor(std::min({x[0], x[1], x[2]}))));
+    triangle.minY = std::max(0, static_cast<int32_t>(std::floor(std::min({y[0], y[1], y[2]}))));
+    triangle.maxX = std::min(static_cast<int32_t>(width) - 1,
+                             static_cast<int32_t>(std::ceil(std::max({x[0], x[1], x[2]}))));
+    triangle.maxY = std::min(static_cast<int32_t>(height) - 1,
+                             static_cast<int32_t>(std::ceil(std::max({y[0], y[1], y[2]}))));
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+    {
+        return;
+    }
+
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        uint8_t const j = (i + 1) % 3;
+        triangle.edgeA[i] = -(y[j] - y[i]);
+        triangle.edgeB[i] = x[j] - x[i];
+        triangle.edgeC[i] = -(triangle.edgeA[i] * x[i] + triangle.edgeB[i] * y[i]);
+    }
+
+    float const invArea = 1.f / area;
+    triangle.depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) * invArea;
+    triangle.depthB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) * invArea;
+    triangle.depthC = z[0] - triangle.depthA * x[0] - triangle.depthB * y[0];
+
+    //A plane changes by at most half of |a| + |b| between the center and a corner of a pixel.
+    //Partly covered pixels would reject boxes that are visible at full resolution around silhouettes.
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        triangle.edgeC[i] -= 0.5f * (std::abs(triangle.edgeA[i]) + std::abs(triangle.edgeB[i]));
+    }
+    triangle.depthC += 0.5f * (std::abs(triangle.depthA) + std::abs(triangle.depthB));
+
+    triangles.push_back(triangle);
+}
+
+// Sutherland-Hodgman against the near plane (z + w >= 0), the remaining planes are
+// handled by clamping the screen bounds of the triangle
+void ClipAndEmitTriangle(
+    sr::math::Vec4 const &c0, sr::math::Vec4 const &c1, sr::math::Vec4 const &c2,
+    uint32_t width, uint32_t height, std::vector<ScreenTriangle> &triangles)
+{
+    sr::math::Vec4 const input[3] = {c0, c1, c2};
+    float const distances[3] = {c0.z + c0.w, c1.z + c1.w, c2.z + c2.w};
+
+    if (distances[0] >= 0 && distances[1] >= 0 && distances[2] >= 0)
+    {
+        EmitScreenTriangle(c0, c1, c2, width, height, triangles);
+        return;
+    }
+    if (distances[0] < 0 && distances[1] < 0 && distances[2] < 0)
+    {
+        return;
+    }
+
+    sr::math::Vec4 output[4];
+    uint8_t outputCount = 0;
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        uint8_t const j = (i + 1) % 3;
+        if (distances[i] >= 0)
+        {
+            output[outputCount++] = input[i];
+        }
+        if ((distances[i] >= 0) != (distances[j] >= 0))
+        {
+            float const t = distances[i] / (distances[i] - distances[j]);
+            output[outputCount++] = input[i] + (input[j] - input[i]) * t;
+        }
+    }
+
+    for (uint8_t i = 2; i < outputCount; ++i)
+    {
+        EmitScreenTriangle(output[0], output[i - 1], output[i], width, height, triangles);
+    }
+}
+
+void RasterizeTriangleInTile(
+    DepthBuffer &buffer, ScreenTriangle const &triangle, int32_t tileMinX, int32_t tileMinY)
+{
+    int32_t const minX = std::max(triangle.minX, tileMinX) & ~7;
+    int32_t const maxX = std::min(triangle.maxX, tileMinX + static_cast<int32_t>(OCCLUSION_TILE_WIDTH) - 1);
+    int32_t const minY = std::max(triangle.minY, tileMinY);
+    int32_t const maxY = std::min(triangle.maxY, tileMinY + static_cast<int32_t>(OCCLUSION_TILE_HEIGHT) - 1);
+
+#if defined(__AVX__)
+    __m256 const laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    __m256 const zero = _mm256_setzero_ps();
+
+    for (int32_t y = minY; y <= maxY; ++y)
+    {
+        float const py = y + 0.5f;
+        float *row = &buffer.depth[static_cast<uint64_t>(y) * buffer.width];
+
+        for (int32_t x = minX; x <= maxX; x += 8)
+        {
+            __m256 const px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), laneOffsets);
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (uint8_t i = 0; i < 3; ++i)
+            {
+                __m256 const edge = _mm256_add_ps(
+                    _mm256_mul_ps(_mm256_set1_ps(triangle.edgeA[i]), px),
+                    _mm256_set1_ps(triangle.edgeB[i] * py + triangle.edgeC[i]));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(edge, zero, _CMP_GE_OQ));
+            }
+
+            if (_mm256_movemask_ps(inside) == 0)
+            {
+                continue;
+            }
+
+            __m256 const depth = _mm256_add_ps(
+                _mm256_mul_ps(_mm256_set1_ps(triangle.depthA), px),
+                _mm256_set1_ps(triangle.depthB * py + triangle.depthC));
+            __m256 const current = _mm256_loadu_ps(row + x);
+            _mm256_storeu_ps(row + x, _mm256_blendv_ps(current, _mm256_min_ps(current, depth), inside));
+        }
+    }
+#else
+    __m128 const laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    __m128 const zero = _mm_setzero_ps();
+
+    for (int32_t y = minY; y <= maxY; ++y)
+    {
+        float const py = y + 0.5f;
+        float *row = &buffer.depth[static_cast<uint64_t>(y) * buffer.width];
+
+        for (int32_t x = minX; x <= maxX; x += 4)
+        {
+            __m128 const px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (uint8_t i = 0; i < 3; ++i)
+            {
+                __m128 const edge = _mm_add_ps(
+                    _mm_mul_ps(_mm_set1_ps(triangle.edgeA[i]), px),
+                    _mm_set1_ps(triangle.edgeB[i] * py + triangle.edgeC[i]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(edge, zero));
+            }
+
+            if (_mm_movemask_ps(inside) == 0)
+            {
+                continue;
+            }
+
+            __m128 const depth = _mm_add_ps(
+                _mm_mul_ps(_mm_set1_ps(triangle.depthA), px),
+                _mm_set1_ps(triangle.depthB * py + triangle.depthC));
+            __m128 const current = _mm_loadu_ps(row + x);
+            __m128 const nearest = _mm_min_ps(current, depth);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+        }
+    }
+#endif
+}
+
+void RasterizeTile(DepthBuffer &buffer, std::vector<ScreenTriangle> const &triangles, uint32_t tileX, uint32_t tileY)
+{
+    int32_t const tileMinX = static_cast<int32_t>(tileX * OCCLUSION_TILE_WIDTH);
+    int32_t const tileMinY = static_cast<int32_t>(tileY * OCCLUSION_TILE_HEIGHT);
+    int32_t const tileMaxX = tileMinX + static_cast<int32_t>(OCCLUSION_TILE_WIDTH) - 1;
+    int32_t const tileMaxY = tileMinY + static_cast<int32_t>(OCCLUSION_TILE_HEIGHT) - 1;
+
+    for (uint32_t y = 0; y < OCCLUSION_TILE_HEIGHT; ++y)
+    {
+        float *row = &buffer.depth[static_cast<uint64_t>(tileMinY + y) * buffer.width + tileMinX];
+        std::fill(row, row + OCCLUSION_TILE_WIDTH, 1.f);
+    }
+
+    for (auto const &triangle : triangles)
+    {
+        if (triangle.maxX >= tileMinX && triangle.minX <= tileMaxX &&
+            triangle.maxY >= tileMinY && triangle.minY <= tileMaxY)
+        {
+            RasterizeTriangleInTile(buffer, triangle, tileMinX, tileMinY);
+        }
+    }
+
+    float maxDepth = 0;
+    for (uint32_t y = 0; y < OCCLUSION_TILE_HEIGHT; ++y)
+    {
+        float const *row = &buffer.depth[static_cast<uint64_t>(tileMinY + y) * buffer.width + tileMinX];
+        maxDepth = std::max(maxDepth, *std::max_element(row, row + OCCLUSION_TILE_WIDTH));
+    }
+    buffer.tileMaxDepth[tileY * buffer.tilesX + tileX] = maxDepth;
+}
+
+} // namespace
+
+inline void TransformOccluders(
+    Occluder const *occluders, uint64_t count, sr::math::Matrix4x4 const &viewProj,
+    uint32_t width, uint32_t height, std::vector<ScreenTriangle> &triangles)
+{
+    triangles.clear();
+    std::vector<sr::math::Vec4> clip;
+
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        auto const &occluder = occluders[i];
+
+        clip.resize(occluder.vertices.size());
+        for (uint64_t j = 0; j < occluder.vertices.size(); ++j)
+        {
+            auto const &v = occluder.vertices[j];
+            clip[j] = viewProj * sr::math::Vec4{v.x, v.y, v.z, 1};
+        }
+
+        for (uint64_t j = 0; j + 2 < occluder.indices.size(); j += 3)
+        {
+            ClipAndEmitTriangle(
+                clip[occluder.indices[j + 0]], clip[occluder.indices[j + 1]], clip[occluder.indices[j + 2]],
+                width, height, triangles);
+        }
+    }
+}
+
+// Every tile is owned by a single job, rows of tiles are spread over the job system
+inline void RasterizeOccluders(DepthBuffer &buffer, std::vector<ScreenTriangle> const &triangles)
+{
+    sr::job::ParallelFor(buffer.tilesY, 1, [&buffer, &triangles](uint64_t begin, uint64_t end) {
+        for (uint64_t tileY = begin; tileY < end; ++tileY)
+        {
+            for (uint32_t tileX = 0; tileX < buffer.tilesX; ++tileX)
+            {
+                RasterizeTile(buffer, triangles, tileX, static_cast<uint32_t>(tileY));
+            }
+        }
+    });
+}
+
+inline bool IsAABBOccluded(DepthBuffer const &buffer, sr::math::Matrix4x4 const &viewProj, sr::geo::AABB const &aabb)
+{
+    float minX = FLT_MAX, minY = FLT_MAX, minDepth = FLT_MAX;
+    float maxX = -FLT_MAX, maxY = -FLT_MAX;
+
+    for (uint8_t i = 0; i < 8; ++i)
+    {
+        sr::math::Vec4 const clip = viewProj * sr::math::Vec4{
+                                                   i & 1 ? aabb.max.x : aabb.min.x,
+                                                   i & 2 ? aabb.max.y : aabb.min.y,
+                                                   i & 4 ? aabb.max.z : aabb.min.z,
+                                                   1};
+
+        //Boxes crossing the near plane are always visible
+        if (clip.z + clip.w < 0 || clip.w <= 0)
+        {
+            return false;
+        }
+
+        float const invW = 1.f / clip.w;
+        minX = std::min(minX, clip.x * invW);
+        maxX = std::max(maxX, clip.x * invW);
+        minY = std::min(minY, clip.y * invW);
+        maxY = std::max(maxY, clip.y * invW);
+        minDepth = std::min(minDepth, clip.z * invW);
+    }
+
+    int32_t const x0 = std::max(0, static_cast<int32_t>(std::floor((minX * 0.5f + 0.5f) * buffer.width)));
+    int32_t const y0 = std::max(0, static_cast<int32_t>(std::floor((minY * 0.5f + 0.5f) * buffer.height)));
+    int32_t const x1 = std::min(static_cast<int32_t>(buffer.width) - 1,
+                                static_cast<int32_t>(std::ceil((maxX * 0.5f + 0.5f) * buffer.width)));
+    int32_t const y1 = std::min(static_cast<int32_t>(buffer.height) - 1,
+                                static_cast<int32_t>(std::ceil((maxY * 0.5f + 0.5f) * buffer.height)));
+    if (x0 > x1 || y0 > y1)
+    {
+        return false;
+    }
+
+    float const boxDepth = minDepth * 0.5f + 0.5f;
+
+    for (int32_t tileY = y0 / OCCLUSION_TILE_HEIGHT; tileY <= y1 / static_cast<int32_t>(OCCLUSION_TILE_HEIGHT); ++tileY)
+    {
+        for (int32_t tileX = x0 / OCCLUSION_TILE_WIDTH; tileX <= x1 / static_cast<int32_t>(OCCLUSION_TILE_WIDTH); ++tileX)
+        {
+            if (boxDepth > buffer.tileMaxDepth[tileY * buffer.tilesX + tileX])
+            {
+                continue;
+            }
+
+            int32_t const px0 = std::max(x0, tileX * static_cast<int32_t>(OCCLUSION_TILE_WIDTH));
+            int32_t const py0 = std::max(y0, tileY * static_cast<int32_t>(OCCLUSION_TILE_HEIGHT));
+            int32_t const px1 = std::min(x1, (tileX + 1) * static_cast<int32_t>(OCCLUSION_TILE_WIDTH) - 1);
+            int32_t const py1 = std::min(y1, (tileY + 1) * static_cast<int32_t>(OCCLUSION_TILE_HEIGHT) - 1);
+
+            for (int32_t y = py0; y <= py1; ++y)
+            {
+                float const *row = &buffer.depth[static_cast<uint64_t>(y) * buffer.width];
+                for (int32_t x = px0; x <= px1; ++x)
+                {
+                    if (boxDepth <= row[x])
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+inline void CullOccludedAABBs(
+    DepthBuffer const &buffer, sr::math::Matrix4x4 const &viewProj,
+    AABBSoA const &boxes, VisibilityList const &input, VisibilityList &output)
+{
+    output.indices.resize(input.count);
+    output.count = 0;
+
+    for (uint64_t i = 0; i < input.count; ++i)
+    {
+        uint32_t const index = input.indices[i];
+        if (!IsAABBOccluded(buffer, viewProj, LoadAABB(boxes, index)))
+        {
+            output.indices[output.count++] = index;
+        }
+    }
+}
+
+} // namespace sr::cull
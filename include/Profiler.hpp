@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "RenderDefinitions.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Frame profiler of the GL thread. Render passes open a CPU zone and every subpass a GL_TIME_ELAPSED
+// query, a pass takes the sum of its subpasses on the GPU. Queries are read PROFILER_LATENCY frames
+// later without waiting, a frame whose queries are not ready by then loses its GPU times.
+namespace sr::prof
+{
+
+constexpr uint32_t PROFILER_LATENCY = 3;
+constexpr uint32_t PROFILER_MAX_ZONES = 64;
+constexpr uint32_t PROFILER_MAX_QUERIES = 64;       //Per frame, subpasses past it are not timed on the GPU
+constexpr uint32_t PROFILER_MAX_DEPTH = 16;
+constexpr uint32_t PROFILER_HISTORY_SIZE = 256;     //Frames the averages and percentiles are computed over
+constexpr uint8_t PROFILER_FRAME_ZONE = 0;
+constexpr uint8_t PROFILER_INVALID_ZONE = UINT8_MAX;
+
+struct ProfilerZone
+{
+    ShortString name = {};
+    uint8_t parent = PROFILER_INVALID_ZONE;         //Render pass of a subpass zone
+    uint8_t subPasses[RENDER_PASS_MAX_SUBPASS] = {};
+    float cpuMs[PROFILER_LATENCY] = {};             //Accumulated over the frame of every slot
+    bool used[PROFILER_LATENCY] = {};
+    float cpuHistory[PROFILER_HISTORY_SIZE] = {};
+    float gpuHistory[PROFILER_HISTORY_SIZE] = {};
+    uint64_t historyCount = 0;
+};
+
+struct ProfilerFrame
+{
+    GLuint queries[PROFILER_MAX_QUERIES] = {};
+    uint8_t queryZones[PROFILER_MAX_QUERIES] = {};
+    uint32_t queryCount = 0;
+    uint64_t frame = 0;
+    bool pending = false;
+};
+
+struct ProfilerScope
+{
+    uint8_t zone = PROFILER_INVALID_ZONE;
+    std::chrono::high_resolution_clock::time_point start = {};
+};
+
+struct ProfilerZoneStats
+{
+    float cpuAverageMs = 0;
+    float cpuP50Ms = 0;
+    float cpuP95Ms = 0;
+    float cpuP99Ms = 0;
+    float gpuAverageMs = 0;
+    float gpuP50Ms = 0;
+    float gpuP95Ms = 0;
+    float gpuP99Ms = 0;
+    uint32_t sampleCount = 0;
+};
+
+struct Profiler
+{
+    bool initialized = false;
+    bool gpuEnabled = true;
+    ProfilerZone zones[PROFILER_MAX_ZONES] = {};
+    uint8_t zoneCount = 0;
+    ProfilerFrame frames[PROFILER_LATENCY] = {};
+    uint64_t frame = 0;
+    ProfilerScope scopes[PROFILER_MAX_DEPTH] = {};
+    uint32_t depth = 0;
+    uint8_t renderPass = PROFILER_INVALID_ZONE;     //Zone of the render pass being executed
+    bool queryActive = false;
+    uint64_t droppedFrames = 0;                     //Frames whose queries were not ready in time
+    std::ofstream csv;
+};
+
+inline Profiler g_profiler;
+
+namespace
+{
+
+uint8_t AddZone(char const *name, uint8_t length, uint8_t parent)
+{
+    if (g_profiler.zoneCount == PROFILER_MAX_ZONES)
+    {
+        return PROFILER_INVALID_ZONE;
+    }
+
+    ProfilerZone &zone = g_profiler.zones[g_profiler.zoneCount];
+    zone.name.length = std::min(length, static_cast<uint8_t>(SHORT_STRING_MAX_LENGTH - 1));
+    std::memcpy(zone.name.data, name, zone.name.length);
+    zone.name.data[zone.name.length] = '\0';
+    zone.parent = parent;
+    std::fill(std::begin(zone.subPasses), std::end(zone.subPasses), PROFILER_INVALID_ZONE);
+
+    return g_profiler.zoneCount++;
+}
+
+uint8_t FindZone(char const *name, uint8_t length)
+{
+    for (uint8_t i = 0; i < g_profiler.zoneCount; ++i)
+    {
+        ShortString const &zoneName = g_profiler.zones[i].name;
+        if (g_profiler.zones[i].parent == PROFILER_INVALID_ZONE && zoneName.length == length &&
+            std::memcmp(zoneName.data, name, length) == 0)
+        {
+            return i;
+        }
+    }
+
+    return AddZone(name, length, PROFILER_INVALID_ZONE);
+}
+
+uint8_t FindSubPassZone(uint8_t pass, uint8_t subPass)
+{
+    uint8_t &zone = g_profiler.zones[pass].subPasses[subPass];
+    if (zone == PROFILER_INVALID_ZONE)
+    {
+        char name[SHORT_STRING_MAX_LENGTH] = {};
+        ShortString const &passName = g_profiler.zones[pass].name;
+        uint8_t const length = std::min(passName.length, static_cast<uint8_t>(SHORT_STRING_MAX_LENGTH - 4));
+        std::memcpy(name, passName.data, length);
+        name[length + 0] = ' ';
+        name[length + 1] = '#';
+        name[length + 2] = static_cast<char>('0' + subPass);
+        zone = AddZone(name, length + 3, pass);
+    }
+
+    return zone;
+}
+
+void PushScope(uint8_t zone)
+{
+    assert(g_profiler.depth < PROFILER_MAX_DEPTH);
+    g_profiler.scopes[g_profiler.depth++] = ProfilerScope{zone, std::chrono::high_resolution_clock::now()};
+}
+
+void PopScope()
+{
+    assert(g_profiler.depth > 0);
+    ProfilerScope const &scope = g_profiler.scopes[--g_profiler.depth];
+    if (scope.zone == PROFILER_INVALID_ZONE)
+    {
+        return;
+    }
+
+    uint32_t const slot = g_profiler.frame % PROFILER_LATENCY;
+    ProfilerZone &zone = g_profiler.zones[scope.zone];
+    zone.cpuMs[slot] += std::chrono::duration<float, std::milli>(
+                            std::chrono::high_resolution_clock::now() - scope.start)
+                            .count();
+    zone.used[slot] = true;
+}
+
+// Moves the times of the frame in slot to the histories and the CSV, gpu is false for dropped frames
+void ResolveFrame(uint32_t slot, bool gpu)
+{
+    ProfilerFrame &frame = g_profiler.frames[slot];
+    float gpuMs[PROFILER_MAX_ZONES] = {};
+    for (uint32_t i = 0; gpu && i < frame.queryCount; ++i)
+    {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &ns);
+        float const ms = static_cast<float>(ns) * 1e-6f;
+        uint8_t const zone = frame.queryZones[i];
+        gpuMs[zone] += ms;
+        gpuMs[g_profiler.zones[zone].parent] += ms; //Queries are only issued for subpasses
+        gpuMs[PROFILER_FRAME_ZONE] += ms;
+    }
+
+    for (uint8_t i = 0; i < g_profiler.zoneCount; ++i)
+    {
+        ProfilerZone &zone = g_profiler.zones[i];
+        if (!zone.used[slot])
+        {
+            continue;
+        }
+
+        if (gpu)
+        {
+            uint32_t const index = zone.historyCount++ % PROFILER_HISTORY_SIZE;
+            zone.cpuHistory[index] = zone.cpuMs[slot];
+            zone.gpuHistory[index] = gpuMs[i];
+            if (g_profiler.csv.is_open())
+            {
+                g_profiler.csv << frame.frame << ",\"" << zone.name.data << "\"," << zone.cpuMs[slot] << ","
+                               << gpuMs[i] << "\n";
+            }
+        }
+        zone.cpuMs[slot] = 0;
+        zone.used[slot] = false;
+    }
+
+    frame.queryCount = 0;
+    frame.pending = false;
+}
+
+float GetPercentile(float const *samples, uint32_t count, float percentile)
+{
+    float sorted[PROFILER_HISTORY_SIZE];
+    std::copy(samples, samples + count, sorted);
+    uint32_t const index = std::min(count - 1, static_cast<uint32_t>(percentile * count));
+    std::nth_element(sorted, sorted + index, sorted + count);
+
+    return sorted[index];
+}
+
+} // namespace
+
+// Needs the GL context, zones opened before only measure the CPU
+inline void InitializeProfiler()
+{
+    assert(!g_profiler.initialized && g_profiler.zoneCount == 0);
+    for (ProfilerFrame &frame : g_profiler.frames)
+    {
+        glGenQueries(PROFILER_MAX_QUERIES, frame.queries);
+    }
+    AddZone("Frame", 5, PROFILER_INVALID_ZONE);
+    g_profiler.initialized = true;
+}
+
+inline void DeinitializeProfiler()
+{
+    for (ProfilerFrame &frame : g_profiler.frames)
+    {
+        glDeleteQueries(PROFILER_MAX_QUERIES, frame.queries);
+    }
+    g_profiler.csv.close();
+    g_profiler.initialized = false;
+}
+
+// Streams one row per zone and frame, the rows of a frame are written once its queries are read
+inline bool OpenProfilerCsv(char const *path)
+{
+    g_profiler.csv.open(path, std::ios::out | std::ios::trunc);
+    if (!g_profiler.csv.is_open())
+    {
+        std::cerr << "Failed to open profiler csv: " << path << std::endl;
+        return false;
+    }
+    g_profiler.csv << "frame,zone,cpu_ms,gpu_ms\n";
+
+    return true;
+}
+
+inline void CloseProfilerCsv()
+{
+    g_profiler.csv.close();
+}
+
+// Reads every finished frame, then reuses the oldest slot for the new frame
+inline void BeginProfilerFrame()
+{
+    assert(g_profiler.initialized && g_profiler.depth == 0);
+    for (uint64_t frame = g_profiler.frame - std::min<uint64_t>(g_profiler.frame, PROFILER_LATENCY);
+         frame < g_profiler.frame;
+         ++frame)
+    {
+        uint32_t const slot = frame % PROFILER_LATENCY;
+        ProfilerFrame const &pending = g_profiler.frames[slot];
+        if (!pending.pending)
+        {
+            continue;
+        }
+        GLint available = 1;
+        if (pending.queryCount > 0)
+        {
+            glGetQueryObjectiv(pending.queries[pending.queryCount - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        }
+        if (available == 0)
+        {
+            break;
+        }
+        ResolveFrame(slot, true);
+    }
+
+    uint32_t const slot = g_profiler.frame % PROFILER_LATENCY;
+    if (g_profiler.frames[slot].pending)
+    {
+        ResolveFrame(slot, false);
+        g_profiler.droppedFrames++;
+    }
+    g_profiler.frames[slot].frame = g_profiler.frame;
+    g_profiler.frames[slot].pending = true;
+
+    PushScope(PROFILER_FRAME_ZONE);
+}
+
+inline void EndProfilerFrame()
+{
+    PopScope();
+    assert(g_profiler.depth == 0);
+    g_profiler.frame++;
+}
+
+// CPU zones nest, they have to be closed in the reverse order
+inline void BeginProfilerZone(char const *name)
+{
+    PushScope(FindZone(name, static_cast<uint8_t>(std::strlen(name))));
+}
+
+inline void EndProfilerZone()
+{
+    PopScope();
+}
+
+inline void BeginRenderPassZone(ShortString const &name)
+{
+    g_profiler.renderPass = FindZone(name.data, name.length);
+    PushScope(g_profiler.renderPass);
+}
+
+inline void EndRenderPassZone()
+{
+    PopScope();
+    g_profiler.renderPass = PROFILER_INVALID_ZONE;
+}
+
+// GL_TIME_ELAPSED queries can not nest, a subpass inside an open query is only timed by its parent
+inline void BeginSubPassZone(uint8_t subPass)
+{
+    ProfilerFrame &frame = g_profiler.frames[g_profiler.frame % PROFILER_LATENCY];
+    if (!g_profiler.initialized || !g_profiler.gpuEnabled || g_profiler.queryActive ||
+        g_profiler.renderPass == PROFILER_INVALID_ZONE || frame.queryCount == PROFILER_MAX_QUERIES)
+    {
+        return;
+    }
+
+    uint8_t const zone = FindSubPassZone(g_profiler.renderPass, subPass);
+    if (zone == PROFILER_INVALID_ZONE)
+    {
+        return;
+    }
+    frame.queryZones[frame.queryCount] = zone;
+    glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.queryCount]);
+    g_profiler.zones[zone].used[g_profiler.frame % PROFILER_LATENCY] = true;
+    g_profiler.queryActive = true;
+}
+
+inline void EndSubPassZone()
+{
+    if (!g_profiler.queryActive)
+    {
+        return;
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    g_profiler.frames[g_profiler.frame % PROFILER_LATENCY].queryCount++;
+    g_profiler.queryActive = false;
+}
+
+// Rolling averages and percentiles over the last PROFILER_HISTORY_SIZE frames the zone was used in
+inline ProfilerZoneStats GetProfilerZoneStats(uint8_t zone)
+{
+    ProfilerZone const &source = g_profiler.zones[zone];
+    ProfilerZoneStats stats;
+    stats.sampleCount = static_cast<uint32_t>(std::min<uint64_t>(source.historyCount, PROFILER_HISTORY_SIZE));
+    if (stats.sampleCount == 0)
+    {
+        return stats;
+    }
+
+    for (uint32_t i = 0; i < stats.sampleCount; ++i)
+    {
+        stats.cpuAverageMs += source.cpuHistory[i];
+        stats.gpuAverageMs += source.gpuHistory[i];
+    }
+    stats.cpuAverageMs /= stats.sampleCount;
+    stats.gpuAverageMs /= stats.sampleCount;
+    stats.cpuP50Ms = GetPercentile(source.cpuHistory, stats.sampleCount, 0.50f);
+    stats.cpuP95Ms = GetPercentile(source.cpuHistory, stats.sampleCount, 0.95f);
+    stats.cpuP99Ms = GetPercentile(source.cpuHistory, stats.sampleCount, 0.99f);
+    stats.gpuP50Ms = GetPercentile(source.gpuHistory, stats.sampleCount, 0.50f);
+    stats.gpuP95Ms = GetPercentile(source.gpuHistory, stats.sampleCount, 0.95f);
+    stats.gpuP99Ms = GetPercentile(source.gpuHistory, stats.sampleCount, 0.99f);
+
+    return stats;
+}
+
+} // namespace sr::prof
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "Input.hpp"
+#include "Math.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+// Binary session recordings. Every frame stores the camera and the keys that are not NONE,
+// the settings are only stored in the frames they changed in.
+//   RecordingHeader
+//   per frame: RecordedFrameHeader, keyCount RecordedKey, RecordedSettings if settingsChanged
+constexpr char RECORDING_MAGIC[4] = {'S', 'R', 'R', 'C'};
+constexpr uint32_t RECORDING_VERSION = 2;
+
+struct RecordingHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t width;  //Framebuffer size the session was recorded at
+    uint32_t height;
+};
+static_assert(std::is_pod<RecordingHeader>::value, "RecordingHeader must be a POD type.");
+
+// Only 32 bit fields so that memcmp can compare them
+struct RecordedSettings
+{
+    uint32_t renderMode;
+    uint32_t directLightEnabled;
+    uint32_t shadowMappingEnabled;
+    uint32_t pointLightEnabled;
+    uint32_t bumpMappingEnabled;
+    uint32_t toneMappingEnabled;
+    uint32_t taaEnabled;
+    uint32_t taaJitterEnabled;
+    uint32_t drawAABBs;
+    uint32_t drawUi;
+    uint32_t frustumCulling;
+    uint32_t bvhCulling;
+    uint32_t occlusionCulling;
+    uint32_t commandBuffers;
+    uint32_t shadowCascadeCount;
+    uint32_t sampleDistribution;
+    uint32_t shadowCache;
+    uint32_t renderGraphAliasing;
+    uint32_t pipelinedSimulation;
+    uint32_t dynamicResolution;
+    uint32_t targetFormats;
+    uint32_t velocityMode;
+    uint32_t lightingPath;
+    uint32_t ambientOcclusion;
+    uint32_t generatedPointLightCount; //The scene is built with it, only the first frame's value is used
+    uint32_t clusteredLighting;
+    uint32_t textureSupersampling;
+    uint32_t taaComputeResolve;
+    uint32_t autoExposure;
+    float shadowCascadeSplitLambda;
+    float ambientLightRadiantFlux;
+    float directLightRadiantFlux;
+    float pointLightRadiantFlux;
+    float bumpMapScaleFactor;
+    float depthBiasScale;
+    float depthUnitScale;
+    float exposureAdaptationRate;
+    float exposureCompensation;
+};
+static_assert(std::is_pod<RecordedSettings>::value, "RecordedSettings must be a POD type.");
+
+struct RecordedFrameHeader
+{
+    float cameraPos[3];
+    float cameraXWorldAngle;
+    float cameraYWorldAngle;
+    float cameraSpeed;
+    uint16_t keyCount;
+    uint16_t settingsChanged;
+};
+static_assert(std::is_pod<RecordedFrameHeader>::value, "RecordedFrameHeader must be a POD type.");
+
+struct RecordedKey
+{
+    uint16_t key;
+    uint8_t action;
+};
+
+struct RecordedFrame
+{
+    sr::math::Vec3 cameraPos = {};
+    float cameraXWorldAngle = 0;
+    float cameraYWorldAngle = 0;
+    float cameraSpeed = 0;
+    sr::input::Inputs inputs = {};
+    RecordedSettings settings = {};
+};
+
+struct InputRecorder
+{
+    std::ofstream file;
+    RecordedSettings settings = {};
+    uint64_t frameCount = 0;
+};
+
+struct InputReplay
+{
+    RecordingHeader header = {};
+    std::vector<uint8_t> data;
+    uint64_t cursor = 0;
+    RecordedSettings settings = {};
+    uint64_t frameCount = 0;
+};
+
+bool OpenInputRecording(InputRecorder &recorder, char const *path, uint32_t width, uint32_t height)
+{
+    recorder.file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!recorder.file.is_open())
+    {
+        std::cerr << "Failed to open recording: " << path << std::endl;
+        return false;
+    }
+
+    RecordingHeader header;
+    std::memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+    header.version = RECORDING_VERSION;
+    header.width = width;
+    header.height = height;
+    recorder.file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    recorder.frameCount = 0;
+
+    return true;
+}
+
+void RecordFrame(InputRecorder &recorder, RecordedFrame const &frame)
+{
+    RecordedKey keys[static_cast<uint32_t>(sr::input::Keys::Count)];
+    uint16_t keyCount = 0;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(sr::input::Keys::Count); ++i)
+    {
+        if (frame.inputs.keys[i] != sr::input::KeyAction::NONE)
+        {
+            keys[keyCount++] = RecordedKey{static_cast<uint16_t>(i), static_cast<uint8_t>(frame.inputs.keys[i])};
+        }
+    }
+
+    RecordedFrameHeader header;
+    header.cameraPos[0] = frame.cameraPos.x;
+    header.cameraPos[1] = frame.cameraPos.y;
+    header.cameraPos[2] = frame.cameraPos.z;
+    header.cameraXWorldAngle = frame.cameraXWorldAngle;
+    header.cameraYWorldAngle = frame.cameraYWorldAngle;
+    header.cameraSpeed = frame.cameraSpeed;
+    header.keyCount = keyCount;
+    header.settingsChanged =
+        recorder.frameCount == 0 || std::memcmp(&recorder.settings, &frame.settings, sizeof(RecordedSettings)) != 0;
+
+    recorder.file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    for (uint16_t i = 0; i < keyCount; ++i)
+    {
+        recorder.file.write(reinterpret_cast<char const *>(&keys[i].key), sizeof(keys[i].key));
+        recorder.file.write(reinterpret_cast<char const *>(&keys[i].action), sizeof(keys[i].action));
+    }
+    if (header.settingsChanged)
+    {
+        recorder.file.write(reinterpret_cast<char const *>(&frame.settings), sizeof(RecordedSettings));
+        recorder.settings = frame.settings;
+    }
+    recorder.frameCount++;
+}
+
+void CloseInputRecording(InputRecorder &recorder)
+{
+    recorder.file.close();
+}
+
+bool OpenInputReplay(InputReplay &replay, char const *path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to open recording: " << path << std::endl;
+        return false;
+    }
+    replay.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    if (replay.data.size() < sizeof(RecordingHeader))
+    {
+        std::cerr << "Recording is too short: " << path << std::endl;
+        return false;
+    }
+    std::memcpy(&replay.header, replay.data.data(), sizeof(RecordingHeader));
+    if (std::memcmp(replay.header.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0 ||
+        replay.header.version != RECORDING_VERSION)
+    {
+        std::cerr << "Unsupported recording: " << path << std::endl;
+        return false;
+    }
+    replay.cursor = sizeof(RecordingHeader);
+    replay.frameCount = 0;
+
+    return true;
+}
+
+// Returns false at the end of the recording or if the rest of it is truncated
+bool ReadRecordedFrame(InputReplay &replay, RecordedFrame &frame)
+{
+    auto read = [&replay](void *destination, uint64_t size) {
+        if (replay.cursor + size > replay.data.size())
+        {
+            return false;
+        }
+        std::memcpy(destination, replay.data.data() + replay.cursor, size);
+        replay.cursor += size;
+        return true;
+    };
+
+    RecordedFrameHeader header;
+    if (!read(&header, sizeof(header)))
+    {
+        return false;
+    }
+
+    frame.cameraPos = {header.cameraPos[0], header.cameraPos[1], header.cameraPos[2]};
+    frame.cameraXWorldAngle = header.cameraXWorldAngle;
+    frame.cameraYWorldAngle = header.cameraYWorldAngle;
+    frame.cameraSpeed = header.cameraSpeed;
+    frame.inputs = {};
+    for (uint16_t i = 0; i < header.keyCount; ++i)
+    {
+        RecordedKey key;
+        if (!read(&key.key, sizeof(key.key)) || !read(&key.action, sizeof(key.action)) ||
+            key.key >= static_cast<uint32_t>(sr::input::Keys::Count) ||
+            key.action >= static_cast<uint8_t>(sr::input::KeyAction::Count))
+        {
+            return false;
+        }
+        frame.inputs.keys[key.key] = static_cast<sr::input::KeyAction>(key.action);
+    }
+    if (header.settingsChanged && !read(&replay.settings, sizeof(RecordedSettings)))
+    {
+        return false;
+    }
+    if (replay.frameCount == 0 && !header.settingsChanged)
+    {
+        return false; //The first frame always has the settings
+    }
+    frame.settings = replay.settings;
+    replay.frameCount++;
+
+    return true;
+}
+
+// Reads the settings of the first frame without consuming it, for the ones that are needed before the scene loads
+bool PeekRecordedSettings(InputReplay &replay, RecordedSettings &settings)
+{
+    uint64_t const cursor = replay.cursor;
+    uint64_t const frameCount = replay.frameCount;
+    RecordedSettings const current = replay.settings;
+
+    RecordedFrame frame;
+    bool const read = ReadRecordedFrame(replay, frame);
+    settings = frame.settings;
+
+    replay.cursor = cursor;
+    replay.frameCount = frameCount;
+    replay.settings = current;
+
+    return read;
+}
@@ -38,8 +38,24 @@ MessageCallback(GLenum source,
 
 } // namespace
 
-GLFWwindow *InitializeGLFW(uint32_t width, uint32_t height)
+#ifndef GLFW_PLATFORM_NULL
+#error "GLFW 3.4 or later is required for the null platform of --headless"
+#endif
+
+// A headless window is never shown and does not wait for vsync. It does not need a display server,
+// the context is created with OSMesa (Mesa llvmpipe) on the null platform of GLFW.
+// There is no fallback to a hidden window, a headless run fails if the null platform does not work.
+GLFWwindow *InitializeGLFW(uint32_t width, uint32_t height, bool headless)
 {
+    if (headless)
+    {
+        if (!glfwPlatformSupported(GLFW_PLATFORM_NULL))
+        {
+            std::cerr << "Failed to init GLFW: the null platform is not supported" << std::endl;
+            return nullptr;
+        }
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    }
     if (!glfwInit())
     {
         std::cerr << "Failed to init GLFW" << std::endl;
@@ -48,17 +64,30 @@ GLFWwindow *InitializeGLFW(uint32_t width, uint32_t height)
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    if (headless)
+    {
+        //Mesa only exposes 4.6 in the core profile
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+    }
 
     GLFWwindow *window = glfwCreateWindow(width, height, "Simple Renderer", nullptr, nullptr);
     if (!window)
     {
-        std::cerr << "Failed to create window" << std::endl;
+        std::cerr << (headless ? "Failed to create an OSMesa context, is libOSMesa installed?"
+                               : "Failed to create window")
+                  << std::endl;
         glfwTerminate();
         return nullptr;
     }
 
     glfwMakeContextCurrent(window);
     glbinding::Binding::initialize(glfwGetProcAddress);
+    if (headless)
+    {
+        glfwSwapInterval(0);
+    }
 
     return window;
 }
@@ -138,6 +138,7 @@ struct ShaderProgram
     PerModleUniformBindings perModelUniformBindings;
     GLuint vertexShaderHandle;
     GLuint fragmentShaderHandle;
+    GLuint computeShaderHandle;
     GLuint handle;
 };
 static_assert(std::is_pod<ShaderProgram>::value, "ShaderProgram must be a POD type.");
@@ -168,9 +169,21 @@ struct Texture2DDescriptor
     float maxAnisatropy = 1.f;
 };
 
+// Sampling state of a sampler object, it overrides the state of the texture bound to the same unit
+struct SamplerDescriptor
+{
+    GLenum sWrap = GL_REPEAT;
+    GLenum tWrap = GL_REPEAT;
+    GLenum minFilter = GL_LINEAR;
+    GLenum magFilter = GL_LINEAR;
+    float maxAnisatropy = 1.f;
+    float lodBias = 0.f;
+};
+
 static const uint8_t RENDER_PASS_MAX_SUBPASS = 4;
 static const uint8_t RENDER_PASS_MAX_DEPENDENCIES = 8;
 static const uint8_t RENDER_PASS_MAX_ATTACHMENTS = 8;
+constexpr uint32_t RENDER_MODEL_TEXTURE_COUNT = 5; //Albedo, normal, bump, metallic and roughness
 
 struct SubPassDependencyDescriptor
 {
@@ -184,6 +197,7 @@ struct SubPassAttachmentDescriptor
     GLenum attachment;
     GLenum texture;
     GLuint handle;
+    GLint layer; //Only used by GL_TEXTURE_2D_ARRAY attachments
 };
 
 struct SubPassDescriptor
@@ -193,6 +207,7 @@ struct SubPassDescriptor
 
     uint8_t dependencyCount;
     uint8_t attachmentCount;
+    GLuint modelSampler; //Bound to the model texture units when not 0, see BindRenderModelSamplers
 
     bool enableWriteToDepth;
     bool enableClearDepthBuffer;
@@ -235,38 +250,18 @@ struct RenderPass
 };
 static_assert(std::is_pod<RenderPass>::value, "RenderPass must be a POD type.");
 
-struct DeferredPipelineShaderPrograms
-{
-    ShaderProgram depthPrePass;
-    ShaderProgram gBufferPass;
-    ShaderProgram lighting;
-    ShaderProgram debug;
-};
-
-constexpr uint8_t DefferPipelinePassCount = 4;
-struct DeferredPipeline
-{
-    union {
-        RenderPass passes[DefferPipelinePassCount];
-
-        struct
-        {
-            RenderPass depthPrePass;
-            RenderPass gBufferPass;
-            RenderPass lighting;
-            RenderPass debug;
-        };
-    };
-};
-static_assert((int)sizeof(DeferredPipeline) - (int)sizeof(DeferredPipeline::passes) == 0,
-              "Number of named and unnamed render passes must be equal!");
-static_assert(std::is_pod<DeferredPipeline>::value, "DeferredPipeline must be a POD type.");
+constexpr uint8_t SHADOW_CASCADE_MAX_COUNT = 4;
+constexpr int32_t SHADOW_CASCADE_RESOLUTION = 2048;
 
 struct ForwardPipelineShaderPrograms
 {
     ShaderProgram depthPrePass;
-    ShaderProgram shadowMapping;
+    ShaderProgram shadowMapping[SHADOW_CASCADE_MAX_COUNT];
+    ShaderProgram ambientOcclusion;
+    ShaderProgram ambientOcclusionUpsample;
+    ShaderProgram gBuffer;
     ShaderProgram lighting;
+    ShaderProgram deferredLighting;
     ShaderProgram transparent;
     ShaderProgram velocity;
     ShaderProgram taa;
@@ -274,7 +269,7 @@ struct ForwardPipelineShaderPrograms
     ShaderProgram debug;
 };
 
-constexpr uint8_t ForwardPipelinePassCount = 8;
+constexpr uint8_t ForwardPipelinePassCount = 11 + SHADOW_CASCADE_MAX_COUNT;
 struct ForwardPipeline
 {
     union {
@@ -283,8 +278,12 @@ struct ForwardPipeline
         struct
         {
             RenderPass depthPrePass;
-            RenderPass shadowMapping;
-            RenderPass lighting;
+            RenderPass shadowMapping[SHADOW_CASCADE_MAX_COUNT]; //One layer of the shadow map array each
+            RenderPass ambientOcclusion;         //At a fraction of the scene resolution
+            RenderPass ambientOcclusionUpsample; //Back to the scene resolution, read by the lighting passes
+            RenderPass gBuffer;          //Deferred lighting path only
+            RenderPass lighting;         //Forward lighting path only
+            RenderPass deferredLighting; //Deferred lighting path only
             RenderPass transparent;
             RenderPass velocity;
             RenderPass taa;
@@ -301,6 +300,7 @@ struct TAABuffer
 {
     sr::math::Matrix4x4 projUnjit = sr::math::CreateIdentityMatrix();
     sr::math::Matrix4x4 prevProjUnjit = sr::math::CreateIdentityMatrix();
+    sr::math::Matrix4x4 invProjUnjit = sr::math::CreateIdentityMatrix();
     std::vector<sr::math::Matrix4x4> prevModels;
     sr::math::Vec2 jitter = {};
     uint32_t count = 0;
@@ -310,6 +310,8 @@ struct Camera
 {
     sr::math::Matrix4x4 proj = sr::math::CreateIdentityMatrix();
     sr::math::Matrix4x4 view = sr::math::CreateIdentityMatrix();
+    sr::math::Matrix4x4 invProj = sr::math::CreateIdentityMatrix(); //For positions reconstructed from depth
+    sr::math::Matrix4x4 invView = sr::math::CreateIdentityMatrix();
     sr::math::Vec3 pos = {};
     float xWorldAngle = 0;
     float yWorldAngle = 0;
@@ -333,8 +335,10 @@ struct RenderModel
     sr::math::Matrix4x4 model = sr::math::CreateIdentityMatrix();
     sr::math::Vec3 color = {0.5f, 0.5f, 0.5f};
     sr::math::Vec3 center = {};
+    sr::geo::AABB localAabb = {};
     sr::geo::AABB aabb = {};
     GLuint debugRenderModel = 0; //This model is for debug rendering only
+    bool isDynamic = false; //Model matrix may change between frames
     //ToDo: Better material system is needed
     GLuint brdf = 0;
 };
@@ -350,6 +354,7 @@ struct RenderModelCreateInfo
     sr::math::Vec3 scale = {1, 1, 1};
     sr::math::Vec3 color;
     GLuint debugRenderModel;
+    bool isDynamic = false;
 };
 
 struct OrthographicFrustum
@@ -372,6 +377,17 @@ struct DirectionalLightSource
     float radiantFlux = 1.5f;
 };
 
+// Orthographic projections of the directional light fitted to slices of the camera frustum
+struct ShadowCascades
+{
+    sr::math::Matrix4x4 projections[SHADOW_CASCADE_MAX_COUNT] = {};
+    sr::math::Matrix4x4 viewProjections[SHADOW_CASCADE_MAX_COUNT] = {};
+    float splits[SHADOW_CASCADE_MAX_COUNT] = {}; //View space distance to the far plane of every cascade
+    float densityGains[SHADOW_CASCADE_MAX_COUNT] = {}; //Texel density relative to the bounding sphere fit
+    sr::math::Matrix4x4 viewToLight = {};
+    uint32_t count = 3;
+};
+
 template <typename T>
 struct SmallStackArray
 {
@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "RenderDefinitions.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+
+// Passes declare the render targets they read and write, CompileRenderGraph sorts them, culls the
+// passes nothing reads from and assigns the targets to textures. Targets of the same format whose
+// lifetimes do not overlap share one texture.
+GLuint CreateDepthTexture(uint32_t width, uint32_t height);
+GLuint CreateDepthTextureArray(uint32_t width, uint32_t height, uint32_t layers);
+GLuint CreateLinearColorAttachment(int32_t width, int32_t height, GLenum internalFormat);
+GLuint CreatePointColorAttachment(int32_t width, int32_t height, GLenum internalFormat);
+
+constexpr uint8_t RENDER_GRAPH_MAX_PASSES = 16;
+constexpr uint8_t RENDER_GRAPH_MAX_RESOURCES = 16;
+constexpr uint8_t RENDER_GRAPH_MAX_PASS_RESOURCES = 8;
+constexpr uint8_t RENDER_GRAPH_INVALID_INDEX = UINT8_MAX;
+
+enum class eRenderGraphFormat : uint8_t
+{
+    LinearColor, //Color with linear filtering, the internal format is RenderGraphResource::colorFormat
+    PointColor,  //Color with nearest filtering
+    Depth,
+    DepthArray,
+};
+
+struct RenderGraphResource
+{
+    ShortString name;
+    eRenderGraphFormat format;
+    GLenum colorFormat; //GL_RGBA32F unless the pipeline sets a smaller one
+    int32_t width;
+    int32_t height;
+    int32_t layers;
+    bool persistent; //Keeps its content between frames or is read outside of the graph, never aliased
+    bool output;     //Read after the last pass, the passes writing it are never culled
+
+    //Filled by CompileRenderGraph
+    bool used;
+    uint8_t firstUse; //Positions in RenderGraph::order
+    uint8_t lastUse;
+    uint8_t texture;  //Index into RenderGraph::textures
+};
+static_assert(std::is_pod<RenderGraphResource>::value, "RenderGraphResource must be a POD type.");
+
+struct RenderGraphPass
+{
+    ShortString name;
+    uint8_t reads[RENDER_GRAPH_MAX_PASS_RESOURCES];
+    uint8_t writes[RENDER_GRAPH_MAX_PASS_RESOURCES];
+    uint8_t readCount;
+    uint8_t writeCount;
+
+    bool active; //Filled by CompileRenderGraph
+};
+static_assert(std::is_pod<RenderGraphPass>::value, "RenderGraphPass must be a POD type.");
+
+struct RenderGraphTexture
+{
+    eRenderGraphFormat format;
+    GLenum colorFormat;
+    int32_t width;
+    int32_t height;
+    int32_t layers;
+    bool persistent;
+    uint8_t lastUse;
+    GLuint handle;
+};
+static_assert(std::is_pod<RenderGraphTexture>::value, "RenderGraphTexture must be a POD type.");
+
+struct RenderGraph
+{
+    RenderGraphResource resources[RENDER_GRAPH_MAX_RESOURCES];
+    RenderGraphPass passes[RENDER_GRAPH_MAX_PASSES];
+    RenderGraphTexture textures[RENDER_GRAPH_MAX_RESOURCES];
+    uint8_t order[RENDER_GRAPH_MAX_PASSES]; //Active passes in execution order
+    uint8_t resourceCount;
+    uint8_t passCount;
+    uint8_t textureCount;
+    uint8_t orderCount;
+
+    uint64_t memoryBytes;          //All textures of the compiled graph
+    uint64_t unaliasedMemoryBytes; //Same resources with a texture each
+};
+static_assert(std::is_pod<RenderGraph>::value, "RenderGraph must be a POD type.");
+
+namespace
+{
+
+ShortString CreateShortString(char const *str)
+{
+    ShortString result = {};
+    result.length = static_cast<uint8_t>(std::min<size_t>(std::strlen(str), SHORT_STRING_MAX_LENGTH));
+    std::memcpy(result.data, str, result.length);
+
+    return result;
+}
+
+uint64_t GetColorFormatTexelSize(GLenum colorFormat)
+{
+    switch (colorFormat)
+    {
+    case GL_RGBA32F:
+        return 16;
+    case GL_RGBA16F:
+    case GL_RGBA16_SNORM:
+        return 8;
+    case GL_R11F_G11F_B10F:
+    case GL_RG16F:
+    case GL_RGBA8:
+    case GL_SRGB8_ALPHA8:
+        return 4;
+    case GL_R8:
+        return 1;
+    default:
+        assert(false && "Unknown render target format");
+        return 16;
+    }
+}
+
+uint64_t GetRenderGraphTextureSize(
+    eRenderGraphFormat format, GLenum colorFormat, int32_t width, int32_t height, int32_t layers)
+{
+    uint64_t const texelSize = format == eRenderGraphFormat::LinearColor || format == eRenderGraphFormat::PointColor
+                                   ? GetColorFormatTexelSize(colorFormat)
+                                   : sizeof(float);
+
+    return texelSize * width * height * layers;
+}
+
+bool IsRenderGraphPassReading(RenderGraphPass const &pass, uint8_t resource)
+{
+    return std::find(pass.reads, pass.reads + pass.readCount, resource) != pass.reads + pass.readCount;
+}
+
+bool IsRenderGraphPassWriting(RenderGraphPass const &pass, uint8_t resource)
+{
+    return std::find(pass.writes, pass.writes + pass.writeCount, resource) != pass.writes + pass.writeCount;
+}
+
+// Writers of a resource run in the declaration order, all of them before its readers
+bool IsRenderGraphPassDependent(RenderGraph const &graph, uint8_t pass, uint8_t dependency)
+{
+    if (pass == dependency)
+    {
+        return false;
+    }
+
+    RenderGraphPass const &p = graph.passes[pass];
+    RenderGraphPass const &d = graph.passes[dependency];
+    for (uint8_t i = 0; i < d.writeCount; ++i)
+    {
+        uint8_t const resource = d.writes[i];
+        if (IsRenderGraphPassReading(p, resource) && !IsRenderGraphPassWriting(p, resource))
+        {
+            return true;
+        }
+        if (IsRenderGraphPassWriting(p, resource) && dependency < pass)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Kahn's algorithm, ties are broken by the declaration order
+bool SortRenderGraphPasses(RenderGraph const &graph, uint8_t (&sorted)[RENDER_GRAPH_MAX_PASSES])
+{
+    uint8_t dependencyCounts[RENDER_GRAPH_MAX_PASSES] = {};
+    for (uint8_t i = 0; i < graph.passCount; ++i)
+    {
+        for (uint8_t j = 0; j < graph.passCount; ++j)
+        {
+            dependencyCounts[i] += IsRenderGraphPassDependent(graph, i, j) ? 1 : 0;
+        }
+    }
+
+    bool scheduled[RENDER_GRAPH_MAX_PASSES] = {};
+    for (uint8_t count = 0; count < graph.passCount; ++count)
+    {
+        uint8_t next = RENDER_GRAPH_INVALID_INDEX;
+        for (uint8_t i = 0; i < graph.passCount && next == RENDER_GRAPH_INVALID_INDEX; ++i)
+        {
+            next = !scheduled[i] && dependencyCounts[i] == 0 ? i : next;
+        }
+        if (next == RENDER_GRAPH_INVALID_INDEX)
+        {
+            return false;
+        }
+
+        scheduled[next] = true;
+        sorted[count] = next;
+        for (uint8_t i = 0; i < graph.passCount; ++i)
+        {
+            dependencyCounts[i] -= IsRenderGraphPassDependent(graph, i, next) ? 1 : 0;
+        }
+    }
+
+    return true;
+}
+
+} // namespace
+
+uint8_t AddRenderGraphResource(
+    RenderGraph &graph, char const *name, eRenderGraphFormat format, int32_t width, int32_t height, int32_t layers = 1)
+{
+    assert(graph.resourceCount < RENDER_GRAPH_MAX_RESOURCES);
+
+    RenderGraphResource &resource = graph.resources[graph.resourceCount];
+    resource = {};
+    resource.name = CreateShortString(name);
+    resource.format = format;
+    resource.colorFormat = GL_RGBA32F;
+    resource.width = width;
+    resource.height = height;
+    resource.layers = layers;
+    resource.texture = RENDER_GRAPH_INVALID_INDEX;
+
+    return graph.resourceCount++;
+}
+
+uint8_t AddRenderGraphPass(
+    RenderGraph &graph, char const *name, std::initializer_list<uint8_t> reads, std::initializer_list<uint8_t> writes)
+{
+    assert(graph.passCount < RENDER_GRAPH_MAX_PASSES);
+    assert(reads.size() <= RENDER_GRAPH_MAX_PASS_RESOURCES);
+    assert(writes.size() <= RENDER_GRAPH_MAX_PASS_RESOURCES);
+
+    RenderGraphPass &pass = graph.passes[graph.passCount];
+    pass = {};
+    pass.name = CreateShortString(name);
+    std::copy(reads.begin(), reads.end(), pass.reads);
+    std::copy(writes.begin(), writes.end(), pass.writes);
+    pass.readCount = static_cast<uint8_t>(reads.size());
+    pass.writeCount = static_cast<uint8_t>(writes.size());
+
+    return graph.passCount++;
+}
+
+// For inputs that only some configurations of a pass read
+void AddRenderGraphPassRead(RenderGraph &graph, uint8_t pass, uint8_t resource)
+{
+    assert(graph.passes[pass].readCount < RENDER_GRAPH_MAX_PASS_RESOURCES);
+
+    RenderGraphPass &p = graph.passes[pass];
+    p.reads[p.readCount++] = resource;
+}
+
+void CompileRenderGraph(RenderGraph &graph, bool aliasing)
+{
+    uint8_t sorted[RENDER_GRAPH_MAX_PASSES] = {};
+    if (!SortRenderGraphPasses(graph, sorted))
+    {
+        std::cerr << "Render graph has a cycle, the passes run in the declaration order!" << std::endl;
+        for (uint8_t i = 0; i < graph.passCount; ++i)
+        {
+            sorted[i] = i;
+        }
+    }
+
+    //Walking back from the outputs, a pass is kept if a kept pass or the output reads what it writes
+    bool needed[RENDER_GRAPH_MAX_RESOURCES] = {};
+    for (uint8_t i = 0; i < graph.resourceCount; ++i)
+    {
+        needed[i] = graph.resources[i].output;
+    }
+    for (uint8_t i = graph.passCount; i-- > 0;)
+    {
+        RenderGraphPass &pass = graph.passes[sorted[i]];
+        pass.active = false;
+        for (uint8_t j = 0; j < pass.writeCount; ++j)
+        {
+            pass.active = pass.active || needed[pass.writes[j]];
+        }
+        for (uint8_t j = 0; j < pass.readCount && pass.active; ++j)
+        {
+            needed[pass.reads[j]] = true;
+        }
+    }
+
+    graph.orderCount = 0;
+    for (uint8_t i = 0; i < graph.resourceCount; ++i)
+    {
+        graph.resources[i].used = false;
+        graph.resources[i].texture = RENDER_GRAPH_INVALID_INDEX;
+    }
+    for (uint8_t i = 0; i < graph.passCount; ++i)
+    {
+        RenderGraphPass const &pass = graph.passes[sorted[i]];
+        if (!pass.active)
+        {
+            continue;
+        }
+
+        uint8_t const position = graph.orderCount++;
+        graph.order[position] = sorted[i];
+        auto const use = [&graph, position](uint8_t index) {
+            RenderGraphResource &resource = graph.resources[index];
+            resource.firstUse = resource.used ? resource.firstUse : position;
+            resource.lastUse = position;
+            resource.used = true;
+        };
+        std::for_each(pass.reads, pass.reads + pass.readCount, use);
+        std::for_each(pass.writes, pass.writes + pass.writeCount, use);
+    }
+
+    //Resources are placed in the order they are first used, a texture is reused once its last user ran
+    uint8_t byFirstUse[RENDER_GRAPH_MAX_RESOURCES] = {};
+    for (uint8_t i = 0; i < graph.resourceCount; ++i)
+    {
+        byFirstUse[i] = i;
+        RenderGraphResource &resource = graph.resources[i];
+        resource.lastUse = resource.output ? graph.orderCount : resource.lastUse;
+    }
+    std::stable_sort(byFirstUse, byFirstUse + graph.resourceCount, [&graph](uint8_t a, uint8_t b) {
+        return graph.resources[a].firstUse < graph.resources[b].firstUse;
+    });
+
+    graph.textureCount = 0;
+    graph.memoryBytes = 0;
+    graph.unaliasedMemoryBytes = 0;
+    for (uint8_t i = 0; i < graph.resourceCount; ++i)
+    {
+        RenderGraphResource &resource = graph.resources[byFirstUse[i]];
+        if (!resource.used)
+        {
+            continue;
+        }
+
+        uint64_t const size = GetRenderGraphTextureSize(
+            resource.format, resource.colorFormat, resource.width, resource.height, resource.layers);
+        graph.unaliasedMemoryBytes += size;
+
+        for (uint8_t t = 0; t < graph.textureCount && aliasing && !resource.persistent; ++t)
+        {
+            RenderGraphTexture &texture = graph.textures[t];
+            if (!texture.persistent && texture.lastUse < resource.firstUse && texture.format == resource.format &&
+                texture.colorFormat == resource.colorFormat && texture.width == resource.width && texture.height == resource.height &&
+                texture.layers == resource.layers)
+            {
+                texture.lastUse = resource.lastUse;
+                resource.texture = t;
+                break;
+            }
+        }
+
+        if (resource.texture == RENDER_GRAPH_INVALID_INDEX)
+        {
+            RenderGraphTexture &texture = graph.textures[graph.textureCount];
+            texture = {};
+            texture.format = resource.format;
+            texture.colorFormat = resource.colorFormat;
+            texture.width = resource.width;
+            texture.height = resource.height;
+            texture.layers = resource.layers;
+            texture.persistent = resource.persistent;
+            texture.lastUse = resource.lastUse;
+            resource.texture = graph.textureCount++;
+            graph.memoryBytes += size;
+        }
+    }
+}
+
+void CreateRenderGraphTextures(RenderGraph &graph)
+{
+    for (uint8_t i = 0; i < graph.textureCount; ++i)
+    {
+        RenderGraphTexture &texture = graph.textures[i];
+        switch (texture.format)
+        {
+        case eRenderGraphFormat::LinearColor:
+            texture.handle = CreateLinearColorAttachment(texture.width, texture.height, texture.colorFormat);
+            break;
+        case eRenderGraphFormat::PointColor:
+            texture.handle = CreatePointColorAttachment(texture.width, texture.height, texture.colorFormat);
+            break;
+        case eRenderGraphFormat::Depth:
+            texture.handle = CreateDepthTexture(texture.width, texture.height);
+            break;
+        case eRenderGraphFormat::DepthArray:
+            texture.handle = CreateDepthTextureArray(texture.width, texture.height, texture.layers);
+            break;
+        }
+    }
+}
+
+// Zero for resources no active pass uses
+GLuint GetRenderGraphTexture(RenderGraph const &graph, uint8_t resource)
+{
+    uint8_t const texture = graph.resources[resource].texture;
+    return texture != RENDER_GRAPH_INVALID_INDEX ? graph.textures[texture].handle : 0;
+}
+
+// Zero unless the pass declared the read, so an undeclared input never sees an aliased texture
+GLuint GetRenderGraphPassInput(RenderGraph const &graph, uint8_t pass, uint8_t resource)
+{
+    return IsRenderGraphPassReading(graph.passes[pass], resource) ? GetRenderGraphTexture(graph, resource) : 0;
+}
+
+void DeleteRenderGraph(RenderGraph &graph)
+{
+    for (uint8_t i = 0; i < graph.textureCount; ++i)
+    {
+        glDeleteTextures(1, &graph.textures[i].handle);
+    }
+    graph.textureCount = 0;
+}
@@ -41,11 +41,29 @@ std::vector<uint32_t> CreateBuffers(std::vector<BufferDescriptor> const &bufferD
 
 } // namespace
 
-RenderModel CreateRenderModel(RenderModelCreateInfo const &createInfo)
+// Everything but the GL objects and the bounds, cheap enough to run on the main thread up front
+RenderModel InitializeRenderModel(RenderModelCreateInfo const &createInfo)
 {
     RenderModel renderModel;
     renderModel.indexCount = createInfo.indexBufferDescriptor->count;
 
+    renderModel.model = sr::math::CreateTranslationMatrix(createInfo.position) *
+                        sr::math::CreateRotationMatrixZ(createInfo.orientation.z) *
+                        sr::math::CreateRotationMatrixY(createInfo.orientation.y) *
+                        sr::math::CreateRotationMatrixX(createInfo.orientation.x) *
+                        sr::math::CreateScaleMatrix(createInfo.scale);
+    renderModel.color = createInfo.color;
+
+    renderModel.debugRenderModel = createInfo.debugRenderModel;
+    renderModel.isDynamic = createInfo.isDynamic;
+    renderModel.brdf = createInfo.material->brdf == "marbel" ? 0 : 1;
+
+    return renderModel;
+}
+
+// Issues GL calls, has to run on the main thread. Leaves the vertex array object bound.
+void CreateRenderModelBuffers(RenderModel &renderModel, RenderModelCreateInfo const &createInfo)
+{
     renderModel.vbos = ::CreateBuffers(*createInfo.vertexBufferDescriptors);
 
     glGenVertexArrays(1, &renderModel.vertexArrayObject);
@@ -78,20 +96,23 @@ RenderModel CreateRenderModel(RenderModelCreateInfo const &createInfo)
     {
         renderModel.roughnessTexture = CreateMipMappedTexture(*createInfo.material->roughness);
     }
+}
 
-    renderModel.model = sr::math::CreateTranslationMatrix(createInfo.position) *
-                        sr::math::CreateRotationMatrixZ(createInfo.orientation.z) *
-                        sr::math::CreateRotationMatrixY(createInfo.orientation.y) *
-                        sr::math::CreateRotationMatrixX(createInfo.orientation.x) *
-                        sr::math::CreateScaleMatrix(createInfo.scale);
-    renderModel.color = createInfo.color;
+// CPU only, safe to run on any thread once the model matrix is set
+void CalculateRenderModelBounds(RenderModel &renderModel, sr::load::Geometry const &geometry)
+{
     renderModel.center = sr::geo::CalculateCenterOfMass(
-        createInfo.geometry->vertices.data(), createInfo.geometry->indices.data(), createInfo.geometry->indices.size());
+        geometry.vertices.data(), geometry.indices.data(), geometry.indices.size());
+    renderModel.localAabb = sr::geo::CalculateAABB(geometry.vertices.data(), geometry.vertices.size());
     renderModel.aabb = sr::geo::CalculateAABB(
-        createInfo.geometry->vertices.data(), createInfo.geometry->vertices.size(), createInfo.position, renderModel.model);
+        geometry.vertices.data(), geometry.vertices.size(), {}, renderModel.model);
+}
 
-    renderModel.debugRenderModel = createInfo.debugRenderModel;
-    renderModel.brdf = createInfo.material->brdf == "marbel" ? 0 : 1;
+RenderModel CreateRenderModel(RenderModelCreateInfo const &createInfo)
+{
+    RenderModel renderModel = InitializeRenderModel(createInfo);
+    CreateRenderModelBuffers(renderModel, createInfo);
+    CalculateRenderModelBounds(renderModel, *createInfo.geometry);
 
     return renderModel;
 }
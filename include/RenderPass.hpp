@@ -5,6 +5,8 @@
  */
 #pragma once
 
+#include "Culling.hpp"
+#include "Profiler.hpp"
 #include "RenderDefinitions.hpp"
 #include "ShaderProgram.hpp"
 
@@ -49,7 +51,14 @@ RenderPass CreateRenderPass(
 
                 glActiveTexture(GL_TEXTURE0);
                 glBindTexture(attachment.texture, attachment.handle);
-                glFramebufferTexture2D(GL_FRAMEBUFFER, attachment.attachment, attachment.texture, attachment.handle, 0);
+                if (attachment.texture == GL_TEXTURE_2D_ARRAY)
+                {
+                    glFramebufferTextureLayer(GL_FRAMEBUFFER, attachment.attachment, attachment.handle, 0, attachment.layer);
+                }
+                else
+                {
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment.attachment, attachment.texture, attachment.handle, 0);
+                }
 
                 if (attachment.attachment >= GL_COLOR_ATTACHMENT0 && attachment.attachment <= GL_COLOR_ATTACHMENT31)
                 {
@@ -224,6 +233,15 @@ void BindRenderModelTextures(RenderModel const &model, uint32_t bindingOffset)
     }
 }
 
+// The model textures of a pass share one sampler object, set once per sub pass instead of per draw
+void BindRenderModelSamplers(GLuint sampler, uint32_t bindingOffset)
+{
+    for (uint32_t i = 0; i < RENDER_MODEL_TEXTURE_COUNT; ++i)
+    {
+        glBindSampler(bindingOffset + i, sampler);
+    }
+}
+
 void UnbindRenderModelTextures(RenderModel const &model, uint32_t bindingOffset)
 {
     if (model.albedoTexture != 0)
@@ -259,17 +277,21 @@ void DrawModel(RenderModel const &model)
     glDrawElements(GL_TRIANGLES, model.indexCount, GL_UNSIGNED_INT, nullptr);
 }
 
-void ExecuteRenderPass(RenderPass const &pass, RenderModel const *models, uint64_t modelCount)
+// Draws models[indices[j]] for every j < count, or the first count models when indices is nullptr.
+// Per model uniforms are looked up with the model index so visibility lists can be passed as is.
+void ExecuteRenderPass(RenderPass const &pass, RenderModel const *models, uint32_t const *indices, uint64_t count)
 {
 #ifdef NDEBUG
     glPushGroupMarkerEXT(pass.name.length, pass.name.data);
 #endif
+    sr::prof::BeginRenderPassZone(pass.name);
 
     for (uint8_t i = 0; i < pass.subPassCount; ++i)
     {
         auto &subPass = pass.subPasses[i];
         if (subPass.active)
         {
+            sr::prof::BeginSubPassZone(i);
             glBindFramebuffer(GL_FRAMEBUFFER, subPass.fbo);
             {
                 glClearColor(static_cast<float>(subPass.desc.colorClearValue[0]),
@@ -294,27 +316,48 @@ void ExecuteRenderPass(RenderPass const &pass, RenderModel const *models, uint64
                 glUseProgram(pass.program.handle);
                 UpdatePerFrameUniforms(pass.program);
                 BindRenderPassDependencies(subPass.desc.dependencies, subPass.desc.dependencyCount);
+                if (subPass.desc.modelSampler != 0)
+                {
+                    BindRenderModelSamplers(subPass.desc.modelSampler, subPass.desc.dependencyCount);
+                }
 
-                for (uint64_t j = 0; j < modelCount; ++j)
+                for (uint64_t j = 0; j < count; ++j)
                 {
-                    UpdatePerModelUniforms(pass.program, j);
-                    BindRenderModelTextures(models[j], subPass.desc.dependencyCount);
-                    DrawModel(models[j]);
-                    UnbindRenderModelTextures(models[j], subPass.desc.dependencyCount);
+                    uint64_t const index = indices != nullptr ? indices[j] : j;
+                    UpdatePerModelUniforms(pass.program, index);
+                    BindRenderModelTextures(models[index], subPass.desc.dependencyCount);
+                    DrawModel(models[index]);
+                    UnbindRenderModelTextures(models[index], subPass.desc.dependencyCount);
                 }
 
+                if (subPass.desc.modelSampler != 0)
+                {
+                    BindRenderModelSamplers(0, subPass.desc.dependencyCount);
+                }
                 UnbindRenderPassDependencies(subPass.desc.dependencies, subPass.desc.dependencyCount);
                 glUseProgram(0);
             }
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            sr::prof::EndSubPassZone();
         }
     }
 
+    sr::prof::EndRenderPassZone();
 #ifdef NDEBUG
     glPopGroupMarkerEXT();
 #endif
 }
 
+void ExecuteRenderPass(RenderPass const &pass, RenderModel const *models, uint64_t modelCount)
+{
+    ExecuteRenderPass(pass, models, nullptr, modelCount);
+}
+
+void ExecuteRenderPass(RenderPass const &pass, RenderModel const *models, sr::cull::VisibilityList const &visibility)
+{
+    ExecuteRenderPass(pass, models, visibility.indices.data(), visibility.count);
+}
+
 void ExecuteBackBufferBlitRenderPass(GLuint fbo, GLenum attachment, int32_t width, int32_t height)
 {
 #ifdef NDEBUG
@@ -348,6 +391,7 @@ SubPassDescriptor CreateDefaultSubPassDescriptor()
 
     desc.dependencyCount = 0;
     desc.attachmentCount = 0;
+    desc.modelSampler = 0;
 
     desc.enableWriteToDepth = false;
     desc.enableClearDepthBuffer = false;
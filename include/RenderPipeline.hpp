@@ -6,228 +6,524 @@
 #pragma once
 
 #include <RenderDefinitions.hpp>
+#include <RenderGraph.hpp>
 
 //ToDo: I'm trying the no include thing, let's see
 GLuint CreateDepthTexture(uint32_t width, uint32_t height);
-GLuint CreateLinearColorAttachment(int32_t width, int32_t height);
+GLuint CreateDepthTextureArray(uint32_t width, uint32_t height, uint32_t layers);
+GLuint CreateLinearColorAttachment(int32_t width, int32_t height, GLenum internalFormat);
+SamplerDescriptor CreateMaterialSamplerDescriptor();
+GLuint GetSampler(SamplerDescriptor const &desc);
 void DeleteRenderPass(RenderPass &pass);
 RenderPass CreateRenderPass(SubPassDescriptor const *desc, uint8_t count,
                             ShaderProgram program,
                             int32_t width, int32_t height,
                             char const(name)[SHORT_STRING_MAX_LENGTH], uint8_t length);
 
-DeferredPipeline CreateDeferredRenderPipeline(DeferredPipelineShaderPrograms programs, int32_t width, int32_t height)
+//Render targets of the forward pipeline, added in this order by CreateForwardRenderGraph
+enum class eForwardResource : uint8_t
 {
-    DeferredPipeline pipeline = {};
+    Depth,
+    ShadowMap,
+    AmbientOcclusion,
+    AmbientOcclusionUpsampled,
+    LightingColor,
+    GBufferAlbedo,
+    GBufferNormal,
+    GBufferMaterial,
+    Velocity,
+    VelocityDepth,
+    TaaHistory0,
+    TaaHistory1,
+    TaaDebug,
+    ToneMapping,
+    Debug,
+    Count
+};
+
+constexpr uint8_t ForwardResourceIndex(eForwardResource resource)
+{
+    return static_cast<uint8_t>(resource);
+}
+
+// Internal formats of the forward pipeline color targets
+struct ForwardTargetFormats
+{
+    GLenum lightingColor;
+    GLenum velocity;
+    GLenum taaHistory; //Keeps the TAA feedback in alpha
+    GLenum taaDebug;
+    GLenum toneMapping; //Everything from tone mapping on is in [0, 1] and blitted as is
+    GLenum debug;
+};
+
+enum class eForwardTargetFormats : uint8_t
+{
+    Full,    //RGBA32F everywhere
+    Half,    //RGBA16F HDR, RG16F velocity, RGBA8 after tone mapping
+    Compact, //As Half with R11F_G11F_B10F lighting
+    Count
+};
+
+// How the motion vectors for TAA are rendered
+enum class eVelocityMode : uint8_t
+{
+    Separate,    //Velocity pass with its own depth buffer, the scene is rasterized once more
+    DepthEqual,  //Velocity pass tested GL_EQUAL against the pre-pass depth, nothing but the visible surface is shaded
+    LightingMRT, //Second color attachment of the lighting pass, the velocity pass is culled
+    Dynamic,     //As DepthEqual but only for the dynamic models, TAA reconstructs the camera motion from depth
+    Count
+};
+
+// Where the opaque models are shaded
+enum class eLightingPath : uint8_t
+{
+    Forward,  //Lighting pass shades every light per fragment
+    Deferred, //G-buffer pass, the lights are culled per screen tile and shaded in a fullscreen pass
+    Count
+};
+
+// Resolution of the ambient occlusion pass, the upsample brings it back to the scene resolution
+enum class eAmbientOcclusion : uint8_t
+{
+    Off,
+    Full,
+    Half,
+    Quarter,
+    Count
+};
+
+int32_t GetAmbientOcclusionDivisor(eAmbientOcclusion ambientOcclusion)
+{
+    switch (ambientOcclusion)
+    {
+    case eAmbientOcclusion::Half:
+        return 2;
+    case eAmbientOcclusion::Quarter:
+        return 4;
+    default:
+        return 1;
+    }
+}
+
+ForwardTargetFormats GetForwardTargetFormats(eForwardTargetFormats preset)
+{
+    switch (preset)
+    {
+    case eForwardTargetFormats::Half:
+        return {GL_RGBA16F, GL_RG16F, GL_RGBA16F, GL_RGBA16F, GL_RGBA8, GL_RGBA8};
+    case eForwardTargetFormats::Compact:
+        return {GL_R11F_G11F_B10F, GL_RG16F, GL_RGBA16F, GL_R11F_G11F_B10F, GL_RGBA8, GL_RGBA8};
+    default:
+        return {GL_RGBA32F, GL_RGBA32F, GL_RGBA32F, GL_RGBA32F, GL_RGBA32F, GL_RGBA32F};
+    }
+}
+
+// The graph passes are declared in the order of ForwardPipeline::passes, so the indices match.
+// Without TAA the tone mapping reads the lighting directly, which culls the velocity and the TAA pass.
+RenderGraph CreateForwardRenderGraph(int32_t width,
+                                     int32_t height,
+                                     bool taaEnabled,
+                                     bool aliasing,
+                                     ForwardTargetFormats const &formats,
+                                     eVelocityMode velocityMode,
+                                     eLightingPath lightingPath,
+                                     eAmbientOcclusion ambientOcclusion)
+{
+    RenderGraph graph = {};
+    int32_t const aoDivisor = GetAmbientOcclusionDivisor(ambientOcclusion);
+
+    uint8_t const depth = AddRenderGraphResource(graph, "Depth", eRenderGraphFormat::Depth, width, height);
+    uint8_t const shadowMap = AddRenderGraphResource(graph, "Shadow Map", eRenderGraphFormat::DepthArray,
+        SHADOW_CASCADE_RESOLUTION, SHADOW_CASCADE_RESOLUTION, SHADOW_CASCADE_MAX_COUNT);
+    uint8_t const ao = AddRenderGraphResource(graph, "Ambient Occlusion", eRenderGraphFormat::PointColor,
+        (width + aoDivisor - 1) / aoDivisor, (height + aoDivisor - 1) / aoDivisor);
+    uint8_t const aoUpsampled =
+        AddRenderGraphResource(graph, "AO Upsampled", eRenderGraphFormat::PointColor, width, height);
+    uint8_t const lightingColor =
+        AddRenderGraphResource(graph, "Lighting Color", eRenderGraphFormat::LinearColor, width, height);
+    uint8_t const gBufferAlbedo =
+        AddRenderGraphResource(graph, "GBuffer Albedo", eRenderGraphFormat::PointColor, width, height);
+    uint8_t const gBufferNormal =
+        AddRenderGraphResource(graph, "GBuffer Normal", eRenderGraphFormat::PointColor, width, height);
+    uint8_t const gBufferMaterial =
+        AddRenderGraphResource(graph, "GBuffer Material", eRenderGraphFormat::PointColor, width, height);
+    uint8_t const velocity = AddRenderGraphResource(graph, "Velocity", eRenderGraphFormat::PointColor, width, height);
+    uint8_t const velocityDepth =
+        AddRenderGraphResource(graph, "Velocity Depth", eRenderGraphFormat::Depth, width, height);
+    uint8_t const taaHistory0 =
+        AddRenderGraphResource(graph, "TAA History 0", eRenderGraphFormat::LinearColor, width, height);
+    uint8_t const taaHistory1 =
+        AddRenderGraphResource(graph, "TAA History 1", eRenderGraphFormat::LinearColor, width, height);
+    uint8_t const taaDebug = AddRenderGraphResource(graph, "TAA Debug", eRenderGraphFormat::LinearColor, width, height);
+    uint8_t const toneMapping =
+        AddRenderGraphResource(graph, "Tone Mapping", eRenderGraphFormat::LinearColor, width, height);
+    uint8_t const debug = AddRenderGraphResource(graph, "Debug", eRenderGraphFormat::LinearColor, width, height);
+    assert(graph.resourceCount == ForwardResourceIndex(eForwardResource::Count));
+
+    //Read by the depth reduction after the graph, the shadow cache and TAA keep their content between frames
+    graph.resources[depth].persistent = true;
+    graph.resources[shadowMap].persistent = true;
+    graph.resources[taaHistory0].persistent = true;
+    graph.resources[taaHistory1].persistent = true;
+    //Blitted to the back buffer
+    graph.resources[debug].output = true;
+
+    graph.resources[ao].colorFormat = GL_R8;
+    graph.resources[aoUpsampled].colorFormat = GL_R8;
+    graph.resources[lightingColor].colorFormat = formats.lightingColor;
+    graph.resources[velocity].colorFormat = formats.velocity;
+    //Albedo and roughness, two octahedral normals, BRDF and flags. Fixed, the G-buffer is sampled with texelFetch
+    graph.resources[gBufferAlbedo].colorFormat = GL_RGBA8;
+    graph.resources[gBufferNormal].colorFormat = GL_RGBA16_SNORM;
+    graph.resources[gBufferMaterial].colorFormat = GL_R8;
+    graph.resources[taaHistory0].colorFormat = formats.taaHistory;
+    graph.resources[taaHistory1].colorFormat = formats.taaHistory;
+    graph.resources[taaDebug].colorFormat = formats.taaDebug;
+    graph.resources[toneMapping].colorFormat = formats.toneMapping;
+    graph.resources[debug].colorFormat = formats.debug;
+
+    AddRenderGraphPass(graph, "Depth Pre-pass", {}, {depth});
+    for (uint8_t i = 0; i < SHADOW_CASCADE_MAX_COUNT; ++i)
+    {
+        char name[] = "Shadow Cascade 0";
+        name[sizeof(name) - 2] = static_cast<char>('0' + i);
+        AddRenderGraphPass(graph, name, {}, {shadowMap});
+    }
+    //Without ambient occlusion the lighting passes do not read it and both passes are culled
+    bool const aoEnabled = ambientOcclusion != eAmbientOcclusion::Off;
+    AddRenderGraphPass(graph, "Ambient Occlusion", {depth}, {ao});
+    AddRenderGraphPass(graph, "AO Upsample", {depth, ao}, {aoUpsampled});
+    //Without TAA nothing reads the velocity, the lighting pass does not write it either.
+    //The passes of the other lighting path write nothing and are culled.
+    bool const velocityMRT = velocityMode == eVelocityMode::LightingMRT && taaEnabled;
+    if (lightingPath == eLightingPath::Deferred)
+    {
+        if (velocityMRT)
+        {
+            AddRenderGraphPass(graph, "GBuffer", {depth}, {gBufferAlbedo, gBufferNormal, gBufferMaterial, velocity});
+        }
+        else
+        {
+            AddRenderGraphPass(graph, "GBuffer", {depth}, {gBufferAlbedo, gBufferNormal, gBufferMaterial});
+        }
+        AddRenderGraphPass(graph, "Lighting", {}, {});
+        uint8_t const deferredLighting = AddRenderGraphPass(graph,
+                                                            "Deferred Lighting",
+                                                            {depth, shadowMap, gBufferAlbedo, gBufferNormal, gBufferMaterial},
+                                                            {lightingColor});
+        if (aoEnabled)
+        {
+            AddRenderGraphPassRead(graph, deferredLighting, aoUpsampled);
+        }
+    }
+    else
+    {
+        AddRenderGraphPass(graph, "GBuffer", {}, {});
+        uint8_t const lighting =
+            velocityMRT ? AddRenderGraphPass(graph, "Lighting", {depth, shadowMap}, {lightingColor, velocity})
+                        : AddRenderGraphPass(graph, "Lighting", {depth, shadowMap}, {lightingColor});
+        if (aoEnabled)
+        {
+            AddRenderGraphPassRead(graph, lighting, aoUpsampled);
+        }
+        AddRenderGraphPass(graph, "Deferred Lighting", {}, {});
+    }
+    AddRenderGraphPass(graph, "Transparency", {depth, shadowMap}, {lightingColor});
+    switch (velocityMode)
+    {
+    case eVelocityMode::DepthEqual:
+    case eVelocityMode::Dynamic:
+        AddRenderGraphPass(graph, "Velocity", {depth}, {velocity});
+        break;
+    case eVelocityMode::LightingMRT:
+        AddRenderGraphPass(graph, "Velocity", {}, {});
+        break;
+    default:
+        AddRenderGraphPass(graph, "Velocity", {}, {velocity, velocityDepth});
+        break;
+    }
+    AddRenderGraphPass(graph,
+                       "Temporal Pass",
+                       {lightingColor, depth, velocity, taaHistory0, taaHistory1},
+                       {taaHistory0, taaHistory1, taaDebug});
+    if (taaEnabled)
+    {
+        AddRenderGraphPass(graph, "Tone Mapping", {taaHistory0, taaHistory1}, {toneMapping});
+    }
+    else
+    {
+        AddRenderGraphPass(graph, "Tone Mapping", {lightingColor}, {toneMapping});
+    }
+    //The debug views of debug.frag sample more targets, they have to be declared here to be bound
+    AddRenderGraphPass(graph, "Debug", {toneMapping}, {debug});
+    assert(graph.passCount == ForwardPipelinePassCount);
+
+    CompileRenderGraph(graph, aliasing);
+    CreateRenderGraphTextures(graph);
+
+    return graph;
+}
 
+ForwardPipeline CreateForwardRenderPipeline(ForwardPipelineShaderPrograms programs, RenderGraph const &graph)
+{
+    ForwardPipeline pipeline = {};
+
+    //Culled passes keep their program so that DeleteRenderPipeline still frees it
+    for (uint8_t i = 0; i < ForwardPipelinePassCount; ++i)
+    {
+        pipeline.passes[i].name = graph.passes[i].name;
+    }
+    pipeline.depthPrePass.program = programs.depthPrePass;
+    for (uint8_t i = 0; i < SHADOW_CASCADE_MAX_COUNT; ++i)
+    {
+        pipeline.shadowMapping[i].program = programs.shadowMapping[i];
+    }
+    pipeline.ambientOcclusion.program = programs.ambientOcclusion;
+    pipeline.ambientOcclusionUpsample.program = programs.ambientOcclusionUpsample;
+    pipeline.gBuffer.program = programs.gBuffer;
+    pipeline.lighting.program = programs.lighting;
+    pipeline.deferredLighting.program = programs.deferredLighting;
+    pipeline.transparent.program = programs.transparent;
+    pipeline.velocity.program = programs.velocity;
+    pipeline.taa.program = programs.taa;
+    pipeline.toneMapping.program = programs.toneMapping;
+    pipeline.debug.program = programs.debug;
+
+    auto const texture = [&graph](eForwardResource resource) {
+        return GetRenderGraphTexture(graph, ForwardResourceIndex(resource));
+    };
+    auto const active = [&graph, &pipeline](RenderPass const &pass) {
+        return graph.passes[&pass - pipeline.passes].active;
+    };
+    //The velocity mode is read back from what the graph passes declared
+    auto const writes = [&graph, &pipeline](RenderPass const &pass, eForwardResource resource) {
+        return IsRenderGraphPassWriting(graph.passes[&pass - pipeline.passes], ForwardResourceIndex(resource));
+    };
+    auto const reads = [&graph, &pipeline](RenderPass const &pass, eForwardResource resource) {
+        return IsRenderGraphPassReading(graph.passes[&pass - pipeline.passes], ForwardResourceIndex(resource));
+    };
+    auto const create = [&graph, &pipeline](RenderPass &pass, SubPassDescriptor const *desc, uint8_t count,
+                                             int32_t width, int32_t height) {
+        ShortString const &name = graph.passes[&pass - pipeline.passes].name;
+        pass = CreateRenderPass(desc, count, pass.program, width, height, name.data, name.length);
+    };
+    GLuint const materialSampler = GetSampler(CreateMaterialSamplerDescriptor());
+    int32_t const width = graph.resources[ForwardResourceIndex(eForwardResource::LightingColor)].width;
+    int32_t const height = graph.resources[ForwardResourceIndex(eForwardResource::LightingColor)].height;
+
+    if (active(pipeline.depthPrePass))
     {
         SubPassDescriptor desc = CreateDefaultSubPassDescriptor();
         desc.attachmentCount = 1;
         desc.attachments[0] = SubPassAttachmentDescriptor{
             GL_DEPTH_ATTACHMENT,
             GL_TEXTURE_2D,
-            CreateDepthTexture(width, height)};
+            texture(eForwardResource::Depth)};
         desc.enableWriteToDepth = true;
         desc.enableClearDepthBuffer = true;
         desc.depthTestFunction = GL_LESS;
 
-        auto const name = "Depth Pre-pass";
-        pipeline.depthPrePass = CreateRenderPass(
-            &desc, 1, programs.depthPrePass, width, height, name, static_cast<uint8_t>(std::strlen(name)));
+        create(pipeline.depthPrePass, &desc, 1, width, height);
     }
 
+    for (uint8_t i = 0; i < SHADOW_CASCADE_MAX_COUNT; ++i)
     {
+        if (!active(pipeline.shadowMapping[i]))
+        {
+            continue;
+        }
+
         SubPassDescriptor desc = CreateDefaultSubPassDescriptor();
-        desc.attachmentCount = 4;
-        //Position
+        desc.attachmentCount = 1;
         desc.attachments[0] = SubPassAttachmentDescriptor{
-            GL_COLOR_ATTACHMENT0,
-            GL_TEXTURE_2D,
-            CreateLinearColorAttachment(width, height)};
-        //Normals
-        desc.attachments[1] = SubPassAttachmentDescriptor{
-            GL_COLOR_ATTACHMENT1,
-            GL_TEXTURE_2D,
-            CreatePointColorAttachment(width, height)};
-        //Albedo
-        desc.attachments[2] = SubPassAttachmentDescriptor{
-            GL_COLOR_ATTACHMENT2,
-            GL_TEXTURE_2D,
-            CreateLinearColorAttachment(width, height)};
-        //Depth
-        desc.attachments[3] = SubPassAttachmentDescriptor{
             GL_DEPTH_ATTACHMENT,
-            GL_TEXTURE_2D,
-            pipeline.depthPrePass.subPasses[0].desc.attachments[0].handle};
-        desc.depthTestFunction = GL_LEQUAL;
-        desc.enableWriteToColor = true;
-        desc.enableClearColorBuffer = true;
+            GL_TEXTURE_2D_ARRAY,
+            texture(eForwardResource::ShadowMap),
+            i};
+        desc.enableWriteToDepth = true;
+        desc.enableClearDepthBuffer = true;
+        desc.depthTestFunction = GL_LESS;
 
-        auto const name = "GBuffer pass";
-        pipeline.gBufferPass = CreateRenderPass(
-            &desc, 1, programs.gBufferPass, width, height, name, static_cast<uint8_t>(std::strlen(name)));
+        create(pipeline.shadowMapping[i], &desc, 1, SHADOW_CASCADE_RESOLUTION, SHADOW_CASCADE_RESOLUTION);
     }
 
+    if (active(pipeline.ambientOcclusion))
     {
         SubPassDescriptor desc = CreateDefaultSubPassDescriptor();
-        desc.dependencyCount = 4;
+        desc.dependencyCount = 1;
         desc.dependencies[0] = SubPassDependencyDescriptor{
-            GL_TEXTURE0,
-            GL_TEXTURE_2D,
-            pipeline.depthPrePass.subPasses[0].desc.attachments[0].handle};
-        desc.dependencies[1] = SubPassDependencyDescriptor{
-            GL_TEXTURE1,
-            GL_TEXTURE_2D,
-            pipeline.gBufferPass.subPasses[0].desc.attachments[0].handle};
-        desc.dependencies[2] = SubPassDependencyDescriptor{
-            GL_TEXTURE2,
-            GL_TEXTURE_2D,
-            pipeline.gBufferPass.subPasses[1].desc.attachments[1].handle};
-        desc.dependencies[3] = SubPassDependencyDescriptor{
-            GL_TEXTURE3,
-            GL_TEXTURE_2D,
-            pipeline.gBufferPass.subPasses[2].desc.attachments[2].handle};
+            GL_TEXTURE0, GL_TEXTURE_2D, texture(eForwardResource::Depth)};
         desc.attachmentCount = 1;
         desc.attachments[0] = SubPassAttachmentDescriptor{
-            GL_COLOR_ATTACHMENT0,
-            GL_TEXTURE_2D,
-            CreateLinearColorAttachment(width, height)};
+            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture(eForwardResource::AmbientOcclusion)};
         desc.enableWriteToColor = true;
         desc.enableClearColorBuffer = true;
 
-        auto const name = "Lighting";
-        pipeline.lighting = CreateRenderPass(
-            &desc, 1, programs.lighting, width, height, name, static_cast<uint8_t>(std::strlen(name)));
+        RenderGraphResource const &target = graph.resources[ForwardResourceIndex(eForwardResource::AmbientOcclusion)];
+        create(pipeline.ambientOcclusion, &desc, 1, target.width, target.height);
     }
 
+    if (active(pipeline.ambientOcclusionUpsample))
     {
         SubPassDescriptor desc = CreateDefaultSubPassDescriptor();
-        desc.dependencyCount = 1;
+        desc.dependencyCount = 2;
         desc.dependencies[0] = SubPassDependencyDescriptor{
-            GL_TEXTURE0,
-            GL_TEXTURE_2D,
-            pipeline.lighting.subPasses[0].desc.attachments[0].handle};
+            GL_TEXTURE0, GL_TEXTURE_2D, texture(eForwardResource::Depth)};
+        desc.dependencies[1] = SubPassDependencyDescriptor{
+            GL_TEXTURE1, GL_TEXTURE_2D, texture(eForwardResource::AmbientOcclusion)};
         desc.attachmentCount = 1;
         desc.attachments[0] = SubPassAttachmentDescriptor{
-            GL_COLOR_ATTACHMENT0,
-            GL_TEXTURE_2D,
-            CreateLinearColorAttachment(width, height)};
+            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture(eForwardResource::AmbientOcclusionUpsampled)};
         desc.enableWriteToColor = true;
         desc.enableClearColorBuffer = true;
 
-        auto const name = "Debug";
-        pipeline.debug = CreateRenderPass(
-            &desc, 1, programs.debug, width, height, name, static_cast<uint8_t>(std::strlen(name)));
-    }
-
-    return pipeline;
-}
-
-ForwardPipeline CreateForwardRenderPipeline(ForwardPipelineShaderPrograms programs, int32_t width, int32_t height)
-{
-    ForwardPipeline pipeline = {};
-
-    {
-        SubPassDescriptor desc = CreateDefaultSubPassDescriptor();
-        desc.attachmentCount = 1;
-        desc.attachments[0] = SubPassAttachmentDescriptor{
-            GL_DEPTH_ATTACHMENT,
-            GL_TEXTURE_2D,
-            CreateDepthTexture(width, height)};
-        desc.enableWriteToDepth = true;
-        desc.enableClearDepthBuffer = true;
-        desc.depthTestFunction = GL_LESS;
-
-        auto const name = "Depth Pre-pass";
-        pipeline.depthPrePass = CreateRenderPass(
-            &desc, 1, programs.depthPrePass, width, height, name, static_cast<uint8_t>(std::strlen(name)));
+        create(pipeline.ambientOcclusionUpsample, &desc, 1, width, height);
     }
 
+    if (active(pipeline.gBuffer))
     {
         SubPassDescriptor desc = CreateDefaultSubPassDescriptor();
-        desc.attachmentCount = 1;
+        desc.attachmentCount = 4;
         desc.attachments[0] = SubPassAttachmentDescriptor{
-            GL_DEPTH_ATTACHMENT,
-            GL_TEXTURE_2D,
-            CreateDepthTexture(4096, 4096)};
-        desc.enableWriteToDepth = true;
-        desc.enableClearDepthBuffer = true;
-        desc.depthTestFunction = GL_LESS;
+            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture(eForwardResource::GBufferAlbedo)};
+        desc.attachments[1] = SubPassAttachmentDescriptor{
+            GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, texture(eForwardResource::GBufferNormal)};
+        desc.attachments[2] = SubPassAttachmentDescriptor{
+            GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, texture(eForwardResource::GBufferMaterial)};
+        desc.attachments[3] = SubPassAttachmentDescriptor{
+            GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture(eForwardResource::Depth)};
+        if (writes(pipeline.gBuffer, eForwardResource::Velocity))
+        {
+            desc.attachmentCount = 5;
+            desc.attachments[4] = SubPassAttachmentDescriptor{
+                GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, texture(eForwardResource::Velocity)};
+        }
+        desc.depthTestFunction = GL_LEQUAL;
+        desc.enableWriteToColor = true;
+        desc.enableClearColorBuffer = true;
 
-        auto const name = "Shadow Mapping";
-        pipeline.shadowMapping = CreateRenderPass(
-            &desc, 1, programs.shadowMapping, 4096, 4096, name, static_cast<uint8_t>(std::strlen(name)));
+        desc.modelSampler = materialSampler;
+        create(pipeline.gBuffer, &desc, 1, width, height);
     }
 
+    if (active(pipeline.lighting))
     {
+        //The model textures follow the dependencies, the unit of the occlusion stays taken without it
         SubPassDescriptor desc = CreateDefaultSubPassDescriptor();
         desc.dependencyCount = 2;
         desc.dependencies[0] = SubPassDependencyDescriptor{
             GL_TEXTURE0,
             GL_TEXTURE_2D,
-            pipeline.depthPrePass.subPasses[0].desc.attachments[0].handle};
+            reads(pipeline.lighting, eForwardResource::AmbientOcclusionUpsampled)
+                ? texture(eForwardResource::AmbientOcclusionUpsampled)
+                : 0};
         desc.dependencies[1] = SubPassDependencyDescriptor{
             GL_TEXTURE1,
-            GL_TEXTURE_2D,
-            pipeline.shadowMapping.subPasses[0].desc.attachments[0].handle};
+            GL_TEXTURE_2D_ARRAY,
+            texture(eForwardResource::ShadowMap)};
         desc.attachmentCount = 2;
         desc.attachments[0] = SubPassAttachmentDescriptor{
-            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, CreateLinearColorAttachment(width, height)};
+            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture(eForwardResource::LightingColor)};
         desc.attachments[1] = SubPassAttachmentDescriptor{
-            GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, pipeline.depthPrePass.subPasses[0].desc.attachments[0].handle};
+            GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture(eForwardResource::Depth)};
+        if (writes(pipeline.lighting, eForwardResource::Velocity))
+        {
+            desc.attachmentCount = 3;
+            desc.attachments[2] = SubPassAttachmentDescriptor{
+                GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, texture(eForwardResource::Velocity)};
+        }
         desc.depthTestFunction = GL_LEQUAL;
         desc.enableWriteToColor = true;
         desc.enableClearColorBuffer = true;
 
-        auto const name = "Lighting";
-        pipeline.lighting = CreateRenderPass(
-            &desc, 1, programs.lighting, width, height, name, static_cast<uint8_t>(std::strlen(name)));
+        desc.modelSampler = materialSampler;
+        create(pipeline.lighting, &desc, 1, width, height);
     }
 
+    if (active(pipeline.deferredLighting))
     {
         SubPassDescriptor desc = CreateDefaultSubPassDescriptor();
-        desc.dependencyCount = 1;
+        desc.dependencyCount = 6;
         desc.dependencies[0] = SubPassDependencyDescriptor{
-            GL_TEXTURE0,
+            GL_TEXTURE0, GL_TEXTURE_2D, texture(eForwardResource::Depth)};
+        desc.dependencies[1] = SubPassDependencyDescriptor{
+            GL_TEXTURE1, GL_TEXTURE_2D_ARRAY, texture(eForwardResource::ShadowMap)};
+        desc.dependencies[2] = SubPassDependencyDescriptor{
+            GL_TEXTURE2, GL_TEXTURE_2D, texture(eForwardResource::GBufferAlbedo)};
+        desc.dependencies[3] = SubPassDependencyDescriptor{
+            GL_TEXTURE3, GL_TEXTURE_2D, texture(eForwardResource::GBufferNormal)};
+        desc.dependencies[4] = SubPassDependencyDescriptor{
+            GL_TEXTURE4, GL_TEXTURE_2D, texture(eForwardResource::GBufferMaterial)};
+        desc.dependencies[5] = SubPassDependencyDescriptor{
+            GL_TEXTURE5,
             GL_TEXTURE_2D,
-            pipeline.shadowMapping.subPasses[0].desc.attachments[0].handle};
+            reads(pipeline.deferredLighting, eForwardResource::AmbientOcclusionUpsampled)
+                ? texture(eForwardResource::AmbientOcclusionUpsampled)
+                : 0};
+        desc.attachmentCount = 1;
+        desc.attachments[0] = SubPassAttachmentDescriptor{
+            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture(eForwardResource::LightingColor)};
+        desc.enableWriteToColor = true;
+        desc.enableClearColorBuffer = true;
+
+        create(pipeline.deferredLighting, &desc, 1, width, height);
+    }
+
+    if (active(pipeline.transparent))
+    {
+        SubPassDescriptor desc = CreateDefaultSubPassDescriptor();
+        desc.dependencyCount = 1;
+        desc.dependencies[0] = SubPassDependencyDescriptor{
+            GL_TEXTURE1,
+            GL_TEXTURE_2D_ARRAY,
+            texture(eForwardResource::ShadowMap)};
         desc.attachmentCount = 2;
         desc.attachments[0] = SubPassAttachmentDescriptor{
-            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pipeline.lighting.subPasses[0].desc.attachments[0].handle};
+            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture(eForwardResource::LightingColor)};
         desc.attachments[1] = SubPassAttachmentDescriptor{
-            GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, pipeline.depthPrePass.subPasses[0].desc.attachments[0].handle};
+            GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture(eForwardResource::Depth)};
         desc.enableWriteToColor = true;
         desc.enableClearColorBuffer = true;
         desc.depthTestFunction = GL_LEQUAL;
 
-        auto const name = "Transparency";
-        pipeline.transparent = CreateRenderPass(
-            &desc, 1, programs.transparent, width, height, name, static_cast<uint8_t>(std::strlen(name)));
+        desc.modelSampler = materialSampler;
+        create(pipeline.transparent, &desc, 1, width, height);
     }
 
+    if (active(pipeline.velocity))
     {
         SubPassDescriptor desc = CreateDefaultSubPassDescriptor();
 
         desc.attachmentCount = 2;
         desc.attachments[0] = SubPassAttachmentDescriptor{
-            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, CreatePointColorAttachment(width, height)};
-        desc.attachments[1] = SubPassAttachmentDescriptor{
-            GL_DEPTH_ATTACHMENT,
-            GL_TEXTURE_2D,
-            CreateDepthTexture(width, height)};
+            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture(eForwardResource::Velocity)};
         desc.enableWriteToColor = true;
         desc.enableClearColorBuffer = true;
-        desc.depthTestFunction = GL_LEQUAL;
-
-        auto const name = "Velocity";
-        pipeline.velocity = CreateRenderPass(
-            &desc, 1, programs.velocity, width, height, name, static_cast<uint8_t>(std::strlen(name)));
+        if (reads(pipeline.velocity, eForwardResource::Depth))
+        {
+            //velocity.vert computes the position the way the pre-pass does, the depth is equal to the bit
+            desc.attachments[1] = SubPassAttachmentDescriptor{
+                GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture(eForwardResource::Depth)};
+            desc.depthTestFunction = GL_EQUAL;
+        }
+        else
+        {
+            desc.attachments[1] = SubPassAttachmentDescriptor{
+                GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture(eForwardResource::VelocityDepth)};
+            desc.enableWriteToDepth = true;
+            desc.enableClearDepthBuffer = true;
+            desc.depthTestFunction = GL_LEQUAL;
+        }
+
+        create(pipeline.velocity, &desc, 1, width, height);
     }
 
+    if (active(pipeline.taa))
     {
-        auto const texture1 = CreateLinearColorAttachment(width, height);
-        auto const texture2 = CreateLinearColorAttachment(width, height);
-        auto const debug_texture = CreateLinearColorAttachment(width, height);
+        auto const texture1 = texture(eForwardResource::TaaHistory0);
+        auto const texture2 = texture(eForwardResource::TaaHistory1);
+        auto const debug_texture = texture(eForwardResource::TaaDebug);
 
         SubPassDescriptor desc[2] = {
             CreateDefaultSubPassDescriptor(),
@@ -235,12 +531,12 @@ ForwardPipeline CreateForwardRenderPipeline(ForwardPipelineShaderPrograms progra
 
         desc[0].dependencyCount = 4;
         desc[0].dependencies[0] = SubPassDependencyDescriptor{
-            GL_TEXTURE0, GL_TEXTURE_2D, pipeline.lighting.subPasses[0].desc.attachments[0].handle};
+            GL_TEXTURE0, GL_TEXTURE_2D, texture(eForwardResource::LightingColor)};
         desc[0].dependencies[1] = SubPassDependencyDescriptor{
-            GL_TEXTURE1, GL_TEXTURE_2D, pipeline.lighting.subPasses[0].desc.attachments[1].handle};
+            GL_TEXTURE1, GL_TEXTURE_2D, texture(eForwardResource::Depth)};
         desc[0].dependencies[2] = SubPassDependencyDescriptor{GL_TEXTURE2, GL_TEXTURE_2D, texture2};
         desc[0].dependencies[3] = SubPassDependencyDescriptor{
-            GL_TEXTURE3, GL_TEXTURE_2D, pipeline.velocity.subPasses[0].desc.attachments[0].handle};
+            GL_TEXTURE3, GL_TEXTURE_2D, texture(eForwardResource::Velocity)};
         desc[0].attachmentCount = 2;
         desc[0].attachments[0] = SubPassAttachmentDescriptor{GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture1};
         desc[0].attachments[1] = SubPassAttachmentDescriptor{GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, debug_texture};
@@ -258,70 +554,72 @@ ForwardPipeline CreateForwardRenderPipeline(ForwardPipelineShaderPrograms progra
         desc[1].enableWriteToColor = desc[0].enableWriteToColor;
         desc[1].enableClearColorBuffer = desc[0].enableClearColorBuffer;
 
-        auto const name = "Temporal Pass";
-        pipeline.taa = CreateRenderPass(
-            desc, 2, programs.taa, width, height, name, static_cast<uint8_t>(std::strlen(name)));
+        create(pipeline.taa, desc, 2, width, height);
         pipeline.taa.subPasses[1].active = false;
     }
 
+    if (active(pipeline.toneMapping))
     {
         SubPassDescriptor desc = CreateDefaultSubPassDescriptor();
         desc.dependencyCount = 1;
         desc.dependencies[0] = SubPassDependencyDescriptor{
             GL_TEXTURE0,
             GL_TEXTURE_2D,
-            pipeline.taa.subPasses[0].desc.attachments[0].handle};
+            active(pipeline.taa) ? texture(eForwardResource::TaaHistory0) : texture(eForwardResource::LightingColor)};
         desc.attachmentCount = 1;
         desc.attachments[0] = SubPassAttachmentDescriptor{
-            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, CreateLinearColorAttachment(width, height)};
+            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture(eForwardResource::ToneMapping)};
         desc.enableWriteToColor = true;
         desc.enableClearColorBuffer = true;
 
-        auto const name = "Tone Mapping";
-        pipeline.toneMapping = CreateRenderPass(
-            &desc, 1, programs.toneMapping, width, height, name, static_cast<uint8_t>(std::strlen(name)));
+        create(pipeline.toneMapping, &desc, 1, width, height);
     }
 
+    if (active(pipeline.debug))
     {
+        //Inputs the debug pass does not declare stay unbound, they might share a texture with another target
+        uint8_t const pass = static_cast<uint8_t>(&pipeline.debug - pipeline.passes);
+        auto const input = [&graph, pass](eForwardResource resource) {
+            return GetRenderGraphPassInput(graph, pass, ForwardResourceIndex(resource));
+        };
+
         SubPassDescriptor desc = CreateDefaultSubPassDescriptor();
         desc.dependencyCount = 7;
         desc.dependencies[0] = SubPassDependencyDescriptor{
             GL_TEXTURE0,
             GL_TEXTURE_2D,
-            pipeline.lighting.subPasses[0].desc.attachments[0].handle};
+            input(eForwardResource::LightingColor)};
         desc.dependencies[1] = SubPassDependencyDescriptor{
             GL_TEXTURE1,
             GL_TEXTURE_2D,
-            pipeline.lighting.subPasses[0].desc.attachments[1].handle};
+            input(eForwardResource::Depth)};
         desc.dependencies[2] = SubPassDependencyDescriptor{
             GL_TEXTURE2,
             GL_TEXTURE_2D,
-            pipeline.velocity.subPasses[0].desc.attachments[0].handle};
+            input(eForwardResource::Velocity)};
         desc.dependencies[3] = SubPassDependencyDescriptor{
             GL_TEXTURE3,
             GL_TEXTURE_2D,
-            pipeline.toneMapping.subPasses[0].desc.attachments[0].handle};
+            input(eForwardResource::ToneMapping)};
         desc.dependencies[4] = SubPassDependencyDescriptor{
             GL_TEXTURE4,
             GL_TEXTURE_2D,
-            pipeline.taa.subPasses[1].desc.attachments[0].handle};
+            input(eForwardResource::TaaHistory1)};
         desc.dependencies[5] = SubPassDependencyDescriptor{
             GL_TEXTURE5,
             GL_TEXTURE_2D,
-            pipeline.taa.subPasses[0].desc.attachments[0].handle};
+            input(eForwardResource::TaaHistory0)};
         desc.dependencies[6] = SubPassDependencyDescriptor{
             GL_TEXTURE6,
             GL_TEXTURE_2D,
-            pipeline.taa.subPasses[0].desc.attachments[1].handle};
+            input(eForwardResource::TaaDebug)};
         desc.attachmentCount = 1;
         desc.attachments[0] = SubPassAttachmentDescriptor{
-            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, CreateLinearColorAttachment(width, height)};
+            GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture(eForwardResource::Debug)};
         desc.enableWriteToColor = true;
         desc.enableClearColorBuffer = true;
 
-        auto const name = "Debug";
-        pipeline.debug = CreateRenderPass(
-            &desc, 1, programs.debug, width, height, name, static_cast<uint8_t>(std::strlen(name)));
+        create(pipeline.debug, &desc, 1, width, height);
     }
 
     return pipeline;
@@ -83,6 +83,39 @@ GLuint CreateShaderProgram(GLuint vertexShader, GLuint fragmentShader)
     return program;
 }
 
+GLuint CreateShaderProgram(GLuint computeShader)
+{
+    if (computeShader == 0)
+    {
+        std::cerr << "Failed to create compute shader program! Compute shader is not valid" << std::endl;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, computeShader);
+    glLinkProgram(program);
+
+    GLint isLinked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, (int *)&isLinked);
+    if (isLinked == 0)
+    {
+        GLint maxLength = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxLength);
+
+        std::vector<GLchar> infoLog(maxLength);
+        glGetProgramInfoLog(program, maxLength, &maxLength, &infoLog[0]);
+
+        glDeleteProgram(program);
+        glDeleteShader(computeShader);
+
+        std::cerr << "Failed to create compute shader program! Linkage failed:\n"
+                  << infoLog.data();
+
+        return 0;
+    }
+
+    return program;
+}
+
 template <typename T>
 HeapArray<T> AllocateHeapArray(uint32_t count)
 {
@@ -162,6 +195,7 @@ ShaderProgram CreateShaderProgram(char const *vert, char const *frag)
 
     program.vertexShaderHandle = ::CreateShader(GL_VERTEX_SHADER, sr::load::LoadFile(vert).c_str());
     program.fragmentShaderHandle = ::CreateShader(GL_FRAGMENT_SHADER, sr::load::LoadFile(frag).c_str());
+    program.computeShaderHandle = 0;
     program.handle = CreateShaderProgram(program.vertexShaderHandle, program.fragmentShaderHandle);
     if (program.handle != 0)
     {
@@ -175,6 +209,25 @@ ShaderProgram CreateShaderProgram(char const *vert, char const *frag)
     return program;
 }
 
+ShaderProgram CreateComputeShaderProgram(char const *comp)
+{
+    ShaderProgram program;
+
+    program.vertexShaderHandle = 0;
+    program.fragmentShaderHandle = 0;
+    program.computeShaderHandle = ::CreateShader(GL_COMPUTE_SHADER, sr::load::LoadFile(comp).c_str());
+    program.handle = CreateShaderProgram(program.computeShaderHandle);
+    if (program.handle != 0)
+    {
+        std::time_t const timestamp = std::time(nullptr);
+        std::cout << "Shader program created:\n"
+                  << "Compute  shader: " << comp << "\n"
+                  << std::asctime(std::localtime(&timestamp)) << std::endl;
+    }
+
+    return program;
+}
+
 void CreateShaderProgramUniformBindings(ShaderProgram &program, UniformsDescriptor const &desc)
 {
     program.perFrameUniformBindings.UI32 = CreateUniformBindings<UniformBindingUI32>(program.handle, desc.ui32.data, desc.ui32.names, desc.ui32.counts);
@@ -212,6 +265,7 @@ void DeleteShaderProgram(ShaderProgram &program)
     glDeleteProgram(program.handle);
     glDeleteShader(program.vertexShaderHandle);
     glDeleteShader(program.fragmentShaderHandle);
+    glDeleteShader(program.computeShaderHandle);
     DeleteShaderProgramUniformBindings(program);
     ShaderProgram emptyProgram;
     std::swap(program, emptyProgram);
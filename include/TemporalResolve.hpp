@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include "Profiler.hpp"
+#include "RenderDefinitions.hpp"
+#include "RenderPass.hpp"
+#include "ShaderProgram.hpp"
+
+// The TAA resolve of taa.frag as a compute dispatch. It runs the active sub pass of the TAA render pass,
+// the dependencies are bound to the same texture units and the color attachments to the image units of
+// the same index. Every work group loads the color and depth texels under its tile into shared memory once.
+constexpr uint32_t TAA_TILE_SIZE = 16;
+
+void DispatchTemporalResolve(ShaderProgram const &program, RenderPass const &pass)
+{
+    //Timed under the name of the fragment pass so that both resolves compare in the reports
+#ifdef NDEBUG
+    glPushGroupMarkerEXT(pass.name.length, pass.name.data);
+#endif
+    sr::prof::BeginRenderPassZone(pass.name);
+
+    for (uint8_t i = 0; i < pass.subPassCount; ++i)
+    {
+        auto const &subPass = pass.subPasses[i];
+        if (!subPass.active)
+        {
+            continue;
+        }
+
+        sr::prof::BeginSubPassZone(i);
+        glUseProgram(program.handle);
+        UpdatePerFrameUniforms(program);
+        BindRenderPassDependencies(subPass.desc.dependencies, subPass.desc.dependencyCount);
+        for (uint8_t j = 0; j < subPass.desc.attachmentCount; ++j)
+        {
+            auto const &attachment = subPass.desc.attachments[j];
+            GLint format = 0;
+            glGetTextureLevelParameteriv(attachment.handle, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+            glBindImageTexture(j, attachment.handle, 0, GL_FALSE, 0, GL_WRITE_ONLY, static_cast<GLenum>(format));
+        }
+
+        glDispatchCompute((pass.width + TAA_TILE_SIZE - 1) / TAA_TILE_SIZE,
+                          (pass.height + TAA_TILE_SIZE - 1) / TAA_TILE_SIZE,
+                          1);
+        //The tone mapping and the next resolve sample the history, the debug view samples the debug target
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        for (uint8_t j = 0; j < subPass.desc.attachmentCount; ++j)
+        {
+            glBindImageTexture(j, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        }
+        UnbindRenderPassDependencies(subPass.desc.dependencies, subPass.desc.dependencyCount);
+        glUseProgram(0);
+        sr::prof::EndSubPassZone();
+    }
+
+    sr::prof::EndRenderPassZone();
+#ifdef NDEBUG
+    glPopGroupMarkerEXT();
+#endif
+}
@@ -8,6 +8,8 @@
 #include "RenderDefinitions.hpp"
 #include "Loader.hpp"
 
+#include <vector>
+
 Texture2DDescriptor CreateDefaultTexture2DDescriptor(sr::load::TextureSource const &source)
 {
     Texture2DDescriptor desc;
@@ -114,18 +116,39 @@ GLuint CreateDepthTexture(uint32_t width, uint32_t height)
     return depthTexture;
 }
 
+// One depth layer per cascade, sampled as sampler2DArray
+GLuint CreateDepthTextureArray(uint32_t width, uint32_t height, uint32_t layers)
+{
+    GLuint depthTexture = 0;
+
+    glGenTextures(1, &depthTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthTexture);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32,
+                 width, height, layers, 0, GL_DEPTH_COMPONENT,
+                 GL_FLOAT, nullptr);
+
+    return depthTexture;
+}
+
 GLuint CreateEmptyRGBATexture(int32_t width, int32_t height)
 {
     return CreateTexture(sr::load::TextureSource{"", nullptr, width, height, 4, GL_RGBA});
 }
 
-GLuint CreatePointColorAttachment(int32_t width, int32_t height)
+GLuint CreatePointColorAttachment(int32_t width, int32_t height, GLenum internalFormat)
 {
     GLuint handle = 0;
 
     auto const source = sr::load::TextureSource{ "", nullptr, width, height, 4, GL_RGBA };
     auto desc = CreateDefaultTexture2DDescriptor(source);
-    desc.internalFormat = GL_RGBA32F;
+    desc.internalFormat = internalFormat;
     desc.type = GL_FLOAT;
     desc.sWrap = GL_CLAMP;
     desc.tWrap = GL_CLAMP;
@@ -138,13 +161,13 @@ GLuint CreatePointColorAttachment(int32_t width, int32_t height)
     return handle;
 }
 
-GLuint CreateLinearColorAttachment(int32_t width, int32_t height)
+GLuint CreateLinearColorAttachment(int32_t width, int32_t height, GLenum internalFormat)
 {
     GLuint handle = 0;
 
     auto const source = sr::load::TextureSource{"", nullptr, width, height, 4, GL_RGBA};
     auto desc = CreateDefaultTexture2DDescriptor(source);
-    desc.internalFormat = GL_RGBA32F;
+    desc.internalFormat = internalFormat;
     desc.type = GL_FLOAT;
     desc.sWrap = GL_CLAMP;
     desc.tWrap = GL_CLAMP;
@@ -157,6 +180,67 @@ GLuint CreateLinearColorAttachment(int32_t width, int32_t height)
     return handle;
 }
 
+// Trilinear and anisotropic, the material textures are sampled with a single hardware filtered fetch
+SamplerDescriptor CreateMaterialSamplerDescriptor()
+{
+    SamplerDescriptor desc;
+
+    desc.sWrap = GL_REPEAT;
+    desc.tWrap = GL_REPEAT;
+    desc.minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    desc.magFilter = GL_LINEAR;
+    desc.maxAnisatropy = 16.f;
+    desc.lodBias = 0.f;
+
+    return desc;
+}
+
+namespace
+{
+
+std::vector<std::pair<SamplerDescriptor, GLuint>> s_samplerCache;
+
+} // namespace
+
+// Samplers with equal state are shared, they live until DeleteSamplers
+GLuint GetSampler(SamplerDescriptor const &desc)
+{
+    for (auto const &entry : s_samplerCache)
+    {
+        SamplerDescriptor const &cached = entry.first;
+        if (cached.sWrap == desc.sWrap && cached.tWrap == desc.tWrap
+            && cached.minFilter == desc.minFilter && cached.magFilter == desc.magFilter
+            && cached.maxAnisatropy == desc.maxAnisatropy && cached.lodBias == desc.lodBias)
+        {
+            return entry.second;
+        }
+    }
+
+    GLuint handle = 0;
+    glGenSamplers(1, &handle);
+    glSamplerParameteri(handle, GL_TEXTURE_WRAP_S, desc.sWrap);
+    glSamplerParameteri(handle, GL_TEXTURE_WRAP_T, desc.tWrap);
+    glSamplerParameteri(handle, GL_TEXTURE_MIN_FILTER, desc.minFilter);
+    glSamplerParameteri(handle, GL_TEXTURE_MAG_FILTER, desc.magFilter);
+    glSamplerParameterf(handle, GL_TEXTURE_LOD_BIAS, desc.lodBias);
+    if (desc.maxAnisatropy > 1.0f)
+    {
+        glSamplerParameterf(handle, GL_TEXTURE_MAX_ANISOTROPY, desc.maxAnisatropy);
+    }
+    s_samplerCache.emplace_back(desc, handle);
+
+    return handle;
+}
+
+void DeleteSamplers()
+{
+    for (auto const &entry : s_samplerCache)
+    {
+        glDeleteSamplers(1, &entry.second);
+    }
+    s_samplerCache.clear();
+}
+
 void DeleteTexture(GLuint texture)
 {
     glDeleteTextures(1, &texture);
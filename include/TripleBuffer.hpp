@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2019 by Ilya Glushchenko
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Single producer, single consumer triple buffer. The producer always owns one slot and
+// the consumer another, the third one is exchanged atomically, so neither side blocks
+// and the consumer always sees the most recently published value.
+template <typename T>
+struct TripleBuffer
+{
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH_BIT = 0x4;
+
+    T slots[3] = {};
+    uint8_t writeIndex = 0;
+    uint8_t readIndex = 1;
+    std::atomic<uint8_t> sharedIndex = {2};
+};
+
+// Returns the slot the producer may fill before calling PublishTripleBuffer
+template <typename T>
+T &GetTripleBufferWriteSlot(TripleBuffer<T> &buffer)
+{
+    return buffer.slots[buffer.writeIndex];
+}
+
+template <typename T>
+void PublishTripleBuffer(TripleBuffer<T> &buffer)
+{
+    uint8_t const previous = buffer.sharedIndex.exchange(
+        buffer.writeIndex | TripleBuffer<T>::FRESH_BIT, std::memory_order_acq_rel);
+    buffer.writeIndex = previous & TripleBuffer<T>::INDEX_MASK;
+}
+
+// Swaps in the latest published slot if there is one, returns false if nothing new was published
+template <typename T>
+bool AcquireTripleBuffer(TripleBuffer<T> &buffer)
+{
+    if ((buffer.sharedIndex.load(std::memory_order_relaxed) & TripleBuffer<T>::FRESH_BIT) == 0)
+    {
+        return false;
+    }
+
+    uint8_t const previous = buffer.sharedIndex.exchange(buffer.readIndex, std::memory_order_acq_rel);
+    buffer.readIndex = previous & TripleBuffer<T>::INDEX_MASK;
+
+    return true;
+}
+
+template <typename T>
+T const &GetTripleBufferReadSlot(TripleBuffer<T> const &buffer)
+{
+    return buffer.slots[buffer.readIndex];
+}
@@ -0,0 +1,93 @@
+#version 460
+
+layout (location = 10) uniform mat4  uProjUnjitMat;
+layout (location = 14) uniform vec2  uRenderScaleVec2;
+layout (location = 15) uniform uint  uAmbientOcclusionDivisorUint;
+layout (location = 16) uniform float uAmbientOcclusionRadiusFloat;
+
+layout (binding = 0, location = 50) uniform sampler2D uDepthTextureSampler2D;
+
+layout (location = 0) in vec2 uv;
+
+layout (location = 0) out float outOcclusion;
+
+const float PI = 3.1415926535897932384626433832795;
+const uint DIRECTION_COUNT = 4;
+const uint STEP_COUNT = 4;
+const float MAX_RADIUS_TEXELS = 64;
+const float ANGLE_BIAS = 0.1;
+const float STRENGTH = 1.5;
+
+// The depth was rendered with the jittered projection, the jitter is far below what the occlusion resolves
+vec3 ViewPosition(ivec2 texel, vec2 sceneSize)
+{
+    float ndcDepth = texelFetch(uDepthTextureSampler2D, texel, 0).r * 2 - 1;
+    float depth = uProjUnjitMat[3][2] / (ndcDepth + uProjUnjitMat[2][2]);
+    vec2 ndc = (vec2(texel) + 0.5) / sceneSize * 2 - 1;
+
+    return vec3(ndc * depth / vec2(uProjUnjitMat[0][0], uProjUnjitMat[1][1]), -depth);
+}
+
+// Takes the neighbour with the smaller depth step on either axis, so the normal does not bend over silhouettes
+vec3 ReconstructNormal(ivec2 texel, vec2 sceneSize)
+{
+    vec3 p = ViewPosition(texel, sceneSize);
+    vec3 right = ViewPosition(texel + ivec2(1, 0), sceneSize) - p;
+    vec3 left = p - ViewPosition(texel - ivec2(1, 0), sceneSize);
+    vec3 up = ViewPosition(texel + ivec2(0, 1), sceneSize) - p;
+    vec3 down = p - ViewPosition(texel - ivec2(0, 1), sceneSize);
+
+    return normalize(cross(abs(right.z) < abs(left.z) ? right : left, abs(up.z) < abs(down.z) ? up : down));
+}
+
+void main()
+{
+    vec2 sceneSize = vec2(textureSize(uDepthTextureSampler2D, 0)) * uRenderScaleVec2;
+    ivec2 size = ivec2(sceneSize + 0.5);
+
+    //Every occlusion texel is computed at the first depth texel of its block, the upsample weighs by that depth
+    ivec2 texel = min(ivec2(gl_FragCoord.xy) * int(uAmbientOcclusionDivisorUint), size - 1);
+    if (texelFetch(uDepthTextureSampler2D, texel, 0).r >= 1)
+    {
+        outOcclusion = 1;
+        return;
+    }
+
+    vec3 p = ViewPosition(texel, sceneSize);
+    vec3 n = ReconstructNormal(clamp(texel, ivec2(1), size - 2), sceneSize);
+
+    float radiusTexels = min(uAmbientOcclusionRadiusFloat * uProjUnjitMat[0][0] * sceneSize.x * 0.5 / -p.z, MAX_RADIUS_TEXELS);
+    if (radiusTexels < 1)
+    {
+        outOcclusion = 1;
+        return;
+    }
+
+    //Interleaved gradient noise rotates the directions per texel, the upsample blurs the pattern away
+    float noise = fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    float stepTexels = radiusTexels / (STEP_COUNT + 1);
+    float radiusSquared = uAmbientOcclusionRadiusFloat * uAmbientOcclusionRadiusFloat;
+
+    float occlusion = 0;
+    for (uint i = 0; i < DIRECTION_COUNT; ++i)
+    {
+        float angle = (float(i) + noise) * (2 * PI / DIRECTION_COUNT);
+        vec2 direction = vec2(cos(angle), sin(angle));
+        for (uint j = 0; j < STEP_COUNT; ++j)
+        {
+            ivec2 sampleTexel = texel + ivec2(round(direction * stepTexels * (float(j) + 1 + noise)));
+            if (any(lessThan(sampleTexel, ivec2(0))) || any(greaterThanEqual(sampleTexel, size)))
+            {
+                break;
+            }
+
+            //Samples above the tangent plane occlude, the further away the less
+            vec3 h = ViewPosition(sampleTexel, sceneSize) - p;
+            float distanceSquared = dot(h, h);
+            float NoH = dot(n, h) * inversesqrt(max(distanceSquared, 1e-4));
+            occlusion += max(NoH - ANGLE_BIAS, 0) * max(1 - distanceSquared / radiusSquared, 0);
+        }
+    }
+
+    outOcclusion = clamp(1 - occlusion * STRENGTH / (DIRECTION_COUNT * STEP_COUNT), 0, 1);
+}
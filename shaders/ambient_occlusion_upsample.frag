@@ -0,0 +1,60 @@
+#version 460
+
+layout (location = 10) uniform mat4 uProjUnjitMat;
+layout (location = 14) uniform vec2 uRenderScaleVec2;
+layout (location = 15) uniform uint uAmbientOcclusionDivisorUint;
+
+layout (binding = 0, location = 50) uniform sampler2D uDepthTextureSampler2D;
+layout (binding = 1, location = 51) uniform sampler2D uAmbientOcclusionSampler2D;
+
+layout (location = 0) in vec2 uv;
+
+layout (location = 0) out float outOcclusion;
+
+const float DEPTH_TOLERANCE = 0.05; //Relative view depth difference at which a sample weighs 1/e
+
+float ViewDepth(ivec2 texel)
+{
+    float ndcDepth = texelFetch(uDepthTextureSampler2D, texel, 0).r * 2 - 1;
+    return uProjUnjitMat[3][2] / (ndcDepth + uProjUnjitMat[2][2]);
+}
+
+// Bilateral blur and upsample in one: the 3x3 occlusion texels around this texel are weighed by
+// their distance and by how close the depth they were computed at is, so nothing bleeds over edges
+void main()
+{
+    ivec2 size = ivec2(vec2(textureSize(uDepthTextureSampler2D, 0)) * uRenderScaleVec2 + 0.5);
+    int divisor = int(uAmbientOcclusionDivisorUint);
+    ivec2 aoSize = (size + divisor - 1) / divisor;
+
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    if (texelFetch(uDepthTextureSampler2D, texel, 0).r >= 1)
+    {
+        outOcclusion = 1;
+        return;
+    }
+
+    float depth = ViewDepth(texel);
+    ivec2 center = texel / divisor;
+    float occlusion = 0;
+    float weightSum = 0;
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            ivec2 aoTexel = clamp(center + ivec2(x, y), ivec2(0), aoSize - 1);
+            ivec2 depthTexel = min(aoTexel * divisor, size - 1);
+
+            vec2 offset = vec2(texel - depthTexel) / divisor;
+            float weight = exp(-0.5 * dot(offset, offset))
+                * exp(-abs(ViewDepth(depthTexel) - depth) / (depth * DEPTH_TOLERANCE));
+            occlusion += texelFetch(uAmbientOcclusionSampler2D, aoTexel, 0).r * weight;
+            weightSum += weight;
+        }
+    }
+
+    //Every neighbour lies on another surface, the covering texel is the best guess
+    outOcclusion = weightSum > 1e-4
+        ? occlusion / weightSum
+        : texelFetch(uAmbientOcclusionSampler2D, clamp(center, ivec2(0), aoSize - 1), 0).r;
+}
@@ -0,0 +1,347 @@
+#version 460
+
+layout (location = 10) uniform mat4 uViewMat;
+layout (location = 11) uniform mat4 uInvProjMat;
+layout (location = 12) uniform mat4 uInvProjUnjitMat;
+layout (location = 13) uniform mat4 uDirLightViewMat;
+layout (location = 14) uniform vec3 uCameraPos;
+layout (location = 15) uniform vec2 uRenderScaleVec2;
+layout (location = 16) uniform mat4 uInvViewMat;
+
+//Modes
+layout (location = 20) uniform uint uRenderModeUint;
+
+//Techniques
+layout (location = 22) uniform uint uShadowMappingEnabledUint;
+layout (location = 24) uniform uint uTaaJitterEnabledUint;
+
+//Light
+layout (location = 30) uniform float uAmbientLightRadiantFluxFloat;
+layout (location = 31) uniform uint  uDirectLightEnabledUint;
+layout (location = 32) uniform float uDirectLightRadiantFluxFloat;
+layout (location = 33) uniform uint  uPointLightEnabledUint;
+layout (location = 34) uniform float uPointLightRadiantFluxFloat;
+layout (location = 39) uniform uint  uAmbientOcclusionEnabledUint;
+
+//Shadow cascades
+layout (location = 60) uniform mat4  uCascadeViewProjMatArray[4];
+layout (location = 64) uniform float uCascadeSplitFloatArray[4];
+layout (location = 68) uniform uint  uCascadeCountUint;
+
+//Samplers
+layout (binding = 0, location = 50) uniform sampler2D uDepthTextureSampler2D;
+layout (binding = 1, location = 51) uniform sampler2DArray uShadowMapSampler2DArray;
+layout (binding = 2, location = 52) uniform sampler2D uGBufferAlbedoSampler2D;
+layout (binding = 3, location = 53) uniform sampler2D uGBufferNormalSampler2D;
+layout (binding = 4, location = 54) uniform sampler2D uGBufferMaterialSampler2D;
+layout (binding = 5, location = 55) uniform sampler2D uAmbientOcclusionSampler2D;
+
+struct PointLight
+{
+    vec3 position;
+    float radius;
+};
+
+layout (std430, binding = 1) readonly buffer PointLights
+{
+    PointLight pointLights[];
+};
+
+// Filled by light_culling.comp, the light count of a tile followed by its light indices
+layout (std430, binding = 2) readonly buffer TileLights
+{
+    uint tileLights[];
+};
+
+layout (location = 0) in vec2 uv;
+
+layout (location = 0) out vec4 outColor;
+
+const uint LIGHT_TILE_SIZE = 16;
+const uint TILE_LIGHT_MAX_COUNT = 255;
+const float PI = 3.1415926535897932384626433832795;
+const vec3 SUN_LIGHT_COLOR = vec3(252.0 / 255.0, 212/ 255.0, 64 / 255.0); // Sun
+const vec3 POINT_LIGHT_COLOR = vec3(255.0 / 255.0, 209/ 255.0, 163 / 255.0); // 4000k
+const float SilkIOR = 1.5605f;
+const float MarbleIOR = 1.486f;
+const float LinenIOR = 5.14593f;
+const float AirIOR = 1.00029f;
+const float SMALL_EPS = 1e-5f;
+const float BIG_EPS = 0.1f;
+const vec3 CASCADE_COLORS[4] = vec3[](vec3(1, 0.2, 0.2), vec3(0.2, 1, 0.2), vec3(0.2, 0.2, 1), vec3(1, 1, 0.2));
+
+//BRDF, same as lighting.frag
+float Chi(vec3 n, vec3 h)
+{
+    return dot(n, h) > 0 ? 1 : 0;
+}
+
+float BeckmannNDF(vec3 n, vec3 h, float ro)
+{
+    float NoHSq = pow(dot(n, h), 2);
+    float RoSq = ro * ro + SMALL_EPS;
+    return Chi(n, h) / (PI * RoSq * pow(NoHSq, 2)) * exp((NoHSq - 1) / (RoSq * NoHSq));
+}
+
+float GinnekenLambdaFunction(vec3 v, vec3 l)
+{
+    float VoL = clamp(dot(v, l), -1, 1);
+    float fi = acos(VoL);
+    return (4.41 * (fi + SMALL_EPS)) / (4.41 * fi + 1);
+}
+
+float BeckmannLambdaFunction(vec3 n, vec3 s, float ro)
+{
+    float NoS = dot(n, s);
+    float a =  NoS / (ro * sqrt(1 - NoS*NoS) + SMALL_EPS);
+
+    return 1;
+    return a < 1.6 ? (1 - 1.259*a + 0.396*a*a) / (3.535*a + 2.181*a*a) : 0;
+}
+
+float SmithDirectionHeightCorrelatedMaskingShadowingFunction(
+    float lambdaL, float lambdaV, float lambdaVL
+)
+{
+    return 1 / (1 + max(lambdaV, lambdaL) + lambdaVL * min(lambdaV, lambdaL));
+}
+
+float SmithHeightCorrelatedMaskingShadowingFunction(
+    float lambdaL, float lambdaV
+)
+{
+    return 1 / (1 + lambdaV + lambdaL);
+}
+
+float FresnelSchlickF0(float iorMedium, float iorInterface)
+{
+    return pow((iorInterface - iorMedium)/(iorInterface + iorMedium), 2);
+}
+
+float FresnelSchlick(float F0, vec3 n, vec3 l)
+{
+    return F0 + (1 - F0) * pow((1 - max(0, dot(n, l) - SMALL_EPS)), 5);
+}
+
+float FresnelSchlick(vec3 v, vec3 l)
+{
+    vec3 h = (l + v) / length(l + v);
+    return FresnelSchlick(FresnelSchlickF0(AirIOR, MarbleIOR), h, l);
+}
+
+//Cloth BRDF
+float CharlieD(float roughness, float ndoth)
+{
+    float invR = 1. / roughness;
+    float cos2h = ndoth * ndoth;
+    float sin2h = 1. - cos2h;
+    return (2. + invR) * pow(sin2h, invR * .5) / (2. * PI);
+}
+
+float AshikhminV(float ndotv, float ndotl)
+{
+    return 1. / (4. * (ndotl + ndotv - ndotl * ndotv));
+}
+
+float CookToranceLinen(vec3 v, vec3 n, vec3 l, float ro)
+{
+    vec3 h = (l + v) / length(l + v);
+
+    float D = BeckmannNDF(n, h, ro);
+    float G2 = SmithDirectionHeightCorrelatedMaskingShadowingFunction(
+        BeckmannLambdaFunction(n, l, ro),
+        BeckmannLambdaFunction(n, v, ro),
+        GinnekenLambdaFunction(v, l)
+    );
+    float F = FresnelSchlick(FresnelSchlickF0(AirIOR, MarbleIOR), h, l);
+
+    return F * CharlieD(ro, dot(n,h)) * AshikhminV(dot(n,v), dot(n,l)) * PI * dot(n, l);
+}
+
+//Cloth BRDF
+
+float CookTorance(vec3 v, vec3 n, vec3 l, float ro)
+{
+    vec3 h = (l + v) / length(l + v);
+
+    float D = BeckmannNDF(n, h, ro);
+    float G2 = SmithDirectionHeightCorrelatedMaskingShadowingFunction(
+        BeckmannLambdaFunction(n, l, ro),
+        BeckmannLambdaFunction(n, v, ro),
+        GinnekenLambdaFunction(v, l)
+    );
+    float F = FresnelSchlick(FresnelSchlickF0(AirIOR, MarbleIOR), h, l);
+
+    return (F * G2 * D) / (4 * max(abs(dot(n, l)), BIG_EPS) * max(abs(dot(n, v)), BIG_EPS));
+}
+
+vec3 ShirleyFresnelSubSurfaceAlbedo(float F0, vec3 ssAlbedo, vec3 v, vec3 n, vec3 l)
+{
+    return 21.f / (20.f * PI) * (1 - F0) * ssAlbedo
+        * (1 - pow(1 - max(dot(n, l) - SMALL_EPS, 0), 5))
+        * (1 - pow(1 - max(dot(n, v) - SMALL_EPS, 0), 5));
+}
+
+float LightFalloffWindowingFunction(float r0, float rMin, float rMax, float r)
+{
+    return pow(r0 / max(r, rMin), 2) * pow(max(1 - pow(r / rMax, 4), 0), 2);
+}
+
+vec3 ViewPosFromDepth(float depth, vec2 TexCoord)
+{
+    vec4 clipSpacePosition = vec4(TexCoord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 viewSpacePosition = bool(uTaaJitterEnabledUint)
+        ? uInvProjMat * clipSpacePosition
+        : uInvProjUnjitMat * clipSpacePosition;
+    viewSpacePosition /= viewSpacePosition.w;
+
+    return viewSpacePosition.xyz;
+}
+
+vec3 DecodeOctahedral(vec2 f)
+{
+    vec3 n = vec3(f, 1 - abs(f.x) - abs(f.y));
+    float t = clamp(-n.z, 0, 1);
+    n.xy += vec2(n.x >= 0 ? -t : t, n.y >= 0 ? -t : t);
+
+    return normalize(n);
+}
+
+// Same selection as lighting.frag with the position reconstructed from depth
+uint SelectShadowCascade(vec3 positionView, vec4 positionWorld)
+{
+    float depth = -positionView.z;
+    uint cascade = 0;
+    while (cascade + 1u < uCascadeCountUint && depth > uCascadeSplitFloatArray[cascade])
+    {
+        cascade += 1;
+    }
+
+    while (cascade + 1u < uCascadeCountUint)
+    {
+        vec4 positionCascade = uCascadeViewProjMatArray[cascade] * positionWorld;
+        if (all(lessThanEqual(abs(positionCascade.xy / positionCascade.w), vec2(1))))
+        {
+            break;
+        }
+        cascade += 1;
+    }
+
+    return cascade;
+}
+
+float SampleAmbientOcclusion()
+{
+    return bool(uAmbientOcclusionEnabledUint) ? texelFetch(uAmbientOcclusionSampler2D, ivec2(gl_FragCoord.xy), 0).r : 1;
+}
+
+// CalculateRadiance of lighting.frag with the material read from the G-buffer, only the lights of the tile are shaded
+vec3 CalculateRadiance(
+    vec3 positionWorld, vec3 ssAlbedo, vec3 normal, vec3 n, float ro, uint brdf, float shadowMapDepth, vec3 shadowPosMVP)
+{
+    vec3 viewDirection = -normalize(positionWorld - uCameraPos);
+    vec3 directionalLightDir = (uViewMat * uDirLightViewMat * vec4(0, 0, -1, 0)).xyz;
+    vec3 radiance = ssAlbedo * uAmbientLightRadiantFluxFloat * SampleAmbientOcclusion();
+
+    if (bool(uPointLightEnabledUint))
+    {
+        ivec2 size = ivec2(vec2(textureSize(uDepthTextureSampler2D, 0)) * uRenderScaleVec2 + 0.5);
+        uvec2 tile = uvec2(gl_FragCoord.xy) / LIGHT_TILE_SIZE;
+        uint tileCountX = (size.x + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+        uint offset = (tile.y * tileCountX + tile.x) * (TILE_LIGHT_MAX_COUNT + 1);
+
+        uint count = tileLights[offset];
+        for (uint i = 0; i < count; i+=1)
+        {
+            PointLight light = pointLights[tileLights[offset + 1 + i]];
+            vec3 pointLightDir = -normalize(positionWorld - light.position);
+            vec3 fDiffPL = ShirleyFresnelSubSurfaceAlbedo(
+                FresnelSchlickF0(AirIOR, MarbleIOR), ssAlbedo, viewDirection, normal, pointLightDir); //Shirley
+            vec3 fSpecPL = PI * (brdf == 0
+                    ? CookTorance(viewDirection, normal, pointLightDir, ro)
+                    : CookToranceLinen(viewDirection, normal, pointLightDir, ro))
+                * POINT_LIGHT_COLOR * uPointLightRadiantFluxFloat * max(dot(n, pointLightDir), 0);
+
+            float d = distance(light.position, positionWorld);
+            radiance += LightFalloffWindowingFunction(1, 1, light.radius, d) * 100000 * (fSpecPL + fDiffPL);
+        }
+    }
+
+    if (bool(uDirectLightEnabledUint))
+    {
+        vec3 fSpecDL = vec3(0);
+        if (bool(uShadowMappingEnabledUint) && shadowPosMVP.z - 0.01f < shadowMapDepth)
+        {
+            fSpecDL = PI * (brdf == 0
+                    ? CookTorance(viewDirection, normal, directionalLightDir, ro)
+                    : CookToranceLinen(viewDirection, normal, directionalLightDir, ro))
+                * SUN_LIGHT_COLOR * uDirectLightRadiantFluxFloat * max(dot(n, directionalLightDir), 0);
+
+            radiance += (fSpecDL + ssAlbedo / PI);
+        }
+    }
+
+    return radiance;
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(uDepthTextureSampler2D, texel, 0).r;
+    if (depth >= 1)
+    {
+        outColor = vec4(0); //Nothing was drawn, same as the cleared forward target
+        return;
+    }
+
+    vec4 albedo = texelFetch(uGBufferAlbedoSampler2D, texel, 0);
+    vec4 normals = texelFetch(uGBufferNormalSampler2D, texel, 0);
+    uint material = uint(texelFetch(uGBufferMaterialSampler2D, texel, 0).r * 255 + 0.5);
+    vec3 normal = DecodeOctahedral(normals.xy);
+    vec3 n = DecodeOctahedral(normals.zw);
+    float ro = albedo.a;
+    uint brdf = material & 1u;
+    bool debugRenderModel = (material & 2u) != 0;
+
+    vec2 sceneSize = vec2(textureSize(uDepthTextureSampler2D, 0)) * uRenderScaleVec2;
+    vec3 positionView = ViewPosFromDepth(depth, gl_FragCoord.xy / sceneSize);
+    vec4 positionWorld = uInvViewMat * vec4(positionView, 1);
+
+    uint cascade = SelectShadowCascade(positionView, positionWorld);
+    vec4 positionShadowMapMvp = uCascadeViewProjMatArray[cascade] * positionWorld;
+    vec3 shadowPosMVP = positionShadowMapMvp.xyz / positionShadowMapMvp.w;
+    float shadowMapDepth = texture(uShadowMapSampler2DArray, vec3((shadowPosMVP.xy+1)*0.5f, cascade)).x * 2 - 1;
+
+    //The views of lighting.frag that need more than the G-buffer show the same fallback as a missing map
+    outColor = vec4(n + vec3(1, 0, 0), 1);
+    if (uRenderModeUint == 0) // Full
+    {
+        outColor = debugRenderModel
+            ? vec4(albedo.rgb, 0.3f)
+            : vec4(CalculateRadiance(positionWorld.xyz, albedo.rgb, normal, n, ro, brdf, shadowMapDepth, shadowPosMVP), 1);
+    }
+    else if (uRenderModeUint == 1) // Normal
+    {
+        outColor = vec4((n + 1) * 0.5f, 1);
+    }
+    else if (uRenderModeUint == 2) // NormalMap
+    {
+        outColor = vec4((n + normal + 1) * 0.5f, 1);
+    }
+    else if (uRenderModeUint == 4) // Depth
+    {
+        outColor = vec4(vec3(pow(depth, 4096)), 1);
+    }
+    else if (uRenderModeUint == 5) // ShadowMap
+    {
+        outColor = vec4(CASCADE_COLORS[cascade] * (shadowPosMVP.z - 0.1f < shadowMapDepth ? 1.0f : 0.25f), 1);
+    }
+    else if (uRenderModeUint == 7) // Roughness
+    {
+        outColor = vec4(vec3(ro), 1);
+    }
+    else if (uRenderModeUint == 8) // AmbientOcclusion
+    {
+        outColor = vec4(vec3(SampleAmbientOcclusion()), 1);
+    }
+}
@@ -8,6 +8,8 @@ layout (location = 15) uniform uint uTaaJitterEnabledUint;
 
 layout (location = 0) in vec3 aPosition;
 
+invariant gl_Position; //Matches velocity.vert
+
 void main()
 {
     mat4 projection = bool(uTaaJitterEnabledUint) ? uProjMat : uProjUnjitMat;
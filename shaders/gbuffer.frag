@@ -0,0 +1,125 @@
+#version 460
+
+//Model
+layout (location = 10) uniform vec3 uColor;
+layout (location = 17) uniform vec3 uCameraPos;
+
+//Modes
+layout (location = 21) uniform uint uDebugRenderModeEnabledUint;
+
+//Techniques
+layout (location = 23) uniform uint uBumpMappingEnabledUint;
+layout (location = 18) uniform uint uTextureSupersamplingEnabledUint;
+
+//Materials
+layout (location = 25) uniform uint  uBumpMapAvailableUint;
+layout (location = 26) uniform float uBumpMapScaleFactorFloat;
+layout (location = 28) uniform uint  uRoughnessMapAvailableUint;
+layout (location = 29) uniform uint  uBrdfUint;
+
+//Samplers, the pass has no dependencies so the model textures start at unit 0
+layout (binding = 0, location = 52) uniform sampler2D uAlbedoMapSampler2D;
+layout (binding = 1, location = 53) uniform sampler2D uNormalMapSampler2D;
+layout (binding = 2, location = 54) uniform sampler2D uBumpMapSampler2D;
+layout (binding = 4, location = 56) uniform sampler2D uRoughnessSampler2D;
+
+layout (location = 0) in vec4 positionWorld;
+layout (location = 2) in vec3 normalWorld;
+layout (location = 6) in vec2 inUv;
+layout (location = 7) in vec4 prevPositionClip;
+layout (location = 8) in vec4 positionClip;
+
+// Albedo and roughness, the mapped and the geometric normal, BRDF and debug flags.
+// Blending is off while the G-buffer is written, every channel is data.
+layout (location = 0) out vec4 outAlbedo;
+layout (location = 1) out vec4 outNormal;
+layout (location = 2) out float outMaterial;
+layout (location = 3) out vec4 outVelocity; //Only attached with eVelocityMode::LightingMRT
+
+const float MipBias = -2.0;
+
+vec3 AnisatropicTextureSample(sampler2D samp, vec2 sampleUV)
+{
+    // per pixel partial derivatives
+    vec2 dx = dFdxFine(sampleUV.xy);
+    vec2 dy = dFdyFine(sampleUV.xy);
+
+    // rotated grid uv offsets
+    vec2 uvOffsets = vec2(0.125, 0.375);
+    vec4 offsetUV = vec4(0.0, 0.0, 0.0, MipBias);
+
+    // supersampled using 2x2 rotated grid
+    vec3 color = vec3(0);
+    offsetUV.xy = sampleUV.xy + uvOffsets.x * dx + uvOffsets.y * dy;
+    color += texture(samp, offsetUV.xy, MipBias).rgb;
+    offsetUV.xy = sampleUV.xy - uvOffsets.x * dx - uvOffsets.y * dy;
+    color += texture(samp, offsetUV.xy, MipBias).rgb;
+    offsetUV.xy = sampleUV.xy + uvOffsets.y * dx - uvOffsets.x * dy;
+    color += texture(samp, offsetUV.xy, MipBias).rgb;
+    offsetUV.xy = sampleUV.xy - uvOffsets.y * dx + uvOffsets.x * dy;
+    color += texture(samp, offsetUV.xy, MipBias).rgb;
+    color *= 0.25;
+
+    return color;
+}
+
+// A single fetch with the anisotropic sampler of the pass, the rotated grid is the quality option
+vec3 SampleMaterial(sampler2D samp, vec2 sampleUV)
+{
+    return bool(uTextureSupersamplingEnabledUint)
+        ? AnisatropicTextureSample(samp, sampleUV)
+        : texture(samp, sampleUV).rgb;
+}
+
+mat3 CalculateTBNMatrix( vec3 N, vec3 p, vec2 pUV )
+{
+    // get edge vectors of the pixel triangle
+    vec3 dp1 = dFdx( p );
+    vec3 dp2 = dFdy( p );
+    vec2 duv1 = dFdx( pUV );
+    vec2 duv2 = dFdy( pUV );
+
+    // solve the linear system
+    vec3 dp2perp = cross( dp2, N );
+    vec3 dp1perp = cross( N, dp1 );
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+
+    // construct a scale-invariant frame
+    float invmax = inversesqrt( max( dot(T,T), dot(B,B) ) );
+    return mat3( T * invmax, B * invmax, N );
+}
+
+// Unit vector to the [-1, 1] square, decoded by DecodeOctahedral in deferred_lighting.frag
+vec2 EncodeOctahedral(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0 ? 1 : -1, n.y >= 0 ? 1 : -1);
+
+    return n.z >= 0 ? n.xy : (1 - abs(n.yx)) * signs;
+}
+
+void main()
+{
+    //Same as velocity.frag
+    outVelocity = vec4((positionClip.xyz / positionClip.w - prevPositionClip.xyz / prevPositionClip.w) / 2, 1);
+
+    vec3 n = normalize(normalWorld);
+    mat3 TBN = CalculateTBNMatrix(n, positionWorld.xyz / positionWorld.w, inUv);
+    vec2 uv = inUv;
+
+    //Same material sampling as CalculateRadiance in lighting.frag
+    if (bool(uBumpMapAvailableUint) && bool(uBumpMappingEnabledUint))
+    {
+        vec3 viewDirection = -normalize(positionWorld.xyz / positionWorld.w - uCameraPos);
+        float h = SampleMaterial(uBumpMapSampler2D, uv).r;
+        uv = uv + h * (TBN * viewDirection.xyz).xy * uBumpMapScaleFactorFloat;
+    }
+    vec3 ssAlbedo = bool(uDebugRenderModeEnabledUint) ? uColor : SampleMaterial(uAlbedoMapSampler2D, uv).rgb;
+    vec3 normal = normalize(TBN * normalize((SampleMaterial(uNormalMapSampler2D, uv).xyz * 2) - 1));
+    float ro = bool(uRoughnessMapAvailableUint) ? SampleMaterial(uRoughnessSampler2D, uv).r : 1;
+
+    outAlbedo = vec4(ssAlbedo, ro);
+    outNormal = vec4(EncodeOctahedral(normal), EncodeOctahedral(n));
+    outMaterial = float(uBrdfUint | (uDebugRenderModeEnabledUint << 1)) / 255;
+}
@@ -16,6 +16,7 @@ layout (location = 21) uniform uint uDebugRenderModeEnabledUint;
 layout (location = 22) uniform uint uShadowMappingEnabledUint;
 layout (location = 23) uniform uint uBumpMappingEnabledUint;
 layout (location = 24) uniform uint uTaaJitterEnabledUint;
+layout (location = 18) uniform uint uTextureSupersamplingEnabledUint;
 
 //Materials
 layout (location = 25) uniform uint  uBumpMapAvailableUint;
@@ -30,26 +31,59 @@ layout (location = 31) uniform uint  uDirectLightEnabledUint;
 layout (location = 32) uniform float uDirectLightRadiantFluxFloat;
 layout (location = 33) uniform uint  uPointLightEnabledUint;
 layout (location = 34) uniform float uPointLightRadiantFluxFloat;
-layout (location = 35) uniform vec3  uPointLightPosVec3Array[5];
+layout (location = 35) uniform uint  uPointLightCountUint;
+layout (location = 36) uniform uint  uClusteredLightingEnabledUint;
+layout (location = 37) uniform vec2  uClusterScaleVec2; //Clusters per texel in x and y
+layout (location = 38) uniform vec2  uClusterDepthScaleBiasVec2; //Slice from log2 of the view depth
+layout (location = 39) uniform uint  uAmbientOcclusionEnabledUint;
+
+//Shadow cascades
+layout (location = 60) uniform mat4  uCascadeViewProjMatArray[4];
+layout (location = 64) uniform float uCascadeSplitFloatArray[4];
+layout (location = 68) uniform uint  uCascadeCountUint;
 
 //Samplers
-layout (binding = 0, location = 50) uniform sampler2D uDepthTextureSampler2D;
-layout (binding = 1, location = 51) uniform sampler2D uShadowMapSampler2D;
+layout (binding = 0, location = 50) uniform sampler2D uAmbientOcclusionSampler2D; //Scene resolution, see ambient_occlusion_upsample.frag
+layout (binding = 1, location = 51) uniform sampler2DArray uShadowMapSampler2DArray;
 layout (binding = 2, location = 52) uniform sampler2D uAlbedoMapSampler2D;
 layout (binding = 3, location = 53) uniform sampler2D uNormalMapSampler2D;
 layout (binding = 4, location = 54) uniform sampler2D uBumpMapSampler2D;
 layout (binding = 5, location = 55) uniform sampler2D uMetallicSampler2D;
 layout (binding = 6, location = 56) uniform sampler2D uRoughnessSampler2D;
 
+struct PointLight
+{
+    vec3 position;
+    float radius;
+};
+
+layout (std430, binding = 1) readonly buffer PointLights
+{
+    PointLight pointLights[];
+};
+
+// Built on the CPU by BuildLightClusters, the offset and count of every cluster in clusterLightIndices
+layout (std430, binding = 3) readonly buffer ClusterRanges
+{
+    uvec2 clusterRanges[];
+};
+
+layout (std430, binding = 4) readonly buffer ClusterLightIndices
+{
+    uint clusterLightIndices[];
+};
+
 layout (location = 0) in vec4 positionWorld;
 layout (location = 1) in vec4 positionView;
 layout (location = 2) in vec3 normalWorld;
 layout (location = 3) in vec3 normalView;
 layout (location = 4) in vec3 directionalLightDir;
-layout (location = 5) in vec4 positionShadowMapMvp;
 layout (location = 6) in vec2 inUv;
+layout (location = 7) in vec4 prevPositionClip;
+layout (location = 8) in vec4 positionClip;
 
 layout (location = 0) out vec4 outColor;
+layout (location = 1) out vec4 outVelocity; //Only attached with eVelocityMode::LightingMRT
 
 const float MipBias = -2.0;
 const float PI = 3.1415926535897932384626433832795;
@@ -61,6 +95,8 @@ const float LinenIOR = 5.14593f;
 const float AirIOR = 1.00029f;
 const float SMALL_EPS = 1e-5f;
 const float BIG_EPS = 0.1f;
+const uvec3 CLUSTER_COUNT = uvec3(16, 9, 24);
+const vec3 CASCADE_COLORS[4] = vec3[](vec3(1, 0.2, 0.2), vec3(0.2, 1, 0.2), vec3(0.2, 0.2, 1), vec3(1, 1, 0.2));
 
 vec3 AnisatropicTextureSample(sampler2D samp, vec2 sampleUV)
 {
@@ -87,6 +123,14 @@ vec3 AnisatropicTextureSample(sampler2D samp, vec2 sampleUV)
     return color;
 }
 
+// A single fetch with the anisotropic sampler of the pass, the rotated grid is the quality option
+vec3 SampleMaterial(sampler2D samp, vec2 sampleUV)
+{
+    return bool(uTextureSupersamplingEnabledUint)
+        ? AnisatropicTextureSample(samp, sampleUV)
+        : texture(samp, sampleUV).rgb;
+}
+
 mat3 CalculateTBNMatrix( vec3 N, vec3 p, vec2 pUV )
 {
     // get edge vectors of the pixel triangle
@@ -222,60 +266,21 @@ float LightFalloffWindowingFunction(float r0, float rMin, float rMax, float r)
     return pow(r0 / max(r, rMin), 2) * pow(max(1 - pow(r / rMax, 4), 0), 2);
 }
 
-vec3 ViewPosFromDepth(float depth, vec2 TexCoord)
+// Same grid as BuildLightClusters, the slices grow exponentially with the view depth
+uint SelectCluster()
 {
-    vec4 clipSpacePosition = vec4(TexCoord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
-    vec4 viewSpacePosition = bool(uTaaJitterEnabledUint)
-        ? inverse(uProjMat) * clipSpacePosition
-        : inverse(uProjUnjitMat) * clipSpacePosition;
-    viewSpacePosition /= viewSpacePosition.w;
+    float depth = max(-positionView.z / positionView.w, 1e-4f);
+    uvec3 cluster = uvec3(
+        uvec2(gl_FragCoord.xy * uClusterScaleVec2),
+        uint(max(log2(depth) * uClusterDepthScaleBiasVec2.x + uClusterDepthScaleBiasVec2.y, 0)));
+    cluster = min(cluster, CLUSTER_COUNT - 1);
 
-    return viewSpacePosition.xyz;
+    return (cluster.z * CLUSTER_COUNT.y + cluster.y) * CLUSTER_COUNT.x + cluster.x;
 }
 
-float HBAO(vec2 uv, vec3 n)
+float SampleAmbientOcclusion()
 {
-    ivec2 wh = textureSize(uDepthTextureSampler2D, 0);
-
-    float dx = 1.0f / wh.x;
-    float dy = 1.0f / wh.y;
-
-    const int HBAO_SAMPLES = 4;
-
-    vec3 minDirection = normalize(ViewPosFromDepth(texture(uDepthTextureSampler2D, uv).r, uv) - positionWorld.xyz / positionWorld.w);
-    float minDot = abs(dot(minDirection, n));
-
-    for (int x = -HBAO_SAMPLES; x < HBAO_SAMPLES; ++x)
-    {
-        vec2 sampleUV = uv + vec2(x*dx, 0);
-
-        vec3 sampleWorldPos = ViewPosFromDepth(texture(uDepthTextureSampler2D, sampleUV).r, sampleUV);
-        vec3 sampleDirection = normalize(sampleWorldPos - positionWorld.xyz / positionWorld.w);
-
-        float NoD = dot(n, sampleDirection);
-        if (abs(NoD) < abs(minDot))
-        {
-            minDot = NoD;
-            minDirection = sampleDirection;
-        }
-    }
-
-    for (int y = -HBAO_SAMPLES; y < HBAO_SAMPLES; ++y)
-    {
-        vec2 sampleUV = uv + vec2(0, y*dx);
-
-        vec3 sampleWorldPos = ViewPosFromDepth(texture(uDepthTextureSampler2D, sampleUV).r, sampleUV);
-        vec3 sampleDirection = normalize(sampleWorldPos - positionWorld.xyz / positionWorld.w);
-
-        float NoD = dot(n, sampleDirection);
-        if (abs(NoD) < abs(minDot))
-        {
-            minDot = NoD;
-            minDirection = sampleDirection;
-        }
-    }
-
-    return 1 - minDot;
+    return bool(uAmbientOcclusionEnabledUint) ? texelFetch(uAmbientOcclusionSampler2D, ivec2(gl_FragCoord.xy), 0).r : 1;
 }
 
 vec3 CalculateRadiance(float shadowMapDepth, vec2 uv, vec3 n, vec3 shadowPosMVP, mat3 TBN)
@@ -284,19 +289,26 @@ vec3 CalculateRadiance(float shadowMapDepth, vec2 uv, vec3 n, vec3 shadowPosMVP,
 
     if (bool(uBumpMapAvailableUint) && bool(uBumpMappingEnabledUint))
     {
-        float h = AnisatropicTextureSample(uBumpMapSampler2D, uv).r;
+        float h = SampleMaterial(uBumpMapSampler2D, uv).r;
         uv = uv + h * (TBN * viewDirection.xyz).xy * uBumpMapScaleFactorFloat;
     }
-    vec3 ssAlbedo = AnisatropicTextureSample(uAlbedoMapSampler2D, uv).rgb;
-    vec3 normal = normalize(TBN * normalize((AnisatropicTextureSample(uNormalMapSampler2D, uv).xyz * 2) - 1));
-    float ro = bool(uRoughnessMapAvailableUint) ? AnisatropicTextureSample(uRoughnessSampler2D, uv).r : 1;
-    vec3 radiance = ssAlbedo * uAmbientLightRadiantFluxFloat;
+    vec3 ssAlbedo = SampleMaterial(uAlbedoMapSampler2D, uv).rgb;
+    vec3 normal = normalize(TBN * normalize((SampleMaterial(uNormalMapSampler2D, uv).xyz * 2) - 1));
+    float ro = bool(uRoughnessMapAvailableUint) ? SampleMaterial(uRoughnessSampler2D, uv).r : 1;
+    vec3 radiance = ssAlbedo * uAmbientLightRadiantFluxFloat * SampleAmbientOcclusion();
 
     if (bool(uPointLightEnabledUint))
     {
-        for (uint i = 0; i < 5; i+=1)
+        uvec2 lights = uvec2(0, uPointLightCountUint);
+        if (bool(uClusteredLightingEnabledUint))
         {
-            vec3 pointLightDir = -normalize(positionWorld.xyz / positionWorld.w - uPointLightPosVec3Array[i]);
+            lights = clusterRanges[SelectCluster()];
+        }
+
+        for (uint i = 0; i < lights.y; i+=1)
+        {
+            PointLight light = pointLights[bool(uClusteredLightingEnabledUint) ? clusterLightIndices[lights.x + i] : i];
+            vec3 pointLightDir = -normalize(positionWorld.xyz / positionWorld.w - light.position);
             vec3 fDiffPL = ShirleyFresnelSubSurfaceAlbedo(
                 FresnelSchlickF0(AirIOR, MarbleIOR), ssAlbedo, viewDirection, normal, pointLightDir); //Shirley
             //vec3 fDiffPL = ssAlbedo / PI; //Lambert
@@ -305,8 +317,8 @@ vec3 CalculateRadiance(float shadowMapDepth, vec2 uv, vec3 n, vec3 shadowPosMVP,
                     : CookToranceLinen(viewDirection, normal, pointLightDir, ro))
                 * POINT_LIGHT_COLOR * uPointLightRadiantFluxFloat * max(dot(n, pointLightDir), 0);
 
-            float d = distance(uPointLightPosVec3Array[i], positionWorld.xyz / positionWorld.w);
-            radiance += LightFalloffWindowingFunction(1, 1, 350, d) * 100000 * (fSpecPL + fDiffPL);
+            float d = distance(light.position, positionWorld.xyz / positionWorld.w);
+            radiance += LightFalloffWindowingFunction(1, 1, light.radius, d) * 100000 * (fSpecPL + fDiffPL);
         }
     }
 
@@ -327,14 +339,44 @@ vec3 CalculateRadiance(float shadowMapDepth, vec2 uv, vec3 n, vec3 shadowPosMVP,
     return radiance;
 }
 
+// The first cascade whose far plane is behind the fragment, the last one covers the rest.
+// Cascades fitted to the visible samples lag a few frames behind, so a fragment outside
+// of its cascade falls back to the next one.
+uint SelectShadowCascade()
+{
+    float depth = -positionView.z / positionView.w;
+    uint cascade = 0;
+    while (cascade + 1u < uCascadeCountUint && depth > uCascadeSplitFloatArray[cascade])
+    {
+        cascade += 1;
+    }
+
+    while (cascade + 1u < uCascadeCountUint)
+    {
+        vec4 positionCascade = uCascadeViewProjMatArray[cascade] * positionWorld;
+        if (all(lessThanEqual(abs(positionCascade.xy / positionCascade.w), vec2(1))))
+        {
+            break;
+        }
+        cascade += 1;
+    }
+
+    return cascade;
+}
+
 void main()
 {
+    //Same as velocity.frag
+    outVelocity = vec4((positionClip.xyz / positionClip.w - prevPositionClip.xyz / prevPositionClip.w) / 2, 1);
+
     outColor = vec4(1, 0, 0, 1);
     vec3 n = normalize(normalWorld);
     vec3 l = normalize(directionalLightDir);
 
+    uint cascade = SelectShadowCascade();
+    vec4 positionShadowMapMvp = uCascadeViewProjMatArray[cascade] * positionWorld;
     vec3 shadowPosMVP = positionShadowMapMvp.xyz / positionShadowMapMvp.w;
-    float shadowMapDepth = texture(uShadowMapSampler2D, (shadowPosMVP.xy+1)*0.5f).x * 2 - 1;
+    float shadowMapDepth = texture(uShadowMapSampler2DArray, vec3((shadowPosMVP.xy+1)*0.5f, cascade)).x * 2 - 1;
 
     mat3 TBN = CalculateTBNMatrix(n, positionWorld.xyz / positionWorld.w, inUv);
     vec2 uv = inUv;
@@ -346,7 +388,6 @@ void main()
         }
         else{
             vec3 radiance = CalculateRadiance(shadowMapDepth, uv, n, shadowPosMVP, TBN);
-            //outColor = vec4(vec3(HBAO(uv, n)), 1);
             outColor = vec4(radiance, 1);
         }
     }
@@ -359,7 +400,7 @@ void main()
         if (bool(uBumpMapAvailableUint) && bool(uBumpMappingEnabledUint))
         {
             vec3 view = -normalize(positionWorld.xyz / positionWorld.w - uCameraPos);
-            float h = AnisatropicTextureSample(uBumpMapSampler2D, uv).r;
+            float h = SampleMaterial(uBumpMapSampler2D, uv).r;
             uv = uv + h * (TBN * view.xyz).xy * uBumpMapScaleFactorFloat;
 
         }
@@ -383,7 +424,7 @@ void main()
     }
     else if (uRenderModeUint == 5) // ShadowMap
     {
-        outColor = vec4(vec3(shadowPosMVP.z - 0.1f < shadowMapDepth ? 1 : 0), 1);
+        outColor = vec4(CASCADE_COLORS[cascade] * (shadowPosMVP.z - 0.1f < shadowMapDepth ? 1.0f : 0.25f), 1);
     }
     else if (uRenderModeUint == 6) // Metallic
     {
@@ -397,4 +438,8 @@ void main()
             ? vec4(texture(uRoughnessSampler2D, uv, MipBias).rrr, 1)
             : vec4(n + vec3(1, 0, 0), 1);
     }
+    else if (uRenderModeUint == 8) // AmbientOcclusion
+    {
+        outColor = vec4(vec3(SampleAmbientOcclusion()), 1);
+    }
 }
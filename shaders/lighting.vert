@@ -5,9 +5,11 @@ layout (location = 11) uniform mat4 uModelMat;
 layout (location = 12) uniform mat4 uViewMat;
 layout (location = 13) uniform mat4 uProjMat;
 layout (location = 14) uniform mat4 uDirLightViewMat;
-layout (location = 15) uniform mat4 uDirLightProjMat;
 layout (location = 16) uniform mat4 uProjUnjitMat;
 layout (location = 24) uniform uint uTaaJitterEnabledUint;
+layout (location = 70) uniform mat4 uPrevModelMat;
+layout (location = 71) uniform mat4 uPrevViewMat;
+layout (location = 72) uniform mat4 uPrevProjUnjitMat;
 
 layout (location = 0) in vec3 aPosition;
 layout (location = 1) in vec3 aNormal;
@@ -18,8 +20,9 @@ layout (location = 1) out vec4 positionView;
 layout (location = 2) out vec3 normalWorld;
 layout (location = 3) out vec3 normalView;
 layout (location = 4) out vec3 directionalLightDir;
-layout (location = 5) out vec4 positionShadowMapMvp;
 layout (location = 6) out vec2 uv;
+layout (location = 7) out vec4 prevPositionClip; //Unjittered, for the velocity attachment
+layout (location = 8) out vec4 positionClip;
 
 void main()
 {
@@ -30,10 +33,12 @@ void main()
     normalView = (uViewMat * uModelMat * vec4(aNormal, 0)).xyz;
 
     directionalLightDir = (uViewMat * uDirLightViewMat * vec4(0, 0, -1, 0)).xyz;
-    positionShadowMapMvp = uDirLightProjMat * uDirLightViewMat * positionWorld;
 
     uv = aUV;
 
+    prevPositionClip = uPrevProjUnjitMat * uPrevViewMat * uPrevModelMat * vec4(aPosition, 1);
+    positionClip = uProjUnjitMat * uViewMat * uModelMat * vec4(aPosition, 1);
+
     mat4 projection = bool(uTaaJitterEnabledUint) ? uProjMat : uProjUnjitMat;
     gl_Position = projection * uViewMat * uModelMat * vec4(aPosition, 1);
 }
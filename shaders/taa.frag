@@ -1,7 +1,7 @@
 #version 460
 
 layout (location = 10) uniform mat4 uViewMat;
-layout (location = 11) uniform mat4 uProjMat;
+layout (location = 11) uniform mat4 uInvViewMat;
 layout (location = 14) uniform mat4 uProjUnjitMat;
 layout (location = 12) uniform mat4 uPrevViewMat;
 layout (location = 13) uniform mat4 uPrevProjMat;
@@ -15,6 +15,10 @@ layout (location = 20, binding = 0) uniform sampler2D uColorTextureSampler2D;
 layout (location = 21, binding = 1) uniform sampler2D uDepthTextureSampler2D;
 layout (location = 22, binding = 2) uniform sampler2D uHistoryTextureSampler2D;
 layout (location = 23, binding = 3) uniform sampler2D uVelocityTextureSampler2D;
+layout (location = 24) uniform vec2 uRenderScaleVec2;
+layout (location = 25) uniform uint uCameraVelocityFromDepthUint;
+layout (location = 26) uniform mat4 uInvProjMat;
+layout (location = 27) uniform mat4 uInvProjUnjitMat;
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
@@ -57,21 +61,29 @@ vec4 ResolveSampleColor(vec4 color)
     return vec4(YCoCg2RGB(color.xyz), color.a);
 }
 
+// The current frame is rendered into the lower left part of the color, depth and velocity textures,
+// the history and the output always cover the full textures
+vec2 SceneUV(vec2 uv)
+{
+    vec2 halfTexel = 0.5f / textureSize(uColorTextureSampler2D, 0);
+    return clamp(uv * uRenderScaleVec2, halfTexel, uRenderScaleVec2 - halfTexel);
+}
+
 vec3 WorldPosFromDepth(float depth, vec2 TexCoord)
 {
     vec4 clipSpacePosition = vec4(TexCoord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
     vec4 viewSpacePosition = bool(uTaaJitterEnabledUint)
-        ? inverse(uProjMat) * clipSpacePosition
-        : inverse(uProjUnjitMat) * clipSpacePosition;
+        ? uInvProjMat * clipSpacePosition
+        : uInvProjUnjitMat * clipSpacePosition;
     viewSpacePosition /= viewSpacePosition.w;
-    vec4 worldSpacePosition = inverse(uViewMat) * viewSpacePosition;
+    vec4 worldSpacePosition = uInvViewMat * viewSpacePosition;
 
     return worldSpacePosition.xyz;
 }
 
 vec3 ReverseReprojectFrag(vec2 uv, vec2 jitter)
 {
-    vec3 fragPosWorld = WorldPosFromDepth(texture(uDepthTextureSampler2D, uv - jitter).r, uv);
+    vec3 fragPosWorld = WorldPosFromDepth(texture(uDepthTextureSampler2D, SceneUV(uv - jitter)).r, uv);
 
     vec4 fragPosPrevProj = bool(uTaaJitterEnabledUint)
         ? uPrevProjMat * uPrevViewMat * vec4(fragPosWorld, 1)
@@ -252,11 +264,28 @@ vec3 SampleAverage(vec2 uv, bool isVelocitySubpixel)
     return averageCross;
 }
 
+// Motion of a static surface under the camera, encoded the way velocity.frag does it
+vec2 ReconstructCameraVelocity(vec2 sceneUV)
+{
+    vec3 fragPosWorld = WorldPosFromDepth(texture(uDepthTextureSampler2D, sceneUV).r, sceneUV / uRenderScaleVec2);
+
+    vec4 currentPos = uProjUnjitMat * uViewMat * vec4(fragPosWorld, 1);
+    vec4 prevPos = uPrevProjUnjitMat * uPrevViewMat * vec4(fragPosWorld, 1);
+
+    return (currentPos.xy / currentPos.w - prevPos.xy / prevPos.w) / 2;
+}
+
 vec2 SampleDilateVelocity(vec2 uv)
 {
     vec2 velocityUV = SampleLocal3x3DepthMinimaUV(uDepthTextureSampler2D, uv);
     vec2 velocity = texture(uVelocityTextureSampler2D, velocityUV).xy;
 
+    //Only the dynamic models were drawn, everything left at zero moved with the camera alone
+    if (bool(uCameraVelocityFromDepthUint) && velocity == vec2(0))
+    {
+        velocity = ReconstructCameraVelocity(velocityUV);
+    }
+
     return velocity;
 }
 
@@ -310,7 +339,7 @@ vec4 TemporalReprojection()
     float feedback = 0.05f;
     //vec2 jitter = bool(uTaaJitterEnabledUint) ? -uJitterVec2 : vec2(0);
     vec2 jitter = vec2(0);
-    vec2 uvUnjit = uv - jitter;
+    vec2 uvUnjit = SceneUV(uv - jitter);
     vec3 fragPosPrevProj = ReverseReprojectFrag(uv, jitter);
 
     if (fragPosPrevProj.x > 1 || fragPosPrevProj.x < -1 || fragPosPrevProj.y > 1 || fragPosPrevProj.y < -1)
@@ -321,8 +350,8 @@ vec4 TemporalReprojection()
     else
     {
         ivec2 textureResolution = textureSize(uDepthTextureSampler2D, 0);
-        vec2 dxdy =  1.f / textureResolution;
-        vec2 velocity = SampleDilateVelocity(uv);
+        vec2 dxdy =  1.f / (textureResolution * uRenderScaleVec2);
+        vec2 velocity = SampleDilateVelocity(SceneUV(uv));
         const bool isVelocitySubpixel = abs(velocity.x) < dxdy.x / 2 && abs(velocity.y) < dxdy.y / 2;
 
 #ifdef  USE_VELOCITY_CORRECTED_UV
@@ -376,7 +405,7 @@ vec4 TemporalReprojection()
                 for (int i = 0; i < 4; i++) {
                     vec3 c = SampleColorTexture(
                         uColorTextureSampler2D,
-                        uv + offsets[i] / textureResolution.xy).rgb;
+                        uvUnjit + offsets[i] / textureResolution.xy).rgb;
                     mean += c;
                     stddev += c * c;
                 }
@@ -412,7 +441,7 @@ vec4 TemporalReprojection()
         else
         {
             //ToDo: Gaussian Blur
-            reprojectedColor = vec4(SampleColorTexture(uColorTextureSampler2D, uv).rgb, 1);
+            reprojectedColor = vec4(SampleColorTexture(uColorTextureSampler2D, SceneUV(uv)).rgb, 1);
         }
     }
 
@@ -424,12 +453,12 @@ void main()
     if (bool(uTaaEnabledUint))
     {
         outColor = uFrameCountUint < 2
-            ? ResolveSampleColor(vec4(SampleColorTexture(uColorTextureSampler2D, uv).rgb, 1))
+            ? ResolveSampleColor(vec4(SampleColorTexture(uColorTextureSampler2D, SceneUV(uv)).rgb, 1))
             : ResolveSampleColor(TemporalReprojection());
     }
     else
     {
-        outColor = ResolveSampleColor(vec4(SampleColorTexture(uColorTextureSampler2D, uv).rgb, 1));
+        outColor = ResolveSampleColor(vec4(SampleColorTexture(uColorTextureSampler2D, SceneUV(uv)).rgb, 1));
     }
 }
 
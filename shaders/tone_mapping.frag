@@ -1,10 +1,19 @@
 #version 460
 
 layout (location = 0) uniform uint uToneMappingEnabledUint;
+layout (location = 1) uniform vec2 uInputScaleVec2; //Upscales the lighting output when TAA is off
+layout (location = 2) uniform uint uAutoExposureEnabledUint;
 layout (location = 10, binding = 0) uniform sampler2D uLinearSpaceSceneReferredTextureSampler2D;
 layout (location = 0) in vec2 uv;
 layout (location = 0) out vec4 outColor;
 
+// Adapted by exposure.comp from the histogram of the input
+layout (std430, binding = 5) readonly buffer Exposure
+{
+    float averageLuminance;
+    float exposure;
+};
+
 float Linear2sRGB(float channel)
 {
     if(channel <= 0.0031308)
@@ -79,14 +88,18 @@ vec3 ACESFitted(vec3 color)
 
 void main()
 {
+    vec2 inputUV = uv * uInputScaleVec2;
+    vec3 color = texture(uLinearSpaceSceneReferredTextureSampler2D, inputUV).rgb;
+    color *= bool(uAutoExposureEnabledUint) ? exposure : 1.0;
+
     //ToDo: Tone Mapping is not physically correct before TAA, can do better
     //  see https://de45xmedrsdbp.cloudfront.net/Resources/files/TemporalAA_small-59732822.pdf
     if (bool(uToneMappingEnabledUint))
     {
-        outColor = vec4(ACESFitted(texture(uLinearSpaceSceneReferredTextureSampler2D, uv).rgb), 1);
+        outColor = vec4(ACESFitted(color), 1);
     }
     else
     {
-        outColor = vec4(texture(uLinearSpaceSceneReferredTextureSampler2D, uv).rgb, 1);
+        outColor = vec4(color, 1);
     }
 }
@@ -5,11 +5,21 @@ layout (location = 1) in vec4 inPosition;
 
 layout (location = 0) out vec4 outVelocity;
 
+//Smallest normal half float is 6.1e-5, the tag survives RG16F
+const float VELOCITY_TAG_EPSILON = 1e-4f;
+
 void main()
 {
     vec3 currentPos = inPosition.xyz / inPosition.w;
     vec3 prevPos = inPrevPosition.xyz / inPrevPosition.w;
     vec3 velocity = (currentPos - prevPos) / 2;
 
+    //The target is cleared to zero, TAA reconstructs the camera motion for the texels left untouched.
+    //A drawn texel never stores zero so it is not mistaken for one, the nudge stays far below a pixel.
+    if (all(lessThan(abs(velocity.xy), vec2(VELOCITY_TAG_EPSILON))))
+    {
+        velocity.x = VELOCITY_TAG_EPSILON;
+    }
+
     outVelocity = vec4(velocity, 1);
 }
\ No newline at end of file
@@ -6,6 +6,8 @@ layout (location = 12) uniform mat4 uPrevProjUnjitMat4;
 layout (location = 13) uniform mat4 uModelMat4;
 layout (location = 14) uniform mat4 uViewMat4;
 layout (location = 15) uniform mat4 uProjUnjitMat4;
+layout (location = 16) uniform mat4 uProjMat4;
+layout (location = 17) uniform uint uTaaJitterEnabledUint;
 
 layout (location = 0) in vec3 aPosition;
 layout (location = 1) in vec3 aNormal;
@@ -14,6 +16,8 @@ layout (location = 2) in vec2 aUV;
 layout (location = 0) out vec4 prevPosition;
 layout (location = 1) out vec4 position;
 
+invariant gl_Position; //Tested GL_EQUAL against the depth of depth_pre_pass.vert
+
 void main()
 {
     mat4 prevMVP = uPrevProjUnjitMat4 * uPrevViewMat4 * uPrevModelMat4;
@@ -22,5 +26,6 @@ void main()
     prevPosition = prevMVP * vec4(aPosition, 1);
     position = MVP * vec4(aPosition, 1);
 
-    gl_Position = position;
+    mat4 projection = bool(uTaaJitterEnabledUint) ? uProjMat4 : uProjUnjitMat4;
+    gl_Position = projection * uViewMat4 * uModelMat4 * vec4(aPosition, 1);
 }
\ No newline at end of file
@@ -3,18 +3,42 @@
  * This code is licensed under the MIT license (MIT)
  * (http://opensource.org/licenses/MIT)
  */
+#include "AutoExposure.hpp"
+#include "BVH.hpp"
+#include "Benchmark.hpp"
 #include "Camera.hpp"
+#include "CameraPath.hpp"
+#include "CommandBuffer.hpp"
+#include "Culling.hpp"
+#include "DepthReduction.hpp"
+#include "DynamicResolution.hpp"
+#include "FrameCapture.hpp"
 #include "Input.hpp"
+#include "JobSystem.hpp"
+#include "LightCulling.hpp"
 #include "Loader.hpp"
 #include "Math.hpp"
+#include "OcclusionCulling.hpp"
+#include "Profiler.hpp"
+#include "Recording.hpp"
 #include "RenderConfiguration.hpp"
 #include "RenderDefinitions.hpp"
 #include "RenderModel.hpp"
 #include "RenderPass.hpp"
 #include "RenderPipeline.hpp"
+#include "TemporalResolve.hpp"
 #include "TestModels.hpp"
+#include "TripleBuffer.hpp"
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
 
 constexpr uint32_t g_defaultWidth = 800;
 constexpr uint32_t g_defaultHeight = 800;
@@ -38,6 +62,7 @@ enum class eRenderMode : uint32_t
     ShadowMap = 5,
     MetallicMap = 6,
     Roughnessmap = 7,
+    AmbientOcclusion = 8,
     Count
 } g_renderMode = {};
 char const *g_renderModesStr[static_cast<uint32_t>(eRenderMode::Count)] = {
@@ -48,15 +73,23 @@ char const *g_renderModesStr[static_cast<uint32_t>(eRenderMode::Count)] = {
     "Depth Buffer",
     "Shadow Maps",
     "Metallic Maps",
-    "Roughness Maps"};
+    "Roughness Maps",
+    "Ambient Occlusion"};
 
 uint32_t g_directLightEnabled = 1;
 uint32_t g_shadowMappingEnabled = 1;
 uint32_t g_pointLightEnabled = 0;
 uint32_t g_bumpMappingEnabled = 0;
+uint32_t g_textureSupersamplingEnabled = 0; //Rotated grid material sampling instead of one anisotropic fetch
 uint32_t g_toneMappingEnabled = 0;
+uint32_t g_autoExposureEnabled = 0;
+sr::math::Vec2 g_luminanceRange = {-8, 12}; //Lowest log2 luminance the histogram tells apart and the width of the range
+float g_exposureAdaptationRate = 1.5f;      //Per second
+float g_exposureCompensation = 0;           //In stops
+float g_frameDeltaTime = 0;                 //Seconds, the exposure adapts over time
 uint32_t g_taaEnabled = 0;
 uint32_t g_taaJitterEnabled = 0;
+bool g_taaComputeResolveEnabled = false; //taa.comp with the neighborhoods in shared memory instead of taa.frag
 
 uint32_t g_bumpMapAvailable = 0;
 uint32_t g_metallicMapAvailable = 0;
@@ -70,13 +103,250 @@ TAABuffer g_taaBuffer = {};
 float g_ambientLightRadiantFlux = 0.5f;
 DirectionalLightSource g_directLight;
 float g_pointLightRadiantFlux = 2.5f;
-constexpr int32_t g_pointLightCount = 5;
-sr::math::Vec3 g_pointLights[g_pointLightCount] = {
-    {-1200, 200, -45},
-    {-700, 200, -45},
-    {0, 200, -45},
-    {700, 200, -45},
-    {1100, 200, -45}};
+std::vector<PointLight> g_pointLights = {
+    {{-1200, 200, -45}, 350},
+    {{-700, 200, -45}, 350},
+    {{0, 200, -45}, 350},
+    {{700, 200, -45}, 350},
+    {{1100, 200, -45}, 350}};
+uint32_t g_pointLightCount = static_cast<uint32_t>(g_pointLights.size());
+uint32_t g_generatedPointLightCount = 0; //--point-lights replaces the lights above, see CreatePointLights
+uint32_t g_clusteredLightingEnabled = 0;   //Forward lighting shades the lights of its cluster only
+sr::cull::LightClusters g_lightClusters = {};
+sr::math::Vec2 g_clusterScale = {};
+sr::math::Vec2 g_clusterDepthScaleBias = {};
+struct ClusterStats
+{
+    float buildMs = 0;
+    uint64_t indexCount = 0;
+} g_clusterStats = {};
+LightCullingStats g_lightCullingStats = {}; //Of the last deferred light culling the GPU finished
+
+bool g_frustumCullingEnabled = true;
+bool g_bvhCullingEnabled = true;
+sr::cull::VisibilityList g_cameraVisibility = {};
+sr::cull::VisibilityList g_shadowVisibility[SHADOW_CASCADE_MAX_COUNT] = {};
+bool g_occlusionCullingEnabled = true;
+sr::cull::VisibilityList g_occlusionVisibility = {};
+sr::cull::VisibilityList g_dynamicVisibility = {};
+constexpr uint32_t g_occlusionBufferWidth = 256;
+constexpr uint32_t g_occlusionBufferHeight = 128;
+constexpr float g_occluderMinArea = 40000.f;
+constexpr uint64_t g_occluderMaxTriangleCount = 4096;
+struct CullingStats
+{
+    uint64_t boxCount = 0;
+    float cameraCullingMs = 0;
+    float shadowCullingMs = 0;
+    uint64_t shadowTriangleCount[SHADOW_CASCADE_MAX_COUNT] = {};
+    uint64_t occluderTriangleCount = 0;
+    float occlusionRasterMs = 0;
+    float occlusionTestMs = 0;
+} g_cullingStats = {};
+
+bool g_commandBuffersEnabled = true;
+struct SubmissionStats
+{
+    float submitMs = 0;       //CPU time from the depth pre-pass to the end of the velocity pass
+    float recordMs[4] = {};   //Depth pre-pass, shadow mapping, lighting, velocity
+    uint64_t commandBytes = 0;
+} g_submissionStats = {};
+
+ShadowCascades g_shadowCascades = {};
+uint32_t g_shadowCascadeCount = 3;
+float g_shadowCascadeSplitLambda = 0.75f; //Blend between the uniform (0) and the logarithmic (1) split
+bool g_sampleDistributionEnabled = true;    //Fit the cascades to the depth buffer instead of the whole frustum
+DepthBounds g_depthBounds = {};
+
+bool g_shadowCacheEnabled = true;
+struct ShadowCacheStats
+{
+    float gpuMs[2] = {};           //Shadow pass GPU time with the cache off and on
+    uint64_t rebuildCount = 0;     //Static map re-renders since start
+    uint64_t hitCount = 0;         //Cascade frames served from the static map since start
+    float hitRate = 0;             //Moving average of the cascade frames served from the static map
+    uint64_t restoredTexels = 0;   //Texels copied from the static map in the last frame
+    uint64_t dynamicCasterCount = 0;
+} g_shadowCacheStats = {};
+
+//Everything the simulation thread reads from the render thread, captured once per frame
+struct InputSnapshot
+{
+    sr::input::Inputs inputs = {};
+    Camera camera = CreateCamera();
+    bool cameraPositionEdited = false;
+    float cameraSpeed = 0;
+    DirectionalLightSource directLight = {};
+    uint32_t shadowCascadeCount = 3;
+    float shadowCascadeSplitLambda = 0;
+    bool sampleDistribution = true;
+    DepthBounds depthBounds = {};
+    int32_t width = g_defaultWidth;
+    int32_t height = g_defaultHeight;
+    bool frustumCulling = true;
+    bool bvhCulling = true;
+    bool occlusionCulling = true;
+    uint64_t frameIndex = 0;  //Render thread frame the snapshot was taken on
+    std::chrono::high_resolution_clock::time_point timestamp = {};
+};
+
+//Immutable result of one simulation step, the render thread only ever reads it
+struct FramePacket
+{
+    uint64_t frameIndex = 0;
+    Camera camera = CreateCamera();
+    Camera prevCamera = CreateCamera();
+    DirectionalLightSource directLight = {};
+    ShadowCascades shadowCascades = {};
+    TAABuffer taaBuffer = {};
+    std::vector<sr::math::Matrix4x4> models;
+    sr::cull::VisibilityList cameraVisibility = {};
+    sr::cull::VisibilityList shadowVisibility[SHADOW_CASCADE_MAX_COUNT] = {};
+    sr::cull::VisibilityList occlusionVisibility = {};
+    CullingStats cullingStats = {};
+    uint64_t inputFrameIndex = 0;
+    std::chrono::high_resolution_clock::time_point inputTimestamp = {};
+    float simulationMs = 0;
+};
+
+bool g_renderGraphAliasingEnabled = true;
+eForwardTargetFormats g_targetFormats = eForwardTargetFormats::Full; //The baseline formats until the goldens show the others match
+char const *g_targetFormatsStr[static_cast<uint32_t>(eForwardTargetFormats::Count)] = {
+    "Full",
+    "Half",
+    "Compact",
+};
+eVelocityMode g_velocityMode = eVelocityMode::Separate; //The baseline pass until the goldens show the others match
+char const *g_velocityModesStr[static_cast<uint32_t>(eVelocityMode::Count)] = {
+    "Separate",
+    "DepthEqual",
+    "LightingMRT",
+    "Dynamic",
+};
+eLightingPath g_lightingPath = eLightingPath::Forward;
+char const *g_lightingPathsStr[static_cast<uint32_t>(eLightingPath::Count)] = {
+    "Forward",
+    "Deferred",
+};
+eAmbientOcclusion g_ambientOcclusion = eAmbientOcclusion::Off; //Off at baseline, Half is opt in
+char const *g_ambientOcclusionStr[static_cast<uint32_t>(eAmbientOcclusion::Count)] = {
+    "Off",
+    "Full",
+    "Half",
+    "Quarter",
+};
+//Set from g_ambientOcclusion, the lighting passes read the upsampled occlusion when it is on
+uint32_t g_ambientOcclusionEnabled = 0;
+uint32_t g_ambientOcclusionDivisor = 1;
+float g_ambientOcclusionRadius = 40.f; //World units around a texel that occlude it
+//Set from g_velocityMode, TAA reconstructs the velocity of the texels the velocity pass did not draw
+uint32_t g_cameraVelocityFromDepth = 0;
+struct RenderGraphStats
+{
+    uint64_t memoryBytes = 0;
+    uint64_t unaliasedMemoryBytes = 0;
+    uint32_t textureCount = 0;
+    uint32_t targetCount = 0;   //Render targets used by the active passes
+    std::string culledPasses;
+} g_renderGraphStats = {};
+
+bool g_dynamicResolutionEnabled = false;
+bool g_dynamicResolutionLogEnabled = false; //Prints every scale change for tuning the thresholds
+DynamicResolution g_dynamicResolution = {};
+float g_dynamicResolutionGpuMs = 0;
+float g_gpuFrameMs = 0; //Latest frame timer reading
+sr::math::Vec2 g_renderScale = {1, 1};      //Part of the scene targets the depth, lighting and velocity passes render to
+sr::math::Vec2 g_toneMappingInputScale = {1, 1};
+
+bool g_pipelinedSimulationEnabled = true;
+struct FrameLatencyStats
+{
+    float frameMs = 0;
+    float simulationMs = 0;
+    float inputToPresentMs = 0;  //From the input snapshot the packet was simulated with to the buffer swap
+    uint64_t packetAge = 0;      //Frames between simulating a packet and presenting it
+} g_frameLatencyStats = {};
+
+// --headless renders a scripted camera flight without vsync and writes a JSON report instead of showing a window
+struct HeadlessSettings
+{
+    bool enabled = false;
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    uint32_t warmupFrames = 60;   //Rendered at the start of the path and left out of the report
+    uint32_t frameCount = 240;
+    char const *reportPath = nullptr; //Standard output if not set
+} g_headless = {};
+
+// --record writes the camera, the keys and the settings of every frame, --replay drives them from a recording
+bool g_recordingEnabled = false;
+InputRecorder g_inputRecorder = {};
+bool g_replayEnabled = false;
+InputReplay g_inputReplay = {};
+std::ofstream g_replayTimings; //--replay-log, one row per frame
+
+// --golden renders every key of the benchmark path as a still view, compares the debug target with
+// view_<n>.png in a directory and fails the run if any view is off by more than the thresholds
+struct GoldenSettings
+{
+    bool enabled = false;
+    bool update = false;          //--golden-update writes the captures as the new goldens
+    char const *directory = nullptr;
+    uint32_t settleFrames = 64;   //Rendered at a view before it is captured so that TAA converges
+    float minPsnr = 35;
+    float maxPerceptualErrorRatio = 0.005f;
+} g_golden = {};
+constexpr int g_goldenMissingExitCode = 77; //The directory has no goldens yet, CTest reports the test as skipped
+
+CameraPathKey const g_benchmarkCameraPath[] = {
+    {{-1100, 150, -35}, 0, -1.57f},
+    {{-530, 150, -35}, 0, -1.57f},
+    {{0, 250, 120}, -0.3f, -0.8f},
+    {{600, 400, -35}, -0.5f, 0},
+    {{900, 150, -200}, 0, 1.57f},
+    {{0, 150, -35}, 0.2f, 1.57f},
+    {{-1100, 600, -35}, -0.6f, 1.57f}};
+
+struct GoldenResult
+{
+    bool captured = false;
+    bool passed = false;
+    char const *error = nullptr; //Why the view could not be compared
+    ImageDiff diff = {};
+    float cpuFrameMs = 0;        //Means of the second half of the settle frames
+    float gpuFrameMs = 0;
+    uint32_t measuredFrames = 0;
+};
+
+struct GoldenRun
+{
+    FrameReadback readback = {};
+    std::vector<GoldenResult> results;
+    uint32_t resolvedViews = 0;
+};
+
+struct SimulationContext
+{
+    FramePacket frame = {};
+    std::vector<RenderModel> models;
+    sr::cull::AABBSoA bounds = {};
+    sr::bvh::BVH bvh = {};
+    std::vector<sr::cull::Occluder> occluders;
+    sr::cull::DepthBuffer occlusionDepthBuffer = {};
+    std::vector<sr::cull::ScreenTriangle> occluderTriangles;
+    TripleBuffer<FramePacket> packets = {};
+};
+
+struct SimulationThread
+{
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    InputSnapshot input = {};
+    uint64_t requestedFrames = 0;
+    uint64_t completedFrames = 0;
+    bool stop = false;
+};
 
 sr::math::Matrix4x4 CreateCameraMatrix(sr::math::Vec3 pos, float xWorldAngle, float yWorldAngle)
 {
@@ -174,6 +444,9 @@ void DrawUI(GLFWwindow *window)
         ImGui::NewLine();
         ImGui::Text("Ambient Light");
         ImGui::SliderFloat("AL Radiant Flux", &g_ambientLightRadiantFlux, 0, 1);
+        ImGui::Combo("Ambient Occlusion", reinterpret_cast<int *>(&g_ambientOcclusion), g_ambientOcclusionStr,
+                     static_cast<uint32_t>(eAmbientOcclusion::Count));
+        ImGui::SliderFloat("AO Radius", &g_ambientOcclusionRadius, 1, 200);
 
         ImGui::NewLine();
         static bool enableDirectLightCheckBoxValue = static_cast<bool>(g_directLightEnabled);
@@ -187,22 +460,145 @@ void DrawUI(GLFWwindow *window)
         static bool enableShadowMappingCheckBoxValue = static_cast<bool>(g_shadowMappingEnabled);
         ImGui::Checkbox("Shadow Mapping", &enableShadowMappingCheckBoxValue);
         g_shadowMappingEnabled = static_cast<bool>(enableShadowMappingCheckBoxValue);
+        static int shadowCascadeCountValue = static_cast<int>(g_shadowCascadeCount);
+        ImGui::SliderInt("Shadow Cascades", &shadowCascadeCountValue, 2, SHADOW_CASCADE_MAX_COUNT);
+        g_shadowCascadeCount = static_cast<uint32_t>(shadowCascadeCountValue);
+        ImGui::SliderFloat("Cascade Split Lambda", &g_shadowCascadeSplitLambda, 0, 1);
+        ImGui::Checkbox("Sample Distribution", &g_sampleDistributionEnabled);
+        if (g_sampleDistributionEnabled && g_depthBounds.valid)
+        {
+            ImGui::Text("Visible depth: %.1f to %.1f", g_depthBounds.minDepth, g_depthBounds.maxDepth);
+        }
+        for (uint32_t i = 0; i < g_shadowCascades.count; ++i)
+        {
+            ImGui::Text("Cascade %u: up to %.0f, %llu draws %.1fK triangles", i, g_shadowCascades.splits[i],
+                        static_cast<unsigned long long>(g_shadowVisibility[i].count),
+                        g_cullingStats.shadowTriangleCount[i] / 1000.f);
+            ImGui::Text("    %.2fx texels per world unit", g_shadowCascades.densityGains[i]);
+        }
 
         ImGui::NewLine();
         static bool enablePointLightCheckBoxValue = static_cast<bool>(g_pointLightEnabled);
         ImGui::Checkbox("Point Light", &enablePointLightCheckBoxValue);
         g_pointLightEnabled = static_cast<bool>(enablePointLightCheckBoxValue);
         ImGui::SliderFloat("PL Radiant Flux", &g_pointLightRadiantFlux, 0, 100);
+        ImGui::Text("Point lights: %u", g_pointLightCount);
+        static bool enableClusteredLightingCheckBoxValue = static_cast<bool>(g_clusteredLightingEnabled);
+        ImGui::Checkbox("Clustered Lights", &enableClusteredLightingCheckBoxValue);
+        g_clusteredLightingEnabled = static_cast<bool>(enableClusteredLightingCheckBoxValue);
+        ImGui::Text("Cluster build %.3f ms, %llu light indices", g_clusterStats.buildMs,
+                    static_cast<unsigned long long>(g_clusterStats.indexCount));
+        ImGui::Text("Tiles over %u lights: %u, busiest tile %u lights", TILE_LIGHT_MAX_COUNT,
+                    g_lightCullingStats.overflowTiles, g_lightCullingStats.maxTileLights);
 
         ImGui::NewLine();
         static bool enableBumpMappingCheckboxValue = static_cast<bool>(g_bumpMappingEnabled);
         ImGui::Checkbox("Bump Mapping", &enableBumpMappingCheckboxValue);
         g_bumpMappingEnabled = static_cast<bool>(enableBumpMappingCheckboxValue);
         ImGui::SliderFloat("Bump map scale", &g_bumpMapScaleFactor, 0.0001f, 0.01f, "%.5f");
+        static bool enableTextureSupersamplingCheckboxValue = static_cast<bool>(g_textureSupersamplingEnabled);
+        ImGui::Checkbox("Texture Supersampling", &enableTextureSupersamplingCheckboxValue);
+        g_textureSupersamplingEnabled = static_cast<bool>(enableTextureSupersamplingCheckboxValue);
 
         ImGui::NewLine();
         ImGui::Checkbox("Draw AABBs", &g_drawAABBs);
 
+        ImGui::NewLine();
+        ImGui::Text("Frustum Culling");
+        ImGui::Checkbox("Cull", &g_frustumCullingEnabled);
+        ImGui::Checkbox("Use BVH", &g_bvhCullingEnabled);
+        if (g_cullingStats.boxCount > 0)
+        {
+            float const boxCount = static_cast<float>(g_cullingStats.boxCount);
+            ImGui::Text("Camera culled: %.1f%%", 100.f * (1.f - g_cameraVisibility.count / boxCount));
+            uint64_t shadowDrawCount = 0;
+            for (uint32_t i = 0; i < g_shadowCascades.count; ++i)
+            {
+                shadowDrawCount += g_shadowVisibility[i].count;
+            }
+            ImGui::Text("Shadow culled: %.1f%% per cascade",
+                        100.f * (1.f - shadowDrawCount / (boxCount * g_shadowCascades.count)));
+            ImGui::Text("Camera cost: %.3f ms per 100k boxes", g_cullingStats.cameraCullingMs * 100000.f / boxCount);
+            ImGui::Text("Shadow cost: %.3f ms per 100k boxes", g_cullingStats.shadowCullingMs * 100000.f / boxCount);
+        }
+        ImGui::Checkbox("Occlusion", &g_occlusionCullingEnabled);
+        if (g_occlusionCullingEnabled && g_cameraVisibility.count > 0)
+        {
+            ImGui::Text("Occluded: %.1f%% of %llu draws",
+                        100.f * (1.f - g_occlusionVisibility.count / static_cast<float>(g_cameraVisibility.count)),
+                        static_cast<unsigned long long>(g_cameraVisibility.count));
+            ImGui::Text("Occluder triangles: %llu", static_cast<unsigned long long>(g_cullingStats.occluderTriangleCount));
+            ImGui::Text("Raster: %.3f ms Test: %.3f ms", g_cullingStats.occlusionRasterMs, g_cullingStats.occlusionTestMs);
+        }
+
+        ImGui::NewLine();
+        ImGui::Text("Submission");
+        ImGui::Checkbox("Command Buffers", &g_commandBuffersEnabled);
+        ImGui::Text("Submit CPU: %.3f ms", g_submissionStats.submitMs);
+        if (g_commandBuffersEnabled)
+        {
+            ImGui::Text("Record: depth %.3f shadow %.3f", g_submissionStats.recordMs[0], g_submissionStats.recordMs[1]);
+            ImGui::Text("Record: lighting %.3f velocity %.3f", g_submissionStats.recordMs[2], g_submissionStats.recordMs[3]);
+            ImGui::Text("Commands: %.1f KiB", g_submissionStats.commandBytes / 1024.f);
+        }
+
+        ImGui::NewLine();
+        ImGui::Text("Shadow Cache");
+        ImGui::Checkbox("Cache Static Casters", &g_shadowCacheEnabled);
+        ImGui::Text("Shadow GPU: off %.3f ms on %.3f ms", g_shadowCacheStats.gpuMs[0], g_shadowCacheStats.gpuMs[1]);
+        ImGui::Text("Rebuilds: %llu hits: %llu, hit rate %.1f%%",
+                    static_cast<unsigned long long>(g_shadowCacheStats.rebuildCount),
+                    static_cast<unsigned long long>(g_shadowCacheStats.hitCount),
+                    100.f * g_shadowCacheStats.hitRate);
+        ImGui::Text("Dynamic casters: %llu restored %.1f Ktexels",
+                    static_cast<unsigned long long>(g_shadowCacheStats.dynamicCasterCount),
+                    g_shadowCacheStats.restoredTexels / 1000.f);
+
+        ImGui::NewLine();
+        ImGui::Text("Render Graph");
+        ImGui::Checkbox("Alias Render Targets", &g_renderGraphAliasingEnabled);
+        ImGui::Combo("Target Formats", reinterpret_cast<int *>(&g_targetFormats), g_targetFormatsStr,
+                     static_cast<uint32_t>(eForwardTargetFormats::Count));
+        ImGui::Combo("Velocity", reinterpret_cast<int *>(&g_velocityMode), g_velocityModesStr,
+                     static_cast<uint32_t>(eVelocityMode::Count));
+        ImGui::Combo("Lighting", reinterpret_cast<int *>(&g_lightingPath), g_lightingPathsStr,
+                     static_cast<uint32_t>(eLightingPath::Count));
+        ImGui::Text("Targets: %.1f MiB, %.1f MiB without aliasing",
+                    g_renderGraphStats.memoryBytes / (1024.f * 1024.f),
+                    g_renderGraphStats.unaliasedMemoryBytes / (1024.f * 1024.f));
+        ImGui::Text("%u textures for %u targets", g_renderGraphStats.textureCount, g_renderGraphStats.targetCount);
+        ImGui::Text("Culled: %s", g_renderGraphStats.culledPasses.empty() ? "none" : g_renderGraphStats.culledPasses.c_str());
+
+        ImGui::NewLine();
+        ImGui::Text("Dynamic Resolution");
+        ImGui::Checkbox("Scale Resolution", &g_dynamicResolutionEnabled);
+        DynamicResolutionSettings &resolution = g_dynamicResolution.settings;
+        ImGui::SliderFloat("GPU Budget ms", &resolution.budgetMs, 2, 50);
+        ImGui::SliderFloat("Min Scale", &resolution.minScale, 0.25f, 1);
+        resolution.maxScale = std::max(resolution.maxScale, resolution.minScale);
+        ImGui::SliderFloat("Max Scale", &resolution.maxScale, resolution.minScale, 1);
+        ImGui::SliderFloat("Lower Threshold", &resolution.lowerThreshold, 0.5f, 1);
+        ImGui::SliderFloat("Upper Threshold", &resolution.upperThreshold, resolution.lowerThreshold, 1.5f);
+        static int settleFramesValue = static_cast<int>(resolution.settleFrames);
+        ImGui::SliderInt("Settle Frames", &settleFramesValue, 1, 60);
+        resolution.settleFrames = static_cast<uint32_t>(settleFramesValue);
+        ImGui::Checkbox("Log to Console", &g_dynamicResolutionLogEnabled);
+        ImGui::Text("Scale: %.2f GPU: %.3f ms", g_dynamicResolution.scale, g_dynamicResolutionGpuMs);
+        uint64_t const logBegin = g_dynamicResolution.logCount > 4 ? g_dynamicResolution.logCount - 4 : 0;
+        for (uint64_t i = g_dynamicResolution.logCount; i > logBegin; --i)
+        {
+            DynamicResolutionLogEntry const &entry = g_dynamicResolution.log[(i - 1) % DYNAMIC_RESOLUTION_LOG_SIZE];
+            ImGui::Text("    frame %llu: %.3f ms %.2f -> %.2f", static_cast<unsigned long long>(entry.frame),
+                        entry.averageMs, entry.oldScale, entry.newScale);
+        }
+
+        ImGui::NewLine();
+        ImGui::Text("Frame Pipeline");
+        ImGui::Checkbox("Pipelined Simulation", &g_pipelinedSimulationEnabled);
+        ImGui::Text("Frame: %.3f ms Simulation: %.3f ms", g_frameLatencyStats.frameMs, g_frameLatencyStats.simulationMs);
+        ImGui::Text("Input to present: %.3f ms", g_frameLatencyStats.inputToPresentMs);
+        ImGui::Text("Packet age: %llu frames", static_cast<unsigned long long>(g_frameLatencyStats.packetAge));
+
         ImGui::NewLine();
         ImGui::Text("Temporal Antialiasing");
         static bool enableTaaCheckboxValue = static_cast<bool>(g_taaEnabled);
@@ -211,11 +607,17 @@ void DrawUI(GLFWwindow *window)
         static bool enableTaaJitterCheckboxValue = static_cast<bool>(g_taaJitterEnabled);
         ImGui::Checkbox("Jitter", &enableTaaJitterCheckboxValue);
         g_taaJitterEnabled = static_cast<decltype(g_taaJitterEnabled)>(enableTaaJitterCheckboxValue);
+        ImGui::Checkbox("Compute Resolve", &g_taaComputeResolveEnabled);
 
         ImGui::NewLine();
         static bool enabledToneMappingCheckboxValue = static_cast<bool>(g_toneMappingEnabled);
         ImGui::Checkbox("Tone Mapping", &enabledToneMappingCheckboxValue);
         g_toneMappingEnabled = static_cast<decltype(g_toneMappingEnabled)>(enabledToneMappingCheckboxValue);
+        static bool enabledAutoExposureCheckboxValue = static_cast<bool>(g_autoExposureEnabled);
+        ImGui::Checkbox("Auto Exposure", &enabledAutoExposureCheckboxValue);
+        g_autoExposureEnabled = static_cast<decltype(g_autoExposureEnabled)>(enabledAutoExposureCheckboxValue);
+        ImGui::SliderFloat("Adaptation Rate", &g_exposureAdaptationRate, 0.1f, 10.f);
+        ImGui::SliderFloat("Exposure Compensation", &g_exposureCompensation, -4.f, 4.f);
     }
 
     ImGui::Spacing();
@@ -224,6 +626,33 @@ void DrawUI(GLFWwindow *window)
 
     ImGui::Text("Frame time: %.3f ms", 1000.0f / ImGui::GetIO().Framerate);
     ImGui::Text("FPS: %.1f", ImGui::GetIO().Framerate);
+
+    ImGui::NewLine();
+    ImGui::Text("Profiler");
+    ImGui::Checkbox("GPU Queries", &sr::prof::g_profiler.gpuEnabled);
+    bool writeCsvValue = sr::prof::g_profiler.csv.is_open();
+    if (ImGui::Checkbox("Write profile.csv", &writeCsvValue))
+    {
+        if (writeCsvValue)
+        {
+            sr::prof::OpenProfilerCsv("profile.csv");
+        }
+        else
+        {
+            sr::prof::CloseProfilerCsv();
+        }
+    }
+    ImGui::Text("Dropped frames: %llu", static_cast<unsigned long long>(sr::prof::g_profiler.droppedFrames));
+    ImGui::Text("Zone: CPU avg p95 p99 | GPU avg p95 p99 ms");
+    for (uint8_t i = 0; i < sr::prof::g_profiler.zoneCount; ++i)
+    {
+        sr::prof::ProfilerZone const &zone = sr::prof::g_profiler.zones[i];
+        sr::prof::ProfilerZoneStats const stats = sr::prof::GetProfilerZoneStats(i);
+        ImGui::Text("%s%s: %.3f %.3f %.3f | %.3f %.3f %.3f",
+                    zone.parent == sr::prof::PROFILER_INVALID_ZONE ? "" : "    ", zone.name.data,
+                    stats.cpuAverageMs, stats.cpuP95Ms, stats.cpuP99Ms,
+                    stats.gpuAverageMs, stats.gpuP95Ms, stats.gpuP99Ms);
+    }
     ImGui::End();
 
     ImGui::Render();
@@ -234,31 +663,78 @@ void DrawUI(GLFWwindow *window)
 #endif
 }
 
-std::vector<RenderModel> LoadOpaqueModels(ShaderProgram const &program)
+bool IsOccluderCandidate(sr::geo::AABB const &aabb, uint64_t triangleCount)
+{
+    sr::math::Vec3 const extent = aabb.max - aabb.min;
+    float const largestFaceArea = std::max({extent.x * extent.y, extent.y * extent.z, extent.z * extent.x});
+
+    return largestFaceArea >= g_occluderMinArea && triangleCount <= g_occluderMaxTriangleCount;
+}
+
+std::vector<RenderModel> LoadOpaqueModels(ShaderProgram const &program, std::vector<sr::cull::Occluder> &occluders)
 {
     std::vector<RenderModel> models;
     std::vector<sr::load::Geometry> geometries;
     std::vector<sr::load::MaterialSource> materials;
 
     sr::load::LoadOBJ("data\\models\\Sponza", "sponza.obj", geometries, materials);
+
+    std::vector<std::vector<BufferDescriptor>> vertexBufferDescriptors(geometries.size());
+    std::vector<BufferDescriptor> indexBufferDescriptors(geometries.size());
+    std::vector<RenderModelCreateInfo> createInfos(geometries.size());
     for (uint32_t i = 0; i < geometries.size(); ++i)
     {
-        auto const vertexBufferDescriptors = sr::load::CreateBufferDescriptors(geometries[i]);
-        auto const indexBufferDescriptor = sr::load::CreateIndexBufferDescriptor(geometries[i]);
+        vertexBufferDescriptors[i] = sr::load::CreateBufferDescriptors(geometries[i]);
+        indexBufferDescriptors[i] = sr::load::CreateIndexBufferDescriptor(geometries[i]);
 
-        RenderModelCreateInfo createInfo;
+        RenderModelCreateInfo &createInfo = createInfos[i];
         createInfo.color = {1, 0, 0};
         createInfo.debugRenderModel = 0;
         createInfo.geometry = &geometries[i];
-        createInfo.indexBufferDescriptor = &indexBufferDescriptor;
+        createInfo.indexBufferDescriptor = &indexBufferDescriptors[i];
         createInfo.material = &materials[createInfo.geometry->material];
-        createInfo.vertexBufferDescriptors = &vertexBufferDescriptors;
+        createInfo.vertexBufferDescriptors = &vertexBufferDescriptors[i];
 
-        models.push_back(CreateRenderModel(createInfo));
-        LinkRenderModelToShaderProgram(
-            program.handle, models[i], g_shaderAttributesPositionNormalUV);
+        models.push_back(InitializeRenderModel(createInfo));
+    }
+
+    //Bounds are computed by the workers while the main thread uploads buffers and textures
+    sr::job::Counter boundsCounter;
+    sr::job::Counter loadCounter;
+    for (uint32_t i = 0; i < geometries.size(); ++i)
+    {
+        sr::job::RunJob([&models, &geometries, i]() {
+            CalculateRenderModelBounds(models[i], geometries[i]);
+        }, &boundsCounter);
+        sr::job::RunJob([&models, &createInfos, &program, i]() {
+            CreateRenderModelBuffers(models[i], createInfos[i]);
+            LinkRenderModelToShaderProgram(program.handle, models[i], g_shaderAttributesPositionNormalUV);
+        }, &loadCounter, sr::job::eJobAffinity::MainThread);
     }
 
+    //Occluders are picked by their world space bounds
+    sr::job::RunJobAfter(boundsCounter, [&models, &geometries, &occluders]() {
+        for (uint32_t i = 0; i < geometries.size(); ++i)
+        {
+            if (!IsOccluderCandidate(models[i].aabb, geometries[i].indices.size() / 3))
+            {
+                continue;
+            }
+
+            sr::cull::Occluder occluder;
+            occluder.indices = geometries[i].indices;
+            occluder.vertices.reserve(geometries[i].vertices.size());
+            for (auto const &v : geometries[i].vertices)
+            {
+                occluder.vertices.push_back((models[i].model * sr::math::Vec4{v.x, v.y, v.z, 1}).xyz);
+            }
+            occluders.push_back(std::move(occluder));
+        }
+    }, &loadCounter);
+
+    sr::job::WaitForCounter(loadCounter);
+    sr::job::WaitForCounter(boundsCounter);
+
     for (auto &material : materials)
     {
         FreeMaterialSource(material);
@@ -274,7 +750,9 @@ std::vector<RenderModel> LoadPointLightModels(ShaderProgram const &program)
     std::vector<sr::load::MaterialSource> materials;
     sr::load::LoadOBJ("data\\models\\box", "box.obj", geometries, materials);
 
-    for (uint32_t i = 0; i < g_pointLightCount; ++i)
+    //Generated lights are not drawn, thousands of debug boxes would cost more than the lights
+    uint32_t const count = g_generatedPointLightCount > 0 ? 0 : g_pointLightCount;
+    for (uint32_t i = 0; i < count; ++i)
     {
         auto const vertexBufferDescriptors = sr::load::CreateBufferDescriptors(geometries.back());
         auto const indexBufferDescriptor = sr::load::CreateIndexBufferDescriptor(geometries.back());
@@ -286,7 +764,7 @@ std::vector<RenderModel> LoadPointLightModels(ShaderProgram const &program)
         createInfo.geometry = &geometries.back();
         createInfo.indexBufferDescriptor = &indexBufferDescriptor;
         createInfo.material = &emptyMaterial;
-        createInfo.position = g_pointLights[i];
+        createInfo.position = g_pointLights[i].position;
         createInfo.scale = {10, 10, 10};
         createInfo.vertexBufferDescriptors = &vertexBufferDescriptors;
 
@@ -360,6 +838,7 @@ std::vector<RenderModel> LoadDynamicModels(ShaderProgram const &program)
         createInfo.orientation = {0, 6.28f * 0.65f, 0};
         createInfo.scale = {100, 100, 100};
         createInfo.vertexBufferDescriptors = &vertexBufferDescriptors;
+        createInfo.isDynamic = true;
 
         models.push_back(CreateRenderModel(createInfo));
         LinkRenderModelToShaderProgram(
@@ -416,8 +895,22 @@ ForwardPipelineShaderPrograms CreateForwardPipelineShaderPrograms()
     ForwardPipelineShaderPrograms desc;
 
     desc.depthPrePass = CreateShaderProgram("shaders/depth_pre_pass.vert", "shaders/depth_pre_pass.frag");
-    desc.shadowMapping = CreateShaderProgram("shaders/shadow_mapping.vert", "shaders/shadow_mapping.frag");
+    for (auto &shadowMapping : desc.shadowMapping)
+    {
+        shadowMapping = CreateShaderProgram("shaders/shadow_mapping.vert", "shaders/shadow_mapping.frag");
+    }
+    desc.ambientOcclusion = CreateShaderProgram("shaders/ambient_occlusion.vert", "shaders/ambient_occlusion.frag");
+    LinkRenderModelToShaderProgram(
+        desc.ambientOcclusion.handle, g_quadWallRenderModel, g_shaderAttributesPositionNormalUV);
+    desc.ambientOcclusionUpsample =
+        CreateShaderProgram("shaders/ambient_occlusion.vert", "shaders/ambient_occlusion_upsample.frag");
+    LinkRenderModelToShaderProgram(
+        desc.ambientOcclusionUpsample.handle, g_quadWallRenderModel, g_shaderAttributesPositionNormalUV);
+    desc.gBuffer = CreateShaderProgram("shaders/lighting.vert", "shaders/gbuffer.frag");
     desc.lighting = CreateShaderProgram("shaders/lighting.vert", "shaders/lighting.frag");
+    desc.deferredLighting = CreateShaderProgram("shaders/deferred_lighting.vert", "shaders/deferred_lighting.frag");
+    LinkRenderModelToShaderProgram(
+        desc.deferredLighting.handle, g_quadWallRenderModel, g_shaderAttributesPositionNormalUV);
     desc.transparent = CreateShaderProgram("shaders/lighting.vert", "shaders/lighting.frag");
     desc.velocity = CreateShaderProgram("shaders/velocity.vert", "shaders/velocity.frag");
     desc.taa = CreateShaderProgram("shaders/taa.vert", "shaders/taa.frag");
@@ -463,9 +956,10 @@ void CreateForwardPipelineUniformBindngs(ForwardPipelineShaderPrograms &desc,
             });
     }
 
+    for (uint8_t i = 0; i < SHADOW_CASCADE_MAX_COUNT; ++i)
     {
         CreateShaderProgramUniformBindings(
-            desc.shadowMapping,
+            desc.shadowMapping[i],
             UniformsDescriptor{
                 UniformsDescriptor::PerFrameUI32{},
                 UniformsDescriptor::PerFrameFloat1{},
@@ -474,7 +968,7 @@ void CreateForwardPipelineUniformBindngs(ForwardPipelineShaderPrograms &desc,
                 UniformsDescriptor::PerFrameFloat4{},
                 UniformsDescriptor::PerFrameMat4{
                     {"uProjMat", "uViewMat"},
-                    {g_directLight.projection.data, g_directLight.view.data},
+                    {g_shadowCascades.projections[i].data, g_directLight.view.data},
                     {1, 1}},
                 UniformsDescriptor::PerModelUI32{},
                 UniformsDescriptor::PerModelFloat1{},
@@ -498,44 +992,58 @@ void CreateForwardPipelineUniformBindngs(ForwardPipelineShaderPrograms &desc,
                     {"uRenderModeUint",
                      "uDirectLightEnabledUint",
                      "uPointLightEnabledUint",
+                     "uPointLightCountUint",
+                     "uClusteredLightingEnabledUint",
+                     "uAmbientOcclusionEnabledUint",
                      "uShadowMappingEnabledUint",
                      "uBumpMappingEnabledUint",
+                     "uTextureSupersamplingEnabledUint",
                      "uTaaEnabledUint",
-                     "uTaaJitterEnabledUint"},
+                     "uTaaJitterEnabledUint",
+                     "uCascadeCountUint"},
                     {reinterpret_cast<uint32_t *>(&g_renderMode),
                      &g_directLightEnabled,
                      &g_pointLightEnabled,
+                     &g_pointLightCount,
+                     &g_clusteredLightingEnabled,
+                     &g_ambientOcclusionEnabled,
                      &g_shadowMappingEnabled,
                      &g_bumpMappingEnabled,
+                     &g_textureSupersamplingEnabled,
                      &g_taaEnabled,
-                     &g_taaJitterEnabled},
-                    {1, 1, 1, 1, 1, 1, 1}},
+                     &g_taaJitterEnabled,
+                     &g_shadowCascades.count},
+                    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}},
                 //floats
                 UniformsDescriptor::PerFrameFloat1{
-                    {"uBumpMapScaleFactorFloat", "uAmbientLightRadiantFluxFloat", "uDirectLightRadiantFluxFloat", "uPointLightRadiantFluxFloat"},
-                    {&g_bumpMapScaleFactor, &g_ambientLightRadiantFlux, &g_directLight.radiantFlux, &g_pointLightRadiantFlux},
-                    {1, 1, 1, 1}},
-                UniformsDescriptor::PerFrameFloat2{},
+                    {"uBumpMapScaleFactorFloat", "uAmbientLightRadiantFluxFloat", "uDirectLightRadiantFluxFloat", "uPointLightRadiantFluxFloat", "uCascadeSplitFloatArray"},
+                    {&g_bumpMapScaleFactor, &g_ambientLightRadiantFlux, &g_directLight.radiantFlux, &g_pointLightRadiantFlux, g_shadowCascades.splits},
+                    {1, 1, 1, 1, SHADOW_CASCADE_MAX_COUNT}},
+                UniformsDescriptor::PerFrameFloat2{
+                    {"uClusterScaleVec2", "uClusterDepthScaleBiasVec2"},
+                    {g_clusterScale.data, g_clusterDepthScaleBias.data},
+                    {1, 1}},
                 //float3
                 UniformsDescriptor::PerFrameFloat3{
-                    {"uCameraPos", "uPointLightPosVec3Array"},
-                    {g_camera.pos.data,
-                     g_pointLights[0].data},
-                    {1, g_pointLightCount}},
+                    {"uCameraPos"}, {g_camera.pos.data}, {1}},
                 UniformsDescriptor::PerFrameFloat4{},
                 //mat4
                 UniformsDescriptor::PerFrameMat4{
                     {"uProjMat",
                      "uProjUnjitMat",
                      "uViewMat",
-                     "uDirLightProjMat",
-                     "uDirLightViewMat"},
+                     "uDirLightViewMat",
+                     "uCascadeViewProjMatArray",
+                     "uPrevViewMat",
+                     "uPrevProjUnjitMat"},
                     {g_camera.proj.data,
                      g_taaBuffer.projUnjit.data,
                      g_camera.view.data,
-                     g_directLight.projection.data,
-                     g_directLight.view.data},
-                    {1, 1, 1, 1, 1}},
+                     g_directLight.view.data,
+                     g_shadowCascades.viewProjections[0].data,
+                     g_prevCamera.view.data,
+                     g_taaBuffer.prevProjUnjit.data},
+                    {1, 1, 1, 1, SHADOW_CASCADE_MAX_COUNT, 1, 1}},
                 //uint32_t array
                 UniformsDescriptor::PerModelUI32{
                     {"uBumpMapAvailableUint",
@@ -570,10 +1078,168 @@ void CreateForwardPipelineUniformBindngs(ForwardPipelineShaderPrograms &desc,
                 UniformsDescriptor::PerModelFloat4{},
                 //mat4
                 UniformsDescriptor::PerModelMat4{
-                    {"uModelMat"},
+                    {"uModelMat", "uPrevModelMat"},
+                    {reinterpret_cast<float const *>(opaqueModels.data()),
+                     reinterpret_cast<float const *>(g_taaBuffer.prevModels.data())},
+                    {offsetof(RenderModel, RenderModel::model), 0},
+                    {sizeof(RenderModel), sizeof(sr::math::Matrix4x4)}},
+            });
+    }
+
+    {
+        CreateShaderProgramUniformBindings(
+            desc.gBuffer,
+            UniformsDescriptor{
+                UniformsDescriptor::PerFrameUI32{
+                    {"uBumpMappingEnabledUint", "uTextureSupersamplingEnabledUint", "uTaaJitterEnabledUint"},
+                    {&g_bumpMappingEnabled, &g_textureSupersamplingEnabled, &g_taaJitterEnabled},
+                    {1, 1, 1}},
+                UniformsDescriptor::PerFrameFloat1{
+                    {"uBumpMapScaleFactorFloat"}, {&g_bumpMapScaleFactor}, {1}},
+                UniformsDescriptor::PerFrameFloat2{},
+                UniformsDescriptor::PerFrameFloat3{
+                    {"uCameraPos"}, {g_camera.pos.data}, {1}},
+                UniformsDescriptor::PerFrameFloat4{},
+                UniformsDescriptor::PerFrameMat4{
+                    {"uProjMat",
+                     "uProjUnjitMat",
+                     "uViewMat",
+                     "uPrevViewMat",
+                     "uPrevProjUnjitMat"},
+                    {g_camera.proj.data,
+                     g_taaBuffer.projUnjit.data,
+                     g_camera.view.data,
+                     g_prevCamera.view.data,
+                     g_taaBuffer.prevProjUnjit.data},
+                    {1, 1, 1, 1, 1}},
+                UniformsDescriptor::PerModelUI32{
+                    {"uBumpMapAvailableUint",
+                     "uRoughnessMapAvailableUint",
+                     "uDebugRenderModeEnabledUint",
+                     "uBrdfUint"},
+                    {reinterpret_cast<uint32_t const *>(opaqueModels.data()),
+                     reinterpret_cast<uint32_t const *>(opaqueModels.data()),
+                     reinterpret_cast<uint32_t const *>(opaqueModels.data()),
+                     reinterpret_cast<uint32_t const *>(opaqueModels.data())},
+                    {offsetof(RenderModel, RenderModel::bumpTexture),
+                     offsetof(RenderModel, RenderModel::roughnessTexture),
+                     offsetof(RenderModel, RenderModel::debugRenderModel),
+                     offsetof(RenderModel, RenderModel::brdf)},
+                    {sizeof(RenderModel),
+                     sizeof(RenderModel),
+                     sizeof(RenderModel),
+                     sizeof(RenderModel)}},
+                UniformsDescriptor::PerModelFloat1{},
+                UniformsDescriptor::PerModelFloat2{},
+                UniformsDescriptor::PerModelFloat3{
+                    {"uColor"},
                     {reinterpret_cast<float const *>(opaqueModels.data())},
-                    {offsetof(RenderModel, RenderModel::model)},
+                    {offsetof(RenderModel, RenderModel::color)},
                     {sizeof(RenderModel)}},
+                UniformsDescriptor::PerModelFloat4{},
+                UniformsDescriptor::PerModelMat4{
+                    {"uModelMat", "uPrevModelMat"},
+                    {reinterpret_cast<float const *>(opaqueModels.data()),
+                     reinterpret_cast<float const *>(g_taaBuffer.prevModels.data())},
+                    {offsetof(RenderModel, RenderModel::model), 0},
+                    {sizeof(RenderModel), sizeof(sr::math::Matrix4x4)}},
+            });
+    }
+
+    {
+        CreateShaderProgramUniformBindings(
+            desc.ambientOcclusion,
+            UniformsDescriptor{
+                UniformsDescriptor::PerFrameUI32{
+                    {"uAmbientOcclusionDivisorUint"}, {&g_ambientOcclusionDivisor}, {1}},
+                UniformsDescriptor::PerFrameFloat1{
+                    {"uAmbientOcclusionRadiusFloat"}, {&g_ambientOcclusionRadius}, {1}},
+                UniformsDescriptor::PerFrameFloat2{
+                    {"uRenderScaleVec2"}, {g_renderScale.data}, {1}},
+                UniformsDescriptor::PerFrameFloat3{},
+                UniformsDescriptor::PerFrameFloat4{},
+                UniformsDescriptor::PerFrameMat4{
+                    {"uProjUnjitMat"}, {g_taaBuffer.projUnjit.data}, {1}},
+                UniformsDescriptor::PerModelUI32{},
+                UniformsDescriptor::PerModelFloat1{},
+                UniformsDescriptor::PerModelFloat2{},
+                UniformsDescriptor::PerModelFloat3{},
+                UniformsDescriptor::PerModelFloat4{},
+                UniformsDescriptor::PerModelMat4{},
+            });
+    }
+
+    {
+        CreateShaderProgramUniformBindings(
+            desc.ambientOcclusionUpsample,
+            UniformsDescriptor{
+                UniformsDescriptor::PerFrameUI32{
+                    {"uAmbientOcclusionDivisorUint"}, {&g_ambientOcclusionDivisor}, {1}},
+                UniformsDescriptor::PerFrameFloat1{},
+                UniformsDescriptor::PerFrameFloat2{
+                    {"uRenderScaleVec2"}, {g_renderScale.data}, {1}},
+                UniformsDescriptor::PerFrameFloat3{},
+                UniformsDescriptor::PerFrameFloat4{},
+                UniformsDescriptor::PerFrameMat4{
+                    {"uProjUnjitMat"}, {g_taaBuffer.projUnjit.data}, {1}},
+                UniformsDescriptor::PerModelUI32{},
+                UniformsDescriptor::PerModelFloat1{},
+                UniformsDescriptor::PerModelFloat2{},
+                UniformsDescriptor::PerModelFloat3{},
+                UniformsDescriptor::PerModelFloat4{},
+                UniformsDescriptor::PerModelMat4{},
+            });
+    }
+
+    {
+        CreateShaderProgramUniformBindings(
+            desc.deferredLighting,
+            UniformsDescriptor{
+                UniformsDescriptor::PerFrameUI32{
+                    {"uRenderModeUint",
+                     "uDirectLightEnabledUint",
+                     "uPointLightEnabledUint",
+                     "uAmbientOcclusionEnabledUint",
+                     "uShadowMappingEnabledUint",
+                     "uTaaJitterEnabledUint",
+                     "uCascadeCountUint"},
+                    {reinterpret_cast<uint32_t *>(&g_renderMode),
+                     &g_directLightEnabled,
+                     &g_pointLightEnabled,
+                     &g_ambientOcclusionEnabled,
+                     &g_shadowMappingEnabled,
+                     &g_taaJitterEnabled,
+                     &g_shadowCascades.count},
+                    {1, 1, 1, 1, 1, 1, 1}},
+                UniformsDescriptor::PerFrameFloat1{
+                    {"uAmbientLightRadiantFluxFloat", "uDirectLightRadiantFluxFloat", "uPointLightRadiantFluxFloat", "uCascadeSplitFloatArray"},
+                    {&g_ambientLightRadiantFlux, &g_directLight.radiantFlux, &g_pointLightRadiantFlux, g_shadowCascades.splits},
+                    {1, 1, 1, SHADOW_CASCADE_MAX_COUNT}},
+                UniformsDescriptor::PerFrameFloat2{
+                    {"uRenderScaleVec2"}, {g_renderScale.data}, {1}},
+                UniformsDescriptor::PerFrameFloat3{
+                    {"uCameraPos"}, {g_camera.pos.data}, {1}},
+                UniformsDescriptor::PerFrameFloat4{},
+                UniformsDescriptor::PerFrameMat4{
+                    {"uInvProjMat",
+                     "uInvProjUnjitMat",
+                     "uViewMat",
+                     "uInvViewMat",
+                     "uDirLightViewMat",
+                     "uCascadeViewProjMatArray"},
+                    {g_camera.invProj.data,
+                     g_taaBuffer.invProjUnjit.data,
+                     g_camera.view.data,
+                     g_camera.invView.data,
+                     g_directLight.view.data,
+                     g_shadowCascades.viewProjections[0].data},
+                    {1, 1, 1, 1, 1, SHADOW_CASCADE_MAX_COUNT}},
+                UniformsDescriptor::PerModelUI32{},
+                UniformsDescriptor::PerModelFloat1{},
+                UniformsDescriptor::PerModelFloat2{},
+                UniformsDescriptor::PerModelFloat3{},
+                UniformsDescriptor::PerModelFloat4{},
+                UniformsDescriptor::PerModelMat4{},
             });
     }
 
@@ -586,44 +1252,52 @@ void CreateForwardPipelineUniformBindngs(ForwardPipelineShaderPrograms &desc,
                     {"uRenderModeUint",
                      "uDirectLightEnabledUint",
                      "uPointLightEnabledUint",
+                     "uPointLightCountUint",
+                     "uClusteredLightingEnabledUint",
                      "uShadowMappingEnabledUint",
                      "uBumpMappingEnabledUint",
+                     "uTextureSupersamplingEnabledUint",
                      "uTaaEnabledUint",
-                     "uTaaJitterEnabledUint"},
+                     "uTaaJitterEnabledUint",
+                     "uCascadeCountUint"},
                     {reinterpret_cast<uint32_t *>(&g_renderMode),
                      &g_directLightEnabled,
                      &g_pointLightEnabled,
+                     &g_pointLightCount,
+                     &g_clusteredLightingEnabled,
                      &g_shadowMappingEnabled,
                      &g_bumpMappingEnabled,
+                     &g_textureSupersamplingEnabled,
                      &g_taaEnabled,
-                     &g_taaJitterEnabled},
-                    {1, 1, 1, 1, 1, 1, 1}},
+                     &g_taaJitterEnabled,
+                     &g_shadowCascades.count},
+                    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}},
                 //floats
                 UniformsDescriptor::PerFrameFloat1{
-                    {"uBumpMapScaleFactorFloat", "uAmbientLightRadiantFluxFloat", "uDirectLightRadiantFluxFloat", "uPointLightRadiantFluxFloat"},
-                    {&g_bumpMapScaleFactor, &g_ambientLightRadiantFlux, &g_directLight.radiantFlux, &g_pointLightRadiantFlux},
-                    {1, 1, 1, 1}},
-                UniformsDescriptor::PerFrameFloat2{},
+                    {"uBumpMapScaleFactorFloat", "uAmbientLightRadiantFluxFloat", "uDirectLightRadiantFluxFloat", "uPointLightRadiantFluxFloat", "uCascadeSplitFloatArray"},
+                    {&g_bumpMapScaleFactor, &g_ambientLightRadiantFlux, &g_directLight.radiantFlux, &g_pointLightRadiantFlux, g_shadowCascades.splits},
+                    {1, 1, 1, 1, SHADOW_CASCADE_MAX_COUNT}},
+                UniformsDescriptor::PerFrameFloat2{
+                    {"uClusterScaleVec2", "uClusterDepthScaleBiasVec2"},
+                    {g_clusterScale.data, g_clusterDepthScaleBias.data},
+                    {1, 1}},
                 //float3
                 UniformsDescriptor::PerFrameFloat3{
-                    {"uCameraPos", "uPointLightPosVec3Array"},
-                    {g_camera.pos.data,
-                     g_pointLights[0].data},
-                    {1, g_pointLightCount}},
+                    {"uCameraPos"}, {g_camera.pos.data}, {1}},
                 UniformsDescriptor::PerFrameFloat4{},
                 //mat4
                 UniformsDescriptor::PerFrameMat4{
                     {"uProjMat",
                      "uProjUnjitMat",
                      "uViewMat",
-                     "uDirLightProjMat",
-                     "uDirLightViewMat"},
+                     "uDirLightViewMat",
+                     "uCascadeViewProjMatArray"},
                     {g_camera.proj.data,
                      g_taaBuffer.projUnjit.data,
                      g_camera.view.data,
-                     g_directLight.projection.data,
-                     g_directLight.view.data},
-                    {1, 1, 1, 1, 1}},
+                     g_directLight.view.data,
+                     g_shadowCascades.viewProjections[0].data},
+                    {1, 1, 1, 1, SHADOW_CASCADE_MAX_COUNT}},
                 //uint32_t array
                 UniformsDescriptor::PerModelUI32{
                     {"uBumpMapAvailableUint",
@@ -669,7 +1343,8 @@ void CreateForwardPipelineUniformBindngs(ForwardPipelineShaderPrograms &desc,
         CreateShaderProgramUniformBindings(
             desc.velocity,
             UniformsDescriptor{
-                UniformsDescriptor::PerFrameUI32{},
+                UniformsDescriptor::PerFrameUI32{
+                    {"uTaaJitterEnabledUint"}, {&g_taaJitterEnabled}, {1}},
                 UniformsDescriptor::PerFrameFloat1{},
                 UniformsDescriptor::PerFrameFloat2{},
                 UniformsDescriptor::PerFrameFloat3{},
@@ -678,12 +1353,14 @@ void CreateForwardPipelineUniformBindngs(ForwardPipelineShaderPrograms &desc,
                     {"uPrevViewMat4",
                      "uPrevProjUnjitMat4",
                      "uViewMat4",
-                     "uProjUnjitMat4"},
+                     "uProjUnjitMat4",
+                     "uProjMat4"},
                     {g_prevCamera.view.data,
                      g_taaBuffer.prevProjUnjit.data,
                      g_camera.view.data,
-                     g_taaBuffer.projUnjit.data},
-                    {1, 1, 1, 1},
+                     g_taaBuffer.projUnjit.data,
+                     g_camera.proj.data},
+                    {1, 1, 1, 1, 1},
                 },
                 UniformsDescriptor::PerModelUI32{},
                 UniformsDescriptor::PerModelFloat1{},
@@ -707,30 +1384,36 @@ void CreateForwardPipelineUniformBindngs(ForwardPipelineShaderPrograms &desc,
                 UniformsDescriptor::PerFrameUI32{
                     {"uFrameCountUint",
                      "uTaaEnabledUint",
-                     "uTaaJitterEnabledUint"},
+                     "uTaaJitterEnabledUint",
+                     "uCameraVelocityFromDepthUint"},
                     {&g_taaBuffer.count,
                      &g_taaEnabled,
-                     &g_taaJitterEnabled},
-                    {1, 1, 1}},
+                     &g_taaJitterEnabled,
+                     &g_cameraVelocityFromDepth},
+                    {1, 1, 1, 1}},
                 UniformsDescriptor::PerFrameFloat1{},
                 UniformsDescriptor::PerFrameFloat2{
-                    {"uJitterVec2"}, {g_taaBuffer.jitter.data}, {1}},
+                    {"uJitterVec2", "uRenderScaleVec2"}, {g_taaBuffer.jitter.data, g_renderScale.data}, {1, 1}},
                 UniformsDescriptor::PerFrameFloat3{},
                 UniformsDescriptor::PerFrameFloat4{},
                 UniformsDescriptor::PerFrameMat4{
                     {"uViewMat",
-                     "uProjMat",
                      "uProjUnjitMat",
+                     "uInvViewMat",
+                     "uInvProjMat",
+                     "uInvProjUnjitMat",
                      "uPrevViewMat",
                      "uPrevProjMat",
                      "uPrevProjUnjitMat"},
                     {g_camera.view.data,
-                     g_camera.proj.data,
                      g_taaBuffer.projUnjit.data,
+                     g_camera.invView.data,
+                     g_camera.invProj.data,
+                     g_taaBuffer.invProjUnjit.data,
                      g_prevCamera.view.data,
                      g_prevCamera.proj.data,
                      g_taaBuffer.prevProjUnjit.data},
-                    {1, 1, 1, 1, 1, 1}},
+                    {1, 1, 1, 1, 1, 1, 1, 1}},
                 UniformsDescriptor::PerModelUI32{},
                 UniformsDescriptor::PerModelFloat1{},
                 UniformsDescriptor::PerModelFloat2{},
@@ -745,9 +1428,12 @@ void CreateForwardPipelineUniformBindngs(ForwardPipelineShaderPrograms &desc,
             desc.toneMapping,
             UniformsDescriptor{
                 UniformsDescriptor::PerFrameUI32{
-                    {"uToneMappingEnabledUint"}, {&g_toneMappingEnabled}, {1}},
+                    {"uToneMappingEnabledUint", "uAutoExposureEnabledUint"},
+                    {&g_toneMappingEnabled, &g_autoExposureEnabled},
+                    {1, 1}},
                 UniformsDescriptor::PerFrameFloat1{},
-                UniformsDescriptor::PerFrameFloat2{},
+                UniformsDescriptor::PerFrameFloat2{
+                    {"uInputScaleVec2"}, {g_toneMappingInputScale.data}, {1}},
                 UniformsDescriptor::PerFrameFloat3{},
                 UniformsDescriptor::PerFrameFloat4{},
                 UniformsDescriptor::PerFrameMat4{},
@@ -781,44 +1467,294 @@ void CreateForwardPipelineUniformBindngs(ForwardPipelineShaderPrograms &desc,
     }
 }
 
+ShaderProgram CreateDepthReductionShaderProgram()
+{
+    ShaderProgram program = CreateComputeShaderProgram("shaders/depth_reduction.comp");
+    CreateShaderProgramUniformBindings(
+        program,
+        UniformsDescriptor{
+            UniformsDescriptor::PerFrameUI32{
+                {"uCascadeCountUint"},
+                {&g_shadowCascades.count},
+                {1}},
+            UniformsDescriptor::PerFrameFloat1{
+                {"uCascadeSplitFloatArray"},
+                {g_shadowCascades.splits},
+                {SHADOW_CASCADE_MAX_COUNT}},
+            UniformsDescriptor::PerFrameFloat2{
+                {"uRenderScaleVec2"}, {g_renderScale.data}, {1}},
+            UniformsDescriptor::PerFrameFloat3{},
+            UniformsDescriptor::PerFrameFloat4{},
+            UniformsDescriptor::PerFrameMat4{
+                {"uProjUnjitMat", "uViewToLightMat"},
+                {g_taaBuffer.projUnjit.data, g_shadowCascades.viewToLight.data},
+                {1, 1}},
+            UniformsDescriptor::PerModelUI32{},
+            UniformsDescriptor::PerModelFloat1{},
+            UniformsDescriptor::PerModelFloat2{},
+            UniformsDescriptor::PerModelFloat3{},
+            UniformsDescriptor::PerModelFloat4{},
+            UniformsDescriptor::PerModelMat4{},
+        });
+
+    return program;
+}
+
+ShaderProgram CreateLightCullingShaderProgram()
+{
+    ShaderProgram program = CreateComputeShaderProgram("shaders/light_culling.comp");
+    CreateShaderProgramUniformBindings(
+        program,
+        UniformsDescriptor{
+            UniformsDescriptor::PerFrameUI32{
+                {"uPointLightCountUint"},
+                {&g_pointLightCount},
+                {1}},
+            UniformsDescriptor::PerFrameFloat1{},
+            UniformsDescriptor::PerFrameFloat2{
+                {"uRenderScaleVec2"}, {g_renderScale.data}, {1}},
+            UniformsDescriptor::PerFrameFloat3{},
+            UniformsDescriptor::PerFrameFloat4{},
+            UniformsDescriptor::PerFrameMat4{
+                {"uProjUnjitMat", "uViewMat"},
+                {g_taaBuffer.projUnjit.data, g_camera.view.data},
+                {1, 1}},
+            UniformsDescriptor::PerModelUI32{},
+            UniformsDescriptor::PerModelFloat1{},
+            UniformsDescriptor::PerModelFloat2{},
+            UniformsDescriptor::PerModelFloat3{},
+            UniformsDescriptor::PerModelFloat4{},
+            UniformsDescriptor::PerModelMat4{},
+        });
+
+    return program;
+}
+
+// Same uniforms as the TAA pass program, see DispatchTemporalResolve
+ShaderProgram CreateTemporalResolveShaderProgram()
+{
+    ShaderProgram program = CreateComputeShaderProgram("shaders/taa.comp");
+    CreateShaderProgramUniformBindings(
+        program,
+        UniformsDescriptor{
+            UniformsDescriptor::PerFrameUI32{
+                {"uFrameCountUint",
+                 "uTaaEnabledUint",
+                 "uTaaJitterEnabledUint",
+                 "uCameraVelocityFromDepthUint"},
+                {&g_taaBuffer.count,
+                 &g_taaEnabled,
+                 &g_taaJitterEnabled,
+                 &g_cameraVelocityFromDepth},
+                {1, 1, 1, 1}},
+            UniformsDescriptor::PerFrameFloat1{},
+            UniformsDescriptor::PerFrameFloat2{
+                {"uRenderScaleVec2"}, {g_renderScale.data}, {1}},
+            UniformsDescriptor::PerFrameFloat3{},
+            UniformsDescriptor::PerFrameFloat4{},
+            UniformsDescriptor::PerFrameMat4{
+                {"uViewMat",
+                 "uProjUnjitMat",
+                 "uInvViewMat",
+                 "uInvProjMat",
+                 "uInvProjUnjitMat",
+                 "uPrevViewMat",
+                 "uPrevProjMat",
+                 "uPrevProjUnjitMat"},
+                {g_camera.view.data,
+                 g_taaBuffer.projUnjit.data,
+                 g_camera.invView.data,
+                 g_camera.invProj.data,
+                 g_taaBuffer.invProjUnjit.data,
+                 g_prevCamera.view.data,
+                 g_prevCamera.proj.data,
+                 g_taaBuffer.prevProjUnjit.data},
+                {1, 1, 1, 1, 1, 1, 1, 1}},
+            UniformsDescriptor::PerModelUI32{},
+            UniformsDescriptor::PerModelFloat1{},
+            UniformsDescriptor::PerModelFloat2{},
+            UniformsDescriptor::PerModelFloat3{},
+            UniformsDescriptor::PerModelFloat4{},
+            UniformsDescriptor::PerModelMat4{},
+        });
+
+    return program;
+}
+
+ShaderProgram CreateLuminanceHistogramShaderProgram()
+{
+    ShaderProgram program = CreateComputeShaderProgram("shaders/luminance_histogram.comp");
+    CreateShaderProgramUniformBindings(
+        program,
+        UniformsDescriptor{
+            UniformsDescriptor::PerFrameUI32{},
+            UniformsDescriptor::PerFrameFloat1{},
+            UniformsDescriptor::PerFrameFloat2{
+                {"uInputScaleVec2", "uLogLuminanceRangeVec2"},
+                {g_toneMappingInputScale.data, g_luminanceRange.data},
+                {1, 1}},
+            UniformsDescriptor::PerFrameFloat3{},
+            UniformsDescriptor::PerFrameFloat4{},
+            UniformsDescriptor::PerFrameMat4{},
+            UniformsDescriptor::PerModelUI32{},
+            UniformsDescriptor::PerModelFloat1{},
+            UniformsDescriptor::PerModelFloat2{},
+            UniformsDescriptor::PerModelFloat3{},
+            UniformsDescriptor::PerModelFloat4{},
+            UniformsDescriptor::PerModelMat4{},
+        });
+
+    return program;
+}
+
+ShaderProgram CreateExposureShaderProgram()
+{
+    ShaderProgram program = CreateComputeShaderProgram("shaders/exposure.comp");
+    CreateShaderProgramUniformBindings(
+        program,
+        UniformsDescriptor{
+            UniformsDescriptor::PerFrameUI32{},
+            UniformsDescriptor::PerFrameFloat1{
+                {"uDeltaTimeFloat", "uExposureAdaptationRateFloat", "uExposureCompensationFloat"},
+                {&g_frameDeltaTime, &g_exposureAdaptationRate, &g_exposureCompensation},
+                {1, 1, 1}},
+            UniformsDescriptor::PerFrameFloat2{
+                {"uLogLuminanceRangeVec2"}, {g_luminanceRange.data}, {1}},
+            UniformsDescriptor::PerFrameFloat3{},
+            UniformsDescriptor::PerFrameFloat4{},
+            UniformsDescriptor::PerFrameMat4{},
+            UniformsDescriptor::PerModelUI32{},
+            UniformsDescriptor::PerModelFloat1{},
+            UniformsDescriptor::PerModelFloat2{},
+            UniformsDescriptor::PerModelFloat3{},
+            UniformsDescriptor::PerModelFloat4{},
+            UniformsDescriptor::PerModelMat4{},
+        });
+
+    return program;
+}
+
+RecordedFrame CaptureRecordedFrame()
+{
+    RecordedFrame frame;
+    frame.cameraPos = g_camera.pos;
+    frame.cameraXWorldAngle = g_camera.xWorldAngle;
+    frame.cameraYWorldAngle = g_camera.yWorldAngle;
+    frame.cameraSpeed = g_cameraSpeed;
+    frame.inputs = sr::input::g_inputs;
+
+    RecordedSettings &settings = frame.settings;
+    settings.renderMode = static_cast<uint32_t>(g_renderMode);
+    settings.directLightEnabled = g_directLightEnabled;
+    settings.shadowMappingEnabled = g_shadowMappingEnabled;
+    settings.pointLightEnabled = g_pointLightEnabled;
+    settings.bumpMappingEnabled = g_bumpMappingEnabled;
+    settings.toneMappingEnabled = g_toneMappingEnabled;
+    settings.taaEnabled = g_taaEnabled;
+    settings.taaJitterEnabled = g_taaJitterEnabled;
+    settings.drawAABBs = g_drawAABBs;
+    settings.drawUi = g_drawUi;
+    settings.frustumCulling = g_frustumCullingEnabled;
+    settings.bvhCulling = g_bvhCullingEnabled;
+    settings.occlusionCulling = g_occlusionCullingEnabled;
+    settings.commandBuffers = g_commandBuffersEnabled;
+    settings.shadowCascadeCount = g_shadowCascadeCount;
+    settings.sampleDistribution = g_sampleDistributionEnabled;
+    settings.shadowCache = g_shadowCacheEnabled;
+    settings.renderGraphAliasing = g_renderGraphAliasingEnabled;
+    settings.pipelinedSimulation = g_pipelinedSimulationEnabled;
+    settings.dynamicResolution = g_dynamicResolutionEnabled;
+    settings.targetFormats = static_cast<uint32_t>(g_targetFormats);
+    settings.velocityMode = static_cast<uint32_t>(g_velocityMode);
+    settings.lightingPath = static_cast<uint32_t>(g_lightingPath);
+    settings.ambientOcclusion = static_cast<uint32_t>(g_ambientOcclusion);
+    settings.generatedPointLightCount = g_generatedPointLightCount;
+    settings.clusteredLighting = g_clusteredLightingEnabled;
+    settings.textureSupersampling = g_textureSupersamplingEnabled;
+    settings.taaComputeResolve = g_taaComputeResolveEnabled;
+    settings.autoExposure = g_autoExposureEnabled;
+    settings.shadowCascadeSplitLambda = g_shadowCascadeSplitLambda;
+    settings.ambientLightRadiantFlux = g_ambientLightRadiantFlux;
+    settings.directLightRadiantFlux = g_directLight.radiantFlux;
+    settings.pointLightRadiantFlux = g_pointLightRadiantFlux;
+    settings.bumpMapScaleFactor = g_bumpMapScaleFactor;
+    settings.depthBiasScale = g_depthBiasScale;
+    settings.depthUnitScale = g_depthUnitScale;
+    settings.exposureAdaptationRate = g_exposureAdaptationRate;
+    settings.exposureCompensation = g_exposureCompensation;
+
+    return frame;
+}
+
+// The UI checkboxes keep their own state, they show the values from before the replay.
+// The point light count is applied before the scene loads, see PeekRecordedSettings.
+void ApplyRecordedFrame(RecordedFrame const &frame)
+{
+    g_camera.pos = frame.cameraPos;
+    g_camera.xWorldAngle = frame.cameraXWorldAngle;
+    g_camera.yWorldAngle = frame.cameraYWorldAngle;
+    g_cameraSpeed = frame.cameraSpeed;
+
+    RecordedSettings const &settings = frame.settings;
+    g_renderMode = static_cast<eRenderMode>(std::min(settings.renderMode, static_cast<uint32_t>(eRenderMode::Count) - 1));
+    g_directLightEnabled = settings.directLightEnabled;
+    g_shadowMappingEnabled = settings.shadowMappingEnabled;
+    g_pointLightEnabled = settings.pointLightEnabled;
+    g_bumpMappingEnabled = settings.bumpMappingEnabled;
+    g_toneMappingEnabled = settings.toneMappingEnabled;
+    g_taaEnabled = settings.taaEnabled;
+    g_taaJitterEnabled = settings.taaJitterEnabled;
+    g_drawAABBs = settings.drawAABBs != 0;
+    g_drawUi = settings.drawUi != 0;
+    g_frustumCullingEnabled = settings.frustumCulling != 0;
+    g_bvhCullingEnabled = settings.bvhCulling != 0;
+    g_occlusionCullingEnabled = settings.occlusionCulling != 0;
+    g_commandBuffersEnabled = settings.commandBuffers != 0;
+    g_shadowCascadeCount = std::min(std::max(settings.shadowCascadeCount, 1u), static_cast<uint32_t>(SHADOW_CASCADE_MAX_COUNT));
+    g_sampleDistributionEnabled = settings.sampleDistribution != 0;
+    g_shadowCacheEnabled = settings.shadowCache != 0;
+    g_renderGraphAliasingEnabled = settings.renderGraphAliasing != 0;
+    g_pipelinedSimulationEnabled = settings.pipelinedSimulation != 0;
+    g_dynamicResolutionEnabled = settings.dynamicResolution != 0;
+    g_targetFormats = static_cast<eForwardTargetFormats>(
+        std::min(settings.targetFormats, static_cast<uint32_t>(eForwardTargetFormats::Count) - 1));
+    g_velocityMode = static_cast<eVelocityMode>(
+        std::min(settings.velocityMode, static_cast<uint32_t>(eVelocityMode::Count) - 1));
+    g_lightingPath = static_cast<eLightingPath>(
+        std::min(settings.lightingPath, static_cast<uint32_t>(eLightingPath::Count) - 1));
+    g_ambientOcclusion = static_cast<eAmbientOcclusion>(
+        std::min(settings.ambientOcclusion, static_cast<uint32_t>(eAmbientOcclusion::Count) - 1));
+    g_clusteredLightingEnabled = settings.clusteredLighting != 0;
+    g_textureSupersamplingEnabled = settings.textureSupersampling != 0;
+    g_taaComputeResolveEnabled = settings.taaComputeResolve != 0;
+    g_autoExposureEnabled = settings.autoExposure != 0;
+    g_shadowCascadeSplitLambda = settings.shadowCascadeSplitLambda;
+    g_ambientLightRadiantFlux = settings.ambientLightRadiantFlux;
+    g_directLight.radiantFlux = settings.directLightRadiantFlux;
+    g_pointLightRadiantFlux = settings.pointLightRadiantFlux;
+    g_bumpMapScaleFactor = settings.bumpMapScaleFactor;
+    g_depthBiasScale = settings.depthBiasScale;
+    g_depthUnitScale = settings.depthUnitScale;
+    g_exposureAdaptationRate = settings.exposureAdaptationRate;
+    g_exposureCompensation = settings.exposureCompensation;
+}
+
 void UpdateInputs(GLFWwindow *window)
 {
     assert(window != nullptr);
 
     sr::input::UpdateInputs();
 
-    sr::math::Vec4 forward = {};
-    sr::math::Vec4 right = {};
-    sr::math::Matrix4x4 const camera = CreateCameraMatrix(
-        g_camera.pos, g_camera.xWorldAngle, g_camera.yWorldAngle);
-
-    if (sr::input::g_inputs.keys[static_cast<uint32_t>(sr::input::Keys::W)] != sr::input::KeyAction::NONE)
-    {
-        forward = sr::math::Mul(camera, sr::math::Vec4{0, 0, -1, 0});
-        forward *= g_cameraSpeed;
-    }
-    if (sr::input::g_inputs.keys[static_cast<uint32_t>(sr::input::Keys::S)] != sr::input::KeyAction::NONE)
-    {
-        forward = sr::math::Mul(camera, sr::math::Vec4{0, 0, -1, 0});
-        forward *= -g_cameraSpeed;
-    }
-    if (sr::input::g_inputs.keys[static_cast<uint32_t>(sr::input::Keys::A)] != sr::input::KeyAction::NONE)
-    {
-        right = sr::math::Mul(camera, sr::math::Vec4{-1, 0, 0, 0});
-        right *= g_cameraSpeed;
-    }
-    if (sr::input::g_inputs.keys[static_cast<uint32_t>(sr::input::Keys::D)] != sr::input::KeyAction::NONE)
+    //Replayed keys go through the same toggles below as the recorded ones did
+    RecordedFrame replayed;
+    bool const replaying = g_replayEnabled && ReadRecordedFrame(g_inputReplay, replayed);
+    if (g_replayEnabled && !replaying)
     {
-        right = sr::math::Mul(camera, sr::math::Vec4{-1, 0, 0, 0});
-        right *= -g_cameraSpeed;
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
     }
-    if (sr::input::g_inputs.keys[static_cast<uint32_t>(sr::input::Keys::Q)] != sr::input::KeyAction::NONE)
+    if (replaying)
     {
-        g_camera.pos.y -= g_cameraSpeed;
-    }
-    if (sr::input::g_inputs.keys[static_cast<uint32_t>(sr::input::Keys::E)] != sr::input::KeyAction::NONE)
-    {
-        g_camera.pos.y += g_cameraSpeed;
+        sr::input::g_inputs = replayed.inputs;
     }
 
     if (sr::input::g_inputs.keys[static_cast<uint32_t>(sr::input::Keys::F)] == sr::input::KeyAction::RELEASE)
@@ -846,94 +1782,409 @@ void UpdateInputs(GLFWwindow *window)
         g_drawUi = !g_drawUi;
     }
 
-    g_camera.pos += forward.xyz;
-    g_camera.pos += right.xyz;
+    if (replaying)
+    {
+        ApplyRecordedFrame(replayed);
+    }
+    if (g_recordingEnabled)
+    {
+        RecordFrame(g_inputRecorder, CaptureRecordedFrame());
+    }
 }
 
-void UpdateModels(std::vector<RenderModel> &models)
+void UpdateCamera(Camera &camera, InputSnapshot const &input)
 {
-    models.back().model = sr::math::CreateRotationMatrixY(0.01f) * models.back().model;
-}
+    //Angles and projection parameters are owned by the render thread, the position by the simulation
+    camera.xWorldAngle = input.camera.xWorldAngle;
+    camera.yWorldAngle = input.camera.yWorldAngle;
+    camera.fov = input.camera.fov;
+    camera.aspect = input.camera.aspect;
+    camera.near = input.camera.near;
+    camera.far = input.camera.far;
+    if (input.cameraPositionEdited)
+    {
+        camera.pos = input.camera.pos;
+    }
 
-void PrePassCommands(ForwardPipeline &pipeline, std::vector<RenderModel> &models)
-{
-    { // Update shadow map view frustum
-        g_directLight.view = sr::math::CreateRotationMatrixZ(-g_directLight.orientation.z) *
-                             sr::math::CreateRotationMatrixY(-g_directLight.orientation.y) *
-                             sr::math::CreateRotationMatrixX(-g_directLight.orientation.x) *
-                             sr::math::CreateTranslationMatrix(-g_directLight.position);
+    sr::math::Vec4 forward = {};
+    sr::math::Vec4 right = {};
+    sr::math::Matrix4x4 const cameraMatrix = CreateCameraMatrix(
+        camera.pos, camera.xWorldAngle, camera.yWorldAngle);
 
-        sr::math::Vec3 min = {FLT_MAX, FLT_MAX, FLT_MAX};
-        sr::math::Vec3 max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    if (input.inputs.keys[static_cast<uint32_t>(sr::input::Keys::W)] != sr::input::KeyAction::NONE)
+    {
+        forward = sr::math::Mul(cameraMatrix, sr::math::Vec4{0, 0, -1, 0});
+        forward *= input.cameraSpeed;
+    }
+    if (input.inputs.keys[static_cast<uint32_t>(sr::input::Keys::S)] != sr::input::KeyAction::NONE)
+    {
+        forward = sr::math::Mul(cameraMatrix, sr::math::Vec4{0, 0, -1, 0});
+        forward *= -input.cameraSpeed;
+    }
+    if (input.inputs.keys[static_cast<uint32_t>(sr::input::Keys::A)] != sr::input::KeyAction::NONE)
+    {
+        right = sr::math::Mul(cameraMatrix, sr::math::Vec4{-1, 0, 0, 0});
+        right *= input.cameraSpeed;
+    }
+    if (input.inputs.keys[static_cast<uint32_t>(sr::input::Keys::D)] != sr::input::KeyAction::NONE)
+    {
+        right = sr::math::Mul(cameraMatrix, sr::math::Vec4{-1, 0, 0, 0});
+        right *= -input.cameraSpeed;
+    }
+    if (input.inputs.keys[static_cast<uint32_t>(sr::input::Keys::Q)] != sr::input::KeyAction::NONE)
+    {
+        camera.pos.y -= input.cameraSpeed;
+    }
+    if (input.inputs.keys[static_cast<uint32_t>(sr::input::Keys::E)] != sr::input::KeyAction::NONE)
+    {
+        camera.pos.y += input.cameraSpeed;
+    }
+
+    camera.pos += forward.xyz;
+    camera.pos += right.xyz;
+}
+
+void UpdateModels(std::vector<RenderModel> &models)
+{
+    auto &model = models.back();
+    model.model = sr::math::CreateRotationMatrixY(0.01f) * model.model;
+    model.aabb = sr::geo::TransformAABB(model.localAabb, model.model);
+}
+
+sr::cull::AABBSoA CreateModelBounds(std::vector<RenderModel> const &models)
+{
+    sr::cull::AABBSoA bounds;
+    sr::cull::ResizeAABBSoA(bounds, models.size());
+
+    for (uint64_t i = 0; i < models.size(); ++i)
+    {
+        sr::cull::StoreAABB(bounds, i, models[i].aabb);
+    }
+
+    return bounds;
+}
+
+sr::bvh::BVH CreateModelBVH(std::vector<RenderModel> const &models)
+{
+    std::vector<sr::geo::AABB> aabbs(models.size());
+    for (uint64_t i = 0; i < models.size(); ++i)
+    {
+        aabbs[i] = models[i].aabb;
+    }
+
+    return sr::bvh::CreateBVH(aabbs.data(), static_cast<uint32_t>(aabbs.size()));
+}
+
+void CountShadowTriangles(FramePacket &frame, std::vector<RenderModel> const &models)
+{
+    for (uint32_t i = 0; i < SHADOW_CASCADE_MAX_COUNT; ++i)
+    {
+        if (i >= frame.shadowCascades.count)
+        {
+            frame.cullingStats.shadowTriangleCount[i] = 0;
+            continue;
+        }
+
+        uint64_t triangleCount = 0;
+        for (uint64_t j = 0; j < frame.shadowVisibility[i].count; ++j)
+        {
+            triangleCount += models[frame.shadowVisibility[i].indices[j]].indexCount / 3;
+        }
+        frame.cullingStats.shadowTriangleCount[i] = triangleCount;
+    }
+}
+
+void CullModels(
+    FramePacket &frame,
+    InputSnapshot const &input,
+    std::vector<RenderModel> const &models,
+    sr::cull::AABBSoA &bounds,
+    sr::bvh::BVH &bvh)
+{
+    for (uint64_t i = 0; i < models.size(); ++i)
+    {
+        if (models[i].isDynamic)
+        {
+            sr::cull::StoreAABB(bounds, i, models[i].aabb);
+            sr::bvh::RefitBVH(bvh, static_cast<uint32_t>(i), models[i].aabb);
+        }
+    }
+
+    frame.cullingStats.boxCount = bounds.count;
+
+    if (!input.frustumCulling)
+    {
+        sr::cull::MarkAllVisible(frame.cameraVisibility, bounds.count);
+        for (uint32_t i = 0; i < frame.shadowCascades.count; ++i)
+        {
+            sr::cull::MarkAllVisible(frame.shadowVisibility[i], bounds.count);
+        }
+        frame.cullingStats.cameraCullingMs = 0;
+        frame.cullingStats.shadowCullingMs = 0;
+        CountShadowTriangles(frame, models);
+        return;
+    }
+
+    auto const cameraFrustum = sr::cull::ExtractFrustum(frame.camera.proj * frame.camera.view);
+
+    auto const start = std::chrono::high_resolution_clock::now();
+    if (input.bvhCulling)
+    {
+        sr::bvh::QueryFrustum(bvh, cameraFrustum, frame.cameraVisibility);
+    }
+    else
+    {
+        sr::cull::CullAABBs(cameraFrustum, bounds, frame.cameraVisibility);
+    }
+    auto const cameraEnd = std::chrono::high_resolution_clock::now();
+    //Every cascade only draws the casters inside its own box
+    for (uint32_t i = 0; i < frame.shadowCascades.count; ++i)
+    {
+        auto const shadowFrustum = sr::cull::ExtractFrustum(frame.shadowCascades.viewProjections[i]);
+        if (input.bvhCulling)
+        {
+            sr::bvh::QueryFrustum(bvh, shadowFrustum, frame.shadowVisibility[i]);
+        }
+        else
+        {
+            sr::cull::CullAABBs(shadowFrustum, bounds, frame.shadowVisibility[i]);
+        }
+    }
+    auto const shadowEnd = std::chrono::high_resolution_clock::now();
+    CountShadowTriangles(frame, models);
+
+    frame.cullingStats.cameraCullingMs = std::chrono::duration<float, std::milli>(cameraEnd - start).count();
+    frame.cullingStats.shadowCullingMs = std::chrono::duration<float, std::milli>(shadowEnd - cameraEnd).count();
+}
+
+void CullOccludedModels(
+    FramePacket &frame,
+    InputSnapshot const &input,
+    std::vector<sr::cull::Occluder> const &occluders,
+    sr::cull::AABBSoA const &bounds,
+    sr::cull::DepthBuffer &depthBuffer,
+    std::vector<sr::cull::ScreenTriangle> &triangles)
+{
+    if (!input.occlusionCulling)
+    {
+        frame.occlusionVisibility.indices = frame.cameraVisibility.indices;
+        frame.occlusionVisibility.count = frame.cameraVisibility.count;
+        return;
+    }
+
+    //Jitter is left out so that the buffer does not shimmer with TAA
+    sr::math::Matrix4x4 const viewProj = frame.taaBuffer.projUnjit * frame.camera.view;
+
+    auto const start = std::chrono::high_resolution_clock::now();
+    sr::cull::TransformOccluders(
+        occluders.data(), occluders.size(), viewProj, depthBuffer.width, depthBuffer.height, triangles);
+    sr::cull::RasterizeOccluders(depthBuffer, triangles);
+    auto const rasterEnd = std::chrono::high_resolution_clock::now();
+    sr::cull::CullOccludedAABBs(depthBuffer, viewProj, bounds, frame.cameraVisibility, frame.occlusionVisibility);
+    auto const testEnd = std::chrono::high_resolution_clock::now();
+
+    frame.cullingStats.occluderTriangleCount = triangles.size();
+    frame.cullingStats.occlusionRasterMs = std::chrono::duration<float, std::milli>(rasterEnd - start).count();
+    frame.cullingStats.occlusionTestMs = std::chrono::duration<float, std::milli>(testEnd - rasterEnd).count();
+}
+
+// Splits the view frustum with the practical split scheme, a blend of the logarithmic and the uniform
+// distribution. Every cascade is fitted to the bounding sphere of its slice, so its size does not depend
+// on the camera orientation, and its origin is snapped to whole texels so that the shadow edges do not
+// crawl when the camera moves. The depth range is the whole scene, casters between the light and
+// the slice still have to be drawn.
+//
+// With the sample distribution enabled the splits only cover the depth range of the visible samples
+// and every cascade is shrunk to the light space bounds of its samples, both measured on the GPU a few
+// frames ago, see DepthReduction.hpp. The sizes and the centers are quantized so that the fit does
+// not change every frame, every change re-renders the static casters of the shadow cache.
+void UpdateShadowCascades(FramePacket &frame, InputSnapshot const &input)
+{
+    ShadowCascades &cascades = frame.shadowCascades;
+    Camera const &camera = frame.camera;
+    cascades.count = std::min<uint32_t>(std::max<uint32_t>(input.shadowCascadeCount, 1), SHADOW_CASCADE_MAX_COUNT);
+
+    sr::math::Matrix4x4 const cameraToWorld = CreateCameraMatrix(camera.pos, camera.xWorldAngle, camera.yWorldAngle);
+    float const tanHalfFovY = std::tan(0.5f * camera.fov);
+    float const tanHalfFovX = tanHalfFovY * camera.aspect;
+    float const cornerSlopeSq = tanHalfFovX * tanHalfFovX + tanHalfFovY * tanHalfFovY;
+    float const lambda = input.shadowCascadeSplitLambda;
+    cascades.viewToLight = frame.directLight.view * cameraToWorld;
+
+    DepthBounds const &bounds = input.depthBounds;
+    bool const sampleDistribution = input.sampleDistribution && bounds.valid;
+    float splitNear = camera.near;
+    float splitFar = camera.far;
+    if (sampleDistribution)
+    {
+        //Padded and rounded to 1/64 of the frustum, the bounds lag behind the camera
+        float const step = (camera.far - camera.near) / 64;
+        splitNear = std::max(camera.near, std::floor(0.9f * bounds.minDepth / step) * step);
+        splitFar = std::min(camera.far, std::max(std::ceil(1.1f * bounds.maxDepth / step) * step, splitNear + step));
+    }
 
-        for (auto const &model : models)
+    auto const split = [lambda, count = cascades.count](float near, float far, uint32_t i) {
+        float const t = static_cast<float>(i + 1) / count;
+        return lambda * near * std::pow(far / near, t) + (1 - lambda) * (near + (far - near) * t);
+    };
+    //Sphere through the near and far corners of the slice, centered on the view axis
+    auto const fitSphere = [cornerSlopeSq](float near, float far, float &centerDepth) {
+        centerDepth = 0.5f * (far + near) * (1 + cornerSlopeSq);
+        if (centerDepth >= far)
         {
-            auto const aabb = sr::geo::AABB{
-                (g_directLight.view * sr::math::Vec4{model.aabb.min.x, model.aabb.min.y, model.aabb.min.z, 1}).xyz,
-                (g_directLight.view * sr::math::Vec4{model.aabb.max.x, model.aabb.max.y, model.aabb.max.z, 1}).xyz,
-            };
+            centerDepth = far;
+            return std::ceil(far * std::sqrt(cornerSlopeSq));
+        }
+        //Whole units, so float noise does not change the texel size from frame to frame
+        return std::ceil(std::sqrt((centerDepth - near) * (centerDepth - near) + near * near * cornerSlopeSq));
+    };
+
+    float near = camera.near;
+    float fullNear = camera.near;
+    for (uint32_t i = 0; i < cascades.count; ++i)
+    {
+        float const far = split(splitNear, splitFar, i);
+        float centerDepth = 0;
+        float const radius = fitSphere(near, far, centerDepth);
+
+        //Fit of the whole frustum, the reference for the density gain
+        float const fullFar = split(camera.near, camera.far, i);
+        float fullCenterDepth = 0;
+        float const fullRadius = fitSphere(fullNear, fullFar, fullCenterDepth);
+        fullNear = fullFar;
+
+        sr::math::Vec4 const centerWorld = cameraToWorld * sr::math::Vec4{0, 0, -centerDepth, 1};
+        sr::math::Vec3 center = (frame.directLight.view * centerWorld).xyz;
+        float extent = radius;
+
+        //Samples were sorted into the cascades with the splits of their frame, they only
+        //describe this cascade while the splits stay the same
+        if (sampleDistribution && bounds.cascadeValid[i] && bounds.cascadeCount == cascades.count &&
+            std::abs(bounds.splits[i] - far) <= 0.01f * far)
+        {
+            float const margin = 0.05f * radius;
+            float const minX = std::max(bounds.lightMin[i].x - margin, center.x - radius);
+            float const minY = std::max(bounds.lightMin[i].y - margin, center.y - radius);
+            float const maxX = std::min(bounds.lightMax[i].x + margin, center.x + radius);
+            float const maxY = std::min(bounds.lightMax[i].y + margin, center.y + radius);
+            if (minX < maxX && minY < maxY)
+            {
+                //The sample bounds move a little every frame with the jitter, on a grid of 1/16 of the radius
+                //the projection only changes once they cross a grid line
+                float const step = radius / 16;
+                float const snappedX = std::round(0.5f * (minX + maxX) / step) * step;
+                float const snappedY = std::round(0.5f * (minY + maxY) / step) * step;
+                float const halfSize = std::max({snappedX - minX, maxX - snappedX, snappedY - minY, maxY - snappedY});
+                float const fitted = std::ceil(halfSize / step) * step;
+                if (fitted < radius)
+                {
+                    extent = fitted;
+                    center.x = snappedX;
+                    center.y = snappedY;
+                }
+            }
+        }
+
+        float const texelSize = 2.f * extent / SHADOW_CASCADE_RESOLUTION;
+        center.x = std::floor(center.x / texelSize) * texelSize;
+        center.y = std::floor(center.y / texelSize) * texelSize;
+
+        //Same axis convention as the scene wide fit, see PrePassCommands
+        cascades.projections[i] = sr::math::CreateOrthographicProjectionMatrix(
+            center.x + extent,
+            center.x - extent,
+            center.y - extent,
+            center.y + extent,
+            frame.directLight.frustum.near,
+            frame.directLight.frustum.far);
+        cascades.viewProjections[i] = cascades.projections[i] * frame.directLight.view;
+        cascades.splits[i] = far;
+        cascades.densityGains[i] = fullRadius / extent;
+
+        near = far;
+    }
+}
 
-            min.x = aabb.min.x < min.x ? aabb.min.x : min.x;
-            min.y = aabb.min.y < min.y ? aabb.min.y : min.y;
-            min.z = aabb.min.z < min.z ? aabb.min.z : min.z;
-            min.x = aabb.max.x < min.x ? aabb.max.x : min.x;
-            min.y = aabb.max.y < min.y ? aabb.max.y : min.y;
-            min.z = aabb.max.z < min.z ? aabb.max.z : min.z;
+void PrePassCommands(
+    FramePacket &frame, InputSnapshot const &input, std::vector<RenderModel> &models, sr::bvh::BVH const &bvh)
+{
+    { // Update shadow map view frustum
+        frame.directLight.position = input.directLight.position;
+        frame.directLight.orientation = input.directLight.orientation;
+        frame.directLight.radiantFlux = input.directLight.radiantFlux;
+        frame.directLight.view = sr::math::CreateRotationMatrixZ(-frame.directLight.orientation.z) *
+                                 sr::math::CreateRotationMatrixY(-frame.directLight.orientation.y) *
+                                 sr::math::CreateRotationMatrixX(-frame.directLight.orientation.x) *
+                                 sr::math::CreateTranslationMatrix(-frame.directLight.position);
+
+        sr::math::Vec3 min = {FLT_MAX, FLT_MAX, FLT_MAX};
+        sr::math::Vec3 max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
 
-            max.x = aabb.max.x > max.x ? aabb.max.x : max.x;
-            max.y = aabb.max.y > max.y ? aabb.max.y : max.y;
-            max.z = aabb.max.z > max.z ? aabb.max.z : max.z;
-            max.x = aabb.min.x > max.x ? aabb.min.x : max.x;
-            max.y = aabb.min.y > max.y ? aabb.min.y : max.y;
-            max.z = aabb.min.z > max.z ? aabb.min.z : max.z;
+        auto const sceneAabb = sr::bvh::GetRootAABB(bvh);
+        for (uint8_t i = 0; i < 8; ++i)
+        {
+            sr::math::Vec4 const corner = {
+                i & 1 ? sceneAabb.max.x : sceneAabb.min.x,
+                i & 2 ? sceneAabb.max.y : sceneAabb.min.y,
+                i & 4 ? sceneAabb.max.z : sceneAabb.min.z,
+                1};
+            sr::math::Vec3 const p = (frame.directLight.view * corner).xyz;
+
+            min.x = p.x < min.x ? p.x : min.x;
+            min.y = p.y < min.y ? p.y : min.y;
+            min.z = p.z < min.z ? p.z : min.z;
+
+            max.x = p.x > max.x ? p.x : max.x;
+            max.y = p.y > max.y ? p.y : max.y;
+            max.z = p.z > max.z ? p.z : max.z;
         }
 
         assert(min.x != max.x);
         assert(min.y != max.y);
         assert(min.z != max.z);
 
-        g_directLight.frustum.far = min.z;
-        g_directLight.frustum.near = max.z;
-        g_directLight.frustum.left = max.x;
-        g_directLight.frustum.right = min.x;
-        g_directLight.frustum.top = max.y;
-        g_directLight.frustum.bottom = min.y;
-
-        g_directLight.projection = sr::math::CreateOrthographicProjectionMatrix(
-            g_directLight.frustum.left,
-            g_directLight.frustum.right,
-            g_directLight.frustum.bottom,
-            g_directLight.frustum.top,
-            g_directLight.frustum.near,
-            g_directLight.frustum.far);
+        frame.directLight.frustum.far = min.z;
+        frame.directLight.frustum.near = max.z;
+        frame.directLight.frustum.left = max.x;
+        frame.directLight.frustum.right = min.x;
+        frame.directLight.frustum.top = max.y;
+        frame.directLight.frustum.bottom = min.y;
+
+        frame.directLight.projection = sr::math::CreateOrthographicProjectionMatrix(
+            frame.directLight.frustum.left,
+            frame.directLight.frustum.right,
+            frame.directLight.frustum.bottom,
+            frame.directLight.frustum.top,
+            frame.directLight.frustum.near,
+            frame.directLight.frustum.far);
     }
 
     { // Save previous frame model matrices
-        g_taaBuffer.prevModels.resize(models.size());
+        frame.taaBuffer.prevModels.resize(models.size());
         for (uint64_t i = 0; i < models.size(); ++i)
         {
-            g_taaBuffer.prevModels[i] = models[i].model;
+            frame.taaBuffer.prevModels[i] = models[i].model;
         }
     }
 
     UpdateModels(models);
 
     { //Save previous frame camera materices
-        g_prevCamera = g_camera;
-        g_taaBuffer.prevProjUnjit = g_taaBuffer.projUnjit;
+        frame.prevCamera = frame.camera;
+        frame.taaBuffer.prevProjUnjit = frame.taaBuffer.projUnjit;
     }
 
     { // Update view projection with respect to TAA
-        g_camera.view = CreateViewMatrix(g_camera.pos, g_camera.xWorldAngle, g_camera.yWorldAngle);
+        frame.camera.view = CreateViewMatrix(frame.camera.pos, frame.camera.xWorldAngle, frame.camera.yWorldAngle);
         // g_camera.proj = sr::math::CreateOrthographicProjectionMatrix(
         //     -2048.f, 2048.f, -2048.f, 2048.f, -2000.f, 1500.f);
-        const uint32_t taaSampleIndex = g_taaBuffer.count % 16;
+        const uint32_t taaSampleIndex = frame.frameIndex % 16;
 
         // https://github.com/playdeadgames/temporal
-        float const oneExtentY = std::tan(0.5f * g_camera.fov);
-        float const oneExtentX = oneExtentY * g_camera.aspect;
-        float const texelSizeX = oneExtentX / (0.5f * pipeline.debug.width);
-        float const texelSizeY = oneExtentY / (0.5f * pipeline.debug.height);
+        float const oneExtentY = std::tan(0.5f * frame.camera.fov);
+        float const oneExtentX = oneExtentY * frame.camera.aspect;
+        float const texelSizeX = oneExtentX / (0.5f * input.width);
+        float const texelSizeY = oneExtentY / (0.5f * input.height);
         float const oneJitterX = texelSizeX * g_taaHalton23Sequence16[taaSampleIndex].x;
         float const oneJitterY = texelSizeY * g_taaHalton23Sequence16[taaSampleIndex].y;
 
@@ -946,27 +2197,473 @@ void PrePassCommands(ForwardPipeline &pipeline, std::vector<RenderModel> &models
         // float const yp = oneJitterY + oneExtentY;
         //g_camera.proj = sr::math::CreatePerspectiveProjectionMatrix(
         //    xm * cn, xp * cn, ym * cn, yp * cn, cn, cf);
-        g_taaBuffer.jitter = {oneJitterX, oneJitterY};
-        g_taaBuffer.projUnjit = sr::math::CreatePerspectiveProjectionMatrix(
-            g_camera.near, g_camera.far, g_camera.fov, g_camera.aspect);
-        g_camera.proj = sr::math::Mul(
-            sr::math::CreateTranslationMatrix(oneJitterX, oneJitterY, 0), g_taaBuffer.projUnjit);
+        frame.taaBuffer.jitter = {oneJitterX, oneJitterY};
+        frame.taaBuffer.projUnjit = sr::math::CreatePerspectiveProjectionMatrix(
+            frame.camera.near, frame.camera.far, frame.camera.fov, frame.camera.aspect);
+        frame.camera.proj = sr::math::Mul(
+            sr::math::CreateTranslationMatrix(oneJitterX, oneJitterY, 0), frame.taaBuffer.projUnjit);
     }
+
+    { // Inverses of the frame, the passes that reconstruct positions from depth read them as uniforms
+        frame.camera.invView = sr::math::InverseAffine(frame.camera.view);
+        frame.camera.invProj = sr::math::InversePerspective(frame.camera.proj);
+        frame.taaBuffer.invProjUnjit = sr::math::InversePerspective(frame.taaBuffer.projUnjit);
+    }
+
+    UpdateShadowCascades(frame, input);
 }
 
-void RenderPassDepthPrePass(ForwardPipeline &pipeline, std::vector<RenderModel> const &models)
+void RenderPassDepthPrePass(
+    ForwardPipeline &pipeline, std::vector<RenderModel> const &models, sr::cull::VisibilityList const &visibility)
 {
     glEnable(GL_POLYGON_OFFSET_FILL);
     glPolygonOffset(g_depthBiasScale, g_depthUnitScale);
 
-    ExecuteRenderPass(pipeline.depthPrePass, models.data(), models.size());
+    ExecuteRenderPass(pipeline.depthPrePass, models.data(), visibility);
 
     glDisable(GL_POLYGON_OFFSET_FILL);
 }
 
-void RenderPassTAA(ForwardPipeline &pipeline)
+struct ForwardCommandBuffers
+{
+    CommandBuffer depthPrePass;
+    CommandBuffer shadowMapping;
+    CommandBuffer lighting;
+    CommandBuffer velocity;
+};
+
+// Timestamps are read back GPU_TIMER_LATENCY frames later so that the query never stalls
+constexpr uint32_t GPU_TIMER_LATENCY = 4;
+struct GpuTimer
+{
+    GLuint queries[GPU_TIMER_LATENCY][2] = {};
+    uint32_t tags[GPU_TIMER_LATENCY] = {};
+    uint64_t frame = 0;
+};
+
+GpuTimer CreateGpuTimer()
+{
+    GpuTimer timer;
+    glGenQueries(GPU_TIMER_LATENCY * 2, &timer.queries[0][0]);
+
+    return timer;
+}
+
+void BeginGpuTimer(GpuTimer &timer, uint32_t tag)
+{
+    uint32_t const slot = timer.frame % GPU_TIMER_LATENCY;
+    timer.tags[slot] = tag;
+    glQueryCounter(timer.queries[slot][0], GL_TIMESTAMP);
+}
+
+void EndGpuTimer(GpuTimer &timer)
 {
-    ExecuteRenderPass(pipeline.taa, &g_quadWallRenderModel, 1);
+    glQueryCounter(timer.queries[timer.frame % GPU_TIMER_LATENCY][1], GL_TIMESTAMP);
+    timer.frame++;
+}
+
+// Returns false until the oldest measurement is available
+bool ReadGpuTimer(GpuTimer const &timer, float &ms, uint32_t &tag)
+{
+    if (timer.frame < GPU_TIMER_LATENCY)
+    {
+        return false;
+    }
+
+    uint32_t const slot = timer.frame % GPU_TIMER_LATENCY;
+    GLint available = 0;
+    glGetQueryObjectiv(timer.queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available == 0)
+    {
+        return false;
+    }
+
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(timer.queries[slot][0], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(timer.queries[slot][1], GL_QUERY_RESULT, &end);
+    ms = static_cast<float>(end - begin) * 1e-6f;
+    tag = timer.tags[slot];
+
+    return true;
+}
+
+struct ShadowRect
+{
+    int32_t minX = INT32_MAX;
+    int32_t minY = INT32_MAX;
+    int32_t maxX = INT32_MIN;
+    int32_t maxY = INT32_MIN;
+};
+
+// Static casters are rendered into staticDepth only when the light or a static transform changes.
+// Every other frame the texels that dynamic casters touched are restored from it and
+// the dynamic casters are drawn on top. Every cascade is cached in its own layer, texel snapping
+// keeps the cascade projections unchanged while the camera stands still.
+struct ShadowCacheCascade
+{
+    sr::math::Matrix4x4 lightView = {};
+    sr::math::Matrix4x4 lightProjection = {};
+    uint64_t staticCasterCount = 0;
+    bool dirty = true;
+    ShadowRect dynamicRect = {}; //Texels covered by dynamic casters in the previous frame
+    ShadowRect restoreRect = {}; //Previous and current dynamic texels, copied from the static map
+    sr::cull::VisibilityList staticCasters = {};
+    sr::cull::VisibilityList dynamicCasters = {};
+};
+
+struct ShadowCache
+{
+    GLuint staticDepth = 0; //One layer per cascade, like the shadow map
+    int32_t width = 0;
+    int32_t height = 0;
+    ShadowCacheCascade cascades[SHADOW_CASCADE_MAX_COUNT] = {};
+    GpuTimer timer = {};
+};
+
+ShadowCache CreateShadowCache(RenderPass const &shadowPass)
+{
+    ShadowCache cache;
+    cache.width = shadowPass.width;
+    cache.height = shadowPass.height;
+    cache.staticDepth = CreateDepthTextureArray(cache.width, cache.height, SHADOW_CASCADE_MAX_COUNT);
+    cache.timer = CreateGpuTimer();
+
+    return cache;
+}
+
+void InvalidateShadowCache(ShadowCache &cache)
+{
+    for (auto &cascade : cache.cascades)
+    {
+        cascade.dirty = true;
+    }
+}
+
+ShadowRect CalculateShadowRect(
+    ShadowCache const &cache, sr::math::Matrix4x4 const &lightViewProj, RenderModel const &model)
+{
+    sr::geo::AABB const aabb = sr::geo::TransformAABB(model.localAabb, model.model);
+    ShadowRect rect;
+
+    for (uint8_t i = 0; i < 8; ++i)
+    {
+        sr::math::Vec4 const corner = lightViewProj * sr::math::Vec4{
+            i & 1 ? aabb.max.x : aabb.min.x,
+            i & 2 ? aabb.max.y : aabb.min.y,
+            i & 4 ? aabb.max.z : aabb.min.z,
+            1};
+        //Orthographic, w stays 1
+        int32_t const x = static_cast<int32_t>((corner.x * 0.5f + 0.5f) * cache.width);
+        int32_t const y = static_cast<int32_t>((corner.y * 0.5f + 0.5f) * cache.height);
+
+        rect.minX = std::min(rect.minX, x - 1);
+        rect.minY = std::min(rect.minY, y - 1);
+        rect.maxX = std::max(rect.maxX, x + 2);
+        rect.maxY = std::max(rect.maxY, y + 2);
+    }
+
+    return rect;
+}
+
+ShadowRect MergeShadowRects(ShadowRect const &a, ShadowRect const &b)
+{
+    return ShadowRect{
+        std::min(a.minX, b.minX), std::min(a.minY, b.minY), std::max(a.maxX, b.maxX), std::max(a.maxY, b.maxY)};
+}
+
+// CPU side of the cache, runs before the opaque passes are recorded. Splits the casters and
+// decides whether the static map has to be re-rendered or only the dynamic texels restored.
+void PrepareShadowCache(
+    ShadowCache &cache, ForwardPipeline &pipeline, std::vector<RenderModel> const &models, bool staticTransformsChanged)
+{
+    for (auto &shadowPass : pipeline.shadowMapping)
+    {
+        shadowPass.subPasses[0].desc.enableClearDepthBuffer = !g_shadowCacheEnabled;
+    }
+    if (!g_shadowCacheEnabled)
+    {
+        InvalidateShadowCache(cache);
+        return;
+    }
+
+    for (uint32_t c = 0; c < g_shadowCascades.count; ++c)
+    {
+        ShadowCacheCascade &cascade = cache.cascades[c];
+        sr::cull::VisibilityList const &visibility = g_shadowVisibility[c];
+
+        cascade.staticCasters.indices.resize(visibility.count);
+        cascade.dynamicCasters.indices.resize(visibility.count);
+        cascade.staticCasters.count = 0;
+        cascade.dynamicCasters.count = 0;
+        for (uint64_t i = 0; i < visibility.count; ++i)
+        {
+            uint32_t const index = visibility.indices[i];
+            auto &list = models[index].isDynamic ? cascade.dynamicCasters : cascade.staticCasters;
+            list.indices[list.count++] = index;
+        }
+
+        cascade.dirty = cascade.dirty || staticTransformsChanged ||
+                        cascade.staticCasterCount != cascade.staticCasters.count ||
+                        std::memcmp(&cascade.lightView, &g_directLight.view, sizeof(sr::math::Matrix4x4)) != 0 ||
+                        std::memcmp(&cascade.lightProjection, &g_shadowCascades.projections[c], sizeof(sr::math::Matrix4x4)) != 0;
+
+        ShadowRect rect;
+        for (uint64_t i = 0; i < cascade.dynamicCasters.count; ++i)
+        {
+            rect = MergeShadowRects(rect, CalculateShadowRect(
+                cache, g_shadowCascades.viewProjections[c], models[cascade.dynamicCasters.indices[i]]));
+        }
+
+        cascade.restoreRect = MergeShadowRects(cascade.dynamicRect, rect);
+        cascade.restoreRect.minX = std::max(cascade.restoreRect.minX, 0);
+        cascade.restoreRect.minY = std::max(cascade.restoreRect.minY, 0);
+        cascade.restoreRect.maxX = std::min(cascade.restoreRect.maxX, cache.width);
+        cascade.restoreRect.maxY = std::min(cascade.restoreRect.maxY, cache.height);
+        cascade.dynamicRect = rect;
+    }
+
+    //Disabled cascades are rebuilt once they come back
+    for (uint32_t c = g_shadowCascades.count; c < SHADOW_CASCADE_MAX_COUNT; ++c)
+    {
+        cache.cascades[c].dirty = true;
+    }
+}
+
+// GL side of the cache, runs right before the shadow passes that draw the dynamic casters
+void RenderShadowCache(ShadowCache &cache, ForwardPipeline const &pipeline, std::vector<RenderModel> const &models)
+{
+    g_shadowCacheStats.restoredTexels = 0;
+    g_shadowCacheStats.dynamicCasterCount = 0;
+    if (!g_shadowCacheEnabled)
+    {
+        return;
+    }
+
+    for (uint32_t c = 0; c < g_shadowCascades.count; ++c)
+    {
+        ShadowCacheCascade &cascade = cache.cascades[c];
+        GLuint const liveDepth = pipeline.shadowMapping[c].subPasses[0].desc.attachments[0].handle;
+        g_shadowCacheStats.dynamicCasterCount += cascade.dynamicCasters.count;
+
+        if (cascade.dirty)
+        {
+            //A copy of the pass, the original may be read by the recording jobs right now
+            RenderPass staticPass = pipeline.shadowMapping[c];
+            staticPass.subPasses[0].desc.enableClearDepthBuffer = true;
+            ExecuteRenderPass(staticPass, models.data(), cascade.staticCasters);
+            glCopyImageSubData(liveDepth, GL_TEXTURE_2D_ARRAY, 0, 0, 0, c,
+                               cache.staticDepth, GL_TEXTURE_2D_ARRAY, 0, 0, 0, c,
+                               cache.width, cache.height, 1);
+
+            cascade.lightView = g_directLight.view;
+            cascade.lightProjection = g_shadowCascades.projections[c];
+            cascade.staticCasterCount = cascade.staticCasters.count;
+            cascade.dirty = false;
+            g_shadowCacheStats.rebuildCount++;
+            g_shadowCacheStats.hitRate *= 0.95f;
+            continue;
+        }
+        g_shadowCacheStats.hitCount++;
+        g_shadowCacheStats.hitRate = g_shadowCacheStats.hitRate * 0.95f + 0.05f;
+
+        ShadowRect const &rect = cascade.restoreRect;
+        if (rect.minX < rect.maxX && rect.minY < rect.maxY)
+        {
+            glCopyImageSubData(cache.staticDepth, GL_TEXTURE_2D_ARRAY, 0, rect.minX, rect.minY, c,
+                               liveDepth, GL_TEXTURE_2D_ARRAY, 0, rect.minX, rect.minY, c,
+                               rect.maxX - rect.minX, rect.maxY - rect.minY, 1);
+            g_shadowCacheStats.restoredTexels += static_cast<uint64_t>(rect.maxX - rect.minX) * (rect.maxY - rect.minY);
+        }
+    }
+}
+
+sr::cull::VisibilityList const &GetShadowCasters(ShadowCache const &cache, uint32_t cascade)
+{
+    return g_shadowCacheEnabled ? cache.cascades[cascade].dynamicCasters : g_shadowVisibility[cascade];
+}
+
+void UpdateShadowCacheStats(ShadowCache const &cache)
+{
+    float ms = 0;
+    uint32_t cached = 0;
+    if (ReadGpuTimer(cache.timer, ms, cached))
+    {
+        g_shadowCacheStats.gpuMs[cached] = g_shadowCacheStats.gpuMs[cached] * 0.95f + ms * 0.05f;
+    }
+}
+
+// Fits the clusters to the camera of the frame on the job threads, the transparent pass reads them as well
+void UpdateLightClusters(ForwardPipeline const &pipeline, ClusteredLightBuffers const &buffers)
+{
+    if (!g_clusteredLightingEnabled || !g_pointLightEnabled)
+    {
+        return;
+    }
+
+    sr::prof::BeginProfilerZone("Light Clusters");
+    auto const start = std::chrono::high_resolution_clock::now();
+    sr::cull::BuildLightClusters(g_lightClusters,
+                                 g_pointLights.data(),
+                                 g_pointLightCount,
+                                 g_camera.view,
+                                 {g_camera.near, g_camera.far, g_camera.proj._11, g_camera.proj._22});
+    float const buildMs =
+        std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    g_clusterStats.buildMs = g_clusterStats.buildMs * 0.95f + buildMs * 0.05f;
+    g_clusterStats.indexCount = sr::cull::GetClusterLightIndexCount(g_lightClusters);
+
+    //The scene passes render to the lower left part of their targets, the grid spans the current render size
+    //the same way the deferred lighting and the ambient occlusion scale their target size by uRenderScaleVec2
+    g_clusterScale = {static_cast<float>(sr::cull::CLUSTER_COUNT_X) / (pipeline.debug.width * g_renderScale.x),
+                      static_cast<float>(sr::cull::CLUSTER_COUNT_Y) / (pipeline.debug.height * g_renderScale.y)};
+    g_clusterDepthScaleBias = {g_lightClusters.depthScale, g_lightClusters.depthBias};
+    UploadLightClusters(buffers, g_lightClusters);
+    sr::prof::EndProfilerZone();
+}
+
+// Both passes are culled by the render graph when the occlusion is off
+void RenderPassAmbientOcclusion(ForwardPipeline &pipeline)
+{
+    if (pipeline.ambientOcclusion.subPassCount == 0)
+    {
+        return;
+    }
+
+    ExecuteRenderPass(pipeline.ambientOcclusion, &g_quadWallRenderModel, 1);
+    ExecuteRenderPass(pipeline.ambientOcclusionUpsample, &g_quadWallRenderModel, 1);
+}
+
+void RenderPassGBuffer(ForwardPipeline &pipeline, std::vector<RenderModel> const &models)
+{
+    if (pipeline.gBuffer.subPassCount == 0)
+    {
+        return;
+    }
+
+    glDisable(GL_BLEND);
+    ExecuteRenderPass(pipeline.gBuffer, models.data(), g_occlusionVisibility);
+    glEnable(GL_BLEND);
+}
+
+// Bins the point lights into screen tiles with the pre-pass depth, then shades the G-buffer
+void RenderPassDeferredLighting(ForwardPipeline &pipeline, TiledLightCulling &lightCulling)
+{
+    if (pipeline.deferredLighting.subPassCount == 0)
+    {
+        return;
+    }
+
+    ReadLightCullingStats(lightCulling, g_lightCullingStats);
+    if (g_pointLightEnabled)
+    {
+        DispatchTiledLightCulling(lightCulling,
+                                  pipeline.depthPrePass.subPasses[0].desc.attachments[0].handle,
+                                  pipeline.deferredLighting.width,
+                                  pipeline.deferredLighting.height);
+    }
+    ExecuteRenderPass(pipeline.deferredLighting, &g_quadWallRenderModel, 1);
+}
+
+sr::cull::VisibilityList const &GetVelocityVisibility()
+{
+    return g_velocityMode == eVelocityMode::Dynamic ? g_dynamicVisibility : g_occlusionVisibility;
+}
+
+template <typename Func>
+void RecordCommandBufferJob(CommandBuffer &buffer, sr::job::Counter &counter, float &recordMs, Func record)
+{
+    sr::job::RunJob([&buffer, &recordMs, record]() {
+        auto const start = std::chrono::high_resolution_clock::now();
+        ResetCommandBuffer(buffer);
+        record(buffer);
+        recordMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }, &counter);
+}
+
+// Opaque passes are recorded as jobs, the GL thread replays each of them
+// as soon as it is ready while the later ones are still being recorded
+void SubmitOpaquePasses(
+    ForwardPipeline &pipeline,
+    std::vector<RenderModel> const &opaqueModels,
+    std::vector<RenderModel> const &transparentModels,
+    ForwardCommandBuffers &buffers,
+    ShadowCache &shadowCache,
+    TiledLightCulling &lightCulling)
+{
+    RenderModel const *models = opaqueModels.data();
+    ShadowCache const *cache = &shadowCache;
+    sr::job::Counter counters[4];
+    float *recordMs = g_submissionStats.recordMs;
+
+    RecordCommandBufferJob(buffers.depthPrePass, counters[0], recordMs[0], [&pipeline, models](CommandBuffer &buffer) {
+        RecordPolygonOffset(buffer, true, g_depthBiasScale, g_depthUnitScale);
+        RecordRenderPass(buffer, pipeline.depthPrePass, models, g_cameraVisibility);
+        RecordPolygonOffset(buffer, false, 0, 0);
+    });
+    RecordCommandBufferJob(buffers.shadowMapping, counters[1], recordMs[1], [&pipeline, models, cache](CommandBuffer &buffer) {
+        for (uint32_t i = 0; i < g_shadowCascades.count; ++i)
+        {
+            RecordRenderPass(buffer, pipeline.shadowMapping[i], models, GetShadowCasters(*cache, i));
+        }
+    });
+    RecordCommandBufferJob(buffers.lighting, counters[2], recordMs[2], [&pipeline, models](CommandBuffer &buffer) {
+        //The render graph culled the pass of the other lighting path, the G-buffer channels are not blended
+        if (pipeline.gBuffer.subPassCount > 0)
+        {
+            RecordBlend(buffer, false);
+            RecordRenderPass(buffer, pipeline.gBuffer, models, g_occlusionVisibility);
+            RecordBlend(buffer, true);
+        }
+        RecordRenderPass(buffer, pipeline.lighting, models, g_occlusionVisibility);
+    });
+    RecordCommandBufferJob(buffers.velocity, counters[3], recordMs[3], [&pipeline, models](CommandBuffer &buffer) {
+        RecordRenderPass(buffer, pipeline.velocity, models, GetVelocityVisibility());
+    });
+    CommandBuffer const *replayOrder[] = {
+        &buffers.depthPrePass, &buffers.shadowMapping, &buffers.lighting, &buffers.velocity};
+
+    g_submissionStats.commandBytes = 0;
+    for (uint8_t i = 0; i < 4; ++i)
+    {
+        sr::job::WaitForCounter(counters[i]);
+        g_submissionStats.commandBytes += replayOrder[i]->data.size();
+
+        //Transparent AABBs go between lighting and velocity
+        if (replayOrder[i] == &buffers.velocity && g_drawAABBs)
+        {
+            ExecuteRenderPass(pipeline.transparent, transparentModels.data(), transparentModels.size());
+        }
+        if (replayOrder[i] == &buffers.shadowMapping)
+        {
+            BeginGpuTimer(shadowCache.timer, g_shadowCacheEnabled);
+            RenderShadowCache(shadowCache, pipeline, opaqueModels);
+        }
+        ExecuteCommandBuffer(*replayOrder[i]);
+        if (replayOrder[i] == &buffers.depthPrePass)
+        {
+            RenderPassAmbientOcclusion(pipeline);
+        }
+        if (replayOrder[i] == &buffers.shadowMapping)
+        {
+            EndGpuTimer(shadowCache.timer);
+        }
+        if (replayOrder[i] == &buffers.lighting)
+        {
+            RenderPassDeferredLighting(pipeline, lightCulling);
+        }
+    }
+}
+
+void RenderPassTAA(ForwardPipeline &pipeline, ShaderProgram const &temporalResolve)
+{
+    if (g_taaComputeResolveEnabled)
+    {
+        DispatchTemporalResolve(temporalResolve, pipeline.taa);
+    }
+    else
+    {
+        ExecuteRenderPass(pipeline.taa, &g_quadWallRenderModel, 1);
+    }
 
     pipeline.taa.subPasses[0].active = !pipeline.taa.subPasses[0].active;
     pipeline.taa.subPasses[1].active = !pipeline.taa.subPasses[0].active;
@@ -974,14 +2671,48 @@ void RenderPassTAA(ForwardPipeline &pipeline)
     g_taaBuffer.count++;
 }
 
-void RenderPassToneMapping(ForwardPipeline &pipeline)
+void RenderPassToneMapping(ForwardPipeline &pipeline, AutoExposure &autoExposure)
 {
+    //Measures the same part of the input the tone mapping samples
+    if (g_autoExposureEnabled)
+    {
+        DispatchAutoExposure(autoExposure,
+                             pipeline.toneMapping.subPasses[0].desc.dependencies[0].handle,
+                             static_cast<int32_t>(pipeline.toneMapping.width * g_toneMappingInputScale.x + 0.5f),
+                             static_cast<int32_t>(pipeline.toneMapping.height * g_toneMappingInputScale.y + 0.5f));
+    }
     ExecuteRenderPass(pipeline.toneMapping, &g_quadWallRenderModel, 1);
 
-    pipeline.toneMapping.subPasses[0].desc.dependencies[0].handle =
-        pipeline.taa.subPasses[0].active
-            ? pipeline.taa.subPasses[0].desc.attachments[0].handle
-            : pipeline.taa.subPasses[1].desc.attachments[0].handle;
+    //Reads the lighting directly when the render graph culled TAA
+    if (pipeline.taa.subPassCount > 0)
+    {
+        pipeline.toneMapping.subPasses[0].desc.dependencies[0].handle =
+            pipeline.taa.subPasses[0].active
+                ? pipeline.taa.subPasses[0].desc.attachments[0].handle
+                : pipeline.taa.subPasses[1].desc.attachments[0].handle;
+    }
+}
+
+void UpdateRenderGraphStats(RenderGraph const &graph)
+{
+    g_renderGraphStats.memoryBytes = graph.memoryBytes;
+    g_renderGraphStats.unaliasedMemoryBytes = graph.unaliasedMemoryBytes;
+    g_renderGraphStats.textureCount = graph.textureCount;
+    g_renderGraphStats.targetCount = 0;
+    for (uint8_t i = 0; i < graph.resourceCount; ++i)
+    {
+        g_renderGraphStats.targetCount += graph.resources[i].used ? 1 : 0;
+    }
+
+    g_renderGraphStats.culledPasses.clear();
+    for (uint8_t i = 0; i < graph.passCount; ++i)
+    {
+        if (!graph.passes[i].active)
+        {
+            g_renderGraphStats.culledPasses += g_renderGraphStats.culledPasses.empty() ? "" : ", ";
+            g_renderGraphStats.culledPasses.append(graph.passes[i].name.data, graph.passes[i].name.length);
+        }
+    }
 }
 
 void RenderPassDebug(ForwardPipeline &pipeline)
@@ -992,7 +2723,399 @@ void RenderPassDebug(ForwardPipeline &pipeline)
               pipeline.debug.subPasses[0].desc.dependencies[5].handle);
 }
 
-void MainLoop(GLFWwindow *window)
+// Sets the internal resolution from the frame time measured GPU_TIMER_LATENCY frames ago. The scene passes
+// render into the lower left part of their full size targets, the first full resolution pass upscales it
+void ApplyDynamicResolution(ForwardPipeline &pipeline, GpuTimer const &frameTimer)
+{
+    float ms = 0;
+    uint32_t measuredScale = 0;
+    if (ReadGpuTimer(frameTimer, ms, measuredScale))
+    {
+        g_dynamicResolutionGpuMs = g_dynamicResolutionGpuMs * 0.95f + ms * 0.05f;
+        g_gpuFrameMs = ms;
+        if (g_dynamicResolutionEnabled &&
+            UpdateDynamicResolution(g_dynamicResolution, ms, measuredScale / 1000.f) &&
+            g_dynamicResolutionLogEnabled)
+        {
+            DynamicResolutionLogEntry const &entry =
+                g_dynamicResolution.log[(g_dynamicResolution.logCount - 1) % DYNAMIC_RESOLUTION_LOG_SIZE];
+            std::cout << "Dynamic resolution: frame " << entry.frame << " " << entry.averageMs << " ms of "
+                      << g_dynamicResolution.settings.budgetMs << " ms, scale " << entry.oldScale << " -> "
+                      << entry.newScale << std::endl;
+        }
+    }
+    if (!g_dynamicResolutionEnabled)
+    {
+        g_dynamicResolution.scale = 1;
+        g_dynamicResolution.settledFrames = 0;
+    }
+
+    int32_t const width = GetDynamicResolutionSize(g_dynamicResolution.scale, pipeline.debug.width);
+    int32_t const height = GetDynamicResolutionSize(g_dynamicResolution.scale, pipeline.debug.height);
+    for (RenderPass *pass : {&pipeline.depthPrePass,
+                             &pipeline.ambientOcclusionUpsample,
+                             &pipeline.gBuffer,
+                             &pipeline.lighting,
+                             &pipeline.deferredLighting,
+                             &pipeline.transparent,
+                             &pipeline.velocity})
+    {
+        pass->width = width;
+        pass->height = height;
+    }
+    g_ambientOcclusionDivisor = static_cast<uint32_t>(GetAmbientOcclusionDivisor(g_ambientOcclusion));
+    pipeline.ambientOcclusion.width = (width + g_ambientOcclusionDivisor - 1) / g_ambientOcclusionDivisor;
+    pipeline.ambientOcclusion.height = (height + g_ambientOcclusionDivisor - 1) / g_ambientOcclusionDivisor;
+
+    g_renderScale = {static_cast<float>(width) / pipeline.debug.width, static_cast<float>(height) / pipeline.debug.height};
+    g_toneMappingInputScale = pipeline.taa.subPassCount > 0 ? sr::math::Vec2{1, 1} : g_renderScale;
+}
+
+InputSnapshot CaptureInputSnapshot(ForwardPipeline const &pipeline, FramePacket const &presented, uint64_t frameIndex)
+{
+    InputSnapshot input;
+
+    input.inputs = sr::input::g_inputs;
+    input.camera = g_camera;
+    input.cameraPositionEdited = !(g_camera.pos == presented.camera.pos);
+    input.cameraSpeed = g_cameraSpeed;
+    input.directLight = g_directLight;
+    input.shadowCascadeCount = g_shadowCascadeCount;
+    input.shadowCascadeSplitLambda = g_shadowCascadeSplitLambda;
+    input.sampleDistribution = g_sampleDistributionEnabled;
+    input.depthBounds = g_depthBounds;
+    input.width = pipeline.depthPrePass.width; //Internal resolution, the jitter is a texel of it
+    input.height = pipeline.depthPrePass.height;
+    input.frustumCulling = g_frustumCullingEnabled;
+    input.bvhCulling = g_bvhCullingEnabled;
+    input.occlusionCulling = g_occlusionCullingEnabled;
+    input.frameIndex = frameIndex;
+    input.timestamp = std::chrono::high_resolution_clock::now();
+
+    return input;
+}
+
+// Advances the world by one frame and publishes the result, runs on either thread but never touches GL
+void SimulateFrame(SimulationContext &context, InputSnapshot const &input)
+{
+    auto const start = std::chrono::high_resolution_clock::now();
+    FramePacket &frame = context.frame;
+
+    UpdateCamera(frame.camera, input);
+    PrePassCommands(frame, input, context.models, context.bvh);
+    CullModels(frame, input, context.models, context.bounds, context.bvh);
+    CullOccludedModels(
+        frame, input, context.occluders, context.bounds, context.occlusionDepthBuffer, context.occluderTriangles);
+
+    frame.models.resize(context.models.size());
+    for (uint64_t i = 0; i < context.models.size(); ++i)
+    {
+        frame.models[i] = context.models[i].model;
+    }
+    frame.inputFrameIndex = input.frameIndex;
+    frame.inputTimestamp = input.timestamp;
+    frame.simulationMs = std::chrono::duration<float, std::milli>(
+                             std::chrono::high_resolution_clock::now() - start)
+                             .count();
+
+    GetTripleBufferWriteSlot(context.packets) = frame;
+    PublishTripleBuffer(context.packets);
+
+    frame.frameIndex++;
+}
+
+void RunSimulationThread(SimulationThread &simulation, SimulationContext &context)
+{
+    uint64_t simulatedFrames = 0;
+
+    while (true)
+    {
+        InputSnapshot input;
+        {
+            std::unique_lock<std::mutex> lock(simulation.mutex);
+            simulation.condition.wait(lock, [&simulation, simulatedFrames]() {
+                return simulation.stop || simulation.requestedFrames != simulatedFrames;
+            });
+            if (simulation.stop)
+            {
+                return;
+            }
+            input = simulation.input;
+        }
+
+        SimulateFrame(context, input);
+        simulatedFrames++;
+
+        {
+            std::lock_guard<std::mutex> lock(simulation.mutex);
+            simulation.completedFrames = simulatedFrames;
+        }
+        simulation.condition.notify_all();
+    }
+}
+
+void RequestSimulationFrame(SimulationThread &simulation, InputSnapshot const &input)
+{
+    {
+        std::lock_guard<std::mutex> lock(simulation.mutex);
+        simulation.input = input;
+        simulation.requestedFrames++;
+    }
+    simulation.condition.notify_all();
+}
+
+void WaitForSimulationFrame(SimulationThread &simulation)
+{
+    std::unique_lock<std::mutex> lock(simulation.mutex);
+    simulation.condition.wait(lock, [&simulation]() {
+        return simulation.completedFrames == simulation.requestedFrames;
+    });
+}
+
+void StopSimulationThread(SimulationThread &simulation)
+{
+    {
+        std::lock_guard<std::mutex> lock(simulation.mutex);
+        simulation.stop = true;
+    }
+    simulation.condition.notify_all();
+    simulation.thread.join();
+}
+
+// Copies a packet into the globals the uniform bindings point to,
+// returns true if the transform of a static model changed
+bool ApplyFramePacket(FramePacket const &frame, std::vector<RenderModel> &models)
+{
+    g_camera = frame.camera;
+    g_prevCamera = frame.prevCamera;
+    g_directLight = frame.directLight;
+    g_shadowCascades = frame.shadowCascades;
+
+    //prevModels keeps its size, so the bound pointer to its data stays valid
+    assert(frame.taaBuffer.prevModels.size() == g_taaBuffer.prevModels.size());
+    g_taaBuffer.projUnjit = frame.taaBuffer.projUnjit;
+    g_taaBuffer.prevProjUnjit = frame.taaBuffer.prevProjUnjit;
+    g_taaBuffer.invProjUnjit = frame.taaBuffer.invProjUnjit;
+    g_taaBuffer.jitter = frame.taaBuffer.jitter;
+    std::copy(frame.taaBuffer.prevModels.begin(), frame.taaBuffer.prevModels.end(), g_taaBuffer.prevModels.begin());
+
+    bool staticTransformsChanged = false;
+    for (uint64_t i = 0; i < frame.models.size(); ++i)
+    {
+        if (!models[i].isDynamic &&
+            std::memcmp(&models[i].model, &frame.models[i], sizeof(sr::math::Matrix4x4)) != 0)
+        {
+            staticTransformsChanged = true;
+        }
+        models[i].model = frame.models[i];
+    }
+
+    g_cameraVisibility = frame.cameraVisibility;
+    for (uint32_t i = 0; i < SHADOW_CASCADE_MAX_COUNT; ++i)
+    {
+        g_shadowVisibility[i] = frame.shadowVisibility[i];
+    }
+    g_occlusionVisibility = frame.occlusionVisibility;
+    g_cullingStats = frame.cullingStats;
+
+    g_dynamicVisibility.indices.resize(g_occlusionVisibility.count);
+    g_dynamicVisibility.count = 0;
+    for (uint64_t i = 0; i < g_occlusionVisibility.count; ++i)
+    {
+        uint32_t const index = g_occlusionVisibility.indices[i];
+        if (models[index].isDynamic)
+        {
+            g_dynamicVisibility.indices[g_dynamicVisibility.count++] = index;
+        }
+    }
+
+    return staticTransformsChanged;
+}
+
+float GetPercentile(std::vector<float> samples, float percentile)
+{
+    if (samples.empty())
+    {
+        return 0;
+    }
+    size_t const index = std::min(samples.size() - 1, static_cast<size_t>(percentile * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+
+    return samples[index];
+}
+
+// Frame times are measured between buffer swaps, the passes and zones come from the last
+// PROFILER_HISTORY_SIZE frames of the profiler
+void WriteHeadlessReport(std::ostream &out, std::vector<float> const &frameMs)
+{
+    float mean = 0;
+    for (float ms : frameMs)
+    {
+        mean += ms / frameMs.size();
+    }
+
+    out << "{\n"
+        << "  \"renderer\": \"" << reinterpret_cast<char const *>(glGetString(GL_RENDERER)) << "\",\n"
+        << "  \"width\": " << g_headless.width << ",\n"
+        << "  \"height\": " << g_headless.height << ",\n"
+        << "  \"targetFormats\": \"" << g_targetFormatsStr[static_cast<uint32_t>(g_targetFormats)] << "\",\n"
+        << "  \"velocityMode\": \"" << g_velocityModesStr[static_cast<uint32_t>(g_velocityMode)] << "\",\n"
+        << "  \"lightingPath\": \"" << g_lightingPathsStr[static_cast<uint32_t>(g_lightingPath)] << "\",\n"
+        << "  \"ambientOcclusion\": \"" << g_ambientOcclusionStr[static_cast<uint32_t>(g_ambientOcclusion)] << "\",\n"
+        << "  \"pointLightCount\": " << g_pointLightCount << ",\n"
+        << "  \"clusteredLighting\": " << (g_clusteredLightingEnabled ? "true" : "false") << ",\n"
+        << "  \"clusterBuildMs\": " << g_clusterStats.buildMs << ",\n"
+        << "  \"tileLightOverflowTiles\": " << g_lightCullingStats.overflowTiles << ",\n"
+        << "  \"textureSupersampling\": " << (g_textureSupersamplingEnabled ? "true" : "false") << ",\n"
+        << "  \"taa\": " << (g_taaEnabled ? "true" : "false") << ",\n"
+        << "  \"taaResolve\": \"" << (g_taaComputeResolveEnabled ? "compute" : "fragment") << "\",\n"
+        << "  \"autoExposure\": " << (g_autoExposureEnabled ? "true" : "false") << ",\n"
+        << "  \"shadowCacheRebuilds\": " << g_shadowCacheStats.rebuildCount << ",\n"
+        << "  \"shadowCacheHits\": " << g_shadowCacheStats.hitCount << ",\n"
+        << "  \"renderTargetBytes\": " << g_renderGraphStats.memoryBytes << ",\n"
+        << "  \"warmupFrames\": " << g_headless.warmupFrames << ",\n"
+        << "  \"frames\": " << frameMs.size() << ",\n"
+        << "  \"frameMs\": {\"mean\": " << mean
+        << ", \"p50\": " << GetPercentile(frameMs, 0.5f)
+        << ", \"p95\": " << GetPercentile(frameMs, 0.95f)
+        << ", \"p99\": " << GetPercentile(frameMs, 0.99f)
+        << ", \"max\": " << GetPercentile(frameMs, 1.f) << "},\n"
+        << "  \"droppedProfilerFrames\": " << sr::prof::g_profiler.droppedFrames << ",\n"
+        << "  \"zones\": [";
+    for (uint8_t i = 0; i < sr::prof::g_profiler.zoneCount; ++i)
+    {
+        sr::prof::ProfilerZoneStats const stats = sr::prof::GetProfilerZoneStats(i);
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"name\": \"" << sr::prof::g_profiler.zones[i].name.data << "\""
+            << ", \"samples\": " << stats.sampleCount
+            << ", \"cpuMeanMs\": " << stats.cpuAverageMs
+            << ", \"cpuP50Ms\": " << stats.cpuP50Ms
+            << ", \"cpuP95Ms\": " << stats.cpuP95Ms
+            << ", \"cpuP99Ms\": " << stats.cpuP99Ms
+            << ", \"gpuMeanMs\": " << stats.gpuAverageMs
+            << ", \"gpuP50Ms\": " << stats.gpuP50Ms
+            << ", \"gpuP95Ms\": " << stats.gpuP95Ms
+            << ", \"gpuP99Ms\": " << stats.gpuP99Ms << "}";
+    }
+    out << "\n  ]\n}" << std::endl;
+}
+
+uint32_t GetGoldenView(uint64_t frameIndex)
+{
+    return static_cast<uint32_t>(std::min<uint64_t>(
+        frameIndex / g_golden.settleFrames, std::size(g_benchmarkCameraPath) - 1));
+}
+
+// Called after the debug pass, the last settle frame of every view is copied to a pixel buffer
+void CaptureGoldenView(GoldenRun &run, ForwardPipeline const &pipeline, uint64_t frameIndex)
+{
+    if (frameIndex % g_golden.settleFrames != g_golden.settleFrames - 1 ||
+        frameIndex / g_golden.settleFrames >= run.results.size())
+    {
+        return;
+    }
+
+    uint32_t const view = GetGoldenView(frameIndex);
+    if (!RequestFrameReadback(run.readback,
+                              pipeline.debug.subPasses[0].desc.attachments[0].handle,
+                              pipeline.debug.width,
+                              pipeline.debug.height,
+                              view))
+    {
+        run.results[view].error = "readback buffers in flight";
+        run.resolvedViews++;
+    }
+}
+
+void MeasureGoldenView(GoldenRun &run, uint64_t frameIndex, float frameMs)
+{
+    uint32_t const view = GetGoldenView(frameIndex);
+    if (frameIndex % g_golden.settleFrames >= g_golden.settleFrames / 2 && view < run.results.size())
+    {
+        GoldenResult &result = run.results[view];
+        result.cpuFrameMs += (frameMs - result.cpuFrameMs) / (result.measuredFrames + 1);
+        result.gpuFrameMs += (g_gpuFrameMs - result.gpuFrameMs) / (result.measuredFrames + 1);
+        result.measuredFrames++;
+    }
+}
+
+// Compares the finished captures with their goldens, returns true once every view is resolved
+bool ResolveGoldenViews(GoldenRun &run)
+{
+    Image image;
+    uint32_t view = 0;
+    while (ReadFrameReadback(run.readback, image, view))
+    {
+        GoldenResult &result = run.results[view];
+        std::string const path = std::string(g_golden.directory) + "/view_" + std::to_string(view);
+        result.captured = true;
+        run.resolvedViews++;
+
+        if (g_golden.update)
+        {
+            result.passed = WritePng((path + ".png").c_str(), image);
+            continue;
+        }
+
+        Image golden;
+        if (!LoadPng((path + ".png").c_str(), golden))
+        {
+            result.error = "missing golden";
+        }
+        else if (golden.width != image.width || golden.height != image.height)
+        {
+            result.error = "size mismatch";
+        }
+        else
+        {
+            result.diff = CompareImages(image, golden);
+            result.passed = result.diff.psnr >= g_golden.minPsnr &&
+                            result.diff.perceptualErrorRatio <= g_golden.maxPerceptualErrorRatio;
+        }
+        //Kept next to the golden for inspection
+        if (!result.passed)
+        {
+            WritePng((path + ".actual.png").c_str(), image);
+        }
+    }
+
+    return run.resolvedViews == run.results.size();
+}
+
+// Returns true if every view passed
+bool WriteGoldenReport(std::ostream &out, GoldenRun const &run)
+{
+    bool passed = true;
+    out << "{\n"
+        << "  \"renderer\": \"" << reinterpret_cast<char const *>(glGetString(GL_RENDERER)) << "\",\n"
+        << "  \"width\": " << g_headless.width << ",\n"
+        << "  \"height\": " << g_headless.height << ",\n"
+        << "  \"minPsnr\": " << g_golden.minPsnr << ",\n"
+        << "  \"maxPerceptualErrorRatio\": " << g_golden.maxPerceptualErrorRatio << ",\n"
+        << "  \"views\": [";
+    for (uint32_t i = 0; i < run.results.size(); ++i)
+    {
+        GoldenResult const &result = run.results[i];
+        passed = passed && result.passed;
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"view\": " << i
+            << ", \"passed\": " << (result.passed ? "true" : "false")
+            << ", \"error\": " << (result.error != nullptr ? "\"" + std::string(result.error) + "\"" : "null")
+            << ", \"psnr\": " << std::min(result.diff.psnr, 100.f) //Identical images are reported as 100 dB
+            << ", \"maxError\": " << result.diff.maxError
+            << ", \"meanDeltaE\": " << result.diff.meanDeltaE
+            << ", \"perceptualErrorRatio\": " << result.diff.perceptualErrorRatio
+            << ", \"cpuFrameMs\": " << result.cpuFrameMs
+            << ", \"gpuFrameMs\": " << result.gpuFrameMs << "}";
+    }
+    out << "\n  ],\n"
+        << "  \"passed\": " << (passed ? "true" : "false") << "\n}" << std::endl;
+
+    return passed;
+}
+
+// Returns the process exit code, non zero if a golden view failed
+int MainLoop(GLFWwindow *window)
 {
     static int swapchainFramebufferWidth = 0, swapchainFramebufferHeight = 0;
     glfwGetFramebufferSize(window, &swapchainFramebufferWidth, &swapchainFramebufferHeight);
@@ -1001,8 +3124,19 @@ void MainLoop(GLFWwindow *window)
     std::vector<sr::load::MaterialSource> materials;
 
     auto programs = CreateForwardPipelineShaderPrograms();
-    auto opaqueModels = LoadOpaqueModels(programs.lighting);
+    SimulationContext simulationContext;
+    auto opaqueModels = LoadOpaqueModels(programs.lighting, simulationContext.occluders);
     auto transparentModels = LoadAABBModels(programs.transparent, opaqueModels);
+    if (g_generatedPointLightCount > 0)
+    {
+        sr::geo::AABB bounds = sr::bvh::EmptyAABB();
+        for (auto const &model : opaqueModels)
+        {
+            bounds = sr::bvh::MergeAABB(bounds, model.aabb);
+        }
+        g_pointLights = CreatePointLights(g_generatedPointLightCount, bounds);
+        g_pointLightCount = g_generatedPointLightCount;
+    }
     auto pointLightModels = LoadPointLightModels(programs.lighting);
     opaqueModels.insert(opaqueModels.end(), pointLightModels.begin(), pointLightModels.end());
     std::vector<RenderModel>().swap(pointLightModels);
@@ -1010,45 +3144,222 @@ void MainLoop(GLFWwindow *window)
     opaqueModels.insert(opaqueModels.end(), dynamicModels.begin(), dynamicModels.end());
     std::vector<RenderModel>().swap(dynamicModels);
 
+    ForwardCommandBuffers commandBuffers;
+
     g_taaBuffer.prevModels.resize(opaqueModels.size());
     CreateForwardPipelineUniformBindngs(programs, opaqueModels, transparentModels);
-    auto forwardPipeline = CreateForwardRenderPipeline(programs, swapchainFramebufferWidth, swapchainFramebufferHeight);
+    auto renderGraph = CreateForwardRenderGraph(swapchainFramebufferWidth,
+                                                swapchainFramebufferHeight,
+                                                g_taaEnabled,
+                                                g_renderGraphAliasingEnabled,
+                                                GetForwardTargetFormats(g_targetFormats),
+                                                g_velocityMode,
+                                                g_lightingPath,
+                                                g_ambientOcclusion);
+    auto forwardPipeline = CreateForwardRenderPipeline(programs, renderGraph);
+    UpdateRenderGraphStats(renderGraph);
+    uint32_t renderGraphTaaEnabled = g_taaEnabled;
+    bool renderGraphAliasingEnabled = g_renderGraphAliasingEnabled;
+    eForwardTargetFormats renderGraphTargetFormats = g_targetFormats;
+    eVelocityMode renderGraphVelocityMode = g_velocityMode;
+    eLightingPath renderGraphLightingPath = g_lightingPath;
+    eAmbientOcclusion renderGraphAmbientOcclusion = g_ambientOcclusion;
+    auto shadowCache = CreateShadowCache(forwardPipeline.shadowMapping[0]);
+    auto depthReduction = CreateDepthReduction(CreateDepthReductionShaderProgram());
+    auto lightCulling = CreateTiledLightCulling(CreateLightCullingShaderProgram());
+    auto temporalResolve = CreateTemporalResolveShaderProgram();
+    auto autoExposure = CreateAutoExposure(CreateLuminanceHistogramShaderProgram(), CreateExposureShaderProgram());
+    UploadPointLights(lightCulling, g_pointLights.data(), g_pointLightCount);
+    auto clusteredLightBuffers = CreateClusteredLightBuffers();
+    auto frameTimer = CreateGpuTimer();
+
+    simulationContext.models = opaqueModels;
+    simulationContext.bounds = CreateModelBounds(opaqueModels);
+    simulationContext.bvh = CreateModelBVH(opaqueModels);
+    simulationContext.occlusionDepthBuffer =
+        sr::cull::CreateDepthBuffer(g_occlusionBufferWidth, g_occlusionBufferHeight);
+    simulationContext.frame.camera = g_camera;
+    simulationContext.frame.directLight = g_directLight;
+
+    SimulationThread simulation;
+    simulation.thread = std::thread(RunSimulationThread, std::ref(simulation), std::ref(simulationContext));
+
+    auto frameStart = std::chrono::high_resolution_clock::now();
+    uint64_t presentedFrameIndex = 0;
+    std::vector<float> measuredFrameMs;
+    bool const benchmarkRun = !g_golden.enabled && (g_headless.enabled || g_replayEnabled);
+    GoldenRun goldenRun;
+    if (g_golden.enabled)
+    {
+        goldenRun.readback = CreateFrameReadback();
+        goldenRun.results.resize(std::size(g_benchmarkCameraPath));
+    }
+    bool simulationFrameInFlight = false;
 
     while (!glfwWindowShouldClose(window))
     {
+        sr::prof::BeginProfilerFrame();
         UpdateInputs(window);
         glfwGetFramebufferSize(window, &swapchainFramebufferWidth, &swapchainFramebufferHeight);
 
+        //The render graph culls TAA when it is off, the pipeline is rebuilt with the programs
+        if (renderGraphTaaEnabled != g_taaEnabled || renderGraphAliasingEnabled != g_renderGraphAliasingEnabled ||
+            renderGraphTargetFormats != g_targetFormats || renderGraphVelocityMode != g_velocityMode ||
+            renderGraphLightingPath != g_lightingPath || renderGraphAmbientOcclusion != g_ambientOcclusion)
+        {
+            renderGraphTaaEnabled = g_taaEnabled;
+            renderGraphAliasingEnabled = g_renderGraphAliasingEnabled;
+            renderGraphTargetFormats = g_targetFormats;
+            renderGraphVelocityMode = g_velocityMode;
+            renderGraphLightingPath = g_lightingPath;
+            renderGraphAmbientOcclusion = g_ambientOcclusion;
+            g_isHotRealoadRequired = true;
+        }
+        g_cameraVelocityFromDepth = g_velocityMode == eVelocityMode::Dynamic;
+        g_ambientOcclusionEnabled = g_ambientOcclusion != eAmbientOcclusion::Off;
+
         if (g_isHotRealoadRequired)
         {
             DeleteRenderPipeline(forwardPipeline.passes, ForwardPipelinePassCount);
+            DeleteRenderGraph(renderGraph);
 
             programs = CreateForwardPipelineShaderPrograms();
             CreateForwardPipelineUniformBindngs(programs, opaqueModels, transparentModels);
-            memcpy(&forwardPipeline,
-                &CreateForwardRenderPipeline(programs, swapchainFramebufferWidth, swapchainFramebufferHeight),
-                sizeof(ForwardPipeline));
+            renderGraph = CreateForwardRenderGraph(swapchainFramebufferWidth,
+                                                   swapchainFramebufferHeight,
+                                                   g_taaEnabled,
+                                                   g_renderGraphAliasingEnabled,
+                                                   GetForwardTargetFormats(g_targetFormats),
+                                                   g_velocityMode,
+                                                   g_lightingPath,
+                                                   g_ambientOcclusion);
+            memcpy(&forwardPipeline, &CreateForwardRenderPipeline(programs, renderGraph), sizeof(ForwardPipeline));
+            UpdateRenderGraphStats(renderGraph);
             
+            InvalidateShadowCache(shadowCache);
+            DeleteShaderProgram(depthReduction.program);
+            depthReduction.program = CreateDepthReductionShaderProgram();
+            DeleteShaderProgram(lightCulling.program);
+            lightCulling.program = CreateLightCullingShaderProgram();
+            DeleteShaderProgram(temporalResolve);
+            temporalResolve = CreateTemporalResolveShaderProgram();
+            DeleteShaderProgram(autoExposure.histogramProgram);
+            autoExposure.histogramProgram = CreateLuminanceHistogramShaderProgram();
+            DeleteShaderProgram(autoExposure.exposureProgram);
+            autoExposure.exposureProgram = CreateExposureShaderProgram();
+
             std::time_t const timestamp = std::time(nullptr);
             std::cout << "Backbuffer size: " << swapchainFramebufferWidth << "x" << swapchainFramebufferHeight
+                      << "\nRender targets: " << g_renderGraphStats.memoryBytes / (1024 * 1024) << " MiB, "
+                      << g_renderGraphStats.unaliasedMemoryBytes / (1024 * 1024) << " MiB without aliasing"
                       << "\nHot reload: " << std::asctime(std::localtime(&timestamp)) << std::endl;
 
             g_isHotRealoadRequired = false;
         }
 
-        PrePassCommands(forwardPipeline, opaqueModels);
+        if (g_golden.enabled)
+        {
+            CameraPathKey const &key = g_benchmarkCameraPath[GetGoldenView(presentedFrameIndex)];
+            g_camera.pos = key.pos;
+            g_camera.xWorldAngle = key.xWorldAngle;
+            g_camera.yWorldAngle = key.yWorldAngle;
+        }
+        else if (g_headless.enabled && !g_replayEnabled)
+        {
+            uint64_t const pathFrame = presentedFrameIndex - std::min<uint64_t>(presentedFrameIndex, g_headless.warmupFrames);
+            CameraPathKey const key = SampleCameraPath(
+                g_benchmarkCameraPath,
+                static_cast<uint32_t>(std::size(g_benchmarkCameraPath)),
+                pathFrame / static_cast<float>(std::max(1u, g_headless.frameCount - 1)));
+            g_camera.pos = key.pos;
+            g_camera.xWorldAngle = key.xWorldAngle;
+            g_camera.yWorldAngle = key.yWorldAngle;
+        }
 
-        RenderPassDepthPrePass(forwardPipeline, opaqueModels);
-        ExecuteRenderPass(forwardPipeline.shadowMapping, opaqueModels.data(), opaqueModels.size());
-        ExecuteRenderPass(forwardPipeline.lighting, opaqueModels.data(), opaqueModels.size());
-        if (g_drawAABBs)
+        ReadDepthReduction(depthReduction, g_depthBounds);
+        ApplyDynamicResolution(forwardPipeline, frameTimer);
+        InputSnapshot const input = CaptureInputSnapshot(
+            forwardPipeline, GetTripleBufferReadSlot(simulationContext.packets), presentedFrameIndex);
+        sr::prof::BeginProfilerZone("Simulation");
+        if (g_pipelinedSimulationEnabled)
+        {
+            //Frame N is rendered while frame N + 1 is simulated with the inputs of this frame
+            if (!simulationFrameInFlight)
+            {
+                RequestSimulationFrame(simulation, input);
+            }
+            WaitForSimulationFrame(simulation);
+            AcquireTripleBuffer(simulationContext.packets);
+            RequestSimulationFrame(simulation, input);
+            simulationFrameInFlight = true;
+        }
+        else
+        {
+            if (simulationFrameInFlight)
+            {
+                WaitForSimulationFrame(simulation);
+                simulationFrameInFlight = false;
+            }
+            SimulateFrame(simulationContext, input);
+            AcquireTripleBuffer(simulationContext.packets);
+        }
+        sr::prof::EndProfilerZone();
+
+        FramePacket const &frame = GetTripleBufferReadSlot(simulationContext.packets);
+        bool const staticTransformsChanged = ApplyFramePacket(frame, opaqueModels);
+        PrepareShadowCache(shadowCache, forwardPipeline, opaqueModels, staticTransformsChanged);
+        UpdateShadowCacheStats(shadowCache);
+        UpdateLightClusters(forwardPipeline, clusteredLightBuffers);
+
+        BeginGpuTimer(frameTimer, static_cast<uint32_t>(std::lround(g_dynamicResolution.scale * 1000)));
+        auto const submitStart = std::chrono::high_resolution_clock::now();
+        sr::prof::BeginProfilerZone("Submit");
+        if (g_commandBuffersEnabled)
+        {
+            SubmitOpaquePasses(
+                forwardPipeline, opaqueModels, transparentModels, commandBuffers, shadowCache, lightCulling);
+        }
+        else
+        {
+            RenderPassDepthPrePass(forwardPipeline, opaqueModels, g_cameraVisibility);
+            RenderPassAmbientOcclusion(forwardPipeline);
+            BeginGpuTimer(shadowCache.timer, g_shadowCacheEnabled);
+            RenderShadowCache(shadowCache, forwardPipeline, opaqueModels);
+            for (uint32_t i = 0; i < g_shadowCascades.count; ++i)
+            {
+                ExecuteRenderPass(forwardPipeline.shadowMapping[i], opaqueModels.data(), GetShadowCasters(shadowCache, i));
+            }
+            EndGpuTimer(shadowCache.timer);
+            RenderPassGBuffer(forwardPipeline, opaqueModels);
+            ExecuteRenderPass(forwardPipeline.lighting, opaqueModels.data(), g_occlusionVisibility);
+            RenderPassDeferredLighting(forwardPipeline, lightCulling);
+            if (g_drawAABBs)
+            {
+                ExecuteRenderPass(forwardPipeline.transparent, transparentModels.data(), transparentModels.size());
+            }
+            ExecuteRenderPass(forwardPipeline.velocity, opaqueModels.data(), GetVelocityVisibility());
+        }
+        sr::prof::EndProfilerZone();
+        float const submitMs = std::chrono::duration<float, std::milli>(
+                                   std::chrono::high_resolution_clock::now() - submitStart)
+                                   .count();
+        g_submissionStats.submitMs = g_submissionStats.submitMs * 0.95f + submitMs * 0.05f;
+        if (g_sampleDistributionEnabled && g_shadowMappingEnabled)
         {
-            ExecuteRenderPass(forwardPipeline.transparent, transparentModels.data(), transparentModels.size());
+            DispatchDepthReduction(depthReduction,
+                                   g_shadowCascades,
+                                   forwardPipeline.depthPrePass.subPasses[0].desc.attachments[0].handle,
+                                   forwardPipeline.depthPrePass.width,
+                                   forwardPipeline.depthPrePass.height);
         }
-        ExecuteRenderPass(forwardPipeline.velocity, opaqueModels.data(), opaqueModels.size());
-        RenderPassTAA(forwardPipeline);
-        RenderPassToneMapping(forwardPipeline);
+        RenderPassTAA(forwardPipeline, temporalResolve);
+        RenderPassToneMapping(forwardPipeline, autoExposure);
+        EndGpuTimer(frameTimer);
         RenderPassDebug(forwardPipeline);
+        if (g_golden.enabled)
+        {
+            CaptureGoldenView(goldenRun, forwardPipeline, presentedFrameIndex);
+        }
 
         ExecuteBackBufferBlitRenderPass(
             forwardPipeline.debug.subPasses[0].fbo,
@@ -1058,26 +3369,331 @@ void MainLoop(GLFWwindow *window)
 
         if (g_drawUi)
         {
+            sr::prof::BeginProfilerZone("UI");
             DrawUI(window);
+            sr::prof::EndProfilerZone();
         }
 
+        sr::prof::BeginProfilerZone("Swap Buffers");
         glfwSwapBuffers(window);
+        sr::prof::EndProfilerZone();
+
+        auto const frameEnd = std::chrono::high_resolution_clock::now();
+        float const frameMs = std::chrono::duration<float, std::milli>(frameEnd - frameStart).count();
+        float const inputToPresentMs =
+            std::chrono::duration<float, std::milli>(frameEnd - frame.inputTimestamp).count();
+        frameStart = frameEnd;
+        g_frameDeltaTime = frameMs / 1000.f;
+
+        g_frameLatencyStats.frameMs = g_frameLatencyStats.frameMs * 0.95f + frameMs * 0.05f;
+        g_frameLatencyStats.simulationMs = g_frameLatencyStats.simulationMs * 0.95f + frame.simulationMs * 0.05f;
+        g_frameLatencyStats.inputToPresentMs =
+            g_frameLatencyStats.inputToPresentMs * 0.95f + inputToPresentMs * 0.05f;
+        g_frameLatencyStats.packetAge = presentedFrameIndex - frame.inputFrameIndex;
+        if (benchmarkRun && presentedFrameIndex >= g_headless.warmupFrames)
+        {
+            measuredFrameMs.push_back(frameMs);
+        }
+        //A replay ends with its recording
+        if (g_headless.enabled && !g_replayEnabled &&
+            presentedFrameIndex + 1 >= g_headless.warmupFrames + g_headless.frameCount)
+        {
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+        }
+        if (g_golden.enabled)
+        {
+            MeasureGoldenView(goldenRun, presentedFrameIndex, frameMs);
+            if (ResolveGoldenViews(goldenRun))
+            {
+                glfwSetWindowShouldClose(window, GLFW_TRUE);
+            }
+        }
+        if (g_replayTimings.is_open())
+        {
+            g_replayTimings << presentedFrameIndex << "," << frameMs << "," << submitMs << "," << frame.simulationMs
+                            << "\n";
+        }
+        presentedFrameIndex++;
+        sr::prof::EndProfilerFrame();
     }
+
+    if (benchmarkRun)
+    {
+        if (g_headless.reportPath != nullptr)
+        {
+            std::ofstream report(g_headless.reportPath);
+            WriteHeadlessReport(report, measuredFrameMs);
+        }
+        else
+        {
+            WriteHeadlessReport(std::cout, measuredFrameMs);
+        }
+    }
+
+    int exitCode = 0;
+    if (g_golden.enabled)
+    {
+        //The window can be closed before every view was captured
+        bool passed = false;
+        if (g_headless.reportPath != nullptr)
+        {
+            std::ofstream report(g_headless.reportPath);
+            passed = WriteGoldenReport(report, goldenRun);
+        }
+        else
+        {
+            passed = WriteGoldenReport(std::cout, goldenRun);
+        }
+        exitCode = passed ? 0 : 1;
+        DeleteFrameReadback(goldenRun.readback);
+    }
+
+    StopSimulationThread(simulation);
+    DeleteShaderProgram(depthReduction.program);
+    DeleteDepthReduction(depthReduction);
+    DeleteShaderProgram(lightCulling.program);
+    DeleteTiledLightCulling(lightCulling);
+    DeleteShaderProgram(temporalResolve);
+    DeleteShaderProgram(autoExposure.histogramProgram);
+    DeleteShaderProgram(autoExposure.exposureProgram);
+    DeleteAutoExposure(autoExposure);
+    DeleteClusteredLightBuffers(clusteredLightBuffers);
+    DeleteSamplers();
+
+    return exitCode;
 }
 
-int main()
+int main(int argc, char **argv)
 {
-    GLFWwindow *window = InitializeGLFW(g_defaultWidth, g_defaultHeight);
+    uint32_t const jobWorkerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+    if (argc > 1 && std::strcmp(argv[1], "--benchmark") == 0)
+    {
+        sr::job::InitializeJobSystem(jobWorkerCount);
+        bool const bvhValid = sr::bench::RunBVHBenchmark();
+        bool const occlusionValid = sr::bench::RunOcclusionBenchmark();
+        bool const lightClustersValid = sr::bench::RunLightClusterBenchmark();
+        sr::job::DeinitializeJobSystem();
+        sr::bench::RunJobSystemBenchmark();
+        return bvhValid && occlusionValid && lightClustersValid ? 0 : 1;
+    }
+
+    char const *profileCsvPath = nullptr;
+    char const *recordPath = nullptr;
+    char const *replayLogPath = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        bool const hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--headless") == 0)
+        {
+            g_headless.enabled = true;
+        }
+        else if (hasValue && std::strcmp(argv[i], "--frames") == 0)
+        {
+            g_headless.frameCount = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (hasValue && std::strcmp(argv[i], "--warmup") == 0)
+        {
+            g_headless.warmupFrames = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (hasValue && std::strcmp(argv[i], "--width") == 0)
+        {
+            g_headless.width = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (hasValue && std::strcmp(argv[i], "--height") == 0)
+        {
+            g_headless.height = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (hasValue && std::strcmp(argv[i], "--report") == 0)
+        {
+            g_headless.reportPath = argv[++i];
+        }
+        //Per frame CPU and GPU times of every zone, see OpenProfilerCsv
+        else if (hasValue && std::strcmp(argv[i], "--profile-csv") == 0)
+        {
+            profileCsvPath = argv[++i];
+        }
+        else if (hasValue && std::strcmp(argv[i], "--record") == 0)
+        {
+            recordPath = argv[++i];
+        }
+        else if (hasValue && std::strcmp(argv[i], "--replay") == 0)
+        {
+            if (!OpenInputReplay(g_inputReplay, argv[++i]))
+            {
+                return 1;
+            }
+            g_replayEnabled = true;
+        }
+        else if (hasValue && std::strcmp(argv[i], "--replay-log") == 0)
+        {
+            replayLogPath = argv[++i];
+        }
+        else if (hasValue && std::strcmp(argv[i], "--golden") == 0)
+        {
+            g_golden.enabled = true;
+            g_golden.directory = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--golden-update") == 0)
+        {
+            g_golden.update = true;
+        }
+        else if (hasValue && std::strcmp(argv[i], "--golden-psnr") == 0)
+        {
+            g_golden.minPsnr = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if (hasValue && std::strcmp(argv[i], "--target-formats") == 0)
+        {
+            ++i;
+            for (uint32_t j = 0; j < static_cast<uint32_t>(eForwardTargetFormats::Count); ++j)
+            {
+                if (std::strcmp(argv[i], g_targetFormatsStr[j]) == 0)
+                {
+                    g_targetFormats = static_cast<eForwardTargetFormats>(j);
+                }
+            }
+        }
+        else if (hasValue && std::strcmp(argv[i], "--velocity-mode") == 0)
+        {
+            ++i;
+            for (uint32_t j = 0; j < static_cast<uint32_t>(eVelocityMode::Count); ++j)
+            {
+                if (std::strcmp(argv[i], g_velocityModesStr[j]) == 0)
+                {
+                    g_velocityMode = static_cast<eVelocityMode>(j);
+                }
+            }
+        }
+        else if (hasValue && std::strcmp(argv[i], "--lighting") == 0)
+        {
+            ++i;
+            for (uint32_t j = 0; j < static_cast<uint32_t>(eLightingPath::Count); ++j)
+            {
+                if (std::strcmp(argv[i], g_lightingPathsStr[j]) == 0)
+                {
+                    g_lightingPath = static_cast<eLightingPath>(j);
+                }
+            }
+        }
+        else if (hasValue && std::strcmp(argv[i], "--ao") == 0)
+        {
+            ++i;
+            for (uint32_t j = 0; j < static_cast<uint32_t>(eAmbientOcclusion::Count); ++j)
+            {
+                if (std::strcmp(argv[i], g_ambientOcclusionStr[j]) == 0)
+                {
+                    g_ambientOcclusion = static_cast<eAmbientOcclusion>(j);
+                }
+            }
+        }
+        //Replaces the default lights, see CreatePointLights
+        else if (hasValue && std::strcmp(argv[i], "--point-lights") == 0)
+        {
+            g_generatedPointLightCount = std::max(0, std::atoi(argv[++i]));
+            g_pointLightEnabled = g_generatedPointLightCount > 0 ? 1 : g_pointLightEnabled;
+        }
+        else if (std::strcmp(argv[i], "--clustered-lights") == 0)
+        {
+            g_clusteredLightingEnabled = 1;
+        }
+        else if (std::strcmp(argv[i], "--texture-supersampling") == 0)
+        {
+            g_textureSupersamplingEnabled = 1;
+        }
+        else if (std::strcmp(argv[i], "--taa") == 0)
+        {
+            g_taaEnabled = 1;
+        }
+        else if (std::strcmp(argv[i], "--taa-compute") == 0)
+        {
+            g_taaComputeResolveEnabled = true;
+        }
+        else if (std::strcmp(argv[i], "--auto-exposure") == 0)
+        {
+            g_autoExposureEnabled = 1;
+        }
+        else if (hasValue && std::strcmp(argv[i], "--golden-settle") == 0)
+        {
+            g_golden.settleFrames = std::max(1, std::atoi(argv[++i]));
+        }
+    }
+
+    //A fresh checkout has no goldens until golden-update wrote them, some missing views still fail the run
+    if (g_golden.enabled && !g_golden.update &&
+        !std::ifstream(std::string(g_golden.directory) + "/view_0.png", std::ios::binary).is_open())
+    {
+        std::cerr << "No goldens in " << g_golden.directory << ", write them with --golden-update" << std::endl;
+        return g_goldenMissingExitCode;
+    }
+
+    //A replay renders at the size it was recorded at
+    //Goldens are compared at the --width and --height they were written at
+    bool const fixedSize = g_headless.enabled || g_golden.enabled;
+    uint32_t width = fixedSize ? g_headless.width : g_defaultWidth;
+    uint32_t height = fixedSize ? g_headless.height : g_defaultHeight;
+    if (g_replayEnabled)
+    {
+        width = g_headless.width = g_inputReplay.header.width;
+        height = g_headless.height = g_inputReplay.header.height;
+
+        //The lights are generated with the scene, later frames cannot change their count
+        RecordedSettings settings;
+        if (PeekRecordedSettings(g_inputReplay, settings))
+        {
+            g_generatedPointLightCount = settings.generatedPointLightCount;
+        }
+    }
+
+    sr::job::InitializeJobSystem(jobWorkerCount);
+
+    GLFWwindow *window = InitializeGLFW(width, height, g_headless.enabled);
+    if (window == nullptr)
+    {
+        sr::job::DeinitializeJobSystem();
+        return 1;
+    }
+    g_camera.aspect = static_cast<float>(width) / height;
     InitializeImGui(window);
 
     SetupGLFWCallbacks(window);
     ConfigureGL();
     InitializeGlobals();
+    sr::prof::InitializeProfiler();
+    if (profileCsvPath != nullptr)
+    {
+        sr::prof::OpenProfilerCsv(profileCsvPath);
+    }
+    if (g_headless.enabled)
+    {
+        g_drawUi = false;
+    }
+    if (g_golden.enabled)
+    {
+        //Captures must not depend on how fast the machine is
+        g_dynamicResolutionEnabled = false;
+    }
+    if (recordPath != nullptr)
+    {
+        int framebufferWidth = 0, framebufferHeight = 0;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        g_recordingEnabled = OpenInputRecording(g_inputRecorder, recordPath, framebufferWidth, framebufferHeight);
+    }
+    if (replayLogPath != nullptr)
+    {
+        g_replayTimings.open(replayLogPath, std::ios::out | std::ios::trunc);
+        g_replayTimings << "frame,frame_ms,submit_ms,simulation_ms\n";
+    }
 
-    MainLoop(window);
+    int const exitCode = MainLoop(window);
 
+    if (g_recordingEnabled)
+    {
+        CloseInputRecording(g_inputRecorder);
+    }
+    sr::prof::DeinitializeProfiler();
     DeinitializeImGui();
     DeinitializeGLFW(window);
+    sr::job::DeinitializeJobSystem();
 
-    return 0;
+    return exitCode;
 }